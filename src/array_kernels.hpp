@@ -0,0 +1,292 @@
+#pragma once
+
+// ── Numeric kernels for the array builtins ────────────────────────────────────
+//
+// Loops over contiguous int64 or double elements.  Like the lexer kernels in
+// scan.hpp, the instruction set is chosen at compile time from __AVX2__ /
+// __SSE2__, and the portable scalar loop is both the tail and the whole
+// implementation elsewhere.
+//
+// Integer arithmetic wraps.  Real sums and dot products accumulate in four
+// lanes (element i goes to lane i % 4) that are combined as (l0 + l1) + (l2 + l3)
+// before the tail is added, on every target, so results do not depend on the
+// instruction set.  They may differ in the last bits from a left-to-right loop.
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DLANG_KERNELS_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DLANG_KERNELS_SSE2 1
+#endif
+
+namespace kernels {
+
+inline constexpr size_t kNotFound = SIZE_MAX;
+
+namespace detail {
+
+inline long long wrap_add(long long a, long long b) noexcept {
+    return static_cast<long long>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+inline long long wrap_mul(long long a, long long b) noexcept {
+    return static_cast<long long>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+}
+
+// Four-lane accumulator for doubles; see the note at the top of the file.
+struct Lanes {
+#if defined(DLANG_KERNELS_AVX2)
+    __m256d v = _mm256_setzero_pd();
+    void add(const double* p) noexcept { v = _mm256_add_pd(v, _mm256_loadu_pd(p)); }
+    void add_mul(const double* a, const double* b) noexcept {
+        v = _mm256_add_pd(v, _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b)));
+    }
+    double total() const noexcept {
+        alignas(32) double l[4];
+        _mm256_store_pd(l, v);
+        return (l[0] + l[1]) + (l[2] + l[3]);
+    }
+#elif defined(DLANG_KERNELS_SSE2)
+    __m128d lo = _mm_setzero_pd(); // lanes 0, 1
+    __m128d hi = _mm_setzero_pd(); // lanes 2, 3
+    void add(const double* p) noexcept {
+        lo = _mm_add_pd(lo, _mm_loadu_pd(p));
+        hi = _mm_add_pd(hi, _mm_loadu_pd(p + 2));
+    }
+    void add_mul(const double* a, const double* b) noexcept {
+        lo = _mm_add_pd(lo, _mm_mul_pd(_mm_loadu_pd(a), _mm_loadu_pd(b)));
+        hi = _mm_add_pd(hi, _mm_mul_pd(_mm_loadu_pd(a + 2), _mm_loadu_pd(b + 2)));
+    }
+    double total() const noexcept {
+        alignas(16) double l[4];
+        _mm_store_pd(l, lo);
+        _mm_store_pd(l + 2, hi);
+        return (l[0] + l[1]) + (l[2] + l[3]);
+    }
+#else
+    double l[4]{};
+    void add(const double* p) noexcept {
+        for (int i = 0; i < 4; ++i)
+            l[i] += p[i];
+    }
+    void add_mul(const double* a, const double* b) noexcept {
+        for (int i = 0; i < 4; ++i)
+            l[i] += a[i] * b[i];
+    }
+    double total() const noexcept { return (l[0] + l[1]) + (l[2] + l[3]); }
+#endif
+};
+
+} // namespace detail
+
+inline long long sum(const long long* p, size_t n) noexcept {
+    size_t i    = 0;
+    long long s = 0;
+#if defined(DLANG_KERNELS_AVX2)
+    __m256i acc = _mm256_setzero_si256();
+    for (; n - i >= 4; i += 4)
+        acc = _mm256_add_epi64(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)));
+    alignas(32) long long l[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(l), acc);
+    s = detail::wrap_add(detail::wrap_add(l[0], l[1]), detail::wrap_add(l[2], l[3]));
+#elif defined(DLANG_KERNELS_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (; n - i >= 2; i += 2)
+        acc = _mm_add_epi64(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)));
+    alignas(16) long long l[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(l), acc);
+    s = detail::wrap_add(l[0], l[1]);
+#endif
+    for (; i < n; ++i)
+        s = detail::wrap_add(s, p[i]);
+    return s;
+}
+
+inline double sum(const double* p, size_t n) noexcept {
+    size_t i = 0;
+    detail::Lanes acc;
+    for (; n - i >= 4; i += 4)
+        acc.add(p + i);
+    double s = acc.total();
+    for (; i < n; ++i)
+        s += p[i];
+    return s;
+}
+
+inline long long dot(const long long* a, const long long* b, size_t n) noexcept {
+    long long s = 0; // no 64-bit lane multiply below AVX-512
+    for (size_t i = 0; i < n; ++i)
+        s = detail::wrap_add(s, detail::wrap_mul(a[i], b[i]));
+    return s;
+}
+
+inline double dot(const double* a, const double* b, size_t n) noexcept {
+    size_t i = 0;
+    detail::Lanes acc;
+    for (; n - i >= 4; i += 4)
+        acc.add_mul(a + i, b + i);
+    double s = acc.total();
+    for (; i < n; ++i)
+        s += a[i] * b[i];
+    return s;
+}
+
+// Index of the smallest / largest element (the first one on ties); n > 0.
+inline size_t min_index(const long long* p, size_t n) noexcept {
+    size_t best = 0;
+    for (size_t i = 1; i < n; ++i)
+        if (p[i] < p[best])
+            best = i;
+    return best;
+}
+
+inline size_t max_index(const long long* p, size_t n) noexcept {
+    size_t best = 0;
+    for (size_t i = 1; i < n; ++i)
+        if (p[i] > p[best])
+            best = i;
+    return best;
+}
+
+// Smallest / largest element; n > 0.  Each step keeps `x < m ? x : m` (or >),
+// like the min/max instructions, so with NaN elements the result depends on
+// which lane they land in.
+inline double min(const double* p, size_t n) noexcept {
+    size_t i = 0;
+    double m = p[0];
+#if defined(DLANG_KERNELS_AVX2)
+    if (n >= 4) {
+        __m256d acc = _mm256_loadu_pd(p);
+        for (i = 4; n - i >= 4; i += 4)
+            acc = _mm256_min_pd(_mm256_loadu_pd(p + i), acc);
+        alignas(32) double l[4];
+        _mm256_store_pd(l, acc);
+        m = l[0];
+        for (int k = 1; k < 4; ++k)
+            m = l[k] < m ? l[k] : m;
+    }
+#elif defined(DLANG_KERNELS_SSE2)
+    if (n >= 2) {
+        __m128d acc = _mm_loadu_pd(p);
+        for (i = 2; n - i >= 2; i += 2)
+            acc = _mm_min_pd(_mm_loadu_pd(p + i), acc);
+        alignas(16) double l[2];
+        _mm_store_pd(l, acc);
+        m = l[1] < l[0] ? l[1] : l[0];
+    }
+#endif
+    for (; i < n; ++i)
+        m = p[i] < m ? p[i] : m;
+    return m;
+}
+
+inline double max(const double* p, size_t n) noexcept {
+    size_t i = 0;
+    double m = p[0];
+#if defined(DLANG_KERNELS_AVX2)
+    if (n >= 4) {
+        __m256d acc = _mm256_loadu_pd(p);
+        for (i = 4; n - i >= 4; i += 4)
+            acc = _mm256_max_pd(_mm256_loadu_pd(p + i), acc);
+        alignas(32) double l[4];
+        _mm256_store_pd(l, acc);
+        m = l[0];
+        for (int k = 1; k < 4; ++k)
+            m = l[k] > m ? l[k] : m;
+    }
+#elif defined(DLANG_KERNELS_SSE2)
+    if (n >= 2) {
+        __m128d acc = _mm_loadu_pd(p);
+        for (i = 2; n - i >= 2; i += 2)
+            acc = _mm_max_pd(_mm_loadu_pd(p + i), acc);
+        alignas(16) double l[2];
+        _mm_store_pd(l, acc);
+        m = l[1] > l[0] ? l[1] : l[0];
+    }
+#endif
+    for (; i < n; ++i)
+        m = p[i] > m ? p[i] : m;
+    return m;
+}
+
+// out[i] = p[i] * k
+inline void scale(const long long* p, size_t n, long long k, long long* out) noexcept {
+    for (size_t i = 0; i < n; ++i)
+        out[i] = detail::wrap_mul(p[i], k);
+}
+
+inline void scale(const double* p, size_t n, double k, double* out) noexcept {
+    size_t i = 0;
+#if defined(DLANG_KERNELS_AVX2)
+    const __m256d vk = _mm256_set1_pd(k);
+    for (; n - i >= 4; i += 4)
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(p + i), vk));
+#elif defined(DLANG_KERNELS_SSE2)
+    const __m128d vk = _mm_set1_pd(k);
+    for (; n - i >= 2; i += 2)
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(p + i), vk));
+#endif
+    for (; i < n; ++i)
+        out[i] = p[i] * k;
+}
+
+// Index of the first element equal to `v`, or kNotFound.
+inline size_t find(const long long* p, size_t n, long long v) noexcept {
+    size_t i = 0;
+#if defined(DLANG_KERNELS_AVX2)
+    const __m256i needle = _mm256_set1_epi64x(v);
+    for (; n - i >= 4; i += 4) {
+        const __m256i x  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        const unsigned m = static_cast<unsigned>(
+            _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(x, needle))));
+        if (m)
+            return i + std::countr_zero(m);
+    }
+#elif defined(DLANG_KERNELS_SSE2)
+    // SSE2 has no 64-bit compare: a lane matches when both of its halves do.
+    const __m128i needle = _mm_set1_epi64x(v);
+    for (; n - i >= 2; i += 2) {
+        const __m128i x    = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        const __m128i eq32 = _mm_cmpeq_epi32(x, needle);
+        const __m128i eq64 = _mm_and_si128(eq32, _mm_shuffle_epi32(eq32, _MM_SHUFFLE(2, 3, 0, 1)));
+        const unsigned m   = static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(eq64)));
+        if (m)
+            return i + std::countr_zero(m);
+    }
+#endif
+    for (; i < n; ++i)
+        if (p[i] == v)
+            return i;
+    return kNotFound;
+}
+
+inline size_t find(const double* p, size_t n, double v) noexcept {
+    size_t i = 0;
+#if defined(DLANG_KERNELS_AVX2)
+    const __m256d needle = _mm256_set1_pd(v);
+    for (; n - i >= 4; i += 4) {
+        const unsigned m = static_cast<unsigned>(
+            _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(p + i), needle, _CMP_EQ_OQ)));
+        if (m)
+            return i + std::countr_zero(m);
+    }
+#elif defined(DLANG_KERNELS_SSE2)
+    const __m128d needle = _mm_set1_pd(v);
+    for (; n - i >= 2; i += 2) {
+        const unsigned m =
+            static_cast<unsigned>(_mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(p + i), needle)));
+        if (m)
+            return i + std::countr_zero(m);
+    }
+#endif
+    for (; i < n; ++i)
+        if (p[i] == v)
+            return i;
+    return kNotFound;
+}
+
+} // namespace kernels
@@ -3,19 +3,34 @@
 #include "print_visitor.hpp"
 
 #include <iostream>
+#include <memory>
 #include <ostream>
+#include <utility>
+#include <vector>
 
 // ── Base ──────────────────────────────────────────────────────────────────────
 
 void ASTNode::print(int indent, std::ostream& os) const {
-    PrintVisitor v{os, indent};
-    accept(v);
+    PrintVisitor{os, indent}.print(*this);
 }
 
 void ASTNode::print(int indent) const {
     print(indent, std::cout);
 }
 
+// ── ProgramNode ───────────────────────────────────────────────────────────────
+
+// Left to the unique_ptrs, a long operator chain would be freed by one nested
+// destructor call per node.  Detach every node's children before freeing it.
+ProgramNode::~ProgramNode() {
+    std::vector<std::unique_ptr<ASTNode>> pending = std::move(stmts);
+    while (!pending.empty()) {
+        std::unique_ptr<ASTNode> n = std::move(pending.back());
+        pending.pop_back();
+        for_each_child(*n, [&](std::unique_ptr<ASTNode>& c) { pending.push_back(std::move(c)); });
+    }
+}
+
 // ── Factory helpers ───────────────────────────────────────────────────────────
 
 std::unique_ptr<ASTNode> ASTNode::make_int(long long v, Location loc) {
@@ -40,6 +55,10 @@ std::unique_ptr<ASTNode> ASTNode::make_none(Location loc) {
 // ── BinOpNode::kind_name ──────────────────────────────────────────────────────
 
 std::string_view BinOpNode::kind_name() const noexcept {
+    return op_name(op);
+}
+
+std::string_view BinOpNode::op_name(Op op) noexcept {
     switch (op) {
     case Op::OR:
         return "Or";
@@ -74,6 +93,10 @@ std::string_view BinOpNode::kind_name() const noexcept {
 // ── UnaryOpNode::kind_name ────────────────────────────────────────────────────
 
 std::string_view UnaryOpNode::kind_name() const noexcept {
+    return op_name(op);
+}
+
+std::string_view UnaryOpNode::op_name(Op op) noexcept {
     switch (op) {
     case Op::UPLUS:
         return "UPlus";
@@ -88,6 +111,10 @@ std::string_view UnaryOpNode::kind_name() const noexcept {
 // ── TypeNode::kind_name ───────────────────────────────────────────────────────
 
 std::string_view TypeNode::kind_name() const noexcept {
+    return type_name(type);
+}
+
+std::string_view TypeNode::type_name(Type type) noexcept {
     switch (type) {
     case Type::INT:
         return "TypeInt";
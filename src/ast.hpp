@@ -2,11 +2,17 @@
 
 #include "ast_visitor.hpp"
 
+#include <atomic>
+#include <cstddef>
+#include <concepts>
+#include <cstdint>
 #include <format>
+#include <iterator>
 #include <memory>
 #include <ostream>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <vector>
 
 // ── Source location ───────────────────────────────────────────────────────────
@@ -15,11 +21,86 @@ struct Location {
     int col{0};
 };
 
+// ── Loop annotations ──────────────────────────────────────────────────────────
+//
+// Filled in by the Optimizer (optimizer.hpp); all zero for an unoptimized loop.
+// The loop owns invariant-cache slots [first_invariant, first_invariant +
+// invariants) and, for ForRange, induction slots starting at first_induction,
+// one per entry of `inductions`.
+struct Affine {
+    long long scale{0}; // value = scale * iterator + offset
+    long long offset{0};
+};
+
+struct LoopInfo {
+    uint32_t id{0}; // 1-based; 0 = not optimized
+    uint32_t first_invariant{0};
+    uint32_t invariants{0};
+    uint32_t first_induction{0};
+    std::vector<Affine> inductions;
+};
+
+// ── Capture annotations ───────────────────────────────────────────────────────
+//
+// Filled in by SemanticAnalyzer.  A function's free variables are the names its
+// body (nested functions included) refers to outside its own scopes, builtins
+// and globals among them.  A declaration is captured when a function nested
+// inside its scope refers to it.
+struct FreeVar {
+    std::string name;
+    int depth{0}; // frames outward from the one the function literal is in
+};
+
+// ── Type feedback ─────────────────────────────────────────────────────────────
+//
+// Written by the tree Interpreter as it runs (interpreter.cpp), for operators
+// and indexing.  A node starts unspecialized and records what its operands
+// were.  After kWarmup runs in a row with the same operand types it is
+// specialized to them: from then on it takes a fast path behind a check of
+// those types.  The first run that fails the check, or a change of types
+// during warm-up, makes it generic for good.  The fields are relaxed atomics
+// so that threads running one Program (engine.hpp) may update them at once; a
+// lost update delays a transition at worst, and every fast path checks its
+// guard, so no result depends on the state read.
+class TypeFeedback {
+public:
+    static constexpr uint8_t kUnspecialized = 0;
+    static constexpr uint8_t kGeneric       = 0xff;
+    static constexpr uint8_t kWarmup        = 8;
+
+    // kUnspecialized, kGeneric or a specialization of the node's kind.
+    uint8_t state() const noexcept { return state_.load(std::memory_order_relaxed); }
+
+    // Records an unspecialized run whose operands suit specialization `s`, or
+    // kGeneric if none.  Returns true if the node is now specialized to `s`.
+    bool observe(uint8_t s) const noexcept {
+        const uint8_t seen = seen_.load(std::memory_order_relaxed);
+        if (s == kGeneric || (seen != kUnspecialized && seen != s)) {
+            generalize();
+            return false;
+        }
+        seen_.store(s, std::memory_order_relaxed);
+        const uint8_t runs = runs_.load(std::memory_order_relaxed) + 1;
+        runs_.store(runs, std::memory_order_relaxed);
+        if (runs < kWarmup)
+            return false;
+        state_.store(s, std::memory_order_relaxed);
+        return true;
+    }
+    void generalize() const noexcept { state_.store(kGeneric, std::memory_order_relaxed); }
+
+private:
+    mutable std::atomic<uint8_t> state_{kUnspecialized};
+    mutable std::atomic<uint8_t> seen_{kUnspecialized}; // during warm-up
+    mutable std::atomic<uint8_t> runs_{0};
+};
+
 // ── Base node ─────────────────────────────────────────────────────────────────
 struct ASTNode {
     Location loc{};
+    NodeKind kind;
 
-    explicit ASTNode(Location loc = {}) : loc{loc} {}
+    explicit ASTNode(NodeKind kind, Location loc = {}) : loc{loc}, kind{kind} {}
     virtual ~ASTNode()                 = default;
     ASTNode(const ASTNode&)            = delete;
     ASTNode& operator=(const ASTNode&) = delete;
@@ -44,109 +125,139 @@ struct ASTNode {
 // ── Statements / structure ────────────────────────────────────────────────────
 
 struct ProgramNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Program;
     std::vector<std::unique_ptr<ASTNode>> stmts;
-    explicit ProgramNode(Location loc = {}) : ASTNode{loc} {}
+    explicit ProgramNode(Location loc = {}) : ASTNode{NodeKind::Program, loc} {}
+    ~ProgramNode() override; // frees the tree without recursing, however deep
     std::string_view kind_name() const noexcept override { return "Program"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct BodyNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Body;
     std::vector<std::unique_ptr<ASTNode>> stmts;
-    explicit BodyNode(Location loc = {}) : ASTNode{loc} {}
+    // Cleared by SemanticAnalyzer when the body declares nothing, or is a
+    // function body that does not redeclare a parameter.  Such a body runs in
+    // the enclosing frame (its variables, if any, go in the parameter frame)
+    // and is not counted by resolved_depth.
+    mutable bool has_frame = true;
+    explicit BodyNode(Location loc = {}) : ASTNode{NodeKind::Body, loc} {}
     std::string_view kind_name() const noexcept override { return "Body"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct VarDeclNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::VarDecl;
     std::vector<std::unique_ptr<ASTNode>> defs; // VarDefNode children
-    explicit VarDeclNode(Location loc = {}) : ASTNode{loc} {}
+    explicit VarDeclNode(Location loc = {}) : ASTNode{NodeKind::VarDecl, loc} {}
     std::string_view kind_name() const noexcept override { return "VarDecl"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct VarDefNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::VarDef;
     std::string varname;
     std::unique_ptr<ASTNode> init; // optional initialiser expression
-    explicit VarDefNode(Location loc = {}) : ASTNode{loc} {}
+    mutable bool captured = false;
+    explicit VarDefNode(Location loc = {}) : ASTNode{NodeKind::VarDef, loc} {}
     std::string_view kind_name() const noexcept override { return "VarDef"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct AssignNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Assign;
     std::unique_ptr<ASTNode> lhs;
     std::unique_ptr<ASTNode> rhs;
-    explicit AssignNode(Location loc = {}) : ASTNode{loc} {}
+    explicit AssignNode(Location loc = {}) : ASTNode{NodeKind::Assign, loc} {}
     std::string_view kind_name() const noexcept override { return "Assign"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct IfNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::If;
     std::unique_ptr<ASTNode> cond;
     std::unique_ptr<ASTNode> then_body;
     std::unique_ptr<ASTNode> else_body; // optional
-    explicit IfNode(Location loc = {}) : ASTNode{loc} {}
+    explicit IfNode(Location loc = {}) : ASTNode{NodeKind::If, loc} {}
     std::string_view kind_name() const noexcept override { return "If"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct IfShortNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::IfShort;
     std::unique_ptr<ASTNode> cond;
     std::unique_ptr<ASTNode> stmt;
-    explicit IfShortNode(Location loc = {}) : ASTNode{loc} {}
+    explicit IfShortNode(Location loc = {}) : ASTNode{NodeKind::IfShort, loc} {}
     std::string_view kind_name() const noexcept override { return "IfShort"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct WhileNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::While;
     std::unique_ptr<ASTNode> cond;
     std::unique_ptr<ASTNode> body;
-    explicit WhileNode(Location loc = {}) : ASTNode{loc} {}
+    LoopInfo opt;
+    explicit WhileNode(Location loc = {}) : ASTNode{NodeKind::While, loc} {}
     std::string_view kind_name() const noexcept override { return "While"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct ForRangeNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::ForRange;
     std::string iter; // iterator variable name (may be empty)
     std::unique_ptr<ASTNode> from;
     std::unique_ptr<ASTNode> to;
     std::unique_ptr<ASTNode> body;
-    explicit ForRangeNode(Location loc = {}) : ASTNode{loc} {}
+    LoopInfo opt;
+    mutable bool captured = false; // iterator captured
+    explicit ForRangeNode(Location loc = {}) : ASTNode{NodeKind::ForRange, loc} {}
     std::string_view kind_name() const noexcept override { return "ForRange"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct ForIterNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::ForIter;
     std::string iter; // iterator variable name (may be empty)
     std::unique_ptr<ASTNode> iterable;
     std::unique_ptr<ASTNode> body;
-    explicit ForIterNode(Location loc = {}) : ASTNode{loc} {}
+    LoopInfo opt;
+    mutable bool captured = false; // iterator captured
+    // Set by SemanticAnalyzer when the body only reads fields of the iterator
+    // and changes no element, so that a copy of each element would do.
+    mutable bool reads_fields = false;
+    explicit ForIterNode(Location loc = {}) : ASTNode{NodeKind::ForIter, loc} {}
     std::string_view kind_name() const noexcept override { return "ForIter"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct LoopInfNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::LoopInf;
     std::unique_ptr<ASTNode> body;
-    explicit LoopInfNode(Location loc = {}) : ASTNode{loc} {}
+    LoopInfo opt;
+    explicit LoopInfNode(Location loc = {}) : ASTNode{NodeKind::LoopInf, loc} {}
     std::string_view kind_name() const noexcept override { return "LoopInf"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct ExitNode : ASTNode {
-    explicit ExitNode(Location loc = {}) : ASTNode{loc} {}
+    static constexpr NodeKind kKind = NodeKind::Exit;
+    explicit ExitNode(Location loc = {}) : ASTNode{NodeKind::Exit, loc} {}
     std::string_view kind_name() const noexcept override { return "Exit"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct ReturnNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Return;
     std::unique_ptr<ASTNode> value; // optional return expression
-    explicit ReturnNode(Location loc = {}) : ASTNode{loc} {}
+    explicit ReturnNode(Location loc = {}) : ASTNode{NodeKind::Return, loc} {}
     std::string_view kind_name() const noexcept override { return "Return"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct PrintNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Print;
     std::vector<std::unique_ptr<ASTNode>> exprs;
-    explicit PrintNode(Location loc = {}) : ASTNode{loc} {}
+    explicit PrintNode(Location loc = {}) : ASTNode{NodeKind::Print, loc} {}
     std::string_view kind_name() const noexcept override { return "Print"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
@@ -154,30 +265,36 @@ struct PrintNode : ASTNode {
 // ── Binary operators ──────────────────────────────────────────────────────────
 
 struct BinOpNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::BinOp;
     enum class Op { OR, AND, XOR, LT, LE, GT, GE, EQ, NEQ, ADD, SUB, MUL, DIV };
     Op op;
     std::unique_ptr<ASTNode> left;
     std::unique_ptr<ASTNode> right;
-    explicit BinOpNode(Op o, Location loc = {}) : ASTNode{loc}, op{o} {}
+    TypeFeedback feedback;
+    explicit BinOpNode(Op o, Location loc = {}) : ASTNode{NodeKind::BinOp, loc}, op{o} {}
     std::string_view kind_name() const noexcept override;
+    static std::string_view op_name(Op op) noexcept;
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 // ── Unary operators ───────────────────────────────────────────────────────────
 
 struct UnaryOpNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::UnaryOp;
     enum class Op { UPLUS, UMINUS, NOT };
     Op op;
     std::unique_ptr<ASTNode> operand;
-    explicit UnaryOpNode(Op o, Location loc = {}) : ASTNode{loc}, op{o} {}
+    explicit UnaryOpNode(Op o, Location loc = {}) : ASTNode{NodeKind::UnaryOp, loc}, op{o} {}
     std::string_view kind_name() const noexcept override;
+    static std::string_view op_name(Op op) noexcept;
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct IsNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Is;
     std::unique_ptr<ASTNode> operand;
     std::unique_ptr<ASTNode> type_node;
-    explicit IsNode(Location loc = {}) : ASTNode{loc} {}
+    explicit IsNode(Location loc = {}) : ASTNode{NodeKind::Is, loc} {}
     std::string_view kind_name() const noexcept override { return "Is"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
@@ -185,43 +302,51 @@ struct IsNode : ASTNode {
 // ── Postfix / access ──────────────────────────────────────────────────────────
 
 struct IdentNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Ident;
     std::string ident_name;
-    mutable int resolved_depth = -1; // set by SemanticAnalyzer; -1 = not yet resolved
+    mutable int resolved_depth = -1;    // set by SemanticAnalyzer; -1 = not yet resolved
+    mutable bool captured      = false; // for a parameter
     explicit IdentNode(std::string name, Location loc = {})
-        : ASTNode{loc},
+        : ASTNode{NodeKind::Ident, loc},
           ident_name{std::move(name)} {}
     std::string_view kind_name() const noexcept override { return "Ident"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct IndexNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Index;
     std::unique_ptr<ASTNode> base;
     std::unique_ptr<ASTNode> index_expr;
-    explicit IndexNode(Location loc = {}) : ASTNode{loc} {}
+    TypeFeedback feedback;
+    explicit IndexNode(Location loc = {}) : ASTNode{NodeKind::Index, loc} {}
     std::string_view kind_name() const noexcept override { return "Index"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct CallNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Call;
     std::unique_ptr<ASTNode> callee;
     std::vector<std::unique_ptr<ASTNode>> args;
-    explicit CallNode(Location loc = {}) : ASTNode{loc} {}
+    explicit CallNode(Location loc = {}) : ASTNode{NodeKind::Call, loc} {}
     std::string_view kind_name() const noexcept override { return "Call"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct DotFieldNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::DotField;
     std::string field;
     std::unique_ptr<ASTNode> base;
-    explicit DotFieldNode(Location loc = {}) : ASTNode{loc} {}
+    explicit DotFieldNode(Location loc = {}) : ASTNode{NodeKind::DotField, loc} {}
     std::string_view kind_name() const noexcept override { return "DotField"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct DotIntNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::DotInt;
     long long index;
     std::unique_ptr<ASTNode> base;
-    explicit DotIntNode(long long idx, Location loc = {}) : ASTNode{loc}, index{idx} {}
+    explicit DotIntNode(long long idx, Location loc = {})
+        : ASTNode{NodeKind::DotInt, loc}, index{idx} {}
     std::string_view kind_name() const noexcept override { return "DotInt"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
@@ -229,72 +354,85 @@ struct DotIntNode : ASTNode {
 // ── Literals ──────────────────────────────────────────────────────────────────
 
 struct IntLitNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::IntLit;
     long long value;
-    explicit IntLitNode(long long v, Location loc = {}) : ASTNode{loc}, value{v} {}
+    explicit IntLitNode(long long v, Location loc = {})
+        : ASTNode{NodeKind::IntLit, loc}, value{v} {}
     std::string_view kind_name() const noexcept override { return "IntLit"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct RealLitNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::RealLit;
     double value;
-    explicit RealLitNode(double v, Location loc = {}) : ASTNode{loc}, value{v} {}
+    explicit RealLitNode(double v, Location loc = {}) : ASTNode{NodeKind::RealLit, loc}, value{v} {}
     std::string_view kind_name() const noexcept override { return "RealLit"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct StrLitNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::StrLit;
     std::string value;
-    explicit StrLitNode(std::string v, Location loc = {}) : ASTNode{loc}, value{std::move(v)} {}
+    explicit StrLitNode(std::string v, Location loc = {})
+        : ASTNode{NodeKind::StrLit, loc}, value{std::move(v)} {}
     std::string_view kind_name() const noexcept override { return "StrLit"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct BoolLitNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::BoolLit;
     bool value;
-    explicit BoolLitNode(bool v, Location loc = {}) : ASTNode{loc}, value{v} {}
+    explicit BoolLitNode(bool v, Location loc = {}) : ASTNode{NodeKind::BoolLit, loc}, value{v} {}
     std::string_view kind_name() const noexcept override { return "BoolLit"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct NoneLitNode : ASTNode {
-    explicit NoneLitNode(Location loc = {}) : ASTNode{loc} {}
+    static constexpr NodeKind kKind = NodeKind::NoneLit;
+    explicit NoneLitNode(Location loc = {}) : ASTNode{NodeKind::NoneLit, loc} {}
     std::string_view kind_name() const noexcept override { return "NoneLit"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct ArrayLitNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::ArrayLit;
     std::vector<std::unique_ptr<ASTNode>> elems;
-    explicit ArrayLitNode(Location loc = {}) : ASTNode{loc} {}
+    explicit ArrayLitNode(Location loc = {}) : ASTNode{NodeKind::ArrayLit, loc} {}
     std::string_view kind_name() const noexcept override { return "ArrayLit"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct TupleLitNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::TupleLit;
     std::vector<std::unique_ptr<ASTNode>> elems; // TupleElemNode children
-    explicit TupleLitNode(Location loc = {}) : ASTNode{loc} {}
+    explicit TupleLitNode(Location loc = {}) : ASTNode{NodeKind::TupleLit, loc} {}
     std::string_view kind_name() const noexcept override { return "TupleLit"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct TupleElemNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::TupleElem;
     std::string elem_name; // element name (empty for unnamed)
     std::unique_ptr<ASTNode> expr;
-    explicit TupleElemNode(Location loc = {}) : ASTNode{loc} {}
+    explicit TupleElemNode(Location loc = {}) : ASTNode{NodeKind::TupleElem, loc} {}
     std::string_view kind_name() const noexcept override { return "TupleElem"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct ParamListNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::ParamList;
     std::vector<std::unique_ptr<ASTNode>> params; // IdentNode children
-    explicit ParamListNode(Location loc = {}) : ASTNode{loc} {}
+    explicit ParamListNode(Location loc = {}) : ASTNode{NodeKind::ParamList, loc} {}
     std::string_view kind_name() const noexcept override { return "ParamList"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
 
 struct FuncLitNode : ASTNode {
-    std::unique_ptr<ASTNode> params; // ParamListNode
-    std::unique_ptr<ASTNode> body;   // BodyNode
-    explicit FuncLitNode(Location loc = {}) : ASTNode{loc} {}
+    static constexpr NodeKind kKind = NodeKind::FuncLit;
+    std::unique_ptr<ASTNode> params;        // ParamListNode
+    std::unique_ptr<ASTNode> body;          // BodyNode
+    mutable std::vector<FreeVar> free_vars; // in order of first use
+    explicit FuncLitNode(Location loc = {}) : ASTNode{NodeKind::FuncLit, loc} {}
     std::string_view kind_name() const noexcept override { return "FuncLit"; }
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
@@ -302,9 +440,220 @@ struct FuncLitNode : ASTNode {
 // ── Type indicators ───────────────────────────────────────────────────────────
 
 struct TypeNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Type;
     enum class Type { INT, REAL, BOOL, STRING, NONE, ARRAY, TUPLE, FUNC };
     Type type;
-    explicit TypeNode(Type t, Location loc = {}) : ASTNode{loc}, type{t} {}
+    explicit TypeNode(Type t, Location loc = {}) : ASTNode{NodeKind::Type, loc}, type{t} {}
     std::string_view kind_name() const noexcept override;
+    static std::string_view type_name(Type type) noexcept;
     void accept(IASTVisitor& v) const override { v.visit(*this); }
 };
+
+// ── Optimizer nodes ───────────────────────────────────────────────────────────
+
+// Loop-invariant expression: evaluated at most once per execution of the
+// owning loop, then read from cache slot `slot`.
+struct InvariantNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Invariant;
+    uint32_t slot;
+    std::unique_ptr<ASTNode> expr;
+    explicit InvariantNode(uint32_t slot, Location loc = {})
+        : ASTNode{NodeKind::Invariant, loc},
+          slot{slot} {}
+    std::string_view kind_name() const noexcept override { return "Invariant"; }
+    void accept(IASTVisitor& v) const override { v.visit(*this); }
+};
+
+// Integer expression affine in a ForRange iterator.  The loop keeps its value
+// in induction slot `slot` and advances it by form.scale per step; `expr` is
+// the original expression.
+struct InductionNode : ASTNode {
+    static constexpr NodeKind kKind = NodeKind::Induction;
+    uint32_t slot;
+    Affine form;
+    std::unique_ptr<ASTNode> expr;
+    explicit InductionNode(uint32_t slot, Affine form, Location loc = {})
+        : ASTNode{NodeKind::Induction, loc},
+          slot{slot},
+          form{form} {}
+    std::string_view kind_name() const noexcept override { return "Induction"; }
+    void accept(IASTVisitor& v) const override { v.visit(*this); }
+};
+
+// ── Kind-based casts ──────────────────────────────────────────────────────────
+
+// Checked downcast through the kind tag; nullptr when `n` is not a T.
+template <typename T> const T* node_cast(const ASTNode* n) noexcept {
+    return n && n->kind == T::kKind ? static_cast<const T*>(n) : nullptr;
+}
+
+// ── Child traversal ───────────────────────────────────────────────────────────
+
+namespace detail {
+// T, const-qualified like Node.
+template <typename T, typename Node>
+using LikeNode = std::conditional_t<std::is_const_v<Node>, const T, T>;
+} // namespace detail
+
+// Calls f on every child slot of n, in evaluation order.  f receives the
+// std::unique_ptr<ASTNode>& of the slot, const when n is const.
+template <typename Node, typename F>
+    requires std::same_as<std::remove_const_t<Node>, ASTNode>
+void for_each_child(Node& n, F&& f) {
+    auto each = [&](auto& v) {
+        for (auto& c : v)
+            f(c);
+    };
+    auto opt = [&](auto& c) {
+        if (c)
+            f(c);
+    };
+
+    switch (n.kind) {
+    case NodeKind::Program:
+        return each(static_cast<detail::LikeNode<ProgramNode, Node>&>(n).stmts);
+    case NodeKind::Body:
+        return each(static_cast<detail::LikeNode<BodyNode, Node>&>(n).stmts);
+    case NodeKind::VarDecl:
+        return each(static_cast<detail::LikeNode<VarDeclNode, Node>&>(n).defs);
+    case NodeKind::VarDef:
+        return opt(static_cast<detail::LikeNode<VarDefNode, Node>&>(n).init);
+    case NodeKind::Assign: {
+        auto& a = static_cast<detail::LikeNode<AssignNode, Node>&>(n);
+        f(a.rhs);
+        return f(a.lhs);
+    }
+    case NodeKind::If: {
+        auto& i = static_cast<detail::LikeNode<IfNode, Node>&>(n);
+        f(i.cond);
+        f(i.then_body);
+        return opt(i.else_body);
+    }
+    case NodeKind::IfShort: {
+        auto& i = static_cast<detail::LikeNode<IfShortNode, Node>&>(n);
+        f(i.cond);
+        return f(i.stmt);
+    }
+    case NodeKind::While: {
+        auto& w = static_cast<detail::LikeNode<WhileNode, Node>&>(n);
+        f(w.cond);
+        return f(w.body);
+    }
+    case NodeKind::ForRange: {
+        auto& r = static_cast<detail::LikeNode<ForRangeNode, Node>&>(n);
+        f(r.from);
+        f(r.to);
+        return f(r.body);
+    }
+    case NodeKind::ForIter: {
+        auto& r = static_cast<detail::LikeNode<ForIterNode, Node>&>(n);
+        f(r.iterable);
+        return f(r.body);
+    }
+    case NodeKind::LoopInf:
+        return f(static_cast<detail::LikeNode<LoopInfNode, Node>&>(n).body);
+    case NodeKind::Return:
+        return opt(static_cast<detail::LikeNode<ReturnNode, Node>&>(n).value);
+    case NodeKind::Print:
+        return each(static_cast<detail::LikeNode<PrintNode, Node>&>(n).exprs);
+    case NodeKind::BinOp: {
+        auto& b = static_cast<detail::LikeNode<BinOpNode, Node>&>(n);
+        f(b.left);
+        return f(b.right);
+    }
+    case NodeKind::UnaryOp:
+        return f(static_cast<detail::LikeNode<UnaryOpNode, Node>&>(n).operand);
+    case NodeKind::Is: {
+        auto& i = static_cast<detail::LikeNode<IsNode, Node>&>(n);
+        f(i.operand);
+        return f(i.type_node);
+    }
+    case NodeKind::Index: {
+        auto& i = static_cast<detail::LikeNode<IndexNode, Node>&>(n);
+        f(i.base);
+        return f(i.index_expr);
+    }
+    case NodeKind::Call: {
+        auto& c = static_cast<detail::LikeNode<CallNode, Node>&>(n);
+        f(c.callee);
+        return each(c.args);
+    }
+    case NodeKind::DotField:
+        return f(static_cast<detail::LikeNode<DotFieldNode, Node>&>(n).base);
+    case NodeKind::DotInt:
+        return f(static_cast<detail::LikeNode<DotIntNode, Node>&>(n).base);
+    case NodeKind::ArrayLit:
+        return each(static_cast<detail::LikeNode<ArrayLitNode, Node>&>(n).elems);
+    case NodeKind::TupleLit:
+        return each(static_cast<detail::LikeNode<TupleLitNode, Node>&>(n).elems);
+    case NodeKind::TupleElem:
+        return f(static_cast<detail::LikeNode<TupleElemNode, Node>&>(n).expr);
+    case NodeKind::ParamList:
+        return each(static_cast<detail::LikeNode<ParamListNode, Node>&>(n).params);
+    case NodeKind::FuncLit: {
+        auto& fn = static_cast<detail::LikeNode<FuncLitNode, Node>&>(n);
+        opt(fn.params);
+        return f(fn.body);
+    }
+    case NodeKind::Invariant:
+        return f(static_cast<detail::LikeNode<InvariantNode, Node>&>(n).expr);
+    case NodeKind::Induction:
+        return f(static_cast<detail::LikeNode<InductionNode, Node>&>(n).expr);
+    case NodeKind::Exit:
+    case NodeKind::Ident:
+    case NodeKind::IntLit:
+    case NodeKind::RealLit:
+    case NodeKind::StrLit:
+    case NodeKind::BoolLit:
+    case NodeKind::NoneLit:
+    case NodeKind::Type:
+        return;
+    }
+}
+
+// ── Dispatch ──────────────────────────────────────────────────────────────────
+
+// One thunk per node kind, indexed by the enum value, so dispatching is a
+// single indirect call and each visit body stays in its own small function.
+template <typename Derived> void ASTVisitorBase<Derived>::dispatch(const ASTNode& n) {
+    using Thunk = void (*)(ASTVisitorBase&, const ASTNode&);
+    static constexpr Thunk table[] = {
+        &ASTVisitorBase::thunk<ProgramNode>,   // Program
+        &ASTVisitorBase::thunk<BodyNode>,      // Body
+        &ASTVisitorBase::thunk<VarDeclNode>,   // VarDecl
+        &ASTVisitorBase::thunk<VarDefNode>,    // VarDef
+        &ASTVisitorBase::thunk<AssignNode>,    // Assign
+        &ASTVisitorBase::thunk<IfNode>,        // If
+        &ASTVisitorBase::thunk<IfShortNode>,   // IfShort
+        &ASTVisitorBase::thunk<WhileNode>,     // While
+        &ASTVisitorBase::thunk<ForRangeNode>,  // ForRange
+        &ASTVisitorBase::thunk<ForIterNode>,   // ForIter
+        &ASTVisitorBase::thunk<LoopInfNode>,   // LoopInf
+        &ASTVisitorBase::thunk<ExitNode>,      // Exit
+        &ASTVisitorBase::thunk<ReturnNode>,    // Return
+        &ASTVisitorBase::thunk<PrintNode>,     // Print
+        &ASTVisitorBase::thunk<BinOpNode>,     // BinOp
+        &ASTVisitorBase::thunk<UnaryOpNode>,   // UnaryOp
+        &ASTVisitorBase::thunk<IsNode>,        // Is
+        &ASTVisitorBase::thunk<IdentNode>,     // Ident
+        &ASTVisitorBase::thunk<IndexNode>,     // Index
+        &ASTVisitorBase::thunk<CallNode>,      // Call
+        &ASTVisitorBase::thunk<DotFieldNode>,  // DotField
+        &ASTVisitorBase::thunk<DotIntNode>,    // DotInt
+        &ASTVisitorBase::thunk<IntLitNode>,    // IntLit
+        &ASTVisitorBase::thunk<RealLitNode>,   // RealLit
+        &ASTVisitorBase::thunk<StrLitNode>,    // StrLit
+        &ASTVisitorBase::thunk<BoolLitNode>,   // BoolLit
+        &ASTVisitorBase::thunk<NoneLitNode>,   // NoneLit
+        &ASTVisitorBase::thunk<ArrayLitNode>,  // ArrayLit
+        &ASTVisitorBase::thunk<TupleLitNode>,  // TupleLit
+        &ASTVisitorBase::thunk<TupleElemNode>, // TupleElem
+        &ASTVisitorBase::thunk<ParamListNode>, // ParamList
+        &ASTVisitorBase::thunk<FuncLitNode>,   // FuncLit
+        &ASTVisitorBase::thunk<TypeNode>,      // Type
+        &ASTVisitorBase::thunk<InvariantNode>, // Invariant
+        &ASTVisitorBase::thunk<InductionNode>, // Induction
+    };
+    static_assert(std::size(table) == kNodeKinds);
+    table[static_cast<size_t>(n.kind)](*this, n);
+}
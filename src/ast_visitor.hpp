@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
+struct ASTNode;
 struct ProgramNode;
 struct BodyNode;
 struct VarDeclNode;
@@ -33,6 +37,49 @@ struct TupleElemNode;
 struct ParamListNode;
 struct FuncLitNode;
 struct TypeNode;
+struct InvariantNode;
+struct InductionNode;
+
+// Compact tag stored in every ASTNode, one per concrete node type.
+enum class NodeKind : uint8_t {
+    Program,
+    Body,
+    VarDecl,
+    VarDef,
+    Assign,
+    If,
+    IfShort,
+    While,
+    ForRange,
+    ForIter,
+    LoopInf,
+    Exit,
+    Return,
+    Print,
+    BinOp,
+    UnaryOp,
+    Is,
+    Ident,
+    Index,
+    Call,
+    DotField,
+    DotInt,
+    IntLit,
+    RealLit,
+    StrLit,
+    BoolLit,
+    NoneLit,
+    ArrayLit,
+    TupleLit,
+    TupleElem,
+    ParamList,
+    FuncLit,
+    Type,
+    Invariant, // inserted by the Optimizer
+    Induction, // inserted by the Optimizer
+};
+
+inline constexpr size_t kNodeKinds = static_cast<size_t>(NodeKind::Induction) + 1;
 
 struct IASTVisitor {
     virtual ~IASTVisitor() = default;
@@ -70,9 +117,17 @@ struct IASTVisitor {
     virtual void visit(const ParamListNode&) = 0;
     virtual void visit(const FuncLitNode&)   = 0;
     virtual void visit(const TypeNode&)      = 0;
+    virtual void visit(const InvariantNode&) = 0;
+    virtual void visit(const InductionNode&) = 0;
 };
 
+// Base for concrete visitors.  Besides the virtual IASTVisitor entry points it
+// offers dispatch(), which indexes a table by ASTNode::kind and calls
+// Derived::visit directly; with Derived declared `final` those calls are
+// resolved at compile time.  Node types Derived does not handle fall back to the no-ops below.
 template <typename Derived> struct ASTVisitorBase : IASTVisitor {
+    void dispatch(const ASTNode& n); // defined in ast.hpp
+
     void visit(const ProgramNode&) override {}
     void visit(const BodyNode&) override {}
     void visit(const VarDeclNode&) override {}
@@ -106,4 +161,18 @@ template <typename Derived> struct ASTVisitorBase : IASTVisitor {
     void visit(const ParamListNode&) override {}
     void visit(const FuncLitNode&) override {}
     void visit(const TypeNode&) override {}
+    void visit(const InvariantNode&) override {}
+    void visit(const InductionNode&) override {}
+
+private:
+    template <typename Node> static void thunk(ASTVisitorBase& self, const ASTNode& n) {
+        self.forward(static_cast<const Node&>(n));
+    }
+
+    template <typename Node> void forward(const Node& node) {
+        if constexpr (requires(Derived& d) { d.visit(node); })
+            static_cast<Derived&>(*this).visit(node);
+        else
+            ASTVisitorBase::visit(node);
+    }
 };
@@ -0,0 +1,205 @@
+#include "budget.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <format>
+#include <new>
+#include <utility>
+
+// Heap counting needs malloc_usable_size(), and must stay out of the way of a
+// sanitizer's allocator.
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer) ||                         \
+    __has_feature(thread_sanitizer)
+#define DLANG_SANITIZED 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define DLANG_SANITIZED 1
+#endif
+
+#if defined(__GLIBC__) && !defined(DLANG_SANITIZED)
+#define DLANG_COUNT_HEAP 1
+#include <malloc.h>
+#else
+#define DLANG_COUNT_HEAP 0
+#endif
+
+namespace {
+
+constinit thread_local Budget* active_budget = nullptr;
+
+std::atomic<int> heap_users{0}; // started budgets with a heap limit; no counting without
+
+} // namespace
+
+bool Budget::heap_limit_supported() noexcept {
+    return DLANG_COUNT_HEAP;
+}
+
+void Budget::start() {
+    outer_         = std::exchange(active_budget, this);
+    started_       = Clock::now();
+    steps_         = 0;
+    heap_exceeded_ = false;
+    if (limited())
+        fuel_ = granted_ = 0; // the first step checks the limits
+    if (limits_.max_heap_bytes) {
+        heap_users.fetch_add(1, std::memory_order_relaxed);
+        heap_used_ = 0;
+    }
+}
+
+void Budget::stop() noexcept {
+    if (limits_.max_heap_bytes)
+        heap_users.fetch_sub(1, std::memory_order_relaxed);
+    active_budget = outer_;
+}
+
+void Budget::interrupt() noexcept {
+    steps_ += static_cast<uint64_t>(granted_ - fuel_);
+    fuel_ = granted_ = 0;
+}
+
+void Budget::refuel(Location where) {
+    steps_ += static_cast<uint64_t>(granted_ - fuel_); // including the step being charged
+    if (heap_exceeded_)
+        throw BudgetExceeded{std::format("heap limit of {} MB exceeded after {} steps",
+                                         limits_.max_heap_bytes >> 20, steps_),
+                             where};
+    if (limits_.timeout_ms &&
+        Clock::now() - started_ >= std::chrono::milliseconds{limits_.timeout_ms})
+        throw BudgetExceeded{
+            std::format("time limit of {} ms exceeded after {} steps", limits_.timeout_ms, steps_),
+            where};
+    if (limits_.max_steps && steps_ > limits_.max_steps)
+        throw BudgetExceeded{std::format("step limit of {} exceeded", limits_.max_steps), where};
+
+    int64_t grant = kCheckInterval;
+    if (limits_.max_steps)
+        grant = static_cast<int64_t>(
+            std::min<uint64_t>(static_cast<uint64_t>(grant), limits_.max_steps - steps_));
+    fuel_ = granted_ = grant;
+}
+
+void Budget::count_heap(int64_t bytes) noexcept {
+    for (Budget* b = active_budget; b; b = b->outer_) {
+        if (!b->limits_.max_heap_bytes)
+            continue;
+        b->heap_used_ += bytes;
+        if (bytes > 0 && !b->heap_exceeded_ &&
+            b->heap_used_ > static_cast<int64_t>(b->limits_.max_heap_bytes)) {
+            b->heap_exceeded_ = true;
+            b->interrupt();
+        }
+    }
+}
+
+// ── Heap counting ─────────────────────────────────────────────────────────────
+//
+// Replacements for every form of the global allocation functions, so that no
+// block is allocated by one allocator and freed by another.  All of them go
+// through allocate() and release(), which count the usable size of each block.
+// Sanitizers bring their own allocator, so under them nothing is replaced.
+
+#if DLANG_COUNT_HEAP
+
+namespace {
+
+void* allocate(std::size_t n, std::size_t align) noexcept {
+    n       = std::max<std::size_t>(n, 1);
+    void* p = align <= __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                  ? std::malloc(n)
+                  : std::aligned_alloc(align, (n + align - 1) / align * align);
+    if (p && heap_users.load(std::memory_order_relaxed)) [[unlikely]]
+        Budget::count_heap(static_cast<int64_t>(malloc_usable_size(p)));
+    return p;
+}
+
+void* allocate_or_throw(std::size_t n, std::size_t align) {
+    for (;;) {
+        if (void* p = allocate(n, align))
+            return p;
+        const std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc{};
+        handler();
+    }
+}
+
+void release(void* p) noexcept {
+    if (p && heap_users.load(std::memory_order_relaxed)) [[unlikely]]
+        Budget::count_heap(-static_cast<int64_t>(malloc_usable_size(p)));
+    std::free(p);
+}
+
+std::size_t alignment(std::align_val_t a) noexcept {
+    return static_cast<std::size_t>(a);
+}
+
+} // namespace
+
+void* operator new(std::size_t n) {
+    return allocate_or_throw(n, 0);
+}
+void* operator new[](std::size_t n) {
+    return allocate_or_throw(n, 0);
+}
+void* operator new(std::size_t n, std::align_val_t a) {
+    return allocate_or_throw(n, alignment(a));
+}
+void* operator new[](std::size_t n, std::align_val_t a) {
+    return allocate_or_throw(n, alignment(a));
+}
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept {
+    return allocate(n, 0);
+}
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept {
+    return allocate(n, 0);
+}
+void* operator new(std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept {
+    return allocate(n, alignment(a));
+}
+void* operator new[](std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept {
+    return allocate(n, alignment(a));
+}
+
+void operator delete(void* p) noexcept {
+    release(p);
+}
+void operator delete[](void* p) noexcept {
+    release(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+    release(p);
+}
+void operator delete[](void* p, std::size_t) noexcept {
+    release(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept {
+    release(p);
+}
+void operator delete[](void* p, std::align_val_t) noexcept {
+    release(p);
+}
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    release(p);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    release(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+    release(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+    release(p);
+}
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    release(p);
+}
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {
+    release(p);
+}
+
+#endif // DLANG_COUNT_HEAP
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+// ── Execution budget ──────────────────────────────────────────────────────────
+//
+// Limits on how much a run may do (dinterp --max-steps, --timeout-ms,
+// --max-heap-mb).  A step is one loop iteration or one call.  The engines
+// charge each step with step(), which only decrements a fuel counter; when the
+// fuel runs out, refuel() adds up the steps, checks every limit and grants at
+// most kCheckInterval more.  The clock is therefore read once per few thousand
+// steps, and a run without limits never leaves the fast path.
+//
+// Heap use is counted by the global operator new/delete in budget.cpp: bytes
+// allocated less bytes freed since start(), on the thread running the budget
+// (and by the budgets it is nested in), so runs on other threads do not count.
+// A block freed on another thread than the one that allocated it is credited
+// to the thread freeing it.  Crossing the heap limit empties the fuel of the
+// budget, so the run stops at its next step.  Counting is only available with
+// glibc, and not under sanitizers (heap_limit_supported()).
+
+// Thrown by refuel() when a limit is exceeded.
+struct BudgetExceeded : std::runtime_error {
+    Location loc; // the loop or call being charged
+    BudgetExceeded(const std::string& what, Location where)
+        : std::runtime_error{what}, loc{where} {}
+};
+
+class Budget {
+public:
+    struct Limits {
+        uint64_t max_steps{0}; // 0 = unlimited, for all three
+        uint64_t timeout_ms{0};
+        uint64_t max_heap_bytes{0};
+    };
+
+    static constexpr int64_t kCheckInterval = 4096;
+
+    Budget() = default; // unlimited
+    explicit Budget(Limits limits) : limits_{limits} {}
+
+    static bool heap_limit_supported() noexcept;
+
+    bool limited() const noexcept {
+        return limits_.max_steps || limits_.timeout_ms || limits_.max_heap_bytes;
+    }
+
+    // Begin / end a run on the calling thread.
+    void start();
+    void stop() noexcept;
+
+    void step(Location where) {
+        if (--fuel_ < 0) [[unlikely]]
+            refuel(where);
+    }
+    void refuel(Location where);
+
+    // Makes the next step() call refuel().
+    void interrupt() noexcept;
+
+    uint64_t steps() const noexcept { return steps_; }
+
+    // Called by the global operator new/delete with the size of each block
+    // (negative when freed), to charge the budgets active on the calling thread.
+    static void count_heap(int64_t bytes) noexcept;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Limits limits_{};
+    int64_t fuel_{std::numeric_limits<int64_t>::max()};
+    int64_t granted_{0}; // fuel at the last refuel()
+    uint64_t steps_{0};  // charged up to the last refuel()
+    Clock::time_point started_{};
+    int64_t heap_used_{0}; // bytes allocated less bytes freed on this thread since start()
+    bool heap_exceeded_{false};
+    Budget* outer_{nullptr}; // budget active on this thread before start()
+};
@@ -0,0 +1,269 @@
+#include "builtins.hpp"
+
+#include "array_kernels.hpp"
+#include "value_ops.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+using T = DValue::Type;
+
+// ── Numeric views of arrays ───────────────────────────────────────────────────
+
+// The elements of a numeric array in key order.  An unboxed array is viewed in
+// place.  A boxed one is copied into `int_buf` or `real_buf` when its elements
+// share a type, and otherwise listed in `mixed`.
+struct Numbers {
+    std::span<const long long> ints;
+    std::span<const double> reals;
+    std::vector<const DValue*> mixed;
+    std::vector<long long> int_buf;
+    std::vector<double> real_buf;
+
+    size_t size() const noexcept { return ints.size() + reals.size() + mixed.size(); }
+};
+
+const ArrayStorage& array_arg(const char* fn, const DValue& v) {
+    if (v.type != T::Array)
+        throw std::runtime_error(std::format("{}: expected an array", fn));
+    return *v.aval;
+}
+
+Numbers numbers(const char* fn, const DValue& v) {
+    const ArrayStorage& arr = array_arg(fn, v);
+    Numbers n;
+    if (arr.kind() == ArrayStorage::Kind::Ints) {
+        n.ints = arr.ints();
+        return n;
+    }
+    if (arr.kind() == ArrayStorage::Kind::Reals) {
+        n.reals = arr.reals();
+        return n;
+    }
+    bool has_int = false, has_real = false;
+    for (const auto& [k, e] : arr.boxed()) {
+        if (e.type == T::Int)
+            has_int = true;
+        else if (e.type == T::Real)
+            has_real = true;
+        else
+            throw std::runtime_error(std::format("{}: array elements must be numeric", fn));
+        n.mixed.push_back(&e);
+    }
+    if (has_int && has_real)
+        return n;
+    for (const DValue* e : n.mixed) {
+        if (has_int)
+            n.int_buf.push_back(e->ival);
+        else
+            n.real_buf.push_back(e->rval);
+    }
+    n.mixed.clear();
+    n.ints  = n.int_buf;
+    n.reals = n.real_buf;
+    return n;
+}
+
+double real_of(const DValue& v) {
+    return v.type == T::Int ? static_cast<double>(v.ival) : v.rval;
+}
+
+bool is_number(const DValue& v) {
+    return v.type == T::Int || v.type == T::Real;
+}
+
+// Ascending, with NaN after every number so that sorting stays well defined.
+bool real_less(double x, double y) {
+    return x < y || (std::isnan(y) && !std::isnan(x));
+}
+
+// The elements of `n` as reals, converted into `buf` unless they already are.
+std::span<const double> as_reals(const Numbers& n, std::vector<double>& buf) {
+    if (!n.reals.empty())
+        return n.reals;
+    for (long long v : n.ints)
+        buf.push_back(static_cast<double>(v));
+    for (const DValue* e : n.mixed)
+        buf.push_back(real_of(*e));
+    return buf;
+}
+
+// ── Builtins ──────────────────────────────────────────────────────────────────
+
+DValue len(std::span<DValue> a) {
+    switch (a[0].type) {
+    case T::Array:
+        return DValue::make_int(static_cast<long long>(a[0].aval->size()));
+    case T::Tuple:
+        return DValue::make_int(static_cast<long long>(a[0].tval->size()));
+    case T::String:
+        return DValue::make_int(static_cast<long long>(a[0].sval.size()));
+    default:
+        throw std::runtime_error("len: expected an array, tuple or string");
+    }
+}
+
+DValue sum(std::span<DValue> a) {
+    const Numbers n = numbers("sum", a[0]);
+    if (n.size() == 0)
+        return DValue::make_int(0);
+    if (!n.ints.empty())
+        return DValue::make_int(kernels::sum(n.ints.data(), n.ints.size()));
+    std::vector<double> buf;
+    const auto r = as_reals(n, buf);
+    return DValue::make_real(kernels::sum(r.data(), r.size()));
+}
+
+template <bool Max>
+DValue extremum(std::span<DValue> a) {
+    const char* fn  = Max ? "max" : "min";
+    const Numbers n = numbers(fn, a[0]);
+    if (n.size() == 0)
+        throw std::runtime_error(std::format("{}: empty array", fn));
+    if (!n.ints.empty()) {
+        const size_t i = Max ? kernels::max_index(n.ints.data(), n.ints.size())
+                             : kernels::min_index(n.ints.data(), n.ints.size());
+        return DValue::make_int(n.ints[i]);
+    }
+    if (!n.reals.empty())
+        return DValue::make_real(Max ? kernels::max(n.reals.data(), n.reals.size())
+                                     : kernels::min(n.reals.data(), n.reals.size()));
+    // Mixed Int and Real: the winning element keeps its own type.
+    const DValue* best = n.mixed[0];
+    for (const DValue* e : n.mixed)
+        if (Max ? real_of(*e) > real_of(*best) : real_of(*e) < real_of(*best))
+            best = e;
+    return *best;
+}
+
+DValue dot(std::span<DValue> a) {
+    const Numbers x = numbers("dot", a[0]);
+    const Numbers y = numbers("dot", a[1]);
+    if (x.size() != y.size())
+        throw std::runtime_error(
+            std::format("dot: arrays differ in length ({} and {})", x.size(), y.size()));
+    if (x.size() == 0)
+        return DValue::make_int(0);
+    if (!x.ints.empty() && !y.ints.empty())
+        return DValue::make_int(kernels::dot(x.ints.data(), y.ints.data(), x.size()));
+    std::vector<double> xbuf, ybuf;
+    const auto rx = as_reals(x, xbuf);
+    const auto ry = as_reals(y, ybuf);
+    return DValue::make_real(kernels::dot(rx.data(), ry.data(), rx.size()));
+}
+
+DValue fill(std::span<DValue> a) {
+    if (a[0].type != T::Int || a[0].ival < 0)
+        throw std::runtime_error("fill: count must be a non-negative integer");
+    ArrayStorage out;
+    for (long long k = 1; k <= a[0].ival; ++k)
+        out.push_back(a[1]);
+    return DValue::make_array(std::move(out));
+}
+
+DValue map_scale(std::span<DValue> a) {
+    const Numbers n = numbers("map_scale", a[0]);
+    const DValue& k = a[1];
+    if (!is_number(k))
+        throw std::runtime_error("map_scale: factor must be numeric");
+
+    // Keys are kept, so a sparse array stays sparse.
+    ArrayStorage out;
+    size_t i = 0;
+    if (!n.ints.empty() && k.type == T::Int) {
+        std::vector<long long> scaled(n.size());
+        kernels::scale(n.ints.data(), n.size(), k.ival, scaled.data());
+        a[0].aval->for_each(
+            [&](long long key, const DValue&) { out.set(key, DValue::make_int(scaled[i++])); });
+    } else {
+        std::vector<double> buf;
+        const auto r = as_reals(n, buf);
+        std::vector<double> scaled(r.size());
+        kernels::scale(r.data(), r.size(), real_of(k), scaled.data());
+        a[0].aval->for_each(
+            [&](long long key, const DValue&) { out.set(key, DValue::make_real(scaled[i++])); });
+    }
+    return DValue::make_array(std::move(out));
+}
+
+DValue sort(std::span<DValue> a) {
+    const Numbers n = numbers("sort", a[0]);
+    ArrayStorage out;
+    if (!n.ints.empty()) {
+        std::vector<long long> v(n.ints.begin(), n.ints.end());
+        std::sort(v.begin(), v.end());
+        for (long long x : v)
+            out.push_back(DValue::make_int(x));
+    } else if (!n.reals.empty()) {
+        std::vector<double> v(n.reals.begin(), n.reals.end());
+        std::sort(v.begin(), v.end(), real_less);
+        for (double x : v)
+            out.push_back(DValue::make_real(x));
+    } else {
+        std::vector<const DValue*> v = n.mixed;
+        std::stable_sort(v.begin(), v.end(), [](const DValue* x, const DValue* y) {
+            return real_less(real_of(*x), real_of(*y));
+        });
+        for (const DValue* e : v)
+            out.push_back(*e);
+    }
+    return DValue::make_array(std::move(out));
+}
+
+DValue find(std::span<DValue> a) {
+    const ArrayStorage& arr = array_arg("find", a[0]);
+    const DValue& key       = a[1];
+
+    // Unboxed arrays are searched by a kernel; anything else compares element
+    // by element with the `=` operator.
+    size_t i = kernels::kNotFound;
+    if (arr.kind() == ArrayStorage::Kind::Ints && key.type == T::Int) {
+        i = kernels::find(arr.ints().data(), arr.size(), key.ival);
+    } else if (arr.kind() == ArrayStorage::Kind::Reals && is_number(key)) {
+        i = kernels::find(arr.reals().data(), arr.size(), real_of(key));
+    } else {
+        long long k = arr.first_key();
+        bool found  = false;
+        arr.for_each([&](long long at, const DValue& e) {
+            if (!found && binary_op(BinOpNode::Op::EQ, e, key).bval) {
+                k     = at;
+                found = true;
+            }
+        });
+        return found ? DValue::make_int(k) : DValue::make_none();
+    }
+    if (i == kernels::kNotFound)
+        return DValue::make_none();
+    return DValue::make_int(arr.first_key() + static_cast<long long>(i));
+}
+
+constexpr std::array kBuiltins{
+    Builtin{"len", 1, len},
+    Builtin{"sum", 1, sum},
+    Builtin{"min", 1, extremum<false>},
+    Builtin{"max", 1, extremum<true>},
+    Builtin{"dot", 2, dot},
+    Builtin{"fill", 2, fill},
+    Builtin{"map_scale", 2, map_scale},
+    Builtin{"sort", 1, sort},
+    Builtin{"find", 2, find},
+};
+
+} // namespace
+
+std::span<const Builtin> builtins() {
+    return kBuiltins;
+}
+
+DValue call_builtin(const Builtin& b, std::span<DValue> args) {
+    if (args.size() != b.arity)
+        throw std::runtime_error(std::format("{}: expected {} argument{}, got {}", b.name, b.arity,
+                                             b.arity == 1 ? "" : "s", args.size()));
+    return b.fn(args);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "value.hpp"
+
+#include <cstddef>
+#include <span>
+#include <string_view>
+
+// ── Builtin functions ─────────────────────────────────────────────────────────
+//
+// Native functions predeclared in a scope that encloses the program's global
+// scope, so a program may still declare its own `sum` or `len`.  They are
+// ordinary Func values at runtime; calling one runs C++ instead of a body.
+//
+//   len(x)          elements of an array or tuple, bytes of a string
+//   sum(a)          sum of a numeric array (0 when empty)
+//   min(a), max(a)  smallest / largest element of a non-empty numeric array
+//   dot(a, b)       sum of a[i] * b[i] over two numeric arrays of equal length
+//   fill(n, v)      new array [v, v, ..., v] with n elements
+//   map_scale(a, k) new array with every element multiplied by k
+//   sort(a)         new array with the elements of a numeric array in order
+//   find(a, v)      key of the first element equal to v, or none
+//
+// Arrays are visited in key order.  Results are Int when every operand is an
+// Int and Real otherwise, as with the arithmetic operators.  The kernels in
+// array_kernels.hpp read unboxed arrays (see ArrayStorage) in place.  Errors
+// are reported as std::runtime_error.
+
+using NativeFn = DValue (*)(std::span<DValue> args);
+
+struct Builtin {
+    std::string_view name;
+    size_t arity;
+    NativeFn fn;
+};
+
+// Every builtin, in a fixed order (the order of their slots in the closure engine).
+std::span<const Builtin> builtins();
+
+// Checks the argument count and runs `b`.
+DValue call_builtin(const Builtin& b, std::span<DValue> args);
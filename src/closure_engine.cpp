@@ -0,0 +1,804 @@
+#include "closure_engine.hpp"
+
+#include "budget.hpp"
+#include "builtins.hpp"
+#include "interpreter.hpp"
+#include "value_ops.hpp"
+
+#include <format>
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace closure {
+
+enum class Flow { Normal, Exit, Return };
+
+struct Machine {
+    std::ostream& out;
+    Budget& budget;
+    SlotEnv env;
+    DValue ret; // value of the `return` that produced Flow::Return
+};
+
+using Expr = std::function<DValue(Machine&)>;
+using Stmt = std::function<Flow(Machine&)>;
+
+} // namespace closure
+
+struct CompiledFunc {
+    size_t params;      // number of parameters
+    size_t slots;       // size of the parameter frame, which may hold the body's variables
+    closure::Stmt body; // BodyNode: pushes and pops its own frame, if it has one
+};
+
+namespace closure {
+namespace {
+
+// Frames without slots are never written, so they all share one vector.
+SlotFramePtr make_frame(size_t slots) {
+    static const SlotFramePtr empty = std::make_shared<SlotFrame>();
+    return slots ? std::make_shared<SlotFrame>(slots) : empty;
+}
+
+DValue& slot_at(Machine& m, size_t depth, size_t slot) {
+    return (*m.env[m.env.size() - 1 - depth])[slot];
+}
+
+DValue call(Machine& m, const DValue& fv, const std::vector<Expr>& args) {
+    if (fv.type != DValue::Type::Func) {
+        for (const Expr& a : args)
+            a(m);
+        throw std::runtime_error("call on non-function");
+    }
+    const FuncClosure& closure = *fv.fval;
+    if (closure.native) {
+        std::vector<DValue> values;
+        values.reserve(args.size());
+        for (const Expr& a : args)
+            values.push_back(a(m));
+        return call_builtin(*closure.native, values);
+    }
+    const CompiledFunc& code = *closure.code;
+
+    // Arguments are evaluated in the caller's environment straight into the
+    // parameter frame; surplus arguments are evaluated and dropped.
+    SlotFramePtr params = make_frame(code.slots);
+    for (size_t i = 0; i < args.size(); ++i) {
+        DValue v = args[i](m);
+        if (i < code.params)
+            (*params)[i] = std::move(v);
+    }
+
+    struct Restore {
+        Machine& m;
+        SlotEnv saved;
+        ~Restore() { m.env = std::move(saved); }
+    } restore{m, std::move(m.env)};
+    m.env = closure.captured_slots;
+    m.env.push_back(std::move(params));
+
+    const Flow f = code.body(m);
+    if (f == Flow::Exit)
+        throw ExitSignal{}; // `exit` escaped the function: unwind to the caller's loop
+    return f == Flow::Return ? std::move(m.ret) : DValue{};
+}
+
+// Runs one iteration of the loop at `where`.  Returns false when the loop must
+// stop, leaving the status for the loop's caller in `out`.
+bool iterate(Machine& m, const Stmt& body, size_t depth, Flow& out, Location where) {
+    m.budget.step(where);
+    Flow f;
+    try {
+        f = body(m);
+    } catch (ExitSignal&) {
+        m.env.resize(depth); // frames pushed between the loop and the throw
+        out = Flow::Normal;
+        return false;
+    }
+    if (f == Flow::Normal)
+        return true;
+    out = f == Flow::Exit ? Flow::Normal : f;
+    return false;
+}
+
+// Binary operator whose Int × Int case is computed inline; everything else
+// (and every error) goes through binary_op.  A literal right operand is folded
+// into the closure.
+template <typename IntOp>
+Expr int_fast_path(BinOpNode::Op op, Expr l, Expr r, const ASTNode& rhs, IntOp int_op) {
+    if (const auto* lit = node_cast<IntLitNode>(&rhs)) {
+        const long long c = lit->value;
+        return [op, l = std::move(l), c, int_op](Machine& m) -> DValue {
+            DValue L = l(m);
+            if (L.type == DValue::Type::Int)
+                return int_op(L.ival, c);
+            return binary_op(op, L, DValue::make_int(c));
+        };
+    }
+    return [op, l = std::move(l), r = std::move(r), int_op](Machine& m) -> DValue {
+        DValue L = l(m);
+        DValue R = r(m);
+        if (L.type == DValue::Type::Int && R.type == DValue::Type::Int)
+            return int_op(L.ival, R.ival);
+        return binary_op(op, L, R);
+    };
+}
+
+// ── Compiler ───────────────────────────────────────────────────────────────────
+
+class Compiler final : public ASTVisitorBase<Compiler> {
+public:
+    // The builtins and `inputs` scopes enclose the program, as in the analyzer.
+    Compiler(std::vector<std::unique_ptr<CompiledFunc>>& funcs, std::span<const std::string> inputs)
+        : funcs_{funcs} {
+        scopes_.emplace_back(); // in the order of builtins()
+        for (const Builtin& b : builtins())
+            declare(std::string{b.name});
+        scopes_.emplace_back();
+        for (const auto& name : inputs)
+            declare(name);
+    }
+
+    Stmt stmt(const ASTNode& n);
+    Expr expr(const ASTNode& n);
+
+    void visit(const ProgramNode&) override;
+    void visit(const BodyNode&) override;
+    void visit(const VarDeclNode&) override;
+    void visit(const VarDefNode&) override;
+    void visit(const AssignNode&) override;
+    void visit(const IfNode&) override;
+    void visit(const IfShortNode&) override;
+    void visit(const WhileNode&) override;
+    void visit(const ForRangeNode&) override;
+    void visit(const ForIterNode&) override;
+    void visit(const LoopInfNode&) override;
+    void visit(const ExitNode&) override;
+    void visit(const ReturnNode&) override;
+    void visit(const PrintNode&) override;
+    void visit(const BinOpNode&) override;
+    void visit(const UnaryOpNode&) override;
+    void visit(const IsNode&) override;
+    void visit(const IdentNode&) override;
+    void visit(const IndexNode&) override;
+    void visit(const CallNode&) override;
+    void visit(const DotFieldNode&) override;
+    void visit(const DotIntNode&) override;
+    void visit(const IntLitNode&) override;
+    void visit(const RealLitNode&) override;
+    void visit(const StrLitNode&) override;
+    void visit(const BoolLitNode&) override;
+    void visit(const NoneLitNode&) override;
+    void visit(const ArrayLitNode&) override;
+    void visit(const TupleLitNode&) override;
+    void visit(const TupleElemNode&) override;
+    void visit(const FuncLitNode&) override;
+    void visit(const TypeNode&) override;
+    void visit(const InvariantNode&) override;
+    void visit(const InductionNode&) override;
+
+private:
+    using Scope = std::unordered_map<std::string, size_t>; // name → slot
+
+    std::vector<std::unique_ptr<CompiledFunc>>& funcs_;
+    std::vector<Scope> scopes_; // mirrors the runtime frames
+    Expr expr_;
+    Stmt stmt_;
+
+    Stmt sequence(const std::vector<std::unique_ptr<ASTNode>>& stmts);
+    Stmt scoped(const std::vector<std::unique_ptr<ASTNode>>& stmts);
+    size_t declare(const std::string& name);
+    std::pair<size_t, size_t> resolve(const IdentNode& id) const;
+};
+
+Stmt Compiler::stmt(const ASTNode& n) {
+    expr_ = nullptr;
+    stmt_ = nullptr;
+    dispatch(n);
+    if (stmt_)
+        return std::move(stmt_);
+    // Expression statement (e.g. a call): evaluate and discard.
+    return [e = std::move(expr_)](Machine& m) {
+        e(m);
+        return Flow::Normal;
+    };
+}
+
+Expr Compiler::expr(const ASTNode& n) {
+    expr_ = nullptr;
+    dispatch(n);
+    return std::move(expr_);
+}
+
+Stmt Compiler::sequence(const std::vector<std::unique_ptr<ASTNode>>& stmts) {
+    std::vector<Stmt> list;
+    list.reserve(stmts.size());
+    for (const auto& s : stmts)
+        list.push_back(stmt(*s));
+    if (list.size() == 1)
+        return std::move(list.front());
+    return [list = std::move(list)](Machine& m) {
+        for (const Stmt& s : list)
+            if (const Flow f = s(m); f != Flow::Normal)
+                return f;
+        return Flow::Normal;
+    };
+}
+
+// A statement list in a fresh scope, run in a fresh frame.
+Stmt Compiler::scoped(const std::vector<std::unique_ptr<ASTNode>>& stmts) {
+    scopes_.emplace_back();
+    Stmt inner         = sequence(stmts);
+    const size_t slots = scopes_.back().size();
+    scopes_.pop_back();
+    return [inner = std::move(inner), slots](Machine& m) {
+        m.env.push_back(make_frame(slots));
+        const Flow f = inner(m);
+        m.env.pop_back();
+        return f;
+    };
+}
+
+size_t Compiler::declare(const std::string& name) {
+    Scope& scope = scopes_.back();
+    return scope.try_emplace(name, scope.size()).first->second;
+}
+
+std::pair<size_t, size_t> Compiler::resolve(const IdentNode& id) const {
+    const int depth = id.resolved_depth;
+    if (depth >= 0 && static_cast<size_t>(depth) < scopes_.size()) {
+        const Scope& scope = scopes_[scopes_.size() - 1 - depth];
+        if (auto it = scope.find(id.ident_name); it != scope.end())
+            return {static_cast<size_t>(depth), it->second};
+    }
+    throw std::runtime_error(std::format("unresolved variable '{}'", id.ident_name));
+}
+
+// ── Statements ─────────────────────────────────────────────────────────────────
+
+// The program frame stays on the environment after the run so that run() can
+// break closure cycles through it.
+void Compiler::visit(const ProgramNode& n) {
+    scopes_.emplace_back();
+    Stmt inner         = sequence(n.stmts);
+    const size_t slots = scopes_.back().size();
+    scopes_.pop_back();
+    stmt_ = [inner = std::move(inner), slots](Machine& m) {
+        m.env.push_back(make_frame(slots));
+        return inner(m);
+    };
+}
+
+void Compiler::visit(const BodyNode& n) {
+    stmt_ = n.has_frame ? scoped(n.stmts) : sequence(n.stmts);
+}
+
+void Compiler::visit(const VarDeclNode& n) {
+    stmt_ = sequence(n.defs);
+}
+
+void Compiler::visit(const VarDefNode& n) {
+    // Mirror the analyzer: a function literal sees its own name.
+    const bool is_func_init = n.init && n.init->kind == NodeKind::FuncLit;
+    size_t slot             = is_func_init ? declare(n.varname) : 0;
+    Expr init               = n.init ? expr(*n.init) : nullptr;
+    if (!is_func_init)
+        slot = declare(n.varname);
+    if (init)
+        stmt_ = [slot, init = std::move(init)](Machine& m) {
+            DValue v              = init(m);
+            (*m.env.back())[slot] = std::move(v);
+            return Flow::Normal;
+        };
+    else
+        stmt_ = [slot](Machine& m) {
+            (*m.env.back())[slot] = DValue{};
+            return Flow::Normal;
+        };
+}
+
+void Compiler::visit(const AssignNode& n) {
+    if (const BinOpNode* add = self_concatenation(n); add && add->right->kind != NodeKind::IntLit) {
+        // x := x + e may append to x's array or tuple in place.
+        using T                  = DValue::Type;
+        const auto [depth, slot] = resolve(static_cast<const IdentNode&>(*n.lhs));
+        stmt_ = [l = expr(*add->left), r = expr(*add->right), depth, slot](Machine& m) {
+            DValue L  = l(m);
+            DValue R  = r(m);
+            DValue& x = slot_at(m, depth, slot);
+            if (L.type == T::Int && R.type == T::Int)
+                x = DValue::make_int(L.ival + R.ival);
+            else if (!(L.type == T::Array || L.type == T::Tuple) || !append_in_place(x, L, R))
+                x = binary_op(BinOpNode::Op::ADD, L, R);
+            return Flow::Normal;
+        };
+        return;
+    }
+    Expr rhs = expr(*n.rhs);
+    if (const auto* id = node_cast<IdentNode>(n.lhs.get())) {
+        const auto [depth, slot] = resolve(*id);
+        stmt_ = [rhs = std::move(rhs), depth, slot](Machine& m) {
+            DValue v                = rhs(m);
+            slot_at(m, depth, slot) = std::move(v);
+            return Flow::Normal;
+        };
+    } else if (const auto* idx = node_cast<IndexNode>(n.lhs.get())) {
+        stmt_ = [rhs = std::move(rhs), base = expr(*idx->base),
+                 key = expr(*idx->index_expr)](Machine& m) {
+            DValue v = rhs(m);
+            DValue b = base(m);
+            DValue k = key(m);
+            index_set(b, k, std::move(v));
+            return Flow::Normal;
+        };
+    } else if (const auto* dot = node_cast<DotFieldNode>(n.lhs.get());
+               dot && dot->base->kind == NodeKind::Index) {
+        const auto& idx = static_cast<const IndexNode&>(*dot->base);
+        stmt_ = [rhs = std::move(rhs), base = expr(*idx.base), key = expr(*idx.index_expr),
+                 field = dot->field](Machine& m) {
+            DValue v = rhs(m);
+            DValue b = base(m);
+            DValue k = key(m);
+            element_field_set(b, k, field, std::move(v));
+            return Flow::Normal;
+        };
+    } else if (const auto* di = node_cast<DotIntNode>(n.lhs.get());
+               di && di->base->kind == NodeKind::Index) {
+        const auto& idx = static_cast<const IndexNode&>(*di->base);
+        stmt_ = [rhs = std::move(rhs), base = expr(*idx.base), key = expr(*idx.index_expr),
+                 index = di->index](Machine& m) {
+            DValue v = rhs(m);
+            DValue b = base(m);
+            DValue k = key(m);
+            element_dot_int_set(b, k, index, std::move(v));
+            return Flow::Normal;
+        };
+    } else if (const auto* dot = node_cast<DotFieldNode>(n.lhs.get())) {
+        stmt_ = [rhs = std::move(rhs), base = expr(*dot->base), field = dot->field](Machine& m) {
+            DValue v = rhs(m);
+            field_set(base(m), field, std::move(v));
+            return Flow::Normal;
+        };
+    } else if (const auto* di = node_cast<DotIntNode>(n.lhs.get())) {
+        stmt_ = [rhs = std::move(rhs), base = expr(*di->base), index = di->index](Machine& m) {
+            DValue v = rhs(m);
+            dot_int_set(base(m), index, std::move(v));
+            return Flow::Normal;
+        };
+    } else {
+        stmt_ = [rhs = std::move(rhs)](Machine& m) -> Flow {
+            rhs(m);
+            throw std::runtime_error("invalid lvalue");
+        };
+    }
+}
+
+void Compiler::visit(const IfNode& n) {
+    Expr cond      = expr(*n.cond);
+    Stmt then_body = stmt(*n.then_body);
+    if (!n.else_body) {
+        stmt_ = [cond = std::move(cond), then_body = std::move(then_body)](Machine& m) {
+            return cond(m).is_truthy() ? then_body(m) : Flow::Normal;
+        };
+        return;
+    }
+    Stmt else_body = stmt(*n.else_body);
+    stmt_          = [cond = std::move(cond), then_body = std::move(then_body),
+             else_body = std::move(else_body)](Machine& m) {
+        return cond(m).is_truthy() ? then_body(m) : else_body(m);
+    };
+}
+
+void Compiler::visit(const IfShortNode& n) {
+    stmt_ = [cond = expr(*n.cond), body = stmt(*n.stmt)](Machine& m) {
+        return cond(m).is_truthy() ? body(m) : Flow::Normal;
+    };
+}
+
+void Compiler::visit(const WhileNode& n) {
+    stmt_ = [cond = expr(*n.cond), body = stmt(*n.body), loc = n.loc](Machine& m) {
+        const size_t depth = m.env.size();
+        Flow out           = Flow::Normal;
+        while (cond(m).is_truthy())
+            if (!iterate(m, body, depth, out, loc))
+                break;
+        return out;
+    };
+}
+
+void Compiler::visit(const ForRangeNode& n) {
+    Expr from = expr(*n.from);
+    Expr to   = expr(*n.to);
+    scopes_.emplace_back();
+    const bool has_iter = !n.iter.empty();
+    if (has_iter)
+        declare(n.iter); // slot 0
+    Stmt body = stmt(*n.body);
+    scopes_.pop_back();
+
+    stmt_ = [from = std::move(from), to = std::move(to), body = std::move(body), has_iter,
+             loc = n.loc](Machine& m) {
+        const long long lo = from(m).ival;
+        const long long hi = to(m).ival;
+        const size_t depth = m.env.size();
+        m.env.push_back(make_frame(has_iter ? 1 : 0));
+        SlotFrame& frame = *m.env.back();
+        Flow out         = Flow::Normal;
+        for (long long v = lo; v <= hi; ++v) {
+            if (has_iter)
+                frame[0] = DValue::make_int(v);
+            if (!iterate(m, body, depth + 1, out, loc))
+                break;
+        }
+        m.env.resize(depth);
+        return out;
+    };
+}
+
+void Compiler::visit(const ForIterNode& n) {
+    Expr iterable = expr(*n.iterable);
+    scopes_.emplace_back();
+    const bool has_iter = !n.iter.empty();
+    if (has_iter)
+        declare(n.iter); // slot 0
+    Stmt body = stmt(*n.body);
+    scopes_.pop_back();
+
+    stmt_ = [iterable = std::move(iterable), body = std::move(body), has_iter,
+             row_copies = n.reads_fields, loc = n.loc](Machine& m) {
+        const DValue seq   = iterable(m);
+        const size_t depth = m.env.size();
+        m.env.push_back(make_frame(has_iter ? 1 : 0));
+        SlotFrame& frame = *m.env.back();
+        Flow out         = Flow::Normal;
+        const auto step  = [&](const DValue& elem) {
+            if (has_iter)
+                frame[0] = elem;
+            return iterate(m, body, depth + 1, out, loc);
+        };
+        if (seq.type == DValue::Type::Array) {
+            ArrayStorage::Cursor cursor{*seq.aval, row_copies};
+            DValue elem;
+            while (cursor.next(elem))
+                if (!step(elem))
+                    break;
+        } else if (seq.type == DValue::Type::Tuple) {
+            for (auto& e : *seq.tval)
+                if (!step(e.value))
+                    break;
+        } else {
+            throw std::runtime_error("cannot iterate over non-array/tuple");
+        }
+        m.env.resize(depth);
+        return out;
+    };
+}
+
+void Compiler::visit(const LoopInfNode& n) {
+    stmt_ = [body = stmt(*n.body), loc = n.loc](Machine& m) {
+        const size_t depth = m.env.size();
+        Flow out           = Flow::Normal;
+        while (iterate(m, body, depth, out, loc)) {
+        }
+        return out;
+    };
+}
+
+void Compiler::visit(const ExitNode&) {
+    stmt_ = [](Machine&) { return Flow::Exit; };
+}
+
+void Compiler::visit(const ReturnNode& n) {
+    if (!n.value) {
+        stmt_ = [](Machine& m) {
+            m.ret = {};
+            return Flow::Return;
+        };
+        return;
+    }
+    stmt_ = [value = expr(*n.value)](Machine& m) {
+        m.ret = value(m);
+        return Flow::Return;
+    };
+}
+
+void Compiler::visit(const PrintNode& n) {
+    std::vector<Expr> exprs;
+    for (const auto& e : n.exprs)
+        exprs.push_back(expr(*e));
+    stmt_ = [exprs = std::move(exprs)](Machine& m) {
+        for (size_t i = 0; i < exprs.size(); ++i) {
+            if (i > 0)
+                m.out << ' ';
+            m.out << exprs[i](m).to_string();
+        }
+        m.out << '\n';
+        return Flow::Normal;
+    };
+}
+
+// ── Expressions ────────────────────────────────────────────────────────────────
+
+void Compiler::visit(const IntLitNode& n) {
+    expr_ = [v = n.value](Machine&) { return DValue::make_int(v); };
+}
+void Compiler::visit(const RealLitNode& n) {
+    expr_ = [v = n.value](Machine&) { return DValue::make_real(v); };
+}
+void Compiler::visit(const StrLitNode& n) {
+    expr_ = [v = n.value](Machine&) { return DValue::make_str(v); };
+}
+void Compiler::visit(const BoolLitNode& n) {
+    expr_ = [v = n.value](Machine&) { return DValue::make_bool(v); };
+}
+void Compiler::visit(const NoneLitNode&) {
+    expr_ = [](Machine&) { return DValue{}; };
+}
+void Compiler::visit(const TypeNode&) {
+    expr_ = [](Machine&) { return DValue{}; };
+}
+void Compiler::visit(const TupleElemNode& n) {
+    expr_ = expr(*n.expr);
+}
+
+// Optimizer annotations are compiled through: slot reads already make plain
+// variable access cheap here, and the original expression is kept intact.
+void Compiler::visit(const InvariantNode& n) {
+    expr_ = expr(*n.expr);
+}
+void Compiler::visit(const InductionNode& n) {
+    expr_ = expr(*n.expr);
+}
+
+void Compiler::visit(const IdentNode& n) {
+    const auto [depth, slot] = resolve(n);
+    if (depth == 0)
+        expr_ = [slot](Machine& m) { return (*m.env.back())[slot]; };
+    else
+        expr_ = [depth, slot](Machine& m) { return slot_at(m, depth, slot); };
+}
+
+void Compiler::visit(const FuncLitNode& n) {
+    scopes_.emplace_back();
+    if (n.params)
+        for (const auto& p : static_cast<const ParamListNode&>(*n.params).params)
+            declare(static_cast<const IdentNode&>(*p).ident_name);
+    const size_t params = scopes_.back().size();
+    Stmt body           = stmt(*n.body);
+    const size_t slots  = scopes_.back().size();
+    scopes_.pop_back();
+
+    funcs_.push_back(
+        std::make_unique<CompiledFunc>(CompiledFunc{params, slots, std::move(body)}));
+    expr_ = [node = &n, code = funcs_.back().get()](Machine& m) {
+        return DValue::make_compiled_func(node, m.env, code);
+    };
+}
+
+void Compiler::visit(const ArrayLitNode& n) {
+    std::vector<Expr> elems;
+    for (const auto& e : n.elems)
+        elems.push_back(expr(*e));
+    expr_ = [elems = std::move(elems)](Machine& m) {
+        ArrayStorage a;
+        for (const Expr& e : elems)
+            a.push_back(e(m));
+        return DValue::make_array(std::move(a));
+    };
+}
+
+void Compiler::visit(const TupleLitNode& n) {
+    std::vector<std::pair<std::string, Expr>> elems;
+    for (const auto& e : n.elems) {
+        const auto& te = static_cast<const TupleElemNode&>(*e);
+        elems.emplace_back(te.elem_name, expr(*te.expr));
+    }
+    expr_ = [elems = std::move(elems)](Machine& m) {
+        std::vector<TupleElem> t;
+        t.reserve(elems.size());
+        for (const auto& [name, e] : elems)
+            t.push_back(TupleElem{name, e(m)});
+        return DValue::make_tuple(std::move(t));
+    };
+}
+
+void Compiler::visit(const IndexNode& n) {
+    expr_ = [base = expr(*n.base), key = expr(*n.index_expr)](Machine& m) {
+        DValue b = base(m);
+        DValue k = key(m);
+        return index_get(b, k);
+    };
+}
+
+void Compiler::visit(const CallNode& n) {
+    std::vector<Expr> args;
+    for (const auto& a : n.args)
+        args.push_back(expr(*a));
+    expr_ = [callee = expr(*n.callee), args = std::move(args), loc = n.loc](Machine& m) {
+        m.budget.step(loc);
+        return call(m, callee(m), args);
+    };
+}
+
+// a[k].field and a[k].index read an array of Records without building the
+// tuple (see ArrayStorage).
+void Compiler::visit(const DotFieldNode& n) {
+    if (const auto* idx = node_cast<IndexNode>(n.base.get())) {
+        expr_ = [base = expr(*idx->base), key = expr(*idx->index_expr),
+                 field = n.field](Machine& m) {
+            DValue b = base(m);
+            DValue k = key(m);
+            return element_field_get(b, k, field);
+        };
+        return;
+    }
+    expr_ = [base = expr(*n.base), field = n.field](Machine& m) {
+        return field_get(base(m), field);
+    };
+}
+
+void Compiler::visit(const DotIntNode& n) {
+    if (const auto* idx = node_cast<IndexNode>(n.base.get())) {
+        expr_ = [base = expr(*idx->base), key = expr(*idx->index_expr),
+                 index = n.index](Machine& m) {
+            DValue b = base(m);
+            DValue k = key(m);
+            return element_dot_int_get(b, k, index);
+        };
+        return;
+    }
+    expr_ = [base = expr(*n.base), index = n.index](Machine& m) {
+        return dot_int_get(base(m), index);
+    };
+}
+
+void Compiler::visit(const UnaryOpNode& n) {
+    expr_ = [op = n.op, operand = expr(*n.operand)](Machine& m) {
+        return unary_op(op, operand(m));
+    };
+}
+
+void Compiler::visit(const IsNode& n) {
+    expr_ = [operand = expr(*n.operand),
+             type = static_cast<const TypeNode&>(*n.type_node).type](Machine& m) {
+        return DValue::make_bool(has_type(operand(m), type));
+    };
+}
+
+void Compiler::visit(const BinOpNode& n) {
+    using Op = BinOpNode::Op;
+    Expr l   = expr(*n.left);
+    Expr r   = expr(*n.right);
+
+    // Integer comparisons go through double, exactly as binary_op does.
+    const auto real = [](long long v) { return static_cast<double>(v); };
+
+    switch (n.op) {
+    case Op::AND:
+        expr_ = [l = std::move(l), r = std::move(r)](Machine& m) {
+            return DValue::make_bool(l(m).is_truthy() && r(m).is_truthy());
+        };
+        return;
+    case Op::OR:
+        expr_ = [l = std::move(l), r = std::move(r)](Machine& m) {
+            return DValue::make_bool(l(m).is_truthy() || r(m).is_truthy());
+        };
+        return;
+    case Op::XOR:
+        expr_ = [l = std::move(l), r = std::move(r)](Machine& m) {
+            return DValue::make_bool(l(m).is_truthy() != r(m).is_truthy());
+        };
+        return;
+    case Op::ADD:
+        expr_ = int_fast_path(n.op, std::move(l), std::move(r), *n.right,
+                              [](long long a, long long b) { return DValue::make_int(a + b); });
+        return;
+    case Op::SUB:
+        expr_ = int_fast_path(n.op, std::move(l), std::move(r), *n.right,
+                              [](long long a, long long b) { return DValue::make_int(a - b); });
+        return;
+    case Op::MUL:
+        expr_ = int_fast_path(n.op, std::move(l), std::move(r), *n.right,
+                              [](long long a, long long b) { return DValue::make_int(a * b); });
+        return;
+    case Op::LT:
+        expr_ = int_fast_path(n.op, std::move(l), std::move(r), *n.right,
+                              [real](long long a, long long b) {
+                                  return DValue::make_bool(real(a) < real(b));
+                              });
+        return;
+    case Op::LE:
+        expr_ = int_fast_path(n.op, std::move(l), std::move(r), *n.right,
+                              [real](long long a, long long b) {
+                                  return DValue::make_bool(real(a) <= real(b));
+                              });
+        return;
+    case Op::GT:
+        expr_ = int_fast_path(n.op, std::move(l), std::move(r), *n.right,
+                              [real](long long a, long long b) {
+                                  return DValue::make_bool(real(a) > real(b));
+                              });
+        return;
+    case Op::GE:
+        expr_ = int_fast_path(n.op, std::move(l), std::move(r), *n.right,
+                              [real](long long a, long long b) {
+                                  return DValue::make_bool(real(a) >= real(b));
+                              });
+        return;
+    case Op::EQ:
+        expr_ = int_fast_path(n.op, std::move(l), std::move(r), *n.right,
+                              [](long long a, long long b) { return DValue::make_bool(a == b); });
+        return;
+    case Op::NEQ:
+        expr_ = int_fast_path(n.op, std::move(l), std::move(r), *n.right,
+                              [](long long a, long long b) { return DValue::make_bool(a != b); });
+        return;
+    default:
+        expr_ = [op = n.op, l = std::move(l), r = std::move(r)](Machine& m) {
+            DValue L = l(m);
+            DValue R = r(m);
+            return binary_op(op, L, R);
+        };
+    }
+}
+
+} // namespace
+} // namespace closure
+
+// ── ClosureEngine ──────────────────────────────────────────────────────────────
+
+struct ClosureEngine::Code {
+    std::vector<std::unique_ptr<CompiledFunc>> funcs; // outlives every closure value
+    closure::Stmt program;
+    size_t inputs;
+};
+
+ClosureEngine::ClosureEngine(std::ostream& out) : out_{out} {}
+
+std::shared_ptr<const ClosureEngine::Code> ClosureEngine::compile(
+    const ASTNode& root, std::span<const std::string> inputs) {
+    auto code     = std::make_shared<Code>();
+    code->program = closure::Compiler{code->funcs, inputs}.stmt(root);
+    code->inputs  = inputs.size();
+    return code;
+}
+
+void ClosureEngine::run(const ASTNode& root) {
+    run(*compile(root));
+}
+
+void ClosureEngine::run(const Code& code, std::span<const DValue> inputs) {
+    struct BudgetScope {
+        Budget& b;
+        ~BudgetScope() { b.stop(); }
+    } budget_scope{budget_};
+    budget_.start();
+
+    closure::Machine m{out_, budget_, {}, {}};
+    // Break shared_ptr cycles (closures capture the frames that hold them),
+    // whether the program finished or failed.
+    struct Cleanup {
+        closure::Machine& m;
+        ~Cleanup() {
+            m.ret = {};
+            for (auto& frame : m.env)
+                for (auto& v : *frame)
+                    v = {};
+            m.env.clear();
+        }
+    } cleanup{m};
+
+    const auto natives = builtins();
+    m.env.push_back(std::make_shared<SlotFrame>(natives.size()));
+    for (size_t i = 0; i < natives.size(); ++i)
+        (*m.env.back())[i] = DValue::make_builtin(&natives[i]);
+    m.env.push_back(std::make_shared<SlotFrame>(inputs.begin(), inputs.end()));
+    m.env.back()->resize(code.inputs);
+    code.program(m);
+}
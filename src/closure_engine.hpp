@@ -0,0 +1,49 @@
+#pragma once
+
+#include "ast.hpp"
+#include "budget.hpp"
+#include "value.hpp"
+
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+
+// ── ClosureEngine ─────────────────────────────────────────────────────────────
+//
+// Alternative to the tree-walking Interpreter.  run() first lowers the AST into
+// a tree of closures in a single pass, binding everything that is known
+// statically: operator kinds, literal values, and each variable's (frame depth,
+// slot) pair.  It then calls the root closure.  At run time there is no
+// accept() dispatch, no result register, no dynamic_cast and no variable
+// lookup by name.
+//
+// Control flow travels as a status code returned by statement closures rather
+// than as ExitSignal/ReturnSignal exceptions.  The exception is an `exit` that
+// escapes the function it appears in, which is rethrown as an ExitSignal at
+// the call site.
+//
+// The AST must have passed semantic analysis (resolved_depth is consumed).
+// Output and runtime errors match the Interpreter's.
+
+class ClosureEngine {
+public:
+    // The closures for one program.  Running only reads them, so one Code may
+    // be run by any number of engines at once.
+    struct Code;
+    // `inputs` are the names passed to SemanticAnalyzer::analyze.
+    static std::shared_ptr<const Code> compile(const ASTNode& root,
+                                               std::span<const std::string> inputs = {});
+
+    explicit ClosureEngine(std::ostream& out);
+    void run(const ASTNode& root);
+    // `inputs` holds the input values in the order of their names.
+    void run(const Code& code, std::span<const DValue> inputs = {});
+
+    // Limits later runs; exceeding a limit throws BudgetExceeded.
+    void set_budget(const Budget::Limits& limits) { budget_ = Budget{limits}; }
+
+private:
+    std::ostream& out_;
+    Budget budget_;
+};
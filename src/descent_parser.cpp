@@ -0,0 +1,607 @@
+#include "descent_parser.hpp"
+
+#include "lexer.hpp"
+
+#include <print>
+#include <utility>
+
+namespace {
+
+using K  = yy::parser::symbol_kind;
+using Op = BinOpNode::Op;
+
+Location at(const yy::position& p) {
+    return Location{p.line, p.column};
+}
+
+// ── Binding powers ────────────────────────────────────────────────────────────
+//
+// Higher binds tighter, as in parser.y: or/xor, and, the relations, + -, * /.
+// All are left-associative except the relations, which do not chain.
+
+constexpr int kRelation = 3;
+
+struct Infix {
+    int power{0}; // 0: not a binary operator
+    Op op{};
+};
+
+constexpr Infix infix(yy::parser::symbol_kind_type k) {
+    switch (k) {
+    case K::S_TOK_OR:
+        return {1, Op::OR};
+    case K::S_TOK_XOR:
+        return {1, Op::XOR};
+    case K::S_TOK_AND:
+        return {2, Op::AND};
+    case K::S_TOK_LT:
+        return {kRelation, Op::LT};
+    case K::S_TOK_LE:
+        return {kRelation, Op::LE};
+    case K::S_TOK_GT:
+        return {kRelation, Op::GT};
+    case K::S_TOK_GE:
+        return {kRelation, Op::GE};
+    case K::S_TOK_EQ:
+        return {kRelation, Op::EQ};
+    case K::S_TOK_NEQ:
+        return {kRelation, Op::NEQ};
+    case K::S_TOK_PLUS:
+        return {4, Op::ADD};
+    case K::S_TOK_MINUS:
+        return {4, Op::SUB};
+    case K::S_TOK_STAR:
+        return {5, Op::MUL};
+    case K::S_TOK_SLASH:
+        return {5, Op::DIV};
+    default:
+        return {};
+    }
+}
+
+constexpr bool starts_expr(yy::parser::symbol_kind_type k) {
+    switch (k) {
+    case K::S_TOK_IDENT:
+    case K::S_TOK_INTEGER:
+    case K::S_TOK_REAL:
+    case K::S_TOK_STRING:
+    case K::S_TOK_TRUE:
+    case K::S_TOK_FALSE:
+    case K::S_TOK_NONE:
+    case K::S_TOK_LBRACKET:
+    case K::S_TOK_LBRACE:
+    case K::S_TOK_FUNC:
+    case K::S_TOK_LPAREN:
+    case K::S_TOK_PLUS:
+    case K::S_TOK_MINUS:
+    case K::S_TOK_NOT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+constexpr bool starts_statement(yy::parser::symbol_kind_type k) {
+    switch (k) {
+    case K::S_TOK_VAR:
+    case K::S_TOK_IDENT:
+    case K::S_TOK_IF:
+    case K::S_TOK_LOOP:
+    case K::S_TOK_WHILE:
+    case K::S_TOK_FOR:
+    case K::S_TOK_EXIT:
+    case K::S_TOK_RETURN:
+    case K::S_TOK_PRINT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+DescentParser::DescentParser(std::unique_ptr<ASTNode>& result, Lexer& lexer)
+    : result_{result}, lexer_{lexer} {}
+
+int DescentParser::parse() {
+    try {
+        stack_base_  = reinterpret_cast<std::uintptr_t>(__builtin_frame_address(0));
+        tok_         = read();
+        auto program = std::make_unique<ProgramNode>(Location{1});
+        statements(program->stmts);
+        if (tok_.kind != K::S_YYEOF)
+            fail();
+        result_ = std::move(program);
+        return 0;
+    } catch (const yy::parser::syntax_error& e) {
+        std::println(stderr, "Parse error at line {}:{}: {}", e.location.begin.line,
+                     e.location.begin.column, e.what());
+        return 1;
+    }
+}
+
+// ── Tokens ────────────────────────────────────────────────────────────────────
+
+DescentParser::Token DescentParser::read() {
+    yy::parser::symbol_type sym = lexer_.next();
+    Token t{sym.kind(), sym.location};
+    switch (t.kind) {
+    case K::S_TOK_IDENT:
+    case K::S_TOK_STRING:
+        t.text = std::move(sym.value.as<std::string>());
+        break;
+    case K::S_TOK_INTEGER:
+        t.ival = sym.value.as<long long>();
+        break;
+    case K::S_TOK_REAL:
+        t.rval = sym.value.as<double>();
+        break;
+    default:
+        break;
+    }
+    return t;
+}
+
+void DescentParser::advance() {
+    prev_end_ = tok_.loc.end;
+    if (peeked_) {
+        tok_    = std::move(ahead_);
+        peeked_ = false;
+    } else {
+        tok_ = read();
+    }
+}
+
+DescentParser::Kind DescentParser::peek() {
+    if (!peeked_) {
+        ahead_  = read();
+        peeked_ = true;
+    }
+    return ahead_.kind;
+}
+
+void DescentParser::expect(Kind k) {
+    if (tok_.kind != k)
+        fail();
+    advance();
+}
+
+// Bison's parser stops at the first token it cannot shift, and so do we.
+void DescentParser::fail() const {
+    throw yy::parser::syntax_error{tok_.loc, "syntax error"};
+}
+
+void DescentParser::nest() const {
+    // Frame addresses rather than those of locals, which a sanitizer may move to
+    // the heap.
+    const auto top  = reinterpret_cast<std::uintptr_t>(__builtin_frame_address(0));
+    const auto used = stack_base_ > top ? stack_base_ - top : top - stack_base_;
+    if (used > kStackBudget)
+        throw yy::parser::syntax_error{tok_.loc, "nesting too deep"};
+}
+
+// ── Statements ────────────────────────────────────────────────────────────────
+
+void DescentParser::statements(std::vector<Node>& out) {
+    for (;;) {
+        if (tok_.kind == K::S_TOK_SEMI)
+            advance();
+        else if (starts_statement(tok_.kind))
+            out.push_back(statement());
+        else
+            return;
+    }
+}
+
+// An empty rule takes the end of the token before it as its location.
+DescentParser::Node DescentParser::body() {
+    auto n = std::make_unique<BodyNode>(at(prev_end_));
+    statements(n->stmts);
+    return n;
+}
+
+DescentParser::Node DescentParser::statement() {
+    nest();
+    const Location loc = at(tok_.loc.begin);
+    switch (tok_.kind) {
+    case K::S_TOK_VAR:
+        return var_decl();
+    case K::S_TOK_IDENT: {
+        Node target = postfix();
+        if (tok_.kind != K::S_TOK_ASSIGN)
+            return target;
+        advance();
+        auto n = std::make_unique<AssignNode>(loc);
+        n->lhs = std::move(target);
+        n->rhs = expr();
+        return n;
+    }
+    case K::S_TOK_IF:
+        return if_stmt();
+    case K::S_TOK_LOOP: {
+        advance();
+        auto n  = std::make_unique<LoopInfNode>(loc);
+        n->body = body();
+        expect(K::S_TOK_END);
+        return n;
+    }
+    case K::S_TOK_WHILE:
+        return while_stmt();
+    case K::S_TOK_FOR:
+        return for_stmt();
+    case K::S_TOK_EXIT:
+        advance();
+        return std::make_unique<ExitNode>(loc);
+    case K::S_TOK_RETURN: {
+        advance();
+        auto n = std::make_unique<ReturnNode>(loc);
+        if (starts_expr(tok_.kind))
+            n->value = expr();
+        return n;
+    }
+    case K::S_TOK_PRINT: {
+        advance();
+        auto n   = std::make_unique<PrintNode>(loc);
+        n->exprs = expr_list();
+        return n;
+    }
+    default:
+        fail();
+    }
+}
+
+DescentParser::Node DescentParser::var_decl() {
+    auto n = std::make_unique<VarDeclNode>(at(tok_.loc.begin));
+    advance();
+    for (;;) {
+        if (tok_.kind != K::S_TOK_IDENT)
+            fail();
+        auto def     = std::make_unique<VarDefNode>(at(tok_.loc.begin));
+        def->varname = std::move(tok_.text);
+        advance();
+        if (tok_.kind == K::S_TOK_ASSIGN) {
+            advance();
+            def->init = expr();
+        }
+        n->defs.push_back(std::move(def));
+        if (tok_.kind != K::S_TOK_COMMA)
+            return n;
+        advance();
+    }
+}
+
+DescentParser::Node DescentParser::if_stmt() {
+    const Location loc = at(tok_.loc.begin);
+    advance();
+    Node cond = expr();
+    if (tok_.kind == K::S_TOK_ARROW) {
+        advance();
+        auto n  = std::make_unique<IfShortNode>(loc);
+        n->cond = std::move(cond);
+        n->stmt = statement();
+        return n;
+    }
+    expect(K::S_TOK_THEN);
+    auto n       = std::make_unique<IfNode>(loc);
+    n->cond      = std::move(cond);
+    n->then_body = body();
+    if (tok_.kind == K::S_TOK_ELSE) {
+        advance();
+        n->else_body = body();
+    }
+    expect(K::S_TOK_END);
+    return n;
+}
+
+DescentParser::Node DescentParser::while_stmt() {
+    auto n = std::make_unique<WhileNode>(at(tok_.loc.begin));
+    advance();
+    n->cond = expr();
+    expect(K::S_TOK_LOOP);
+    n->body = body();
+    expect(K::S_TOK_END);
+    return n;
+}
+
+// for [name in] from .. to loop ... end   or   for [name in] iterable loop ... end
+DescentParser::Node DescentParser::for_stmt() {
+    const Location loc = at(tok_.loc.begin);
+    advance();
+    std::string iter;
+    if (tok_.kind == K::S_TOK_IDENT && peek() == K::S_TOK_IN) {
+        iter = std::move(tok_.text);
+        advance();
+        advance();
+    }
+    Node first = expr();
+    if (tok_.kind == K::S_TOK_DOTDOT) {
+        advance();
+        auto n  = std::make_unique<ForRangeNode>(loc);
+        n->iter = std::move(iter);
+        n->from = std::move(first);
+        n->to   = expr();
+        expect(K::S_TOK_LOOP);
+        n->body = body();
+        expect(K::S_TOK_END);
+        return n;
+    }
+    expect(K::S_TOK_LOOP);
+    auto n      = std::make_unique<ForIterNode>(loc);
+    n->iter     = std::move(iter);
+    n->iterable = std::move(first);
+    n->body     = body();
+    expect(K::S_TOK_END);
+    return n;
+}
+
+// ── Expressions ───────────────────────────────────────────────────────────────
+
+// Binary operators binding at least as tightly as `min_power`.
+DescentParser::Node DescentParser::expr(int min_power) {
+    nest();
+    Node left = unary();
+    int last  = 0; // power of the operator that built `left`
+    for (;;) {
+        const Infix in = infix(tok_.kind);
+        if (in.power < min_power)
+            return left;
+        if (in.power == kRelation && last == kRelation)
+            fail();
+        advance();
+        auto n   = std::make_unique<BinOpNode>(in.op, left->loc);
+        n->left  = std::move(left);
+        n->right = expr(in.power + 1);
+        left     = std::move(n);
+        last     = in.power;
+    }
+}
+
+// A sign or `not` applies to an operand, and `is` follows one; neither nests.
+DescentParser::Node DescentParser::unary() {
+    const Location loc = at(tok_.loc.begin);
+    UnaryOpNode::Op op;
+    switch (tok_.kind) {
+    case K::S_TOK_PLUS:
+        op = UnaryOpNode::Op::UPLUS;
+        break;
+    case K::S_TOK_MINUS:
+        op = UnaryOpNode::Op::UMINUS;
+        break;
+    case K::S_TOK_NOT:
+        op = UnaryOpNode::Op::NOT;
+        break;
+    default: {
+        Node operand = this->operand();
+        if (tok_.kind != K::S_TOK_IS)
+            return operand;
+        advance();
+        auto n       = std::make_unique<IsNode>(loc);
+        n->operand   = std::move(operand);
+        n->type_node = type_indicator();
+        return n;
+    }
+    }
+    advance();
+    auto n     = std::make_unique<UnaryOpNode>(op, loc);
+    n->operand = operand();
+    return n;
+}
+
+// A postfix chain, a literal or a parenthesized expression.  Only a chain
+// takes indexing, calls and fields.
+DescentParser::Node DescentParser::operand() {
+    const Location loc = at(tok_.loc.begin);
+    switch (tok_.kind) {
+    case K::S_TOK_IDENT:
+        return postfix();
+    case K::S_TOK_INTEGER: {
+        Node n = ASTNode::make_int(tok_.ival, loc);
+        advance();
+        return n;
+    }
+    case K::S_TOK_REAL: {
+        Node n = ASTNode::make_real(tok_.rval, loc);
+        advance();
+        return n;
+    }
+    case K::S_TOK_STRING: {
+        Node n = ASTNode::make_str(std::move(tok_.text), loc);
+        advance();
+        return n;
+    }
+    case K::S_TOK_TRUE:
+    case K::S_TOK_FALSE: {
+        Node n = ASTNode::make_bool(tok_.kind == K::S_TOK_TRUE, loc);
+        advance();
+        return n;
+    }
+    case K::S_TOK_NONE:
+        advance();
+        return ASTNode::make_none(loc);
+    case K::S_TOK_LBRACKET:
+        return array_literal();
+    case K::S_TOK_LBRACE:
+        return tuple_literal();
+    case K::S_TOK_FUNC:
+        return func_literal();
+    case K::S_TOK_LPAREN: {
+        advance();
+        Node n = expr();
+        expect(K::S_TOK_RPAREN);
+        return n;
+    }
+    default:
+        fail();
+    }
+}
+
+DescentParser::Node DescentParser::postfix() {
+    const Location loc = at(tok_.loc.begin);
+    Node n             = ASTNode::make_ident(std::move(tok_.text), loc);
+    advance();
+    for (;;) {
+        switch (tok_.kind) {
+        case K::S_TOK_LBRACKET: {
+            advance();
+            auto idx        = std::make_unique<IndexNode>(loc);
+            idx->base       = std::move(n);
+            idx->index_expr = expr();
+            expect(K::S_TOK_RBRACKET);
+            n = std::move(idx);
+            break;
+        }
+        case K::S_TOK_LPAREN: {
+            advance();
+            auto call    = std::make_unique<CallNode>(loc);
+            call->callee = std::move(n);
+            if (tok_.kind != K::S_TOK_RPAREN)
+                call->args = expr_list();
+            expect(K::S_TOK_RPAREN);
+            n = std::move(call);
+            break;
+        }
+        case K::S_TOK_DOT:
+            advance();
+            if (tok_.kind == K::S_TOK_IDENT) {
+                auto dot   = std::make_unique<DotFieldNode>(loc);
+                dot->field = std::move(tok_.text);
+                dot->base  = std::move(n);
+                n          = std::move(dot);
+            } else if (tok_.kind == K::S_TOK_INTEGER) {
+                auto dot  = std::make_unique<DotIntNode>(tok_.ival, loc);
+                dot->base = std::move(n);
+                n         = std::move(dot);
+            } else {
+                fail();
+            }
+            advance();
+            break;
+        default:
+            return n;
+        }
+    }
+}
+
+// func is ... end   func => e   func(a, b) is ... end   func(a, b) => e
+DescentParser::Node DescentParser::func_literal() {
+    const Location loc = at(tok_.loc.begin);
+    auto n             = std::make_unique<FuncLitNode>(loc);
+    advance();
+    if (tok_.kind == K::S_TOK_LPAREN) {
+        advance();
+        auto params = std::make_unique<ParamListNode>(at(tok_.loc.begin));
+        for (;;) {
+            if (tok_.kind != K::S_TOK_IDENT)
+                fail();
+            params->params.push_back(ASTNode::make_ident(std::move(tok_.text), at(tok_.loc.begin)));
+            advance();
+            if (tok_.kind != K::S_TOK_COMMA)
+                break;
+            advance();
+        }
+        expect(K::S_TOK_RPAREN);
+        n->params = std::move(params);
+    } else {
+        n->params = std::make_unique<ParamListNode>(loc);
+    }
+
+    if (tok_.kind == K::S_TOK_IS) {
+        advance();
+        n->body = body();
+        expect(K::S_TOK_END);
+    } else if (tok_.kind == K::S_TOK_ARROW) {
+        advance();
+        auto ret   = std::make_unique<ReturnNode>(loc);
+        ret->value = expr();
+        auto b     = std::make_unique<BodyNode>(loc);
+        b->stmts.push_back(std::move(ret));
+        n->body = std::move(b);
+    } else {
+        fail();
+    }
+    return n;
+}
+
+DescentParser::Node DescentParser::array_literal() {
+    auto n = std::make_unique<ArrayLitNode>(at(tok_.loc.begin));
+    advance();
+    if (tok_.kind != K::S_TOK_RBRACKET)
+        n->elems = expr_list();
+    expect(K::S_TOK_RBRACKET);
+    return n;
+}
+
+DescentParser::Node DescentParser::tuple_literal() {
+    auto n = std::make_unique<TupleLitNode>(at(tok_.loc.begin));
+    advance();
+    if (tok_.kind == K::S_TOK_RBRACE) {
+        advance();
+        return n;
+    }
+    for (;;) {
+        auto elem = std::make_unique<TupleElemNode>(at(tok_.loc.begin));
+        if (tok_.kind == K::S_TOK_IDENT && peek() == K::S_TOK_ASSIGN) {
+            elem->elem_name = std::move(tok_.text);
+            advance();
+            advance();
+        }
+        elem->expr = expr();
+        n->elems.push_back(std::move(elem));
+        if (tok_.kind != K::S_TOK_COMMA)
+            break;
+        advance();
+    }
+    expect(K::S_TOK_RBRACE);
+    return n;
+}
+
+DescentParser::Node DescentParser::type_indicator() {
+    const Location loc = at(tok_.loc.begin);
+    TypeNode::Type type;
+    switch (tok_.kind) {
+    case K::S_TOK_TYPE_INT:
+        type = TypeNode::Type::INT;
+        break;
+    case K::S_TOK_TYPE_REAL:
+        type = TypeNode::Type::REAL;
+        break;
+    case K::S_TOK_TYPE_BOOL:
+        type = TypeNode::Type::BOOL;
+        break;
+    case K::S_TOK_TYPE_STRING:
+        type = TypeNode::Type::STRING;
+        break;
+    case K::S_TOK_NONE:
+        type = TypeNode::Type::NONE;
+        break;
+    case K::S_TOK_FUNC:
+        type = TypeNode::Type::FUNC;
+        break;
+    case K::S_TOK_LBRACKET:
+        advance();
+        if (tok_.kind != K::S_TOK_RBRACKET)
+            fail();
+        type = TypeNode::Type::ARRAY;
+        break;
+    case K::S_TOK_LBRACE:
+        advance();
+        if (tok_.kind != K::S_TOK_RBRACE)
+            fail();
+        type = TypeNode::Type::TUPLE;
+        break;
+    default:
+        fail();
+    }
+    advance();
+    return std::make_unique<TypeNode>(type, loc);
+}
+
+std::vector<DescentParser::Node> DescentParser::expr_list() {
+    std::vector<Node> list;
+    list.push_back(expr());
+    while (tok_.kind == K::S_TOK_COMMA) {
+        advance();
+        list.push_back(expr());
+    }
+    return list;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "ast.hpp"
+#include "parser.tab.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Lexer;
+
+// ── DescentParser ─────────────────────────────────────────────────────────────
+//
+// Hand-written parser for D: recursive descent for statements and Pratt
+// parsing (binding powers) for the binary operators.  It accepts the language
+// of parser.y and builds the same tree, locations included.  A syntax error is
+// reported as Bison's parser reports it: on stderr, at the same token, with
+// the same message.  Nodes are built where they are parsed instead of being
+// moved through a value stack on every reduction.
+//
+// The interface is yy::parser's, so either can stand in for the other (see
+// Parser below).  Tokens, their kinds and their locations are still Bison's.
+//
+// Nested expressions and statements recurse on the native stack.  Once parsing
+// has used kStackBudget bytes of it, some thousands of levels deep, further
+// nesting is reported as a syntax error ("nesting too deep") where Bison's
+// parser, whose stack is on the heap, would go on.
+
+class DescentParser {
+public:
+    DescentParser(std::unique_ptr<ASTNode>& result, Lexer& lexer);
+
+    // 0 with the program in `result`, or 1 after reporting a syntax error.
+    int parse();
+
+    static constexpr std::uintptr_t kStackBudget = 4 << 20;
+
+private:
+    using Kind = yy::parser::symbol_kind_type;
+    using Node = std::unique_ptr<ASTNode>;
+
+    // A token with its semantic value unpacked.
+    struct Token {
+        Kind kind{};
+        yy::location loc{};
+        std::string text{}; // TOK_IDENT, TOK_STRING
+        long long ival{0};  // TOK_INTEGER
+        double rval{0};     // TOK_REAL
+    };
+
+    std::unique_ptr<ASTNode>& result_;
+    Lexer& lexer_;
+    Token tok_;                    // current token
+    Token ahead_;                  // the token after it, once peek() has read it
+    yy::position prev_end_;        // end of the last token consumed
+    bool peeked_{false};
+    std::uintptr_t stack_base_{0}; // frame address of parse()
+
+    Token read();
+    void advance();
+    Kind peek();
+    void expect(Kind k);
+    [[noreturn]] void fail() const;
+    // Fails with "nesting too deep" once the stack budget is spent.
+    void nest() const;
+
+    // Statements
+    void statements(std::vector<Node>& out);
+    Node body();
+    Node statement();
+    Node var_decl();
+    Node if_stmt();
+    Node while_stmt();
+    Node for_stmt();
+
+    // Expressions
+    Node expr(int min_power = 1);
+    Node unary();
+    Node operand();
+    Node postfix();
+    Node func_literal();
+    Node array_literal();
+    Node tuple_literal();
+    Node type_indicator();
+    std::vector<Node> expr_list();
+};
+
+// The parser the tools use: DescentParser when built with
+// DLANG_HANDWRITTEN_PARSER, Bison's otherwise.
+#ifdef DLANG_HANDWRITTEN_PARSER
+using Parser = DescentParser;
+#else
+using Parser = yy::parser;
+#endif
@@ -1,26 +1,219 @@
+/*
+ * dinterp – run a D program
+ *
+ * Usage:
+ *   dinterp [options] [file]
+ *
+ * Without a file reads from stdin.
+ *
+ * Options:
+ *   --pipeline                lex on a separate thread, overlapping with parsing
+ *   --engine=tree|closure|stack
+ *                             execution engine: the AST-walking interpreter
+ *                             (default), the closure compiler, or the
+ *                             explicit-stack evaluator, whose recursion depth
+ *                             (D calls and nested expressions) is bounded by
+ *                             memory rather than by the native stack
+ *   -O0 | -O1 | -O2           -O1 runs the loop optimizer (invariant caching and
+ *                             induction variables) before execution; -O2 first
+ *                             inlines calls of small function literals; -O0
+ *                             (default) runs the program as parsed
+ *   --profile=<out.json>      profile the run; writes Chrome trace-event JSON to
+ *                             <out.json> and collapsed stacks to <out>.folded
+ *   --profile-mode=exact|sample
+ *                             exact timing of every call and statement (default),
+ *                             or SIGPROF sampling with much lower overhead
+ *   --profile-interval=<us>   sampling interval in microseconds (default 1000)
+ *   --stats                   print interpreter counters to stderr at exit
+ *   --region                  allocate the run's arrays, tuples and closures
+ *                             from one region, freed at once when it ends
+ *   --max-steps=<n>           stop after n loop iterations and calls
+ *   --timeout-ms=<n>          stop after n milliseconds of execution
+ *   --max-heap-mb=<n>         stop when the heap grows by more than n MB
+ *   --snapshot-after=<line>   once the top-level statements starting on or
+ *                             before <line> have run, write the global
+ *                             variables to <file>.snap, then carry on
+ *   --restore=<snap>          start from a snapshot of the same program: skip
+ *                             the statements it covers and load their globals
+ *                             on first use (their output is not repeated)
+ *
+ * --profile, --stats, --region and snapshots need the tree engine.  With the stack
+ * engine the whole pipeline before and after the run is iterative as well,
+ * except the optimizer.
+ *
+ * Exit codes: 1 parse error, 2 semantic error, 3 runtime error, 4 budget
+ * exceeded.
+ */
 #include "ast.hpp"
+#include "budget.hpp"
+#include "closure_engine.hpp"
+#include "descent_parser.hpp"
 #include "interpreter.hpp"
 #include "lexer.hpp"
-#include "parser.tab.hpp"
+#include "optimizer.hpp"
+#include "profiler.hpp"
 #include "semantic_analyzer.hpp"
+#include "snapshot.hpp"
+#include "stack_engine.hpp"
 
+#include <charconv>
 #include <fstream>
+#include <iterator>
 #include <memory>
+#include <optional>
 #include <print>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+// "out.json" → "out.folded"; other names get ".folded" appended.
+static std::string folded_path(std::string_view json_path) {
+    std::string p{json_path};
+    if (p.ends_with(".json"))
+        p.resize(p.size() - 5);
+    return p + ".folded";
+}
+
+static bool write_profile(const Profiler& prof, const std::string& path) {
+    std::ofstream json{path};
+    std::ofstream folded{folded_path(path)};
+    if (!json || !folded) {
+        std::println(stderr, "Error: cannot write profile '{}'", path);
+        return false;
+    }
+    prof.write_chrome_trace(json);
+    prof.write_collapsed(folded);
+    return true;
+}
+
+// Parses the positive integer after `prefix` in `arg`.
+static std::optional<uint64_t> parse_limit(std::string_view arg, std::string_view prefix) {
+    const std::string_view v = arg.substr(prefix.size());
+    uint64_t n               = 0;
+    auto [end, ec]           = std::from_chars(v.data(), v.data() + v.size(), n);
+    if (ec != std::errc{} || end != v.data() + v.size() || n == 0) {
+        std::println(stderr, "Error: invalid limit '{}'", arg);
+        return std::nullopt;
+    }
+    return n;
+}
+
+enum class Backend { Tree, Closure, Stack };
 
 int main(int argc, char* argv[]) {
+    bool pipeline    = false;
+    bool stats       = false;
+    bool region      = false;
+    Backend backend  = Backend::Tree;
+    int opt_level    = 0;
+    const char* path = nullptr;
+    std::optional<std::string> profile_path;
+    Profiler::Mode profile_mode = Profiler::Mode::Exact;
+    int profile_interval_us     = 1000;
+    Budget::Limits limits;
+    std::optional<uint64_t> snapshot_line;
+    std::optional<std::string> restore_path;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--pipeline") {
+            pipeline = true;
+        } else if (arg == "--engine=tree") {
+            backend = Backend::Tree;
+        } else if (arg == "--engine=closure") {
+            backend = Backend::Closure;
+        } else if (arg == "--engine=stack") {
+            backend = Backend::Stack;
+        } else if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+            opt_level = arg[2] - '0';
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg == "--region") {
+            region = true;
+        } else if (arg.starts_with("--profile=")) {
+            profile_path = std::string{arg.substr(10)};
+        } else if (arg == "--profile-mode=exact") {
+            profile_mode = Profiler::Mode::Exact;
+        } else if (arg == "--profile-mode=sample") {
+            profile_mode = Profiler::Mode::Sample;
+        } else if (arg.starts_with("--profile-interval=")) {
+            const std::string_view v = arg.substr(19);
+            auto [end, ec] = std::from_chars(v.data(), v.data() + v.size(), profile_interval_us);
+            if (ec != std::errc{} || end != v.data() + v.size() || profile_interval_us <= 0) {
+                std::println(stderr, "Error: invalid profile interval '{}'", v);
+                return 1;
+            }
+        } else if (arg.starts_with("--max-steps=")) {
+            const auto n = parse_limit(arg, "--max-steps=");
+            if (!n)
+                return 1;
+            limits.max_steps = *n;
+        } else if (arg.starts_with("--timeout-ms=")) {
+            const auto n = parse_limit(arg, "--timeout-ms=");
+            if (!n)
+                return 1;
+            limits.timeout_ms = *n;
+        } else if (arg.starts_with("--max-heap-mb=")) {
+            const auto n = parse_limit(arg, "--max-heap-mb=");
+            if (!n)
+                return 1;
+            if (!Budget::heap_limit_supported()) {
+                std::println(stderr, "Error: --max-heap-mb is not supported on this platform");
+                return 1;
+            }
+            limits.max_heap_bytes = *n << 20;
+        } else if (arg.starts_with("--snapshot-after=")) {
+            snapshot_line = parse_limit(arg, "--snapshot-after=");
+            if (!snapshot_line || *snapshot_line > INT32_MAX)
+                return 1;
+        } else if (arg.starts_with("--restore=")) {
+            restore_path = std::string{arg.substr(10)};
+        } else if (arg.starts_with("-")) {
+            std::println(stderr, "Error: unknown option '{}'", arg);
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if (backend != Backend::Tree &&
+        (stats || region || profile_path || snapshot_line || restore_path)) {
+        std::println(stderr,
+                     "Error: --profile, --stats, --region and snapshots require --engine=tree");
+        return 1;
+    }
+    if (snapshot_line && restore_path) {
+        std::println(stderr, "Error: --snapshot-after and --restore cannot be combined");
+        return 1;
+    }
+    if (snapshot_line && !path) {
+        std::println(stderr, "Error: --snapshot-after needs a program file");
+        return 1;
+    }
+
     std::ifstream yyin;
-    if (argc > 1) {
-        yyin = std::ifstream(argv[1]);
+    if (path) {
+        yyin = std::ifstream(path);
         if (!yyin) {
-            std::println(stderr, "Error: cannot open '{}'", argv[1]);
+            std::println(stderr, "Error: cannot open '{}'", path);
             return 1;
         }
     }
 
+    std::istream& input = path ? static_cast<std::istream&>(yyin) : std::cin;
+
+    // Snapshots are tied to the program text, so read it whole to hash it.
+    uint64_t hash = 0;
+    std::istringstream text;
+    if (snapshot_line || restore_path) {
+        text.str(std::string{std::istreambuf_iterator<char>{input}, {}});
+        hash = source_hash(text.view());
+    }
+
     std::unique_ptr<ASTNode> root;
-    Lexer lexer{argc > 1 ? static_cast<std::istream&>(yyin) : std::cin};
-    yy::parser parser{root, lexer};
+    Lexer lexer{snapshot_line || restore_path ? text : input};
+    if (pipeline)
+        lexer.enable_pipeline();
+    Parser parser{root, lexer};
     if (parser.parse() != 0 || !root) {
         std::println(stderr, "Parsing failed.");
         return 1;
@@ -34,12 +227,73 @@ int main(int argc, char* argv[]) {
         return 2;
     }
 
+    Optimizer optimizer;
+    if (opt_level >= 2 && optimizer.inline_calls(*root) > 0)
+        sema.analyze(*root); // resolve the names in the inlined expressions
+    if (opt_level >= 1)
+        optimizer.optimize(*root);
+
+    std::unique_ptr<Snapshot> snapshot;
+    if (restore_path) {
+        try {
+            snapshot = std::make_unique<Snapshot>(*restore_path, hash, *root);
+        } catch (const SnapshotError& ex) {
+            std::println(stderr, "Error: {}", ex.what());
+            return 1;
+        }
+    }
+
+    std::unique_ptr<Profiler> profiler;
+    if (profile_path)
+        profiler = std::make_unique<Profiler>(profile_mode, profile_interval_us);
+
+    InterpStats counters;
+    int status = 0;
     try {
+        if (backend == Backend::Closure) {
+            ClosureEngine engine{std::cout};
+            engine.set_budget(limits);
+            engine.run(*root);
+            return 0;
+        }
+        if (backend == Backend::Stack) {
+            StackEngine engine{std::cout};
+            engine.set_budget(limits);
+            engine.run(*root);
+            return 0;
+        }
         Interpreter interp{std::cout};
+        interp.set_budget(limits);
+        if (snapshot_line)
+            interp.snapshot_after(static_cast<int>(*snapshot_line), std::string{path} + ".snap",
+                                  hash);
+        interp.restore_from(snapshot.get());
+        if (stats)
+            interp.set_stats(&counters);
+        interp.set_region(region);
+        if (profiler) {
+            interp.set_profiler(profiler.get());
+            profiler->start();
+        }
         interp.run(*root);
+    } catch (const BudgetExceeded& ex) {
+        std::println(stderr, "Budget exceeded at {}:{}: {}", ex.loc.line, ex.loc.col, ex.what());
+        status = 4;
     } catch (const std::exception& ex) {
         std::println(stderr, "Runtime error: {}", ex.what());
-        return 3;
+        status = 3;
+    }
+
+    if (stats) {
+        std::cout.flush();
+        counters.print(std::cerr);
+    }
+
+    // A failing run is still worth profiling.
+    if (profiler) {
+        profiler->stop();
+        if (!write_profile(*profiler, *profile_path) && status == 0)
+            status = 1;
     }
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
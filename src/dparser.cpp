@@ -2,39 +2,64 @@
  * main.cpp – entry point for the D language parser (C++23)
  *
  * Usage:
- *   dparser [file]
+ *   dparser [--pipeline] [--flat] [file]
  *
- * Without arguments reads from stdin.
+ * Without a file reads from stdin.
  * Prints the AST on success; exits with 1 on parse error.
+ *
+ * --pipeline  lex on a separate thread, overlapping with parsing
+ * --flat      print the AST from its flat (index-based) encoding
  */
 #include "ast.hpp"
+#include "descent_parser.hpp"
+#include "flat_ast.hpp"
 #include "lexer.hpp"
-#include "parser.tab.hpp"
 #include "semantic_analyzer.hpp"
 
 #include <cstdio>
 #include <fstream>
+#include <iostream>
 #include <memory>
 #include <print>
+#include <string_view>
 
 int main(int argc, char* argv[]) {
 
+    bool pipeline    = false;
+    bool flat        = false;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--pipeline") {
+            pipeline = true;
+        } else if (arg == "--flat") {
+            flat = true;
+        } else if (arg.starts_with("--")) {
+            std::println(stderr, "Error: unknown option '{}'", arg);
+            return 1;
+        } else {
+            path = argv[i];
+        }
+    }
+
     std::ifstream yyin;
-    if (argc > 1) {
-        yyin = std::ifstream(argv[1]);
+    if (path) {
+        yyin = std::ifstream(path);
         if (!yyin) {
-            std::println(stderr, "Error: cannot open '{}'", argv[1]);
+            std::println(stderr, "Error: cannot open '{}'", path);
             return 1;
         }
     }
 
     std::unique_ptr<ASTNode> root;
-    Lexer lexer{yyin};
-    yy::parser parser{root, lexer};
+    Lexer lexer{path ? static_cast<std::istream&>(yyin) : std::cin};
+    if (pipeline)
+        lexer.enable_pipeline();
+    Parser parser{root, lexer};
 
     const int rc = parser.parse();
 
-    if (argc > 1)
+    if (path)
         yyin.close();
 
     if (rc != 0 || !root) {
@@ -42,7 +67,10 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    root->print(0);
+    if (flat)
+        FlatAst::flatten(*root).print(std::cout);
+    else
+        root->print(0);
 
     SemanticAnalyzer sema;
     sema.analyze(*root);
@@ -0,0 +1,81 @@
+#include "engine.hpp"
+
+#include "descent_parser.hpp"
+#include "interpreter.hpp"
+#include "lexer.hpp"
+#include "optimizer.hpp"
+#include "semantic_analyzer.hpp"
+#include "stack_engine.hpp"
+
+#include <algorithm>
+#include <format>
+#include <sstream>
+#include <utility>
+
+// ── Engine ────────────────────────────────────────────────────────────────────
+
+std::shared_ptr<const Program> Engine::compile(std::string_view source,
+                                               std::vector<std::string> inputs) const {
+    std::shared_ptr<Program> program{new Program};
+    program->backend_ = options_.backend;
+    program->inputs_  = std::move(inputs);
+
+    std::istringstream stream{std::string{source}};
+    Lexer lexer{stream};
+    Parser parser{program->root_, lexer};
+    if (parser.parse() != 0 || !program->root_)
+        throw CompileError{"parsing failed"};
+
+    SemanticAnalyzer sema;
+    sema.analyze(*program->root_, program->inputs_);
+    if (!sema.ok()) {
+        std::string msg;
+        for (const auto& e : sema.errors())
+            msg += std::format("{}{}:{}: {}", msg.empty() ? "" : "\n", e.loc.line, e.loc.col,
+                               e.message);
+        throw CompileError{msg};
+    }
+
+    Optimizer optimizer;
+    if (options_.opt_level >= 2 && optimizer.inline_calls(*program->root_) > 0)
+        sema.analyze(*program->root_, program->inputs_);
+    if (options_.opt_level >= 1)
+        optimizer.optimize(*program->root_);
+    if (options_.backend == Backend::Closure)
+        program->code_ = ClosureEngine::compile(*program->root_, program->inputs_);
+    return program;
+}
+
+// ── Context ───────────────────────────────────────────────────────────────────
+
+Context::Context(std::shared_ptr<const Program> program, std::ostream& out)
+    : program_{std::move(program)}, out_{out}, inputs_(program_->inputs().size()) {}
+
+void Context::set_input(std::string_view name, DValue value) {
+    const auto& names = program_->inputs();
+    const auto it     = std::find(names.begin(), names.end(), name);
+    if (it == names.end())
+        throw std::out_of_range{std::format("'{}' is not an input of the program", name)};
+    inputs_[static_cast<size_t>(it - names.begin())] = std::move(value);
+}
+
+void Context::run() {
+    if (program_->backend_ == Engine::Backend::Closure) {
+        ClosureEngine engine{out_};
+        engine.set_budget(limits_);
+        engine.run(*program_->code_, inputs_);
+        return;
+    }
+    Frame inputs;
+    for (size_t i = 0; i < inputs_.size(); ++i)
+        inputs.emplace(program_->inputs()[i], inputs_[i]);
+    if (program_->backend_ == Engine::Backend::Stack) {
+        StackEngine engine{out_};
+        engine.set_budget(limits_);
+        engine.run(*program_->root_, inputs);
+        return;
+    }
+    Interpreter interp{out_};
+    interp.set_budget(limits_);
+    interp.run(*program_->root_, inputs);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "ast.hpp"
+#include "budget.hpp"
+#include "closure_engine.hpp"
+#include "value.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ── Embedding API ─────────────────────────────────────────────────────────────
+//
+// Engine::compile() parses, analyzes and optionally optimizes a source text
+// once.  The resulting Program is immutable: the analyzer's resolved depths
+// and the optimizer's annotations are written before compile() returns, and
+// running only reads the tree (and, for the closure backend, the compiled
+// closures), apart from the tree backend's type feedback, which is atomic (see
+// TypeFeedback in ast.hpp).  Any number of threads may therefore run the same
+// Program at once, each through its own Context, which holds the output sink,
+// the input values and the budget of a run.
+//
+//   auto program = Engine{}.compile(source, {"n"});
+//   Context ctx{program, out};
+//   ctx.set_input("n", DValue::make_int(42));
+//   ctx.run();
+//
+// Inputs are globals whose values the host supplies per run; the program
+// reads and assigns them like any other variable.  Unset inputs are none.
+
+// Parse or semantic errors.  what() lists semantic errors one per line; the
+// parser reports its own errors on stderr.
+struct CompileError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+class Program;
+
+class Engine {
+public:
+    enum class Backend : uint8_t { Tree, Closure, Stack }; // see stack_engine.hpp
+    struct Options {
+        Backend backend{Backend::Tree};
+        int opt_level{0}; // 1 runs the loop optimizer, 2 also inlines
+    };
+
+    Engine() = default;
+    explicit Engine(Options options) : options_{options} {}
+
+    // Throws CompileError.
+    std::shared_ptr<const Program> compile(std::string_view source,
+                                           std::vector<std::string> inputs = {}) const;
+
+private:
+    Options options_{};
+};
+
+class Program {
+public:
+    const std::vector<std::string>& inputs() const noexcept { return inputs_; }
+    const ASTNode& ast() const noexcept { return *root_; }
+
+private:
+    friend class Engine;
+    friend class Context;
+
+    Program() = default;
+
+    Engine::Backend backend_{};
+    std::vector<std::string> inputs_;
+    std::unique_ptr<ASTNode> root_;
+    std::shared_ptr<const ClosureEngine::Code> code_; // closure backend only
+};
+
+// State of one run.  Cheap to construct; use one per thread.  Keeps the
+// program alive.
+class Context {
+public:
+    Context(std::shared_ptr<const Program> program, std::ostream& out);
+
+    // Throws std::out_of_range for a name that is not an input of the program.
+    // Arrays and tuples are passed by reference, so contexts running at the
+    // same time must not be given the same one.
+    void set_input(std::string_view name, DValue value);
+    void set_budget(const Budget::Limits& limits) { limits_ = limits; }
+
+    // Runs the program once.  Runtime errors are thrown as std::runtime_error
+    // (BudgetExceeded for an exceeded budget).  Inputs keep their values
+    // across runs.
+    void run();
+
+private:
+    std::shared_ptr<const Program> program_;
+    std::ostream& out_;
+    std::vector<DValue> inputs_; // in the order of Program::inputs()
+    Budget::Limits limits_{};
+};
@@ -0,0 +1,441 @@
+#include "flat_ast.hpp"
+
+#include <format>
+#include <initializer_list>
+#include <iterator>
+#include <utility>
+
+// ── Builder ───────────────────────────────────────────────────────────────────
+
+class FlatAst::Builder final : public ASTVisitorBase<Builder> {
+public:
+    explicit Builder(FlatAst& out) : out_{out} {}
+
+    Index add(const ASTNode& n) {
+        const Index i = static_cast<Index>(out_.kinds_.size());
+        dispatch(n);
+        return i;
+    }
+
+    void visit(const ProgramNode& n) override { list(n, n.stmts); }
+    void visit(const BodyNode& n) override { list(n, n.stmts, n.has_frame ? 1 : 0); }
+    void visit(const VarDeclNode& n) override { list(n, n.defs); }
+    void visit(const VarDefNode& n) override { fixed(n, {n.init.get()}, 0, string(n.varname)); }
+    void visit(const AssignNode& n) override { fixed(n, {n.lhs.get(), n.rhs.get()}); }
+    void visit(const IfNode& n) override {
+        fixed(n, {n.cond.get(), n.then_body.get(), n.else_body.get()});
+    }
+    void visit(const IfShortNode& n) override { fixed(n, {n.cond.get(), n.stmt.get()}); }
+    void visit(const WhileNode& n) override {
+        fixed(n, {n.cond.get(), n.body.get()}, loop(n.opt));
+    }
+    void visit(const ForRangeNode& n) override {
+        fixed(n, {n.from.get(), n.to.get(), n.body.get()}, loop(n.opt), string(n.iter));
+    }
+    void visit(const ForIterNode& n) override {
+        fixed(n, {n.iterable.get(), n.body.get()}, loop(n.opt), string(n.iter));
+    }
+    void visit(const LoopInfNode& n) override { fixed(n, {n.body.get()}, loop(n.opt)); }
+    void visit(const ExitNode& n) override { fixed(n, {}); }
+    void visit(const ReturnNode& n) override { fixed(n, {n.value.get()}); }
+    void visit(const PrintNode& n) override { list(n, n.exprs); }
+    void visit(const BinOpNode& n) override {
+        fixed(n, {n.left.get(), n.right.get()}, static_cast<int32_t>(n.op));
+    }
+    void visit(const UnaryOpNode& n) override {
+        fixed(n, {n.operand.get()}, static_cast<int32_t>(n.op));
+    }
+    void visit(const IsNode& n) override { fixed(n, {n.operand.get(), n.type_node.get()}); }
+    void visit(const IdentNode& n) override {
+        fixed(n, {}, n.resolved_depth, string(n.ident_name));
+    }
+    void visit(const IndexNode& n) override { fixed(n, {n.base.get(), n.index_expr.get()}); }
+    void visit(const CallNode& n) override {
+        const Index i = open(n, 1 + n.args.size());
+        child(i, 0, n.callee.get());
+        for (size_t k = 0; k < n.args.size(); ++k)
+            child(i, 1 + k, n.args[k].get());
+        close(i);
+    }
+    void visit(const DotFieldNode& n) override { fixed(n, {n.base.get()}, 0, string(n.field)); }
+    void visit(const DotIntNode& n) override { fixed(n, {n.base.get()}, 0, integer(n.index)); }
+    void visit(const IntLitNode& n) override { fixed(n, {}, 0, integer(n.value)); }
+    void visit(const RealLitNode& n) override {
+        out_.reals_.push_back(n.value);
+        fixed(n, {}, 0, static_cast<Index>(out_.reals_.size() - 1));
+    }
+    void visit(const StrLitNode& n) override { fixed(n, {}, 0, string(n.value)); }
+    void visit(const BoolLitNode& n) override { fixed(n, {}, n.value ? 1 : 0); }
+    void visit(const NoneLitNode& n) override { fixed(n, {}); }
+    void visit(const ArrayLitNode& n) override { list(n, n.elems); }
+    void visit(const TupleLitNode& n) override { list(n, n.elems); }
+    void visit(const TupleElemNode& n) override {
+        fixed(n, {n.expr.get()}, 0, string(n.elem_name));
+    }
+    void visit(const ParamListNode& n) override { list(n, n.params); }
+    void visit(const FuncLitNode& n) override { fixed(n, {n.params.get(), n.body.get()}); }
+    void visit(const TypeNode& n) override { fixed(n, {}, static_cast<int32_t>(n.type)); }
+    void visit(const InvariantNode& n) override {
+        fixed(n, {n.expr.get()}, static_cast<int32_t>(n.slot));
+    }
+    void visit(const InductionNode& n) override {
+        const Index payload = integer(n.form.scale);
+        integer(n.form.offset);
+        fixed(n, {n.expr.get()}, static_cast<int32_t>(n.slot), payload);
+    }
+
+private:
+    FlatAst& out_;
+
+    // Appends the node and reserves its child slots, so that the slots of
+    // consecutive nodes are adjacent in children_.
+    Index open(const ASTNode& n, size_t nchildren, int32_t aux = 0, Index payload = kNone) {
+        const Index i = static_cast<Index>(out_.kinds_.size());
+        out_.kinds_.push_back(n.kind);
+        out_.aux_.push_back(aux);
+        out_.payload_.push_back(payload);
+        out_.lines_.push_back(n.loc.line);
+        out_.cols_.push_back(n.loc.col);
+        out_.ends_.push_back(kNone);
+        out_.child_begin_.push_back(static_cast<Index>(out_.children_.size()));
+        out_.children_.resize(out_.children_.size() + nchildren, kNone);
+        return i;
+    }
+
+    void child(Index i, size_t slot, const ASTNode* c) {
+        if (c) {
+            const Index ci = add(*c);
+            out_.children_[out_.child_begin_[i] + slot] = ci;
+        }
+    }
+
+    void close(Index i) { out_.ends_[i] = static_cast<Index>(out_.kinds_.size()); }
+
+    void fixed(const ASTNode& n, std::initializer_list<const ASTNode*> kids, int32_t aux = 0,
+               Index payload = kNone) {
+        const Index i = open(n, kids.size(), aux, payload);
+        size_t slot   = 0;
+        for (const ASTNode* c : kids)
+            child(i, slot++, c);
+        close(i);
+    }
+
+    void list(const ASTNode& n, const std::vector<std::unique_ptr<ASTNode>>& kids,
+              int32_t aux = 0) {
+        const Index i = open(n, kids.size(), aux);
+        for (size_t k = 0; k < kids.size(); ++k)
+            child(i, k, kids[k].get());
+        close(i);
+    }
+
+    Index string(const std::string& s) {
+        out_.strings_.push_back(s);
+        return static_cast<Index>(out_.strings_.size() - 1);
+    }
+
+    Index integer(long long v) {
+        out_.ints_.push_back(v);
+        return static_cast<Index>(out_.ints_.size() - 1);
+    }
+
+    int32_t loop(const LoopInfo& info) {
+        if (info.id == 0)
+            return 0;
+        out_.loops_.push_back(info);
+        return static_cast<int32_t>(out_.loops_.size() - 1);
+    }
+};
+
+FlatAst FlatAst::flatten(const ASTNode& root) {
+    FlatAst flat;
+    Builder{flat}.add(root);
+    flat.child_begin_.push_back(static_cast<Index>(flat.children_.size()));
+    return flat;
+}
+
+// ── Names ─────────────────────────────────────────────────────────────────────
+
+std::string_view FlatAst::kind_name(Index i) const noexcept {
+    switch (kinds_[i]) {
+    case NodeKind::BinOp:
+        return BinOpNode::op_name(binop(i));
+    case NodeKind::UnaryOp:
+        return UnaryOpNode::op_name(unop(i));
+    case NodeKind::Type:
+        return TypeNode::type_name(type(i));
+    default:
+        break;
+    }
+    static constexpr std::string_view names[] = {
+        "Program", "Body", "VarDecl", "VarDef", "Assign", "If", "IfShort", "While", "ForRange",
+        "ForIter", "LoopInf", "Exit", "Return", "Print", "BinOp", "UnaryOp", "Is", "Ident", "Index",
+        "Call", "DotField", "DotInt", "IntLit", "RealLit", "StrLit", "BoolLit", "NoneLit",
+        "ArrayLit", "TupleLit", "TupleElem", "ParamList", "FuncLit", "Type", "Invariant",
+        "Induction",
+    };
+    static_assert(std::size(names) == kNodeKinds);
+    return names[static_cast<size_t>(kinds_[i])];
+}
+
+// ── Printing ──────────────────────────────────────────────────────────────────
+
+// A single forward scan: the indent of node i is the number of enclosing
+// subtrees still open, tracked as a stack of their end indices.
+void FlatAst::print(std::ostream& os, int indent) const {
+    std::vector<Index> open;
+    for (Index i = 0; i < size(); ++i) {
+        while (!open.empty() && open.back() <= i)
+            open.pop_back();
+        const size_t depth = static_cast<size_t>(indent) + open.size();
+        for (size_t d = 0; d < depth; ++d)
+            os << "  ";
+        os << '[' << kind_name(i) << ']';
+
+        const Location l = loc(i);
+        switch (kinds_[i]) {
+        case NodeKind::VarDef:
+        case NodeKind::DotField:
+            os << " name=" << text(i);
+            break;
+        case NodeKind::ForRange:
+        case NodeKind::ForIter:
+        case NodeKind::TupleElem:
+            if (!text(i).empty())
+                os << " name=" << text(i);
+            break;
+        case NodeKind::Ident:
+        case NodeKind::StrLit:
+            os << ' ' << text(i);
+            break;
+        case NodeKind::IntLit:
+            os << ' ' << int_value(i);
+            break;
+        case NodeKind::RealLit:
+            os << ' ' << std::format("{:g}", real_value(i));
+            break;
+        case NodeKind::DotInt:
+            os << ' ' << int_value(i) << "  (." << int_value(i) << ") (loc " << l.line << ':'
+               << l.col << ")\n";
+            open.push_back(ends_[i]);
+            continue;
+        case NodeKind::Invariant:
+            os << " slot=" << slot(i);
+            break;
+        case NodeKind::Induction:
+            os << " slot=" << slot(i) << " scale=" << affine(i).scale
+               << " offset=" << affine(i).offset;
+            break;
+        case NodeKind::BoolLit:
+            os << ' ' << (bool_value(i) ? 1LL : 0LL) << "  (" << (bool_value(i) ? "true" : "false")
+               << ") (loc " << l.line << ':' << l.col << ")\n";
+            open.push_back(ends_[i]);
+            continue;
+        default:
+            break;
+        }
+        os << "  (loc " << l.line << ':' << l.col << ")\n";
+        open.push_back(ends_[i]);
+    }
+}
+
+// ── Unflattening ──────────────────────────────────────────────────────────────
+
+std::unique_ptr<ASTNode> FlatAst::unflatten() const {
+    return size() ? build(root()) : nullptr;
+}
+
+std::unique_ptr<ASTNode> FlatAst::build(Index i) const {
+    const Location l                   = loc(i);
+    const std::span<const Index> slots = children(i);
+    auto at = [&](size_t k) { return slots[k] == kNone ? nullptr : build(slots[k]); };
+    auto all = [&] {
+        std::vector<std::unique_ptr<ASTNode>> v;
+        v.reserve(slots.size());
+        for (const Index c : slots)
+            v.push_back(build(c));
+        return v;
+    };
+
+    switch (kinds_[i]) {
+    case NodeKind::Program: {
+        auto n   = std::make_unique<ProgramNode>(l);
+        n->stmts = all();
+        return n;
+    }
+    case NodeKind::Body: {
+        auto n       = std::make_unique<BodyNode>(l);
+        n->stmts     = all();
+        n->has_frame = has_frame(i);
+        return n;
+    }
+    case NodeKind::VarDecl: {
+        auto n  = std::make_unique<VarDeclNode>(l);
+        n->defs = all();
+        return n;
+    }
+    case NodeKind::VarDef: {
+        auto n     = std::make_unique<VarDefNode>(l);
+        n->varname = std::string{text(i)};
+        n->init    = at(0);
+        return n;
+    }
+    case NodeKind::Assign: {
+        auto n = std::make_unique<AssignNode>(l);
+        n->lhs = at(0);
+        n->rhs = at(1);
+        return n;
+    }
+    case NodeKind::If: {
+        auto n       = std::make_unique<IfNode>(l);
+        n->cond      = at(0);
+        n->then_body = at(1);
+        n->else_body = at(2);
+        return n;
+    }
+    case NodeKind::IfShort: {
+        auto n  = std::make_unique<IfShortNode>(l);
+        n->cond = at(0);
+        n->stmt = at(1);
+        return n;
+    }
+    case NodeKind::While: {
+        auto n  = std::make_unique<WhileNode>(l);
+        n->opt  = loop_info(i);
+        n->cond = at(0);
+        n->body = at(1);
+        return n;
+    }
+    case NodeKind::ForRange: {
+        auto n  = std::make_unique<ForRangeNode>(l);
+        n->opt  = loop_info(i);
+        n->iter = std::string{text(i)};
+        n->from = at(0);
+        n->to   = at(1);
+        n->body = at(2);
+        return n;
+    }
+    case NodeKind::ForIter: {
+        auto n      = std::make_unique<ForIterNode>(l);
+        n->opt      = loop_info(i);
+        n->iter     = std::string{text(i)};
+        n->iterable = at(0);
+        n->body     = at(1);
+        return n;
+    }
+    case NodeKind::LoopInf: {
+        auto n  = std::make_unique<LoopInfNode>(l);
+        n->opt  = loop_info(i);
+        n->body = at(0);
+        return n;
+    }
+    case NodeKind::Exit:
+        return std::make_unique<ExitNode>(l);
+    case NodeKind::Return: {
+        auto n   = std::make_unique<ReturnNode>(l);
+        n->value = at(0);
+        return n;
+    }
+    case NodeKind::Print: {
+        auto n   = std::make_unique<PrintNode>(l);
+        n->exprs = all();
+        return n;
+    }
+    case NodeKind::BinOp: {
+        auto n   = std::make_unique<BinOpNode>(binop(i), l);
+        n->left  = at(0);
+        n->right = at(1);
+        return n;
+    }
+    case NodeKind::UnaryOp: {
+        auto n     = std::make_unique<UnaryOpNode>(unop(i), l);
+        n->operand = at(0);
+        return n;
+    }
+    case NodeKind::Is: {
+        auto n       = std::make_unique<IsNode>(l);
+        n->operand   = at(0);
+        n->type_node = at(1);
+        return n;
+    }
+    case NodeKind::Ident: {
+        auto n            = std::make_unique<IdentNode>(std::string{text(i)}, l);
+        n->resolved_depth = resolved_depth(i);
+        return n;
+    }
+    case NodeKind::Index: {
+        auto n        = std::make_unique<IndexNode>(l);
+        n->base       = at(0);
+        n->index_expr = at(1);
+        return n;
+    }
+    case NodeKind::Call: {
+        auto n    = std::make_unique<CallNode>(l);
+        n->callee = at(0);
+        n->args.reserve(slots.size() - 1);
+        for (size_t k = 1; k < slots.size(); ++k)
+            n->args.push_back(build(slots[k]));
+        return n;
+    }
+    case NodeKind::DotField: {
+        auto n   = std::make_unique<DotFieldNode>(l);
+        n->field = std::string{text(i)};
+        n->base  = at(0);
+        return n;
+    }
+    case NodeKind::DotInt: {
+        auto n  = std::make_unique<DotIntNode>(int_value(i), l);
+        n->base = at(0);
+        return n;
+    }
+    case NodeKind::IntLit:
+        return std::make_unique<IntLitNode>(int_value(i), l);
+    case NodeKind::RealLit:
+        return std::make_unique<RealLitNode>(real_value(i), l);
+    case NodeKind::StrLit:
+        return std::make_unique<StrLitNode>(std::string{text(i)}, l);
+    case NodeKind::BoolLit:
+        return std::make_unique<BoolLitNode>(bool_value(i), l);
+    case NodeKind::NoneLit:
+        return std::make_unique<NoneLitNode>(l);
+    case NodeKind::ArrayLit: {
+        auto n   = std::make_unique<ArrayLitNode>(l);
+        n->elems = all();
+        return n;
+    }
+    case NodeKind::TupleLit: {
+        auto n   = std::make_unique<TupleLitNode>(l);
+        n->elems = all();
+        return n;
+    }
+    case NodeKind::TupleElem: {
+        auto n       = std::make_unique<TupleElemNode>(l);
+        n->elem_name = std::string{text(i)};
+        n->expr      = at(0);
+        return n;
+    }
+    case NodeKind::ParamList: {
+        auto n    = std::make_unique<ParamListNode>(l);
+        n->params = all();
+        return n;
+    }
+    case NodeKind::FuncLit: {
+        auto n    = std::make_unique<FuncLitNode>(l);
+        n->params = at(0);
+        n->body   = at(1);
+        return n;
+    }
+    case NodeKind::Type:
+        return std::make_unique<TypeNode>(type(i), l);
+    case NodeKind::Invariant: {
+        auto n  = std::make_unique<InvariantNode>(slot(i), l);
+        n->expr = at(0);
+        return n;
+    }
+    case NodeKind::Induction: {
+        auto n  = std::make_unique<InductionNode>(slot(i), affine(i), l);
+        n->expr = at(0);
+        return n;
+    }
+    }
+    return nullptr;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ── FlatAst ───────────────────────────────────────────────────────────────────
+//
+// Index-based encoding of an AST.  Nodes live in pre-order in parallel arrays
+// (struct of arrays): a one-byte kind, a 32-bit auxiliary word, a payload index
+// into the literal side tables, the location, the index one past the node's
+// subtree, and the node's range in a shared child-index array.
+//
+// Child slots follow the order in which PrintVisitor recurses.  Fixed-arity
+// nodes always have the same number of slots and mark an absent optional child
+// (If's else, VarDef's init, Return's value, FuncLit's params) with kNone:
+//
+//   VarDef     init                  Index      base, index
+//   Assign     lhs, rhs              Call       callee, args...
+//   If         cond, then, else      DotField   base
+//   IfShort    cond, stmt            DotInt     base
+//   While      cond, body            TupleElem  expr
+//   ForRange   from, to, body        FuncLit    params, body
+//   ForIter    iterable, body        Is         operand, type
+//   LoopInf    body                  BinOp      left, right
+//   Return     value                 UnaryOp    operand
+//   Invariant  expr                  Induction  expr
+//
+// Program, Body, VarDecl, Print, ArrayLit, TupleLit and ParamList store their
+// lists as-is.  Because a subtree is the contiguous range [i, end(i)), passes
+// that only need a pre-order walk (printing, counting, searching) are a
+// sequential scan.  SemanticAnalyzer::analyze(FlatAst&) resolves names over
+// the index ranges directly; unflatten() rebuilds the pointer tree for passes
+// written against ASTNode.  resolved_depth and Body's has_frame (its auxiliary
+// word) are carried across in both directions, the capture annotations are not
+// (analyze the rebuilt tree again).
+
+class FlatAst {
+public:
+    using Index                  = uint32_t;
+    static constexpr Index kNone = UINT32_MAX;
+
+    static FlatAst flatten(const ASTNode& root);
+    std::unique_ptr<ASTNode> unflatten() const;
+
+    // Prints the same text as ASTNode::print(indent, os).
+    void print(std::ostream& os, int indent = 0) const;
+
+    size_t size() const noexcept { return kinds_.size(); }
+    Index root() const noexcept { return 0; }
+
+    NodeKind kind(Index i) const noexcept { return kinds_[i]; }
+    std::string_view kind_name(Index i) const noexcept;
+    Location loc(Index i) const noexcept { return {lines_[i], cols_[i]}; }
+    Index end(Index i) const noexcept { return ends_[i]; }
+    std::span<const Index> children(Index i) const noexcept {
+        return {children_.data() + child_begin_[i], children_.data() + child_begin_[i + 1]};
+    }
+
+    // Operator, type tag, boolean value, resolved depth, optimizer slot or
+    // loop-info index, depending on kind.
+    int32_t aux(Index i) const noexcept { return aux_[i]; }
+    BinOpNode::Op binop(Index i) const noexcept { return static_cast<BinOpNode::Op>(aux_[i]); }
+    UnaryOpNode::Op unop(Index i) const noexcept { return static_cast<UnaryOpNode::Op>(aux_[i]); }
+    TypeNode::Type type(Index i) const noexcept { return static_cast<TypeNode::Type>(aux_[i]); }
+    bool bool_value(Index i) const noexcept { return aux_[i] != 0; }
+    int resolved_depth(Index i) const noexcept { return aux_[i]; }
+    bool has_frame(Index i) const noexcept { return aux_[i] != 0; }
+    uint32_t slot(Index i) const noexcept { return static_cast<uint32_t>(aux_[i]); }
+    // Optimizer annotations of a loop node (all zero when unoptimized).
+    const LoopInfo& loop_info(Index i) const noexcept { return loops_[aux_[i]]; }
+    Affine affine(Index i) const noexcept {
+        return {ints_[payload_[i]], ints_[payload_[i] + 1]};
+    }
+
+    // Written by SemanticAnalyzer, for an Ident and a Body respectively.
+    void set_resolved_depth(Index i, int depth) noexcept { aux_[i] = depth; }
+    void set_has_frame(Index i, bool has_frame) noexcept { aux_[i] = has_frame ? 1 : 0; }
+
+    // IntLit value, DotInt index.
+    long long int_value(Index i) const noexcept { return ints_[payload_[i]]; }
+    double real_value(Index i) const noexcept { return reals_[payload_[i]]; }
+    // Ident/StrLit value, VarDef/ForRange/ForIter/TupleElem name, DotField field.
+    std::string_view text(Index i) const noexcept { return strings_[payload_[i]]; }
+
+private:
+    std::vector<NodeKind> kinds_;
+    std::vector<int32_t> aux_;
+    std::vector<Index> payload_; // into ints_, reals_ or strings_ depending on kind
+    std::vector<int32_t> lines_;
+    std::vector<int32_t> cols_;
+    std::vector<Index> ends_;
+    std::vector<Index> child_begin_; // size() + 1 entries
+    std::vector<Index> children_;
+
+    std::vector<long long> ints_;
+    std::vector<double> reals_;
+    std::vector<std::string> strings_;
+    std::vector<LoopInfo> loops_{LoopInfo{}}; // entry 0 is shared by unoptimized loops
+
+    class Builder;
+    std::unique_ptr<ASTNode> build(Index i) const;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "value.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// ── FramePool ─────────────────────────────────────────────────────────────────
+//
+// Frames of exited scopes, kept for the scopes entered next.  A frame is taken
+// back only when nothing else refers to it (no closure captured it); its values
+// are released at once, but its hash table and entries are kept.  Each frame
+// remembers the node whose scope it served: re-entered by the same node, as a
+// loop body is on every iteration, it already holds the names that scope will
+// declare, so entering the scope allocates nothing.  Handed to another node, it
+// is cleared first.  At most kCapacity frames are kept, so unwinding a deep
+// recursion does not leave the pool holding all of its frames.
+
+class FramePool {
+public:
+    // A frame for the scope of `owner`: empty, or holding the names `owner`'s
+    // scope declared when it last used it, all set to none.
+    FramePtr acquire(const void* owner) {
+        if (free_.empty())
+            return std::make_shared<Frame>();
+        Entry e = std::move(free_.back());
+        free_.pop_back();
+        if (e.owner != owner)
+            e.frame->clear();
+        return std::move(e.frame);
+    }
+
+    // Takes `frame` back from the scope of `owner` if it is not shared; the
+    // caller drops its pointer either way.
+    void release(FramePtr& frame, const void* owner) {
+        if (frame.use_count() != 1 || free_.size() == kCapacity)
+            return;
+        for (auto& [name, v] : *frame)
+            v = {};
+        free_.push_back({std::move(frame), owner});
+    }
+
+    bool empty() const noexcept { return free_.empty(); }
+    void clear() { free_.clear(); }
+
+private:
+    struct Entry {
+        FramePtr frame;
+        const void* owner;
+    };
+    static constexpr size_t kCapacity = 64;
+    std::vector<Entry> free_;
+};
@@ -0,0 +1,30 @@
+#include "interp_stats.hpp"
+
+#include <format>
+#include <sys/resource.h>
+
+void InterpStats::print(std::ostream& os) const {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage); // ru_maxrss is in KiB on Linux
+
+    const auto row = [&](const char* name, uint64_t v) {
+        os << std::format("{:<22}{:>14}\n", name, v);
+    };
+    os << "── interpreter stats ──\n";
+    row("frames pushed", frames_pushed);
+    row("frames allocated", frames_allocated);
+    row("value copies", value_copies);
+    row("value moves", value_moves);
+    row("string allocs", string_allocs);
+    row("array allocs", array_allocs);
+    row("tuple allocs", tuple_allocs);
+    row("closure allocs", closure_allocs);
+    row("variable lookups", lookups);
+    row("exit signals", exit_signals);
+    row("return signals", return_signals);
+    row("peak env depth", peak_env_depth);
+    row("nodes specialized", nodes_specialized);
+    row("guard failures", guard_failures);
+    row("region bytes", region_bytes);
+    row("peak RSS (KiB)", static_cast<uint64_t>(usage.ru_maxrss));
+}
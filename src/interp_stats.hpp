@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// ── Interpreter statistics ────────────────────────────────────────────────────
+//
+// Counters describing what the tree walker did during a run.  The Interpreter
+// fills them in only when an InterpStats is attached (set_stats); otherwise
+// every counting site is a single not-taken branch.
+
+struct InterpStats {
+    uint64_t frames_pushed{0};
+    uint64_t frames_allocated{0}; // pushed frames not taken from the frame pool
+    uint64_t value_copies{0};
+    uint64_t value_moves{0};
+    uint64_t string_allocs{0}; // strings too long for the small-string buffer
+    uint64_t array_allocs{0};
+    uint64_t tuple_allocs{0};
+    uint64_t closure_allocs{0};
+    uint64_t lookups{0};
+    uint64_t exit_signals{0};
+    uint64_t return_signals{0};
+    uint64_t peak_env_depth{0};
+    uint64_t nodes_specialized{0}; // see TypeFeedback (ast.hpp)
+    uint64_t guard_failures{0};
+    uint64_t region_bytes{0}; // handed out by the run's Region (Interpreter::set_region)
+
+    void print(std::ostream& os) const;
+};
+
+// Stats of the run in progress on this thread.  DValue has no back pointer to
+// its interpreter, so value copies/moves and allocations are counted here.
+inline constinit thread_local InterpStats* active_stats = nullptr;
+
+// ── ValueTracker ──────────────────────────────────────────────────────────────
+//
+// Empty member of DValue whose special members count copies and moves of the
+// enclosing value.
+
+struct ValueTracker {
+    ValueTracker() = default;
+    ValueTracker(const ValueTracker&) noexcept {
+        if (active_stats) [[unlikely]]
+            ++active_stats->value_copies;
+    }
+    ValueTracker(ValueTracker&&) noexcept {
+        if (active_stats) [[unlikely]]
+            ++active_stats->value_moves;
+    }
+    ValueTracker& operator=(const ValueTracker&) noexcept {
+        if (active_stats) [[unlikely]]
+            ++active_stats->value_copies;
+        return *this;
+    }
+    ValueTracker& operator=(ValueTracker&&) noexcept {
+        if (active_stats) [[unlikely]]
+            ++active_stats->value_moves;
+        return *this;
+    }
+};
@@ -1,82 +1,175 @@
 #include "interpreter.hpp"
 
 #include "ast.hpp"
+#include "builtins.hpp"
+#include "profiler.hpp"
+#include "snapshot.hpp"
+#include "value_ops.hpp"
 
-#include <cmath>
+#include <algorithm>
 #include <format>
+#include <span>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace {
+
+// ── Specializations ───────────────────────────────────────────────────────────
+//
+// The fast paths behind TypeFeedback.  Each computes what binary_op() or
+// index_get() would for operands that pass its guard; comparisons of Ints go
+// through double, as in binary_op().
+
+enum : uint8_t {
+    kIntOperands  = 1, // BinOp: Int op Int (not /, which can divide by zero)
+    kRealOperands = 2, // BinOp: Real op Real
+};
+enum : uint8_t {
+    kIntElements  = 1, // Index: unboxed Int array, Int key
+    kRealElements = 2, // Index: unboxed Real array, Int key
+};
+
+uint8_t operand_kind(BinOpNode::Op op, const DValue& L, const DValue& R) {
+    using T  = DValue::Type;
+    using Op = BinOpNode::Op;
+    if (op == Op::AND || op == Op::OR || op == Op::XOR || L.type != R.type)
+        return TypeFeedback::kGeneric;
+    if (L.type == T::Int && op != Op::DIV)
+        return kIntOperands;
+    if (L.type == T::Real)
+        return kRealOperands;
+    return TypeFeedback::kGeneric;
+}
 
-// ── DValue helpers ─────────────────────────────────────────────────────────────
-
-std::string DValue::to_string() const {
-    switch (type) {
-    case Type::None:
-        return "none";
-    case Type::Int:
-        return std::to_string(ival);
-    case Type::Bool:
-        return bval ? "true" : "false";
-    case Type::String:
-        return sval;
-    case Type::Real:
-        if (std::isfinite(rval) && rval == std::floor(rval))
-            return std::to_string(static_cast<long long>(rval));
-        return std::format("{:g}", rval);
-    case Type::Array: {
-        std::string s = "[";
-        bool first    = true;
-        for (auto& [k, v] : *aval) {
-            if (!first)
-                s += ", ";
-            s += v.to_string();
-            first = false;
-        }
-        return s + "]";
-    }
-    case Type::Tuple: {
-        std::string s = "{";
-        bool first    = true;
-        for (auto& e : *tval) {
-            if (!first)
-                s += ", ";
-            s += e.name.empty() ? e.value.to_string() : e.name + " := " + e.value.to_string();
-            first = false;
-        }
-        return s + "}";
-    }
-    case Type::Func:
-        return "<func>";
+template <class N>
+DValue arithmetic(BinOpNode::Op op, N a, N b) {
+    using Op = BinOpNode::Op;
+    auto num = [](N v) {
+        if constexpr (std::is_same_v<N, double>)
+            return DValue::make_real(v);
+        else
+            return DValue::make_int(v);
+    };
+    switch (op) {
+    case Op::ADD:
+        return num(a + b);
+    case Op::SUB:
+        return num(a - b);
+    case Op::MUL:
+        return num(a * b);
+    case Op::DIV:
+        return num(a / b);
+    case Op::LT:
+        return DValue::make_bool(static_cast<double>(a) < static_cast<double>(b));
+    case Op::LE:
+        return DValue::make_bool(static_cast<double>(a) <= static_cast<double>(b));
+    case Op::GT:
+        return DValue::make_bool(static_cast<double>(a) > static_cast<double>(b));
+    case Op::GE:
+        return DValue::make_bool(static_cast<double>(a) >= static_cast<double>(b));
+    case Op::EQ:
+        return DValue::make_bool(a == b);
+    case Op::NEQ:
+        return DValue::make_bool(a != b);
+    default:
+        return {};
     }
-    return "";
 }
 
-bool DValue::is_truthy() const {
-    if (type == Type::Bool)
-        return bval;
-    throw std::runtime_error("non-boolean value used in boolean context");
+uint8_t element_kind(const DValue& base, const DValue& key) {
+    if (base.type != DValue::Type::Array || key.type != DValue::Type::Int)
+        return TypeFeedback::kGeneric;
+    switch (base.aval->kind()) {
+    case ArrayStorage::Kind::Ints:
+        return kIntElements;
+    case ArrayStorage::Kind::Reals:
+        return kRealElements;
+    default:
+        return TypeFeedback::kGeneric;
+    }
 }
 
+} // namespace
+
 // ── Interpreter ────────────────────────────────────────────────────────────────
 
 Interpreter::Interpreter(std::ostream& out) : out_{out} {}
 
-void Interpreter::run(const ASTNode& root) {
+void Interpreter::run(const ASTNode& root, const Frame& inputs) {
+    // DValue counts its copies, moves and allocations through active_stats.
+    struct StatsScope {
+        InterpStats* saved;
+        ~StatsScope() { active_stats = saved; }
+    } stats_scope{std::exchange(active_stats, stats_)};
+    struct BudgetScope {
+        Budget& b;
+        ~BudgetScope() { b.stop(); }
+    } budget_scope{budget_};
+    budget_.start();
+    // The run's values are dropped before its region is released, error or
+    // not.  An input array, tuple or function could be given the run's values
+    // to keep, so with any of those the run does without the region.
+    const bool region = use_region_ && std::ranges::none_of(inputs, [](const auto& in) {
+        using T = DValue::Type;
+        return in.second.type == T::Array || in.second.type == T::Tuple ||
+               in.second.type == T::Func;
+    });
+    struct RegionScope {
+        Interpreter& in;
+        Region* saved;
+        ~RegionScope() {
+            in.release_values();
+            if (std::exchange(active_region, saved) != &in.region_)
+                return;
+            if (in.stats_)
+                in.stats_->region_bytes += in.region_.used();
+            in.region_.release();
+        }
+    } region_scope{*this, std::exchange(active_region, region ? &region_ : nullptr)};
+
     env_.clear();
+    env_base_ = 0;
+    frames_.clear();
+    push_frame(); // builtins
+    for (const Builtin& b : builtins())
+        declare(std::string{b.name}, DValue::make_builtin(&b));
+    env_.push_back(std::make_shared<Frame>(inputs));
     push_frame();
-    root.accept(*this);
+    globals_ = env_.back().get();
+    dispatch(root);
+}
+
+void Interpreter::release_values() noexcept {
     // Break shared_ptr reference cycles: closures capture env frames by
     // shared_ptr, and those frames may store the same closures as variables.
     // Clear values first (dropping closure→frame refs), then release frames.
     val_ = {};
+    args_.clear();
+    invariants_.clear();
     for (auto& frame : env_)
         frame->clear();
     env_.clear();
+    if (restore_)
+        restore_->release();
 }
 
-void Interpreter::push_frame() {
-    env_.push_back(std::make_shared<Frame>());
+FramePtr Interpreter::new_frame(const void* owner) {
+    if (stats_ && frames_.empty()) [[unlikely]]
+        ++stats_->frames_allocated;
+    return frames_.acquire(owner);
 }
-void Interpreter::pop_frame() {
+
+void Interpreter::push_frame(FramePtr frame) {
+    env_.push_back(std::move(frame));
+    if (stats_) [[unlikely]] {
+        ++stats_->frames_pushed;
+        stats_->peak_env_depth =
+            std::max<uint64_t>(stats_->peak_env_depth, env_.size() - env_base_);
+    }
+}
+void Interpreter::pop_frame(const void* owner) {
+    frames_.release(env_.back(), owner);
     env_.pop_back();
 }
 
@@ -85,46 +178,166 @@ void Interpreter::declare(const std::string& name, DValue v) {
 }
 
 DValue& Interpreter::lookup_ref(const std::string& name) {
-    for (auto it = env_.rbegin(); it != env_.rend(); ++it)
+    if (stats_) [[unlikely]]
+        ++stats_->lookups;
+    for (auto it = env_.rbegin(); it != env_.rend() - env_base_; ++it)
         if (auto jt = (*it)->find(name); jt != (*it)->end())
             return jt->second;
     throw std::runtime_error(std::format("undefined variable '{}'", name));
 }
 
+DValue& Interpreter::variable(const IdentNode& id) {
+    Frame& frame = *env_[env_.size() - 1 - id.resolved_depth];
+    if (restore_ && &frame == globals_) [[unlikely]]
+        return restored(frame, id.ident_name);
+    return frame[id.ident_name];
+}
+
+// Globals of a restored run are rebuilt from the snapshot when first used.
+DValue& Interpreter::restored(Frame& globals, const std::string& name) {
+    if (auto it = globals.find(name); it != globals.end())
+        return it->second;
+    auto v = restore_->load(name, env_);
+    return globals[name] = v ? std::move(*v) : DValue{};
+}
+
+void Interpreter::exec(const ASTNode& stmt) {
+    if (!profiler_ || !profiler_->enter_line(stmt.loc.line)) [[likely]] {
+        dispatch(stmt);
+        return;
+    }
+    struct Guard {
+        Profiler& p;
+        ~Guard() { p.leave_line(); }
+    } g{*profiler_};
+    dispatch(stmt);
+}
+
 DValue Interpreter::eval(const ASTNode& node) {
-    node.accept(*this);
+    dispatch(node);
     return std::move(val_);
 }
 
+// ── Loop scope ─────────────────────────────────────────────────────────────────
+
+// Gives one execution of an optimized loop fresh invariant and induction
+// slots.  When the loop is re-entered recursively (from a call in its own
+// body) the outer execution's slots are saved and restored on the way out.
+class Interpreter::LoopScope {
+public:
+    LoopScope(Interpreter& in, const LoopInfo& info) : in_{in}, info_{info} {
+        if (info.id == 0)
+            return;
+        if (in.loop_active_.size() <= info.id)
+            in.loop_active_.resize(info.id + 1);
+        const size_t inv_end = info.first_invariant + info.invariants;
+        const size_t ind_end = info.first_induction + info.inductions.size();
+        if (in.invariants_.size() < inv_end)
+            in.invariants_.resize(inv_end);
+        if (in.inductions_.size() < ind_end)
+            in.inductions_.resize(ind_end);
+        if (in.loop_active_[info.id]++ > 0) {
+            auto inv = in.invariants_.begin() + info.first_invariant;
+            auto ind = in.inductions_.begin() + info.first_induction;
+            saved_invariants_.assign(std::make_move_iterator(inv),
+                                     std::make_move_iterator(inv + info.invariants));
+            saved_inductions_.assign(ind, ind + info.inductions.size());
+        }
+        reset();
+    }
+
+    ~LoopScope() {
+        if (info_.id == 0)
+            return;
+        if (--in_.loop_active_[info_.id] > 0) {
+            std::ranges::move(saved_invariants_, in_.invariants_.begin() + info_.first_invariant);
+            std::ranges::copy(saved_inductions_, in_.inductions_.begin() + info_.first_induction);
+        } else {
+            reset();
+        }
+    }
+
+    LoopScope(const LoopScope&)            = delete;
+    LoopScope& operator=(const LoopScope&) = delete;
+
+    // Induction values for the first iterator value, then one step at a time.
+    // Arithmetic wraps like the interpreter's integer operators.
+    void start(long long first) {
+        for (size_t j = 0; j < info_.inductions.size(); ++j) {
+            const Affine& f = info_.inductions[j];
+            in_.inductions_[info_.first_induction + j] =
+                static_cast<long long>(u(f.scale) * u(first) + u(f.offset));
+        }
+    }
+    void step() {
+        for (size_t j = 0; j < info_.inductions.size(); ++j) {
+            long long& v = in_.inductions_[info_.first_induction + j];
+            v            = static_cast<long long>(u(v) + u(info_.inductions[j].scale));
+        }
+    }
+
+private:
+    Interpreter& in_;
+    const LoopInfo& info_;
+    std::vector<std::optional<DValue>> saved_invariants_;
+    std::vector<long long> saved_inductions_;
+
+    static unsigned long long u(long long v) { return static_cast<unsigned long long>(v); }
+
+    void reset() {
+        auto inv = in_.invariants_.begin() + info_.first_invariant;
+        std::fill(inv, inv + info_.invariants, std::nullopt);
+    }
+};
+
 // ── Statements ─────────────────────────────────────────────────────────────────
 
 void Interpreter::visit(const ProgramNode& n) {
-    for (const auto& s : n.stmts)
-        s->accept(*this);
+    bool pending = snapshot_.has_value();
+    for (const auto& s : n.stmts) {
+        if (restore_ && s->loc.line <= restore_->line())
+            continue;
+        if (pending && s->loc.line > snapshot_->line) {
+            write_snapshot(snapshot_->path, snapshot_->hash, snapshot_->line, env_);
+            pending = false;
+        }
+        exec(*s);
+    }
+    if (pending)
+        write_snapshot(snapshot_->path, snapshot_->hash, snapshot_->line, env_);
 }
 
 void Interpreter::visit(const BodyNode& n) {
-    push_frame();
+    if (!n.has_frame) {
+        for (const auto& s : n.stmts)
+            exec(*s);
+        return;
+    }
+    push_frame(&n);
     // RAII: always pop frame even when exception propagates
     struct Guard {
         Interpreter& i;
-        ~Guard() { i.pop_frame(); }
-    } g{*this};
+        const BodyNode& n;
+        ~Guard() { i.pop_frame(&n); }
+    } g{*this, n};
     for (const auto& s : n.stmts)
-        s->accept(*this);
+        exec(*s);
 }
 
 void Interpreter::visit(const VarDeclNode& n) {
     for (const auto& d : n.defs)
-        d->accept(*this);
+        dispatch(*d);
 }
 
 void Interpreter::visit(const VarDefNode& n) {
     // Mirror semantic analyzer: pre-declare func-literal initialisers so the
     // closure can capture a frame that already contains the variable slot.
-    const bool is_func_init = n.init && dynamic_cast<const FuncLitNode*>(n.init.get()) != nullptr;
-    if (is_func_init)
+    const bool is_func_init = n.init && n.init->kind == NodeKind::FuncLit;
+    if (is_func_init) {
         declare(n.varname); // initially none
+        if (profiler_)
+            profiler_->name_function(static_cast<const FuncLitNode&>(*n.init), n.varname);
+    }
     DValue v = n.init ? eval(*n.init) : DValue{};
     if (is_func_init)
         lookup_ref(n.varname) = std::move(v);
@@ -133,38 +346,47 @@ void Interpreter::visit(const VarDefNode& n) {
 }
 
 void Interpreter::visit(const AssignNode& n) {
+    using T = DValue::Type;
+    if (const BinOpNode* add = self_concatenation(n)) {
+        DValue L = eval(*add->left);
+        DValue R = eval(*add->right);
+        if ((L.type == T::Array || L.type == T::Tuple) &&
+            append_in_place(variable(static_cast<const IdentNode&>(*n.lhs)), L, R)) {
+            if (stats_) [[unlikely]]
+                ++stats_->lookups;
+            return;
+        }
+        assign_lvalue(*n.lhs, operate(*add, L, R));
+        return;
+    }
     assign_lvalue(*n.lhs, eval(*n.rhs));
 }
 
 void Interpreter::assign_lvalue(const ASTNode& lhs, DValue rhs) {
-    if (auto* id = dynamic_cast<const IdentNode*>(&lhs)) {
-        (*env_[env_.size() - 1 - id->resolved_depth])[id->ident_name] = std::move(rhs);
-    } else if (auto* idx = dynamic_cast<const IndexNode*>(&lhs)) {
+    if (auto* id = node_cast<IdentNode>(&lhs)) {
+        if (stats_) [[unlikely]]
+            ++stats_->lookups;
+        variable(*id) = std::move(rhs);
+    } else if (auto* idx = node_cast<IndexNode>(&lhs)) {
         DValue base = eval(*idx->base);
         DValue key  = eval(*idx->index_expr);
-        if (base.type != DValue::Type::Array)
-            throw std::runtime_error("index assignment on non-array");
-        if (key.type != DValue::Type::Int)
-            throw std::runtime_error("array index must be integer");
-        (*base.aval)[key.ival] = std::move(rhs);
-    } else if (auto* dot = dynamic_cast<const DotFieldNode*>(&lhs)) {
-        DValue base = eval(*dot->base);
-        if (base.type != DValue::Type::Tuple)
-            throw std::runtime_error("field assignment on non-tuple");
-        for (auto& e : *base.tval) {
-            if (e.name == dot->field) {
-                e.value = std::move(rhs);
-                return;
-            }
+        index_set(base, key, std::move(rhs));
+    } else if (auto* dot = node_cast<DotFieldNode>(&lhs)) {
+        if (auto* idx = node_cast<IndexNode>(dot->base.get())) {
+            DValue base = eval(*idx->base);
+            DValue key  = eval(*idx->index_expr);
+            element_field_set(base, key, dot->field, std::move(rhs));
+        } else {
+            field_set(eval(*dot->base), dot->field, std::move(rhs));
+        }
+    } else if (auto* di = node_cast<DotIntNode>(&lhs)) {
+        if (auto* idx = node_cast<IndexNode>(di->base.get())) {
+            DValue base = eval(*idx->base);
+            DValue key  = eval(*idx->index_expr);
+            element_dot_int_set(base, key, di->index, std::move(rhs));
+        } else {
+            dot_int_set(eval(*di->base), di->index, std::move(rhs));
         }
-        throw std::runtime_error(std::format("tuple has no field '{}'", dot->field));
-    } else if (auto* di = dynamic_cast<const DotIntNode*>(&lhs)) {
-        DValue base = eval(*di->base);
-        if (base.type != DValue::Type::Tuple)
-            throw std::runtime_error("dot-int assignment on non-tuple");
-        if (di->index < 1 || di->index > static_cast<long long>(base.tval->size()))
-            throw std::runtime_error("tuple index out of range");
-        (*base.tval)[di->index - 1].value = std::move(rhs);
     } else {
         throw std::runtime_error("invalid lvalue");
     }
@@ -172,20 +394,22 @@ void Interpreter::assign_lvalue(const ASTNode& lhs, DValue rhs) {
 
 void Interpreter::visit(const IfNode& n) {
     if (eval(*n.cond).is_truthy())
-        n.then_body->accept(*this);
+        dispatch(*n.then_body);
     else if (n.else_body)
-        n.else_body->accept(*this);
+        dispatch(*n.else_body);
 }
 
 void Interpreter::visit(const IfShortNode& n) {
     if (eval(*n.cond).is_truthy())
-        n.stmt->accept(*this);
+        dispatch(*n.stmt);
 }
 
 void Interpreter::visit(const WhileNode& n) {
+    LoopScope loop{*this, n.opt};
     while (eval(*n.cond).is_truthy()) {
+        budget_.step(n.loc);
         try {
-            n.body->accept(*this);
+            dispatch(*n.body);
         } catch (ExitSignal&) {
             return;
         }
@@ -196,38 +420,49 @@ void Interpreter::visit(const ForRangeNode& n) {
     const long long from = eval(*n.from).ival;
     const long long to   = eval(*n.to).ival;
 
-    push_frame(); // scope for iterator variable
+    push_frame(&n); // scope for iterator variable
     struct Guard {
         Interpreter& i;
-        ~Guard() { i.pop_frame(); }
-    } g{*this};
-
+        const ASTNode& n;
+        ~Guard() { i.pop_frame(&n); }
+    } g{*this, n};
+
+    // The iterator's map entry is found once; references into the frame stay
+    // valid while it is on the stack.
+    DValue* iter = n.iter.empty() ? nullptr : &(*env_.back())[n.iter];
+    LoopScope loop{*this, n.opt};
+    loop.start(from);
     for (long long v = from; v <= to; ++v) {
-        if (!n.iter.empty())
-            (*env_.back())[n.iter] = DValue::make_int(v);
+        budget_.step(n.loc);
+        if (iter)
+            *iter = DValue::make_int(v);
         try {
-            n.body->accept(*this);
+            dispatch(*n.body);
         } catch (ExitSignal&) {
             return;
         }
         // ReturnSignal propagates through; Guard ensures iter frame is popped
+        loop.step();
     }
 }
 
 void Interpreter::visit(const ForIterNode& n) {
     DValue iterable = eval(*n.iterable);
 
-    push_frame(); // scope for iterator variable
+    push_frame(&n); // scope for iterator variable
     struct Guard {
         Interpreter& i;
-        ~Guard() { i.pop_frame(); }
-    } g{*this};
+        const ASTNode& n;
+        ~Guard() { i.pop_frame(&n); }
+    } g{*this, n};
 
+    LoopScope loop{*this, n.opt};
     auto run_body = [&](DValue elem) {
+        budget_.step(n.loc);
         if (!n.iter.empty())
             (*env_.back())[n.iter] = std::move(elem);
         try {
-            n.body->accept(*this);
+            dispatch(*n.body);
             return true;
         } catch (ExitSignal&) {
             return false;
@@ -235,8 +470,10 @@ void Interpreter::visit(const ForIterNode& n) {
     };
 
     if (iterable.type == DValue::Type::Array) {
-        for (auto& [k, v] : *iterable.aval)
-            if (!run_body(v))
+        ArrayStorage::Cursor cursor{*iterable.aval, n.reads_fields};
+        DValue elem;
+        while (cursor.next(elem))
+            if (!run_body(std::move(elem)))
                 return;
     } else if (iterable.type == DValue::Type::Tuple) {
         for (auto& e : *iterable.tval)
@@ -248,9 +485,11 @@ void Interpreter::visit(const ForIterNode& n) {
 }
 
 void Interpreter::visit(const LoopInfNode& n) {
+    LoopScope loop{*this, n.opt};
     while (true) {
+        budget_.step(n.loc);
         try {
-            n.body->accept(*this);
+            dispatch(*n.body);
         } catch (ExitSignal&) {
             return;
         }
@@ -258,9 +497,17 @@ void Interpreter::visit(const LoopInfNode& n) {
 }
 
 void Interpreter::visit(const ExitNode&) {
+    if (stats_) [[unlikely]]
+        ++stats_->exit_signals;
     throw ExitSignal{};
 }
 void Interpreter::visit(const ReturnNode& n) {
+    if (stats_) [[unlikely]]
+        ++stats_->return_signals;
+    if (&n == tail_return_) {
+        val_ = n.value ? eval(*n.value) : DValue{};
+        return;
+    }
     throw ReturnSignal{n.value ? eval(*n.value) : DValue{}};
 }
 
@@ -292,26 +539,47 @@ void Interpreter::visit(const NoneLitNode&) {
 }
 
 void Interpreter::visit(const IdentNode& n) {
-    val_ = (*env_[env_.size() - 1 - n.resolved_depth])[n.ident_name];
+    if (stats_) [[unlikely]]
+        ++stats_->lookups;
+    val_ = variable(n);
 }
 
 void Interpreter::visit(const FuncLitNode& n) {
+    if (profiler_)
+        profiler_->count_alloc();
     val_ = DValue::make_func(&n, capture_env());
 }
 
 void Interpreter::visit(const TypeNode&) {
     val_ = {};
 }
+
+void Interpreter::visit(const InvariantNode& n) {
+    if (const auto& cached = invariants_[n.slot]) {
+        val_ = *cached;
+        return;
+    }
+    val_ = eval(*n.expr);
+    // Arrays, tuples and functions are references; see optimizer.hpp.
+    if (val_.type != DValue::Type::Array && val_.type != DValue::Type::Tuple &&
+        val_.type != DValue::Type::Func)
+        invariants_[n.slot] = val_;
+}
+
+void Interpreter::visit(const InductionNode& n) {
+    val_ = DValue::make_int(inductions_[n.slot]);
+}
 void Interpreter::visit(const TupleElemNode& n) {
     val_ = eval(*n.expr);
 }
 
 void Interpreter::visit(const ArrayLitNode& n) {
-    std::map<long long, DValue> m;
-    long long key = 1;
+    ArrayStorage a;
     for (const auto& e : n.elems)
-        m[key++] = eval(*e);
-    val_ = DValue::make_array(std::move(m));
+        a.push_back(eval(*e));
+    if (profiler_)
+        profiler_->count_alloc();
+    val_ = DValue::make_array(std::move(a));
 }
 
 void Interpreter::visit(const TupleLitNode& n) {
@@ -320,161 +588,164 @@ void Interpreter::visit(const TupleLitNode& n) {
         const auto& te = static_cast<const TupleElemNode&>(*e);
         elems.push_back(TupleElem{te.elem_name, eval(*te.expr)});
     }
+    if (profiler_)
+        profiler_->count_alloc();
     val_ = DValue::make_tuple(std::move(elems));
 }
 
 void Interpreter::visit(const IndexNode& n) {
     DValue base = eval(*n.base);
     DValue key  = eval(*n.index_expr);
-    if (base.type != DValue::Type::Array)
-        throw std::runtime_error("index on non-array");
-    if (key.type != DValue::Type::Int)
-        throw std::runtime_error("array index must be integer");
-    auto it = base.aval->find(key.ival);
-    if (it == base.aval->end())
-        throw std::runtime_error(std::format("array key {} not found", key.ival));
-    val_ = it->second;
+
+    const uint8_t spec = n.feedback.state();
+    if (spec == kIntElements || spec == kRealElements) {
+        if (element_kind(base, key) == spec) {
+            const ArrayStorage& a = *base.aval;
+            const auto i = static_cast<unsigned long long>(key.ival - a.first_key());
+            if (spec == kIntElements && i < a.ints().size()) {
+                val_ = DValue::make_int(a.ints()[i]);
+                return;
+            }
+            if (spec == kRealElements && i < a.reals().size()) {
+                val_ = DValue::make_real(a.reals()[i]);
+                return;
+            }
+        }
+        deoptimize(n.feedback);
+    } else if (spec == TypeFeedback::kUnspecialized) {
+        specialize(n.feedback, element_kind(base, key));
+    }
+    val_ = index_get(base, key);
 }
 
+// A D function's arguments are evaluated straight into its parameter frame, a
+// builtin's onto args_.  Once the frame pool and the stacks have grown, a call
+// allocates nothing.
 void Interpreter::visit(const CallNode& n) {
     DValue callee = eval(*n.callee);
-    std::vector<DValue> args;
+    if (callee.type == DValue::Type::Func && !callee.fval->native) {
+        val_ = call(*callee.fval, n);
+        return;
+    }
+    struct ArgsGuard {
+        std::vector<DValue>& args;
+        size_t base;
+        ~ArgsGuard() { args.resize(base); }
+    } ag{args_, args_.size()};
     for (const auto& a : n.args)
-        args.push_back(eval(*a));
-    val_ = call_func(callee, std::move(args));
+        args_.push_back(eval(*a));
+    budget_.step(n.loc);
+    if (callee.type != DValue::Type::Func)
+        throw std::runtime_error("call on non-function");
+    val_ = call_builtin(*callee.fval->native, std::span{args_}.subspan(ag.base));
 }
 
-DValue Interpreter::call_func(const DValue& fv, std::vector<DValue> args) {
-    if (fv.type != DValue::Type::Func)
-        throw std::runtime_error("call on non-function");
-    const FuncClosure& closure = *fv.fval;
-    const FuncLitNode& fn      = *closure.node;
-
-    Env saved = std::move(env_);
-    env_      = closure.captured_env;
-    push_frame(); // frame for parameters
-
-    if (fn.params) {
-        const auto& pl = static_cast<const ParamListNode&>(*fn.params);
-        for (size_t i = 0; i < pl.params.size(); ++i) {
-            const auto& ident                = static_cast<const IdentNode&>(*pl.params[i]);
-            (*env_.back())[ident.ident_name] = i < args.size() ? std::move(args[i]) : DValue{};
-        }
+DValue Interpreter::call(const FuncClosure& closure, const CallNode& n) {
+    const FuncLitNode& fn = *closure.node;
+
+    // Surplus arguments are evaluated and dropped; missing ones are none.
+    FramePtr frame = new_frame(&fn);
+    const auto* params =
+        fn.params ? &static_cast<const ParamListNode&>(*fn.params).params : nullptr;
+    const size_t nparams = params ? params->size() : 0;
+
+    auto param = [&](size_t i) -> DValue& {
+        return (*frame)[static_cast<const IdentNode&>(*(*params)[i]).ident_name];
+    };
+    for (size_t i = 0; i < n.args.size(); ++i) {
+        DValue v = eval(*n.args[i]);
+        if (i < nparams)
+            param(i) = std::move(v);
     }
+    for (size_t i = n.args.size(); i < nparams; ++i)
+        param(i) = {};
+    budget_.step(n.loc);
+
+    // The callee's environment goes on top of the caller's, from env_base_ up.
+    // Cutting back to the caller's restores it however the call ends: `exit`
+    // may end it too, through the loop around the call.
+    struct EnvGuard {
+        Interpreter& i;
+        size_t base, top; // the caller's env_base_ and env_.size()
+        ~EnvGuard() {
+            i.env_.resize(top);
+            i.env_base_ = base;
+        }
+    } eg{*this, env_base_, env_.size()};
+    env_base_ = env_.size();
+    env_.insert(env_.end(), closure.captured_env.begin(), closure.captured_env.end());
+    push_frame(std::move(frame)); // parameters, and the body's variables unless it has a frame
+
+    if (profiler_)
+        profiler_->enter_function(fn);
+    struct ProfileGuard {
+        Profiler* p;
+        ~ProfileGuard() {
+            if (p)
+                p->leave_function();
+        }
+    } pg{profiler_};
+
+    // A `return` ending the body leaves its value in val_ rather than throwing
+    // (see visit(ReturnNode)).
+    const auto& body = static_cast<const BodyNode&>(*fn.body);
+    const ASTNode* tail =
+        !body.stmts.empty() && body.stmts.back()->kind == NodeKind::Return ? body.stmts.back().get()
+                                                                            : nullptr;
+    struct TailGuard {
+        const ASTNode*& slot;
+        const ASTNode* saved;
+        ~TailGuard() { slot = saved; }
+    } tg{tail_return_, std::exchange(tail_return_, tail)};
 
     DValue result;
     try {
-        fn.body->accept(*this); // BodyNode pushes/pops its own frame
+        dispatch(body);
+        if (tail)
+            result = std::move(val_);
     } catch (ReturnSignal& r) {
         result = std::move(r.value);
     }
-    // env_ may have had frames popped by BodyNode guards on exception path,
-    // but we unconditionally replace it anyway:
-    env_ = std::move(saved);
+    // The body's frames are popped; only the parameters remain above the
+    // captured environment.
+    pop_frame(&fn);
     return result;
 }
 
+// a[k].field and a[k].index read an array of Records without building the
+// tuple (see ArrayStorage).
 void Interpreter::visit(const DotFieldNode& n) {
+    if (const auto* idx = node_cast<IndexNode>(n.base.get())) {
+        DValue base = eval(*idx->base);
+        DValue key  = eval(*idx->index_expr);
+        val_        = element_field_get(base, key, n.field);
+        return;
+    }
     DValue base = eval(*n.base);
-    if (base.type != DValue::Type::Tuple)
-        throw std::runtime_error("dot field access on non-tuple");
-    for (const auto& e : *base.tval)
-        if (e.name == n.field) {
-            val_ = e.value;
-            return;
-        }
-    throw std::runtime_error(std::format("tuple has no field '{}'", n.field));
+    val_        = field_get(base, n.field);
 }
 
 void Interpreter::visit(const DotIntNode& n) {
+    if (const auto* idx = node_cast<IndexNode>(n.base.get())) {
+        DValue base = eval(*idx->base);
+        DValue key  = eval(*idx->index_expr);
+        val_        = element_dot_int_get(base, key, n.index);
+        return;
+    }
     DValue base = eval(*n.base);
-    if (base.type != DValue::Type::Tuple)
-        throw std::runtime_error("dot-int access on non-tuple");
-    if (n.index < 1 || n.index > static_cast<long long>(base.tval->size()))
-        throw std::runtime_error(std::format("tuple index {} out of range", n.index));
-    val_ = (*base.tval)[n.index - 1].value;
+    val_        = dot_int_get(base, n.index);
 }
 
 void Interpreter::visit(const UnaryOpNode& n) {
-    DValue v = eval(*n.operand);
-    switch (n.op) {
-    case UnaryOpNode::Op::UPLUS:
-        val_ = (v.type == DValue::Type::Int) ? DValue::make_int(v.ival)
-               : (v.type == DValue::Type::Real)
-                   ? DValue::make_real(v.rval)
-                   : (throw std::runtime_error("unary + on non-numeric"), DValue{});
-        break;
-    case UnaryOpNode::Op::UMINUS:
-        val_ = (v.type == DValue::Type::Int) ? DValue::make_int(-v.ival)
-               : (v.type == DValue::Type::Real)
-                   ? DValue::make_real(-v.rval)
-                   : (throw std::runtime_error("unary - on non-numeric"), DValue{});
-        break;
-    case UnaryOpNode::Op::NOT:
-        val_ = DValue::make_bool(!v.is_truthy());
-        break;
-    }
+    val_ = unary_op(n.op, eval(*n.operand));
 }
 
 void Interpreter::visit(const IsNode& n) {
-    DValue v       = eval(*n.operand);
-    const auto& tn = static_cast<const TypeNode&>(*n.type_node);
-    bool ok        = false;
-    switch (tn.type) {
-    case TypeNode::Type::INT:
-        ok = v.type == DValue::Type::Int;
-        break;
-    case TypeNode::Type::REAL:
-        ok = v.type == DValue::Type::Real;
-        break;
-    case TypeNode::Type::BOOL:
-        ok = v.type == DValue::Type::Bool;
-        break;
-    case TypeNode::Type::STRING:
-        ok = v.type == DValue::Type::String;
-        break;
-    case TypeNode::Type::NONE:
-        ok = v.type == DValue::Type::None;
-        break;
-    case TypeNode::Type::ARRAY:
-        ok = v.type == DValue::Type::Array;
-        break;
-    case TypeNode::Type::TUPLE:
-        ok = v.type == DValue::Type::Tuple;
-        break;
-    case TypeNode::Type::FUNC:
-        ok = v.type == DValue::Type::Func;
-        break;
-    }
-    val_ = DValue::make_bool(ok);
-}
-
-// ── Helper: floor division (spec: integer/integer rounds down) ─────────────────
-static long long floor_div(long long a, long long b) {
-    long long q = a / b;
-    if (a % b != 0 && (a ^ b) < 0)
-        --q; // adjust when signs differ
-    return q;
-}
-
-// ── Numeric coercion helpers ───────────────────────────────────────────────────
-static double to_real(const DValue& v) {
-    if (v.type == DValue::Type::Int)
-        return static_cast<double>(v.ival);
-    if (v.type == DValue::Type::Real)
-        return v.rval;
-    throw std::runtime_error("expected numeric value");
-}
-static bool is_numeric(const DValue& v) {
-    return v.type == DValue::Type::Int || v.type == DValue::Type::Real;
-}
-static bool is_mixed_real(const DValue& a, const DValue& b) {
-    return is_numeric(a) && is_numeric(b) &&
-           (a.type == DValue::Type::Real || b.type == DValue::Type::Real);
+    DValue v = eval(*n.operand);
+    val_     = DValue::make_bool(has_type(v, static_cast<const TypeNode&>(*n.type_node).type));
 }
 
 void Interpreter::visit(const BinOpNode& n) {
-    using T  = DValue::Type;
     using Op = BinOpNode::Op;
 
     // Short-circuit logical operators
@@ -493,122 +764,36 @@ void Interpreter::visit(const BinOpNode& n) {
 
     DValue L = eval(*n.left);
     DValue R = eval(*n.right);
+    val_     = operate(n, L, R);
+}
 
-    switch (n.op) {
-    case Op::ADD:
-        if (L.type == T::Int && R.type == T::Int)
-            val_ = DValue::make_int(L.ival + R.ival);
-        else if (is_mixed_real(L, R))
-            val_ = DValue::make_real(to_real(L) + to_real(R));
-        else if (L.type == T::String && R.type == T::String)
-            val_ = DValue::make_str(L.sval + R.sval);
-        else if (L.type == T::Array && R.type == T::Array) {
-            std::map<long long, DValue> result = *L.aval;
-            long long next                     = result.empty() ? 1 : result.rbegin()->first + 1;
-            for (auto& [k, v] : *R.aval)
-                result[next++] = v;
-            val_ = DValue::make_array(std::move(result));
-        } else if (L.type == T::Tuple && R.type == T::Tuple) {
-            std::vector<TupleElem> elems = *L.tval;
-            for (auto& e : *R.tval)
-                elems.push_back(e);
-            val_ = DValue::make_tuple(std::move(elems));
-        } else
-            throw std::runtime_error("invalid operands for +");
-        break;
+// `n` applied to its operands' values.
+DValue Interpreter::operate(const BinOpNode& n, const DValue& L, const DValue& R) {
+    using T  = DValue::Type;
+    using Op = BinOpNode::Op;
 
-    case Op::SUB:
+    switch (n.feedback.state()) {
+    case kIntOperands:
         if (L.type == T::Int && R.type == T::Int)
-            val_ = DValue::make_int(L.ival - R.ival);
-        else if (is_mixed_real(L, R))
-            val_ = DValue::make_real(to_real(L) - to_real(R));
-        else
-            throw std::runtime_error("invalid operands for -");
+            return arithmetic(n.op, L.ival, R.ival);
+        deoptimize(n.feedback);
         break;
-
-    case Op::MUL:
-        if (L.type == T::Int && R.type == T::Int)
-            val_ = DValue::make_int(L.ival * R.ival);
-        else if (is_mixed_real(L, R))
-            val_ = DValue::make_real(to_real(L) * to_real(R));
-        else
-            throw std::runtime_error("invalid operands for *");
+    case kRealOperands:
+        if (L.type == T::Real && R.type == T::Real)
+            return arithmetic(n.op, L.rval, R.rval);
+        deoptimize(n.feedback);
         break;
-
-    case Op::DIV:
-        if (L.type == T::Int && R.type == T::Int)
-            val_ = DValue::make_int(floor_div(L.ival, R.ival));
-        else if (is_mixed_real(L, R))
-            val_ = DValue::make_real(to_real(L) / to_real(R));
-        else
-            throw std::runtime_error("invalid operands for /");
+    case TypeFeedback::kUnspecialized:
+        specialize(n.feedback, operand_kind(n.op, L, R));
         break;
-
-    // Comparisons
-    case Op::LT:
-        if (is_numeric(L) && is_numeric(R))
-            val_ = DValue::make_bool(to_real(L) < to_real(R));
-        else
-            throw std::runtime_error("< requires numeric operands");
-        break;
-    case Op::LE:
-        if (is_numeric(L) && is_numeric(R))
-            val_ = DValue::make_bool(to_real(L) <= to_real(R));
-        else
-            throw std::runtime_error("<= requires numeric operands");
-        break;
-    case Op::GT:
-        if (is_numeric(L) && is_numeric(R))
-            val_ = DValue::make_bool(to_real(L) > to_real(R));
-        else
-            throw std::runtime_error("> requires numeric operands");
-        break;
-    case Op::GE:
-        if (is_numeric(L) && is_numeric(R))
-            val_ = DValue::make_bool(to_real(L) >= to_real(R));
-        else
-            throw std::runtime_error(">= requires numeric operands");
-        break;
-
-    case Op::EQ: {
-        bool eq = false;
-        if (L.type == T::None && R.type == T::None)
-            eq = true;
-        else if (L.type == T::None || R.type == T::None)
-            eq = false;
-        else if (L.type == T::Bool && R.type == T::Bool)
-            eq = L.bval == R.bval;
-        else if (L.type == T::String && R.type == T::String)
-            eq = L.sval == R.sval;
-        else if (is_numeric(L) && is_numeric(R)) {
-            if (L.type == T::Int && R.type == T::Int)
-                eq = L.ival == R.ival;
-            else
-                eq = to_real(L) == to_real(R);
-        }
-        val_ = DValue::make_bool(eq);
-        break;
-    }
-    case Op::NEQ: {
-        bool eq = false;
-        if (L.type == T::None && R.type == T::None)
-            eq = true;
-        else if (L.type == T::None || R.type == T::None)
-            eq = false;
-        else if (L.type == T::Bool && R.type == T::Bool)
-            eq = L.bval == R.bval;
-        else if (L.type == T::String && R.type == T::String)
-            eq = L.sval == R.sval;
-        else if (is_numeric(L) && is_numeric(R)) {
-            if (L.type == T::Int && R.type == T::Int)
-                eq = L.ival == R.ival;
-            else
-                eq = to_real(L) == to_real(R);
-        }
-        val_ = DValue::make_bool(!eq);
-        break;
-    }
     default:
         break;
     }
-}
\ No newline at end of file
+
+    // Concatenation allocates a new string, array or tuple.
+    if (profiler_ && n.op == Op::ADD && L.type == R.type &&
+        (L.type == T::String || L.type == T::Array || L.type == T::Tuple))
+        profiler_->count_alloc();
+
+    return binary_op(n.op, L, R);
+}
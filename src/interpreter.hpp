@@ -2,117 +2,20 @@
 
 #include "ast.hpp"
 #include "ast_visitor.hpp"
-
-#include <map>
-#include <memory>
+#include "budget.hpp"
+#include "frame_pool.hpp"
+#include "interp_stats.hpp"
+#include "region.hpp"
+#include "value.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
 #include <ostream>
-#include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <utility>
 #include <vector>
 
-// ── Runtime value ─────────────────────────────────────────────────────────────
-//
-// Forward declarations to break circular dependencies:
-//   DValue  ← shared_ptr<vector<TupleElem>>
-//   TupleElem ← DValue (by value)
-//
-// Solution: DValue holds a shared_ptr to an opaque vector; TupleElem is
-// defined after DValue is complete; make_tuple/make_func are out-of-line.
-
-struct TupleElem;   // forward – complete definition follows DValue
-struct FuncClosure; // forward – complete definition follows TupleElem
-
-struct DValue {
-    enum class Type { None, Int, Real, Bool, String, Array, Tuple, Func };
-    Type type{Type::None};
-
-    long long ival{};
-    double rval{};
-    bool bval{};
-    std::string sval;
-    std::shared_ptr<std::map<long long, DValue>> aval; // Array: key → value
-    std::shared_ptr<std::vector<TupleElem>> tval;      // Tuple elements (heap)
-    std::shared_ptr<FuncClosure> fval;                 // Function closure
-
-    static DValue make_none() { return {}; }
-    static DValue make_int(long long v) {
-        DValue d;
-        d.type = Type::Int;
-        d.ival = v;
-        return d;
-    }
-    static DValue make_real(double v) {
-        DValue d;
-        d.type = Type::Real;
-        d.rval = v;
-        return d;
-    }
-    static DValue make_bool(bool v) {
-        DValue d;
-        d.type = Type::Bool;
-        d.bval = v;
-        return d;
-    }
-    static DValue make_str(std::string v) {
-        DValue d;
-        d.type = Type::String;
-        d.sval = std::move(v);
-        return d;
-    }
-    static DValue make_array(std::map<long long, DValue> m) {
-        DValue d;
-        d.type = Type::Array;
-        d.aval = std::make_shared<std::map<long long, DValue>>(std::move(m));
-        return d;
-    }
-
-    // Declared here, defined after TupleElem / FuncClosure are complete:
-    static DValue make_tuple(std::vector<TupleElem> e);
-    static DValue make_func(
-        const FuncLitNode* n,
-        std::vector<std::shared_ptr<std::unordered_map<std::string, DValue>>> env);
-
-    std::string to_string() const;
-    bool is_truthy() const; // throws if not Bool
-};
-
-// ── TupleElem (complete after DValue) ────────────────────────────────────────
-
-struct TupleElem {
-    std::string name; // empty for unnamed elements
-    DValue value;
-};
-
-// ── Environment types ─────────────────────────────────────────────────────────
-
-using Frame    = std::unordered_map<std::string, DValue>;
-using FramePtr = std::shared_ptr<Frame>;
-using Env      = std::vector<FramePtr>;
-
-// ── FuncClosure (complete after Env) ─────────────────────────────────────────
-
-struct FuncClosure {
-    const FuncLitNode* node; // non-owning; AST owns the node
-    Env captured_env;        // lexical environment at definition time
-};
-
-// ── Out-of-line factory definitions (all dependencies now complete) ────────────
-
-inline DValue DValue::make_tuple(std::vector<TupleElem> e) {
-    DValue d;
-    d.type = Type::Tuple;
-    d.tval = std::make_shared<std::vector<TupleElem>>(std::move(e));
-    return d;
-}
-
-inline DValue DValue::make_func(const FuncLitNode* n, Env env) {
-    DValue d;
-    d.type = Type::Func;
-    d.fval = std::make_shared<FuncClosure>(FuncClosure{n, std::move(env)});
-    return d;
-}
-
 // ── Control-flow signals (thrown as exceptions) ────────────────────────────────
 
 struct ExitSignal {};
@@ -122,10 +25,33 @@ struct ReturnSignal {
 
 // ── Interpreter ───────────────────────────────────────────────────────────────
 
-class Interpreter : public ASTVisitorBase<Interpreter> {
+class Profiler;
+class Snapshot;
+
+class Interpreter final : public ASTVisitorBase<Interpreter> {
 public:
     explicit Interpreter(std::ostream& out);
-    void run(const ASTNode& root);
+    // `inputs` holds the values of the names passed to SemanticAnalyzer::analyze.
+    void run(const ASTNode& root, const Frame& inputs = {});
+
+    // Reports calls, statements and allocations to `p` (nullptr detaches).
+    void set_profiler(Profiler* p) { profiler_ = p; }
+    // Counts interpreter events into `s` during run() (nullptr detaches).
+    void set_stats(InterpStats* s) { stats_ = s; }
+    // Limits later runs; exceeding a limit throws BudgetExceeded.
+    void set_budget(const Budget::Limits& limits) { budget_ = Budget{limits}; }
+    // Writes the globals to `path` once the top-level statements starting on or
+    // before `line` have run (see snapshot.hpp).
+    void snapshot_after(int line, std::string path, uint64_t source_hash) {
+        snapshot_ = SnapshotPlan{line, std::move(path), source_hash};
+    }
+    // Continues later runs from `s`: skips the top-level statements it covers
+    // and rebuilds the globals they defined on first use (nullptr detaches).
+    void restore_from(Snapshot* s) { restore_ = s; }
+    // Allocates the arrays, tuples and closures of later runs from a Region
+    // released when run() returns, unless an input is an array, tuple or
+    // function.
+    void set_region(bool on) { use_region_ = on; }
 
     void visit(const ProgramNode&) override;
     void visit(const BodyNode&) override;
@@ -159,19 +85,70 @@ public:
     void visit(const TupleElemNode&) override;
     void visit(const FuncLitNode&) override;
     void visit(const TypeNode&) override;
+    void visit(const InvariantNode&) override;
+    void visit(const InductionNode&) override;
 
 private:
     std::ostream& out_;
+    // The frames of the calls in progress, each call's above its caller's.  The
+    // environment of the running code is the part from env_base_ up.
     Env env_;
-    DValue val_; // expression result register
-
-    void push_frame();
-    void pop_frame();
-    Env capture_env() const { return env_; }
+    size_t env_base_{0};
+    std::vector<DValue> args_;            // arguments of the builtin calls in progress
+    const ASTNode* tail_return_{nullptr}; // `return` ending the running function's body
+    DValue val_;                          // expression result register
+    Profiler* profiler_{nullptr};
+    InterpStats* stats_{nullptr};
+    Budget budget_;
+
+    struct SnapshotPlan {
+        int line;
+        std::string path;
+        uint64_t hash;
+    };
+    std::optional<SnapshotPlan> snapshot_;
+    Snapshot* restore_{nullptr};
+    const Frame* globals_{nullptr}; // of the current run
+
+    // Optimizer slots (see LoopInfo), sized on first use.
+    std::vector<std::optional<DValue>> invariants_;
+    std::vector<long long> inductions_;
+    std::vector<uint32_t> loop_active_; // by LoopInfo::id: executions in progress
+    class LoopScope;
+
+    FramePool frames_;
+    Region region_;
+    bool use_region_{false};
+
+    // Drops every value the interpreter holds, ending the run.
+    void release_values() noexcept;
+
+    // `owner` is the node whose scope the frame is for (see FramePool).
+    FramePtr new_frame(const void* owner);
+    void push_frame(FramePtr frame);
+    void push_frame(const void* owner = nullptr) { push_frame(new_frame(owner)); }
+    void pop_frame(const void* owner = nullptr);
+    Env capture_env() const { return {env_.begin() + env_base_, env_.end()}; }
     void declare(const std::string& name, DValue v = {});
     DValue& lookup_ref(const std::string& name);
+    // The variable `id` names, in the frame its resolved depth selects.
+    DValue& variable(const IdentNode& id);
+    DValue& restored(Frame& globals, const std::string& name);
 
+    void exec(const ASTNode& stmt);
     DValue eval(const ASTNode& node);
     void assign_lvalue(const ASTNode& lhs, DValue rhs);
-    DValue call_func(const DValue& fv, std::vector<DValue> args);
+    DValue operate(const BinOpNode& n, const DValue& L, const DValue& R);
+    DValue call(const FuncClosure& closure, const CallNode& n);
+
+    // Type feedback transitions (see TypeFeedback), counted in stats_.
+    void specialize(const TypeFeedback& f, uint8_t s) {
+        if (f.observe(s) && stats_) [[unlikely]]
+            ++stats_->nodes_specialized;
+    }
+    void deoptimize(const TypeFeedback& f) {
+        f.generalize();
+        if (stats_) [[unlikely]]
+            ++stats_->guard_failures;
+    }
 };
@@ -1,44 +1,200 @@
 #include "lexer.hpp"
 
 #include "parser.tab.hpp"
+#include "scan.hpp"
+#include "token_pipeline.hpp"
 
+#include <array>
 #include <cassert>
-#include <cctype>
+#include <cstdint>
 #include <cstring>
-#include <iostream>
 #include <istream>
+#include <iterator>
 #include <string>
-#include <unordered_map>
-
-static std::unordered_map<std::string, yy::parser::symbol_type (*)(yy::parser::location_type)>
-    make_keyword = {{"var", yy::parser::make_TOK_VAR},
-                    {"if", yy::parser::make_TOK_IF},
-                    {"then", yy::parser::make_TOK_THEN},
-                    {"else", yy::parser::make_TOK_ELSE},
-                    {"end", yy::parser::make_TOK_END},
-                    {"while", yy::parser::make_TOK_WHILE},
-                    {"for", yy::parser::make_TOK_FOR},
-                    {"in", yy::parser::make_TOK_IN},
-                    {"loop", yy::parser::make_TOK_LOOP},
-                    {"exit", yy::parser::make_TOK_EXIT},
-                    {"return", yy::parser::make_TOK_RETURN},
-                    {"print", yy::parser::make_TOK_PRINT},
-                    {"func", yy::parser::make_TOK_FUNC},
-                    {"is", yy::parser::make_TOK_IS},
-                    {"not", yy::parser::make_TOK_NOT},
-                    {"and", yy::parser::make_TOK_AND},
-                    {"or", yy::parser::make_TOK_OR},
-                    {"xor", yy::parser::make_TOK_XOR},
-                    {"none", yy::parser::make_TOK_NONE},
-                    {"int", yy::parser::make_TOK_TYPE_INT},
-                    {"real", yy::parser::make_TOK_TYPE_REAL},
-                    {"bool", yy::parser::make_TOK_TYPE_BOOL},
-                    {"string", yy::parser::make_TOK_TYPE_STRING}};
-
-Lexer::Lexer(std::istream& in) : _input(in) {}
+#include <string_view>
+
+// ── Compile-time scanner tables ───────────────────────────────────────────────
+//
+// Everything below is built by constexpr code, so the lexer itself only does
+// table lookups: one to classify the first byte of a token, a walk over the
+// operator DFA for punctuation, and one perfect-hash probe per identifier.
+
+namespace {
+
+using token = yy::parser::token;
+using Tok   = yy::parser::token::token_kind_type;
+
+// ── Character classes ─────────────────────────────────────────────────────────
+
+enum class CharClass : uint8_t { Other, IdentStart, Digit, Quote };
+
+constexpr std::array<CharClass, 256> char_class = [] {
+    std::array<CharClass, 256> t{};
+    for (int c = 'a'; c <= 'z'; ++c)
+        t[c] = t[c - 'a' + 'A'] = CharClass::IdentStart;
+    t['_'] = CharClass::IdentStart;
+    for (int c = '0'; c <= '9'; ++c)
+        t[c] = CharClass::Digit;
+    t['"'] = t['\''] = CharClass::Quote;
+    return t;
+}();
+
+constexpr CharClass classify(char c) {
+    return char_class[static_cast<unsigned char>(c)];
+}
+
+// ── Operator DFA ──────────────────────────────────────────────────────────────
+//
+// A trie over all operator spellings.  State 0 is the start state; a zero
+// transition means "no edge".  Scanning is maximal munch: the longest prefix
+// that ends in an accepting state wins, and a byte that cannot start an
+// operator (or a lone ':') becomes YYUNDEF.
+
+struct OperatorSpelling {
+    std::string_view text;
+    Tok kind;
+};
+
+constexpr OperatorSpelling operators[] = {
+    {"+", token::TOK_PLUS},     {"-", token::TOK_MINUS},    {"*", token::TOK_STAR},
+    {"/", token::TOK_SLASH},    {"/=", token::TOK_NEQ},     {"(", token::TOK_LPAREN},
+    {")", token::TOK_RPAREN},   {"[", token::TOK_LBRACKET}, {"]", token::TOK_RBRACKET},
+    {"{", token::TOK_LBRACE},   {"}", token::TOK_RBRACE},   {",", token::TOK_COMMA},
+    {";", token::TOK_SEMI},     {".", token::TOK_DOT},      {"..", token::TOK_DOTDOT},
+    {":=", token::TOK_ASSIGN},  {"=", token::TOK_EQ},       {"=>", token::TOK_ARROW},
+    {"<", token::TOK_LT},       {"<=", token::TOK_LE},      {">", token::TOK_GT},
+    {">=", token::TOK_GE},
+};
+
+constexpr size_t kOperatorStates = [] {
+    size_t n = 1;
+    for (const auto& op : operators)
+        n += op.text.size();
+    return n;
+}();
+
+struct OperatorDfa {
+    std::array<std::array<uint8_t, 256>, kOperatorStates> next{};
+    std::array<Tok, kOperatorStates> accept{};
+};
+
+constexpr OperatorDfa operator_dfa = [] {
+    OperatorDfa dfa{};
+    dfa.accept.fill(token::YYUNDEF);
+    size_t states = 1;
+    for (const auto& op : operators) {
+        size_t s = 0;
+        for (char ch : op.text) {
+            auto& edge = dfa.next[s][static_cast<unsigned char>(ch)];
+            if (edge == 0)
+                edge = static_cast<uint8_t>(states++);
+            s = edge;
+        }
+        dfa.accept[s] = op.kind;
+    }
+    return dfa;
+}();
+
+// ── Keywords: perfect hash over (length, first byte, last byte) ─────────────
+
+struct Keyword {
+    std::string_view text;
+    Tok kind;
+};
+
+constexpr Keyword keywords[] = {
+    {"var", token::TOK_VAR},         {"if", token::TOK_IF},
+    {"then", token::TOK_THEN},       {"else", token::TOK_ELSE},
+    {"end", token::TOK_END},         {"while", token::TOK_WHILE},
+    {"for", token::TOK_FOR},         {"in", token::TOK_IN},
+    {"loop", token::TOK_LOOP},       {"exit", token::TOK_EXIT},
+    {"return", token::TOK_RETURN},   {"print", token::TOK_PRINT},
+    {"func", token::TOK_FUNC},       {"is", token::TOK_IS},
+    {"not", token::TOK_NOT},         {"and", token::TOK_AND},
+    {"or", token::TOK_OR},           {"xor", token::TOK_XOR},
+    {"none", token::TOK_NONE},       {"int", token::TOK_TYPE_INT},
+    {"real", token::TOK_TYPE_REAL},  {"bool", token::TOK_TYPE_BOOL},
+    {"string", token::TOK_TYPE_STRING},
+    {"true", token::TOK_TRUE},       {"false", token::TOK_FALSE},
+};
+
+constexpr size_t kKeywordSlots = 128;
+
+constexpr size_t keyword_hash(uint32_t seed, const char* s, size_t n) {
+    // Pack the three features into one word and run it through the murmur3
+    // finaliser so a seed that separates all keywords is found in a few tries.
+    uint32_t x = (static_cast<uint32_t>(n) | static_cast<unsigned char>(s[0]) << 8 |
+                  static_cast<uint32_t>(static_cast<unsigned char>(s[n - 1])) << 16) ^
+                 seed;
+    x ^= x >> 16;
+    x *= 0x85ebca6bu;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35u;
+    x ^= x >> 16;
+    return x % kKeywordSlots;
+}
+
+// Smallest seed for which no two keywords share a slot.
+constexpr uint32_t keyword_seed = [] {
+    for (uint32_t seed = 0; seed < 100000; ++seed) {
+        std::array<bool, kKeywordSlots> used{};
+        bool ok = true;
+        for (const auto& kw : keywords) {
+            const size_t h = keyword_hash(seed, kw.text.data(), kw.text.size());
+            if (used[h]) {
+                ok = false;
+                break;
+            }
+            used[h] = true;
+        }
+        if (ok)
+            return seed;
+    }
+    return ~0u;
+}();
+static_assert(keyword_seed != ~0u, "no collision-free keyword hash seed found");
+
+constexpr std::array<Keyword, kKeywordSlots> keyword_table = [] {
+    std::array<Keyword, kKeywordSlots> t{};
+    for (const auto& kw : keywords)
+        t[keyword_hash(keyword_seed, kw.text.data(), kw.text.size())] = kw;
+    return t;
+}();
+
+// Keyword kind for [s, s + n), or TOK_IDENT.  Never allocates.
+inline Tok keyword_kind(const char* s, size_t n) {
+    const Keyword& kw = keyword_table[keyword_hash(keyword_seed, s, n)];
+    if (kw.text.size() == n && std::memcmp(kw.text.data(), s, n) == 0)
+        return kw.kind;
+    return token::TOK_IDENT;
+}
+
+} // namespace
+
+Lexer::Lexer(std::istream& in)
+    : _buffer(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()),
+      _cur(_buffer.data()),
+      _end(_buffer.data() + _buffer.size()) {}
+
+Lexer::Lexer(std::string source)
+    : _buffer(std::move(source)),
+      _cur(_buffer.data()),
+      _end(_buffer.data() + _buffer.size()) {}
+
+Lexer::~Lexer() = default;
+
+void Lexer::enable_pipeline() {
+    assert(!_pipeline && _cur == _buffer.data());
+    _pipeline = std::make_unique<TokenPipeline>(std::move(_buffer));
+    _cur = _end = nullptr;
+}
 
 char Lexer::getch() {
-    char c = _input.get();
+    if (_cur == _end) {
+        next_col();
+        return EOF;
+    }
+    char c = *_cur++;
     if (c == '\n') {
         next_line();
     } else {
@@ -47,47 +203,26 @@ char Lexer::getch() {
     return c;
 }
 
-void Lexer::ungetch(char c) {
-    if (c == '\n') {
-        prev_line();
-    } else {
-        prev_col();
-    }
-
-    if (c != EOF) {
-        _input.putback(c);
-    }
-}
-
 void Lexer::next_line() {
     _end_location.line++;
     _end_location.column = 1;
-
-    if (_line_size.size() <= (size_t)_end_location.line) {
-        assert(_line_size.size() == (size_t)_end_location.line);
-
-        _line_size.push_back(1);
-    }
 }
 
 void Lexer::next_col() {
-    assert((size_t)_end_location.line < _line_size.size());
     _end_location.column++;
-
-    int& line_size = _line_size[_end_location.line];
-    line_size      = std::max(line_size, _end_location.column);
 }
 
-void Lexer::prev_line() {
-    assert(_end_location.line > 1 && (size_t)_end_location.line < _line_size.size());
-
-    _end_location.line--;
-    _end_location.column = _line_size[_end_location.line];
-}
+void Lexer::advance(const char* to) {
+    assert(_cur <= to && to <= _end);
 
-void Lexer::prev_col() {
-    assert(_end_location.column > 0);
-    _end_location.column--;
+    if (const size_t lines = scan::count_newlines(_cur, to)) {
+        const char* nl = scan::find_last_newline(_cur, to);
+        _end_location.line += static_cast<int>(lines);
+        _end_location.column = static_cast<int>(to - nl);
+    } else {
+        _end_location.column += static_cast<int>(to - _cur);
+    }
+    _cur = to;
 }
 
 yy::position Lexer::begin_location() const {
@@ -107,222 +242,149 @@ yy::parser::location_type Lexer::seal() {
 }
 
 yy::parser::symbol_type Lexer::next() {
-    _begin_location = _end_location;
+    if (_pipeline) {
+        yy::parser::symbol_type sym = _pipeline->next();
+        _token_location             = sym.location;
+        _begin_location             = sym.location.begin;
+        _end_location               = sym.location.end;
+        return sym;
+    }
+    return scan();
+}
 
-    int c;
+yy::parser::symbol_type Lexer::scan() {
+    _begin_location = _end_location;
 
     /* Skip whitespace and commentaries */
-    while ((c = getch()) != EOF) {
-        if (c == '/') {
-            if ((c = getch()) == '/') {
-                // find comment, move cursor to next line or EOF
-                do {
-                    c = getch();
-                } while (c != '\n' && c != EOF);
-            } else {
-                // rollback, assume '/' is a part of token
-                ungetch(c);
-                c = '/';
-            }
-        }
-        if (!isspace(c)) {
+    while (true) {
+        advance(scan::skip_space(_cur, _end));
+        _begin_location = _end_location;
+
+        if (_end - _cur < 2 || _cur[0] != '/' || _cur[1] != '/')
+            break;
+
+        // find comment, move cursor past the next line break or to EOF
+        const char* nl = scan::find(_cur + 2, _end, '\n');
+        if (nl == _end) {
+            // the token at EOF keeps the location of the comment start
+            advance(_end);
             break;
         }
-        _begin_location = _end_location;
+        advance(nl + 1);
     }
 
-    if (c == EOF)
+    if (_cur == _end) {
+        next_col();
         return yy::parser::make_YYEOF(seal());
+    }
 
+    switch (classify(*_cur)) {
     /* ---------- IDENTIFIERS / KEYWORDS ---------- */
-    if (isalpha(c) || c == '_') {
-        std::string text;
-        text += (char)c;
-
-        while (true) {
-            c = getch();
-            if (isalnum(c) || c == '_')
-                text += (char)c;
-            else {
-                ungetch(c);
-                break;
-            }
-        }
-
-        if (text == "true") {
+    case CharClass::IdentStart: {
+        const char* start = _cur;
+        advance(scan::skip_ident(_cur + 1, _end));
+        const size_t len = _cur - start;
+
+        switch (const Tok kind = keyword_kind(start, len)) {
+        case token::TOK_IDENT:
+            return yy::parser::make_TOK_IDENT(std::string(start, len), seal());
+        case token::TOK_TRUE:
             return yy::parser::make_TOK_TRUE(1, seal());
-        }
-        if (text == "false") {
+        case token::TOK_FALSE:
             return yy::parser::make_TOK_FALSE(0, seal());
+        default:
+            return yy::parser::symbol_type(kind, seal());
         }
-
-        auto it = make_keyword.find(text);
-        if (it != make_keyword.end()) {
-            return it->second(seal());
-        }
-
-        return yy::parser::make_TOK_IDENT(text, seal());
     }
 
-    /* ---------- NUMBERS ---------- */
-    if (isdigit(c)) {
-        std::string num;
-        bool isReal = false;
-
-        num += (char)c;
-
-        while (true) {
-            c = getch();
-
-            if (isdigit(c)) {
-                num += (char)c;
-            } else if (c == '.') {
-                /* Could be real or ".." */
-                int next = getch();
-                if (next == '.') {
-                    /* integer followed by ".." */
-                    ungetch(next);
-                    ungetch('.');
-                    break;
-                } else {
-                    isReal = true;
-                    num += '.';
-                    ungetch(next);
-                }
-            } else {
-                ungetch(c);
-                break;
-            }
-        }
-
-        if (isReal) {
-            return yy::parser::make_TOK_REAL(std::stod(num), seal());
-        } else {
-            return yy::parser::make_TOK_INTEGER(std::stoll(num), seal());
-        }
-    }
+    case CharClass::Digit:
+        return scan_number();
 
-    /* ---------- STRING ---------- */
-    if (c == '"' || c == '\'') {
-        char quote = c;
-        std::string str;
+    case CharClass::Quote:
+        return scan_string();
 
-        while (true) {
-            c = getch();
-            if (c == EOF || c == quote)
-                break;
+    /* ---------- OPERATORS / PUNCTUATION ---------- */
+    case CharClass::Other:
+        break;
+    }
 
-            if (c == '\\') {
-                int next = getch();
-                switch (next) {
-                case 'n':
-                    str += '\n';
-                    break;
-                case 't':
-                    str += '\t';
-                    break;
-                case '"':
-                    str += '"';
-                    break;
-                case '\'':
-                    str += '\'';
-                    break;
-                case '\\':
-                    str += '\\';
-                    break;
-                default:
-                    str += next;
-                    break;
-                }
-            } else {
-                str += (char)c;
-            }
+    const char* p     = _cur;
+    const char* match = _cur + 1; // unknown bytes are consumed one at a time
+    Tok kind          = token::YYUNDEF;
+    for (uint8_t s = 0; p != _end;) {
+        s = operator_dfa.next[s][static_cast<unsigned char>(*p++)];
+        if (s == 0)
+            break;
+        if (operator_dfa.accept[s] != token::YYUNDEF) {
+            kind  = operator_dfa.accept[s];
+            match = p;
         }
-
-        return yy::parser::make_TOK_STRING(str, seal());
     }
+    advance(match);
+    return yy::parser::symbol_type(kind, seal());
+}
 
-    /* ---------- OPERATORS / PUNCTUATION ---------- */
-
-    switch (c) {
-    case '+':
-        return yy::parser::make_TOK_PLUS(seal());
-    case '-':
-        return yy::parser::make_TOK_MINUS(seal());
-
-    case '*':
-        return yy::parser::make_TOK_STAR(seal());
-    case '/': {
-        int n = getch();
-        if (n == '=')
-            return yy::parser::make_TOK_NEQ(seal());
-        if (n == '/') {
-            while ((c = getch()) != '\n')
-                ;
+yy::parser::symbol_type Lexer::scan_number() {
+    const char* p = _cur;
+    bool is_real  = false;
+
+    while (p != _end) {
+        if (classify(*p) == CharClass::Digit) {
+            ++p;
+        } else if (*p == '.' && (_end - p < 2 || p[1] != '.')) {
+            /* a '.' not followed by another '.' makes it real; ".." is a range */
+            is_real = true;
+            ++p;
+        } else {
+            break;
         }
-        ungetch(n);
-        return yy::parser::make_TOK_SLASH(seal());
     }
 
-    case '(':
-        return yy::parser::make_TOK_LPAREN(seal());
-    case ')':
-        return yy::parser::make_TOK_RPAREN(seal());
-
-    case '[':
-        return yy::parser::make_TOK_LBRACKET(seal());
-    case ']':
-        return yy::parser::make_TOK_RBRACKET(seal());
-
-    case '{':
-        return yy::parser::make_TOK_LBRACE(seal());
-    case '}':
-        return yy::parser::make_TOK_RBRACE(seal());
-
-    case ',':
-        return yy::parser::make_TOK_COMMA(seal());
-    case ';':
-        return yy::parser::make_TOK_SEMI(seal());
-    case '.': {
-        int n = getch();
-        if (n == '.')
-            return yy::parser::make_TOK_DOTDOT(seal());
-        ungetch(n);
-        return yy::parser::make_TOK_DOT(seal());
-    }
+    const std::string num(_cur, p);
+    advance(p);
 
-    case ':': {
-        int n = getch();
-        if (n == '=')
-            return yy::parser::make_TOK_ASSIGN(seal());
-        ungetch(n);
-        break;
+    if (is_real) {
+        return yy::parser::make_TOK_REAL(std::stod(num), seal());
     }
+    return yy::parser::make_TOK_INTEGER(std::stoll(num), seal());
+}
 
-    case '=': {
-        int n = getch();
-        if (n == '>')
-            return yy::parser::make_TOK_ARROW(seal());
-        ungetch(n);
-        return yy::parser::make_TOK_EQ(seal());
-    }
+yy::parser::symbol_type Lexer::scan_string() {
+    const char quote = getch();
+    std::string str;
 
-    case '<': {
-        int n = getch();
-        if (n == '=')
-            return yy::parser::make_TOK_LE(seal());
-        ungetch(n);
-        return yy::parser::make_TOK_LT(seal());
-    }
+    while (true) {
+        const char* stop = scan::find_either(_cur, _end, quote, '\\');
+        str.append(_cur, stop);
+        advance(stop);
 
-    case '>': {
-        int n = getch();
-        if (n == '=')
-            return yy::parser::make_TOK_GE(seal());
-        ungetch(n);
-        return yy::parser::make_TOK_GT(seal());
-    }
+        const int c = getch();
+        if (c == EOF || c == quote)
+            break;
+
+        // c == '\\'
+        const int next = getch();
+        switch (next) {
+        case 'n':
+            str += '\n';
+            break;
+        case 't':
+            str += '\t';
+            break;
+        case '"':
+            str += '"';
+            break;
+        case '\'':
+            str += '\'';
+            break;
+        case '\\':
+            str += '\\';
+            break;
+        default:
+            str += next;
+            break;
+        }
     }
 
-    return yy::parser::make_YYUNDEF(seal());
+    return yy::parser::make_TOK_STRING(str, seal());
 }
@@ -2,16 +2,30 @@
 
 #include "parser.tab.hpp"
 
-#include <cstdint>
 #include <istream>
+#include <memory>
 #include <string>
 
+class TokenPipeline;
+
+// Hand-written scanner for D.  The whole input is read into memory up front so
+// that whitespace, comments, identifiers and string bodies can be consumed in
+// bulk by the kernels in scan.hpp instead of one `getch()` at a time.
 class Lexer {
 public:
     Lexer(std::istream& input);
+    explicit Lexer(std::string source);
+    ~Lexer();
 
     yy::parser::symbol_type next();
 
+    /**
+     * Move scanning to a worker thread that runs ahead of the caller, so that
+     * lexing overlaps with parsing.  Must be called before the first next();
+     * tokens and locations are identical to the synchronous mode.
+     */
+    void enable_pipeline();
+
     /**
      * Returns `yy::position` where last returned token starts
      */
@@ -28,21 +42,28 @@ public:
     yy::parser::location_type token_location() const;
 
 private:
-    std::istream& _input;
+    std::string _buffer;
+    const char* _cur;
+    const char* _end;
 
-    std::vector<int> _line_size  = {INT32_MIN, 0};
     yy::position _begin_location = yy::position(nullptr, 1, 1);
     yy::position _end_location   = yy::position(nullptr, 1, 1);
     yy::parser::location_type _token_location;
 
+    std::unique_ptr<TokenPipeline> _pipeline;
+
     void next_line();
     void next_col();
-    void prev_line();
-    void prev_col();
+
+    /* Move the cursor to `to`, updating the end location for every newline passed. */
+    void advance(const char* to);
 
     /* Snapshot current begin/end into _token_location and return it. */
     yy::parser::location_type seal();
 
     char getch();
-    void ungetch(char c);
+
+    yy::parser::symbol_type scan();
+    yy::parser::symbol_type scan_number();
+    yy::parser::symbol_type scan_string();
 };
@@ -0,0 +1,698 @@
+#include "optimizer.hpp"
+
+#include <algorithm>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Integer arithmetic as the interpreter performs it, without signed overflow.
+long long wrap_add(long long a, long long b) {
+    return static_cast<long long>(static_cast<unsigned long long>(a) +
+                                  static_cast<unsigned long long>(b));
+}
+long long wrap_mul(long long a, long long b) {
+    return static_cast<long long>(static_cast<unsigned long long>(a) *
+                                  static_cast<unsigned long long>(b));
+}
+
+// scale * iter + offset, if n has that form.
+std::optional<Affine> affine(const ASTNode& n, const std::string& iter) {
+    using Op = BinOpNode::Op;
+    switch (n.kind) {
+    case NodeKind::Ident:
+        if (static_cast<const IdentNode&>(n).ident_name == iter)
+            return Affine{1, 0};
+        return std::nullopt;
+    case NodeKind::IntLit:
+        return Affine{0, static_cast<const IntLitNode&>(n).value};
+    case NodeKind::UnaryOp: {
+        const auto& u = static_cast<const UnaryOpNode&>(n);
+        auto a        = affine(*u.operand, iter);
+        if (!a || u.op == UnaryOpNode::Op::NOT)
+            return std::nullopt;
+        if (u.op == UnaryOpNode::Op::UMINUS)
+            return Affine{wrap_mul(a->scale, -1), wrap_mul(a->offset, -1)};
+        return a;
+    }
+    case NodeKind::BinOp: {
+        const auto& b = static_cast<const BinOpNode&>(n);
+        if (b.op != Op::ADD && b.op != Op::SUB && b.op != Op::MUL)
+            return std::nullopt;
+        auto l = affine(*b.left, iter);
+        auto r = affine(*b.right, iter);
+        if (!l || !r)
+            return std::nullopt;
+        if (b.op == Op::ADD)
+            return Affine{wrap_add(l->scale, r->scale), wrap_add(l->offset, r->offset)};
+        if (b.op == Op::SUB)
+            return Affine{wrap_add(l->scale, wrap_mul(r->scale, -1)),
+                          wrap_add(l->offset, wrap_mul(r->offset, -1))};
+        if (l->scale != 0 && r->scale != 0)
+            return std::nullopt; // quadratic
+        const Affine& var = l->scale != 0 ? *l : *r;
+        const long long c = l->scale != 0 ? r->offset : l->offset;
+        return Affine{wrap_mul(var.scale, c), wrap_mul(var.offset, c)};
+    }
+    default:
+        return std::nullopt;
+    }
+}
+
+// Kinds worth caching: anything that does work beyond a single read.
+bool hoistable(NodeKind k) {
+    switch (k) {
+    case NodeKind::BinOp:
+    case NodeKind::UnaryOp:
+    case NodeKind::Is:
+    case NodeKind::Index:
+    case NodeKind::DotField:
+    case NodeKind::DotInt:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Names declared or assigned with `:=` under n, and whether n contains a call
+// or an element/field store.
+void collect_writes(ASTNode& n, std::unordered_set<std::string>& names, bool& calls,
+                    bool& stores) {
+    switch (n.kind) {
+    case NodeKind::Assign:
+        if (const auto* id = node_cast<IdentNode>(static_cast<AssignNode&>(n).lhs.get()))
+            names.insert(id->ident_name);
+        else
+            stores = true;
+        break;
+    case NodeKind::VarDef:
+        names.insert(static_cast<VarDefNode&>(n).varname);
+        break;
+    case NodeKind::ForRange:
+        names.insert(static_cast<ForRangeNode&>(n).iter);
+        break;
+    case NodeKind::ForIter:
+        names.insert(static_cast<ForIterNode&>(n).iter);
+        break;
+    case NodeKind::ParamList:
+        for (const auto& p : static_cast<ParamListNode&>(n).params)
+            names.insert(static_cast<const IdentNode&>(*p).ident_name);
+        break;
+    case NodeKind::Call:
+        calls = true;
+        break;
+    default:
+        break;
+    }
+    for_each_child(n, [&](std::unique_ptr<ASTNode>& c) {
+        collect_writes(*c, names, calls, stores);
+    });
+}
+
+// Names assigned with `:=` anywhere under n.
+void collect_assigned(ASTNode& n, std::unordered_set<std::string>& names) {
+    if (n.kind == NodeKind::Assign)
+        if (const auto* id = node_cast<IdentNode>(static_cast<AssignNode&>(n).lhs.get()))
+            names.insert(id->ident_name);
+    for_each_child(n, [&](std::unique_ptr<ASTNode>& c) { collect_assigned(*c, names); });
+}
+
+// Whether n is an expression the inliner may copy: no calls, no function
+// literals, and with at most `budget` nodes counting those already in `size`.
+bool copyable(const ASTNode& n, size_t& size, size_t budget) {
+    switch (n.kind) {
+    case NodeKind::IntLit:
+    case NodeKind::RealLit:
+    case NodeKind::StrLit:
+    case NodeKind::BoolLit:
+    case NodeKind::NoneLit:
+    case NodeKind::Type:
+    case NodeKind::Ident:
+    case NodeKind::BinOp:
+    case NodeKind::UnaryOp:
+    case NodeKind::Is:
+    case NodeKind::Index:
+    case NodeKind::DotField:
+    case NodeKind::DotInt:
+    case NodeKind::ArrayLit:
+    case NodeKind::TupleLit:
+    case NodeKind::TupleElem:
+        break;
+    default:
+        return false;
+    }
+    if (++size > budget)
+        return false;
+    bool ok = true;
+    for_each_child(n, [&](const std::unique_ptr<ASTNode>& c) {
+        ok = ok && copyable(*c, size, budget);
+    });
+    return ok;
+}
+
+// An argument that cannot fail or have an effect, so evaluating it later, more
+// than once or not at all changes nothing.
+bool atomic(const ASTNode& n) {
+    switch (n.kind) {
+    case NodeKind::IntLit:
+    case NodeKind::RealLit:
+    case NodeKind::StrLit:
+    case NodeKind::BoolLit:
+    case NodeKind::NoneLit:
+    case NodeKind::Ident:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool makes_call(const ASTNode& n) {
+    bool found = n.kind == NodeKind::Call;
+    for_each_child(n, [&](const std::unique_ptr<ASTNode>& c) { found = found || makes_call(*c); });
+    return found;
+}
+
+// The leaf evaluated first when n is: children are evaluated in the order
+// for_each_child visits them.
+const ASTNode& first_evaluated(const ASTNode& n) {
+    const ASTNode* first = nullptr;
+    for_each_child(n, [&](const std::unique_ptr<ASTNode>& c) {
+        if (!first)
+            first = c.get();
+    });
+    return first ? first_evaluated(*first) : n;
+}
+
+void collect_idents(const ASTNode& n, std::vector<const IdentNode*>& out) {
+    if (const auto* id = node_cast<IdentNode>(&n))
+        out.push_back(id);
+    for_each_child(n, [&](const std::unique_ptr<ASTNode>& c) { collect_idents(*c, out); });
+}
+
+// Deep copy of a subtree, annotations included; type feedback starts afresh.
+class Cloner final : public ASTVisitorBase<Cloner> {
+public:
+    std::unique_ptr<ASTNode> clone(const ASTNode& n) {
+        auto parent = std::move(out_); // copies of children nest inside the parent's visit
+        dispatch(n);
+        auto c = std::move(out_);
+        out_   = std::move(parent);
+        return c;
+    }
+
+    void visit(const ProgramNode& n) override { list(n, &ProgramNode::stmts); }
+    void visit(const BodyNode& n) override {
+        auto c       = list(n, &BodyNode::stmts);
+        c->has_frame = n.has_frame;
+    }
+    void visit(const VarDeclNode& n) override { list(n, &VarDeclNode::defs); }
+    void visit(const VarDefNode& n) override {
+        auto c      = make(n);
+        c->varname  = n.varname;
+        c->init     = opt(n.init);
+        c->captured = n.captured;
+    }
+    void visit(const AssignNode& n) override {
+        auto c = make(n);
+        c->lhs = clone(*n.lhs);
+        c->rhs = clone(*n.rhs);
+    }
+    void visit(const IfNode& n) override {
+        auto c       = make(n);
+        c->cond      = clone(*n.cond);
+        c->then_body = clone(*n.then_body);
+        c->else_body = opt(n.else_body);
+    }
+    void visit(const IfShortNode& n) override {
+        auto c  = make(n);
+        c->cond = clone(*n.cond);
+        c->stmt = clone(*n.stmt);
+    }
+    void visit(const WhileNode& n) override {
+        auto c  = make(n);
+        c->cond = clone(*n.cond);
+        c->body = clone(*n.body);
+        c->opt  = n.opt;
+    }
+    void visit(const ForRangeNode& n) override {
+        auto c      = make(n);
+        c->iter     = n.iter;
+        c->from     = clone(*n.from);
+        c->to       = clone(*n.to);
+        c->body     = clone(*n.body);
+        c->opt      = n.opt;
+        c->captured = n.captured;
+    }
+    void visit(const ForIterNode& n) override {
+        auto c          = make(n);
+        c->iter         = n.iter;
+        c->iterable     = clone(*n.iterable);
+        c->body         = clone(*n.body);
+        c->opt          = n.opt;
+        c->captured     = n.captured;
+        c->reads_fields = n.reads_fields;
+    }
+    void visit(const LoopInfNode& n) override {
+        auto c  = make(n);
+        c->body = clone(*n.body);
+        c->opt  = n.opt;
+    }
+    void visit(const ExitNode& n) override { make(n); }
+    void visit(const ReturnNode& n) override { make(n)->value = opt(n.value); }
+    void visit(const PrintNode& n) override { list(n, &PrintNode::exprs); }
+    void visit(const BinOpNode& n) override {
+        auto c   = make(n, n.op);
+        c->left  = clone(*n.left);
+        c->right = clone(*n.right);
+    }
+    void visit(const UnaryOpNode& n) override { make(n, n.op)->operand = clone(*n.operand); }
+    void visit(const IsNode& n) override {
+        auto c       = make(n);
+        c->operand   = clone(*n.operand);
+        c->type_node = clone(*n.type_node);
+    }
+    void visit(const IdentNode& n) override {
+        auto c            = make(n, n.ident_name);
+        c->resolved_depth = n.resolved_depth;
+        c->captured       = n.captured;
+    }
+    void visit(const IndexNode& n) override {
+        auto c        = make(n);
+        c->base       = clone(*n.base);
+        c->index_expr = clone(*n.index_expr);
+    }
+    void visit(const CallNode& n) override {
+        auto c    = make(n);
+        c->callee = clone(*n.callee);
+        c->args   = clones(n.args);
+    }
+    void visit(const DotFieldNode& n) override {
+        auto c   = make(n);
+        c->field = n.field;
+        c->base  = clone(*n.base);
+    }
+    void visit(const DotIntNode& n) override { make(n, n.index)->base = clone(*n.base); }
+    void visit(const IntLitNode& n) override { make(n, n.value); }
+    void visit(const RealLitNode& n) override { make(n, n.value); }
+    void visit(const StrLitNode& n) override { make(n, n.value); }
+    void visit(const BoolLitNode& n) override { make(n, n.value); }
+    void visit(const NoneLitNode& n) override { make(n); }
+    void visit(const ArrayLitNode& n) override { list(n, &ArrayLitNode::elems); }
+    void visit(const TupleLitNode& n) override { list(n, &TupleLitNode::elems); }
+    void visit(const TupleElemNode& n) override {
+        auto c       = make(n);
+        c->elem_name = n.elem_name;
+        c->expr      = clone(*n.expr);
+    }
+    void visit(const ParamListNode& n) override { list(n, &ParamListNode::params); }
+    void visit(const FuncLitNode& n) override {
+        auto c       = make(n);
+        c->params    = opt(n.params);
+        c->body      = clone(*n.body);
+        c->free_vars = n.free_vars;
+    }
+    void visit(const TypeNode& n) override { make(n, n.type); }
+    void visit(const InvariantNode& n) override { make(n, n.slot)->expr = clone(*n.expr); }
+    void visit(const InductionNode& n) override {
+        make(n, n.slot, n.form)->expr = clone(*n.expr);
+    }
+
+private:
+    std::unique_ptr<ASTNode> out_;
+
+    // Makes the copy of `n` the result, from the node-specific constructor
+    // arguments, and returns it for the rest to be filled in.
+    template <class T, class... Args>
+    T* make(const T& n, Args&&... args) {
+        auto c = std::make_unique<T>(std::forward<Args>(args)..., n.loc);
+        T* raw = c.get();
+        out_   = std::move(c);
+        return raw;
+    }
+
+    std::unique_ptr<ASTNode> opt(const std::unique_ptr<ASTNode>& n) {
+        return n ? clone(*n) : nullptr;
+    }
+
+    std::vector<std::unique_ptr<ASTNode>> clones(const std::vector<std::unique_ptr<ASTNode>>& v) {
+        std::vector<std::unique_ptr<ASTNode>> out;
+        out.reserve(v.size());
+        for (const auto& c : v)
+            out.push_back(clone(*c));
+        return out;
+    }
+
+    template <class T>
+    T* list(const T& n, std::vector<std::unique_ptr<ASTNode>> T::*member) {
+        auto items = clones(n.*member);
+        T* c       = make(n);
+        c->*member = std::move(items);
+        return c;
+    }
+};
+
+std::unique_ptr<ASTNode> clone(const ASTNode& n) {
+    return Cloner{}.clone(n);
+}
+
+// Replaces the parameters in a copy of an inlined expression with the call's
+// arguments: moved in where used once, copied where used more often.
+void substitute(std::unique_ptr<ASTNode>& slot, const std::vector<std::string>& params,
+                const std::vector<int>& uses, std::vector<std::unique_ptr<ASTNode>>& args) {
+    if (const auto* id = node_cast<IdentNode>(slot.get())) {
+        const auto p = std::ranges::find(params, id->ident_name);
+        if (p != params.end()) {
+            const auto i = p - params.begin();
+            slot         = uses[i] == 1 ? std::move(args[i]) : clone(*args[i]);
+        }
+        return;
+    }
+    for_each_child(*slot, [&](std::unique_ptr<ASTNode>& c) { substitute(c, params, uses, args); });
+}
+
+} // namespace
+
+// ── Analysis ──────────────────────────────────────────────────────────────────
+
+bool Optimizer::invariant(const ASTNode& n, const LoopFacts& facts) const {
+    switch (n.kind) {
+    case NodeKind::IntLit:
+    case NodeKind::RealLit:
+    case NodeKind::StrLit:
+    case NodeKind::BoolLit:
+    case NodeKind::NoneLit:
+    case NodeKind::Type:
+        return true;
+    case NodeKind::Ident: {
+        const std::string& name = static_cast<const IdentNode&>(n).ident_name;
+        return !facts.written.contains(name) && !(facts.calls && assigned_.contains(name));
+    }
+    case NodeKind::BinOp: {
+        const auto& b = static_cast<const BinOpNode&>(n);
+        return invariant(*b.left, facts) && invariant(*b.right, facts);
+    }
+    case NodeKind::UnaryOp:
+        return invariant(*static_cast<const UnaryOpNode&>(n).operand, facts);
+    case NodeKind::Is:
+        return invariant(*static_cast<const IsNode&>(n).operand, facts);
+    case NodeKind::Index: {
+        const auto& i = static_cast<const IndexNode&>(n);
+        return !facts.calls && !facts.stores && invariant(*i.base, facts) &&
+               invariant(*i.index_expr, facts);
+    }
+    case NodeKind::DotField:
+        return !facts.calls && !facts.stores &&
+               invariant(*static_cast<const DotFieldNode&>(n).base, facts);
+    case NodeKind::DotInt:
+        return !facts.calls && !facts.stores &&
+               invariant(*static_cast<const DotIntNode&>(n).base, facts);
+    default:
+        return false;
+    }
+}
+
+// ── Rewriting ─────────────────────────────────────────────────────────────────
+
+void Optimizer::optimize(ASTNode& root) {
+    collect_assigned(root, assigned_);
+    walk(root);
+}
+
+void Optimizer::walk(ASTNode& n) {
+    switch (n.kind) {
+    case NodeKind::While:
+    case NodeKind::ForRange:
+    case NodeKind::ForIter:
+    case NodeKind::LoopInf:
+        optimize_loop(n);
+        break;
+    default:
+        break;
+    }
+    for_each_child(n, [this](std::unique_ptr<ASTNode>& c) { walk(*c); });
+}
+
+void Optimizer::optimize_loop(ASTNode& loop) {
+    // The parts of the loop that run on every iteration.
+    std::vector<std::unique_ptr<ASTNode>*> parts;
+    LoopInfo* info          = nullptr;
+    const std::string* iter = nullptr;
+    switch (loop.kind) {
+    case NodeKind::While: {
+        auto& w = static_cast<WhileNode&>(loop);
+        parts   = {&w.cond, &w.body};
+        info    = &w.opt;
+        break;
+    }
+    case NodeKind::ForRange: {
+        auto& r = static_cast<ForRangeNode&>(loop);
+        parts   = {&r.body};
+        info    = &r.opt;
+        iter    = &r.iter;
+        break;
+    }
+    case NodeKind::ForIter: {
+        auto& r = static_cast<ForIterNode&>(loop);
+        parts   = {&r.body};
+        info    = &r.opt;
+        iter    = &r.iter;
+        break;
+    }
+    default: {
+        auto& l = static_cast<LoopInfNode&>(loop);
+        parts   = {&l.body};
+        info    = &l.opt;
+        break;
+    }
+    }
+
+    LoopFacts facts;
+    for (auto* p : parts)
+        collect_writes(**p, facts.written, facts.calls, facts.stores);
+
+    info->first_induction = next_induction_;
+    if (loop.kind == NodeKind::ForRange && !iter->empty() && !facts.written.contains(*iter))
+        for (auto* p : parts)
+            induct(*p, *iter, *info);
+
+    // The iterator itself changes every step.
+    if (iter && !iter->empty())
+        facts.written.insert(*iter);
+
+    info->first_invariant = next_invariant_;
+    for (auto* p : parts)
+        hoist(*p, facts, *info);
+
+    if (info->invariants > 0 || !info->inductions.empty())
+        info->id = ++loops_;
+}
+
+void Optimizer::hoist(std::unique_ptr<ASTNode>& slot, const LoopFacts& facts, LoopInfo& info) {
+    ASTNode& n = *slot;
+    switch (n.kind) {
+    case NodeKind::FuncLit:
+    case NodeKind::Invariant:
+    case NodeKind::Induction:
+        return;
+    case NodeKind::Assign: {
+        // The target itself is not a value; only its subexpressions are.
+        auto& a = static_cast<AssignNode&>(n);
+        hoist(a.rhs, facts, info);
+        for_each_child(*a.lhs, [&](std::unique_ptr<ASTNode>& c) { hoist(c, facts, info); });
+        return;
+    }
+    default:
+        break;
+    }
+    if (hoistable(n.kind) && invariant(n, facts)) {
+        auto wrapped  = std::make_unique<InvariantNode>(next_invariant_++, n.loc);
+        wrapped->expr = std::move(slot);
+        slot          = std::move(wrapped);
+        ++info.invariants;
+        return;
+    }
+    for_each_child(n, [&](std::unique_ptr<ASTNode>& c) { hoist(c, facts, info); });
+}
+
+void Optimizer::induct(std::unique_ptr<ASTNode>& slot, const std::string& iter, LoopInfo& info) {
+    ASTNode& n = *slot;
+    switch (n.kind) {
+    case NodeKind::FuncLit:
+    case NodeKind::Invariant:
+    case NodeKind::Induction:
+        return;
+    case NodeKind::Assign: {
+        auto& a = static_cast<AssignNode&>(n);
+        induct(a.rhs, iter, info);
+        for_each_child(*a.lhs, [&](std::unique_ptr<ASTNode>& c) { induct(c, iter, info); });
+        return;
+    }
+    case NodeKind::BinOp:
+    case NodeKind::UnaryOp:
+        if (const auto form = affine(n, iter); form && form->scale != 0) {
+            auto wrapped  = std::make_unique<InductionNode>(next_induction_++, *form, n.loc);
+            wrapped->expr = std::move(slot);
+            slot          = std::move(wrapped);
+            info.inductions.push_back(*form);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+    for_each_child(n, [&](std::unique_ptr<ASTNode>& c) { induct(c, iter, info); });
+}
+
+// ── Inlining ──────────────────────────────────────────────────────────────────
+
+size_t Optimizer::inline_calls(ASTNode& root) {
+    collect_assigned(root, assigned_);
+    scopes_.emplace_back();
+    for_each_child(root, [this](std::unique_ptr<ASTNode>& c) { inline_walk(c); });
+    scopes_.clear();
+    inlinable_.clear();
+    return inlined_;
+}
+
+// Tracks declarations as SemanticAnalyzer does and inlines calls bottom-up, so
+// that a call in an argument is inlined before the call it is passed to.
+void Optimizer::inline_walk(std::unique_ptr<ASTNode>& slot) {
+    ASTNode& n = *slot;
+    auto children = [&](ASTNode& p) {
+        for_each_child(p, [this](std::unique_ptr<ASTNode>& c) { inline_walk(c); });
+    };
+    switch (n.kind) {
+    case NodeKind::Body:
+        scopes_.emplace_back();
+        children(n);
+        scopes_.pop_back();
+        return;
+    case NodeKind::VarDef: {
+        // A function literal may refer to the variable it initializes.
+        auto& d         = static_cast<VarDefNode&>(n);
+        const bool func = d.init && d.init->kind == NodeKind::FuncLit;
+        if (func) {
+            scopes_.back()[d.varname] = &d;
+            consider(d);
+        }
+        children(n);
+        if (!func)
+            scopes_.back()[d.varname] = &d;
+        return;
+    }
+    case NodeKind::ForRange: {
+        auto& r = static_cast<ForRangeNode&>(n);
+        inline_walk(r.from);
+        inline_walk(r.to);
+        scopes_.emplace_back();
+        if (!r.iter.empty())
+            scopes_.back()[r.iter] = &r;
+        inline_walk(r.body);
+        scopes_.pop_back();
+        return;
+    }
+    case NodeKind::ForIter: {
+        auto& r = static_cast<ForIterNode&>(n);
+        inline_walk(r.iterable);
+        scopes_.emplace_back();
+        if (!r.iter.empty())
+            scopes_.back()[r.iter] = &r;
+        inline_walk(r.body);
+        scopes_.pop_back();
+        return;
+    }
+    case NodeKind::FuncLit: {
+        auto& fn = static_cast<FuncLitNode&>(n);
+        scopes_.emplace_back();
+        if (fn.params)
+            for (const auto& p : static_cast<const ParamListNode&>(*fn.params).params)
+                scopes_.back()[static_cast<const IdentNode&>(*p).ident_name] = p.get();
+        inline_walk(fn.body);
+        scopes_.pop_back();
+        return;
+    }
+    case NodeKind::Call:
+        children(n);
+        try_inline(slot);
+        return;
+    default:
+        children(n);
+        return;
+    }
+}
+
+const ASTNode* Optimizer::declaration(const std::string& name) const {
+    for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it)
+        if (auto jt = it->find(name); jt != it->end())
+            return jt->second;
+    return nullptr;
+}
+
+// Records `def` as inlinable if it binds a function literal that only returns
+// a small expression.  Runs where `def` is declared, which is where the names
+// in the expression are resolved.
+void Optimizer::consider(const VarDefNode& def) {
+    const auto& fn = static_cast<const FuncLitNode&>(*def.init);
+    if (assigned_.contains(def.varname))
+        return;
+    const auto& body = static_cast<const BodyNode&>(*fn.body);
+    if (body.stmts.size() != 1)
+        return;
+    const auto* ret = node_cast<ReturnNode>(body.stmts.front().get());
+    size_t size     = 0;
+    if (!ret || !ret->value || !copyable(*ret->value, size, kInlineBudget))
+        return;
+
+    Inlinable f;
+    f.expr = ret->value.get();
+    if (fn.params)
+        for (const auto& p : static_cast<const ParamListNode&>(*fn.params).params)
+            f.params.push_back(static_cast<const IdentNode&>(*p).ident_name);
+    f.uses.assign(f.params.size(), 0);
+    std::vector<const IdentNode*> idents;
+    collect_idents(*f.expr, idents);
+    for (const IdentNode* id : idents) {
+        const auto p = std::ranges::find(f.params, id->ident_name);
+        if (p != f.params.end())
+            ++f.uses[p - f.params.begin()];
+        else
+            f.names.emplace_back(id->ident_name, declaration(id->ident_name));
+    }
+    if (const auto* id = node_cast<IdentNode>(&first_evaluated(*f.expr))) {
+        const auto p = std::ranges::find(f.params, id->ident_name);
+        if (p != f.params.end())
+            f.first = static_cast<int>(p - f.params.begin());
+    }
+    inlinable_.emplace(&def, std::move(f));
+}
+
+void Optimizer::try_inline(std::unique_ptr<ASTNode>& slot) {
+    auto& call         = static_cast<CallNode&>(*slot);
+    const auto* callee = node_cast<IdentNode>(call.callee.get());
+    if (!callee)
+        return;
+    const auto it = inlinable_.find(declaration(callee->ident_name));
+    if (it == inlinable_.end())
+        return;
+    const Inlinable& f = it->second;
+    if (call.args.size() != f.params.size())
+        return;
+    for (const auto& [name, decl] : f.names)
+        if (declaration(name) != decl)
+            return;
+    bool other = false;
+    for (size_t i = 0; i < call.args.size(); ++i) {
+        const ASTNode& a = *call.args[i];
+        if (atomic(a))
+            continue;
+        if (other || f.uses[i] != 1 || f.first != static_cast<int>(i) || (i > 0 && makes_call(a)))
+            return;
+        other = true;
+    }
+
+    auto inlined = clone(*f.expr);
+    substitute(inlined, f.params, f.uses, call.args);
+    slot = std::move(inlined);
+    ++inlined_;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "ast.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// ── Optimizer ─────────────────────────────────────────────────────────────────
+//
+// Optimizations on the AST, run after semantic analysis: loop optimizations
+// (dinterp -O1) and, at -O2, inlining.
+//
+// Loop-invariant code motion.  Inside each loop, a maximal subexpression made
+// of literals, variable reads, operators, `is` and element or field reads is
+// wrapped in an InvariantNode when it provably has the same value on every
+// iteration:
+//   - none of its variables is declared or assigned anywhere in the loop
+//     (matched by name, so shadowing only makes the test stricter);
+//   - if the loop makes a call, none of its variables is assigned anywhere in
+//     the program, because the callee might be what assigns it;
+//   - element and field reads also need a loop without calls and without
+//     element or field assignments, since arrays and tuples are shared.
+// The expression is not physically moved in front of the loop.  Instead the
+// interpreter evaluates it in place the first time it is reached and reuses the
+// result for the rest of that loop execution.  A loop that runs zero times, or
+// reaches the expression only conditionally, therefore raises exactly the
+// errors it did before.  Only scalar results are cached: a concatenation
+// builds a new array or tuple each time and must not become shared.
+//
+// Induction variables.  In a `for i in a..b` loop whose iterator is never
+// assigned or redeclared, each maximal integer expression scale * i + offset
+// (built from i, integer literals, + - * and unary minus) becomes an
+// InductionNode.  The loop sets it from the first iterator value and adds
+// `scale` on every step, so the multiplication is gone from the body.
+//
+// Function literals inside a loop are never treated as part of it: their
+// bodies run whenever they are called.  Loops inside them are optimized on
+// their own.
+//
+// Inlining (dinterp -O2, run before the loop optimizations).  A variable bound
+// by `var f := func(x, ...) => e` (or a body that is just `return e`) and never
+// assigned anywhere in the program always holds that literal once declared.
+// A call f(a, ...) that resolves to it is replaced by a copy of e with the
+// arguments substituted for the parameters when
+//   - e has at most kInlineBudget nodes and makes no call and no function
+//     literal;
+//   - the call passes exactly one argument per parameter;
+//   - every other name in e denotes the same declaration at the call as at the
+//     literal, so substitution captures nothing;
+//   - the arguments are still evaluated once each, in order, before anything
+//     in e that could fail: literals and variable reads may be copied or
+//     dropped freely, and at most one other argument is allowed, whose
+//     parameter e uses exactly once, as the first thing it evaluates, and which
+//     makes no call unless it is the first argument.
+// The variable still holds the literal for other uses.  Identifiers are
+// re-resolved by running SemanticAnalyzer again on the result.
+
+class Optimizer {
+public:
+    void optimize(ASTNode& root);
+    // Returns the number of calls inlined; the tree needs analyzing again if
+    // any were.
+    size_t inline_calls(ASTNode& root);
+
+    size_t loops() const noexcept { return loops_; }
+    size_t invariants() const noexcept { return next_invariant_; }
+    size_t inductions() const noexcept { return next_induction_; }
+
+    static constexpr size_t kInlineBudget = 16;
+
+private:
+    struct LoopFacts {
+        std::unordered_set<std::string> written; // declared or assigned in the loop
+        bool calls{false};
+        bool stores{false}; // element or field assignment
+    };
+
+    // A function literal whose calls can be inlined (see inline_calls()).
+    struct Inlinable {
+        const ASTNode* expr{nullptr};
+        std::vector<std::string> params;
+        std::vector<int> uses;                                     // per parameter
+        int first{-1};                                             // parameter evaluated first
+        std::vector<std::pair<std::string, const ASTNode*>> names; // other names and declarations
+    };
+
+    std::unordered_set<std::string> assigned_; // assignment targets in the whole program
+    uint32_t loops_{0};
+    uint32_t next_invariant_{0};
+    uint32_t next_induction_{0};
+
+    // Declarations visible during inlining, innermost last; nullptr stands for
+    // builtins and inputs.
+    std::vector<std::unordered_map<std::string, const ASTNode*>> scopes_;
+    std::unordered_map<const ASTNode*, Inlinable> inlinable_; // by VarDefNode
+    size_t inlined_{0};
+
+    void walk(ASTNode& n);
+    void optimize_loop(ASTNode& loop);
+
+    bool invariant(const ASTNode& n, const LoopFacts& facts) const;
+    void hoist(std::unique_ptr<ASTNode>& slot, const LoopFacts& facts, LoopInfo& info);
+    void induct(std::unique_ptr<ASTNode>& slot, const std::string& iter, LoopInfo& info);
+
+    void inline_walk(std::unique_ptr<ASTNode>& slot);
+    const ASTNode* declaration(const std::string& name) const;
+    void consider(const VarDefNode& def);
+    void try_inline(std::unique_ptr<ASTNode>& slot);
+};
@@ -18,11 +18,20 @@ void PrintVisitor::put_suffix(const ASTNode& n) {
 }
 
 void PrintVisitor::recurse(const ASTNode* n) {
-    if (!n)
-        return;
-    ++indent_;
-    n->accept(*this);
-    --indent_;
+    if (n)
+        queued_.push_back({n, indent_ + 1});
+}
+
+void PrintVisitor::print(const ASTNode& root) {
+    pending_.push_back({&root, indent_});
+    while (!pending_.empty()) {
+        const Pending p = pending_.back();
+        pending_.pop_back();
+        indent_ = p.indent;
+        dispatch(*p.node);
+        pending_.insert(pending_.end(), queued_.rbegin(), queued_.rend());
+        queued_.clear();
+    }
 }
 
 // ── Statements / structure ────────────────────────────────────────────────────
@@ -295,3 +304,21 @@ void PrintVisitor::visit(const TypeNode& n) {
     os_ << '[' << n.kind_name() << ']';
     put_suffix(n);
 }
+
+// ── Optimizer nodes ───────────────────────────────────────────────────────────
+
+void PrintVisitor::visit(const InvariantNode& n) {
+    put_indent();
+    os_ << '[' << n.kind_name() << ']';
+    os_ << " slot=" << n.slot;
+    put_suffix(n);
+    recurse(n.expr.get());
+}
+
+void PrintVisitor::visit(const InductionNode& n) {
+    put_indent();
+    os_ << '[' << n.kind_name() << ']';
+    os_ << " slot=" << n.slot << " scale=" << n.form.scale << " offset=" << n.form.offset;
+    put_suffix(n);
+    recurse(n.expr.get());
+}
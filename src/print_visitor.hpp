@@ -3,21 +3,26 @@
 #include "ast_visitor.hpp"
 
 #include <ostream>
+#include <vector>
 
 // ── PrintVisitor ──────────────────────────────────────────────────────────────
 //
 // Walks the AST and prints an indented textual representation to an ostream.
-// Each visit() method writes the current node's header line and recurses into
-// children at indent+1 via the helper recurse().
+// Each visit() method writes the current node's header line and queues its
+// children at indent+1 via the helper recurse().  print() visits the queued
+// nodes from an explicit stack, so the depth of the tree does not matter.
 
 struct ASTNode;
 
-struct PrintVisitor : ASTVisitorBase<PrintVisitor> {
+struct PrintVisitor final : ASTVisitorBase<PrintVisitor> {
     std::ostream& os_;
     int indent_{0};
 
     explicit PrintVisitor(std::ostream& os, int indent = 0) : os_{os}, indent_{indent} {}
 
+    // Prints `root` and everything below it.
+    void print(const ASTNode& root);
+
     void visit(const ProgramNode&) override;
     void visit(const BodyNode&) override;
     void visit(const VarDeclNode&) override;
@@ -51,8 +56,17 @@ struct PrintVisitor : ASTVisitorBase<PrintVisitor> {
     void visit(const ParamListNode&) override;
     void visit(const FuncLitNode&) override;
     void visit(const TypeNode&) override;
+    void visit(const InvariantNode&) override;
+    void visit(const InductionNode&) override;
 
 private:
+    struct Pending {
+        const ASTNode* node;
+        int indent;
+    };
+    std::vector<Pending> pending_; // next to print last
+    std::vector<Pending> queued_;  // children of the node being printed, in order
+
     void put_indent() const;
     void put_suffix(const ASTNode& n);
     void recurse(const ASTNode* n);
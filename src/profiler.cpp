@@ -0,0 +1,383 @@
+#include "profiler.hpp"
+
+#include "ast.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <format>
+#include <stdexcept>
+#include <sys/time.h>
+
+namespace {
+
+// The profiler the SIGPROF handler records into; at most one samples at a time.
+std::atomic<Profiler*> sampling_profiler{nullptr};
+
+struct sigaction previous_action {};
+
+std::string json_escape(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (const char c : s) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+                out += std::format("\\u{:04x}", static_cast<unsigned char>(c));
+            else
+                out += c;
+        }
+    }
+    return out;
+}
+
+double to_us(int64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+}
+
+} // namespace
+
+Profiler::Profiler(Mode mode, int interval_us)
+    : mode_{mode}, interval_us_{std::max(interval_us, 1)} {
+    // Site 0 / context 0 stand for the top-level program.
+    sites_.push_back(Site{SiteKind::Function, "<main>"});
+    contexts_.push_back(Context{0, -1});
+}
+
+Profiler::~Profiler() {
+    if (running_)
+        stop();
+}
+
+int64_t Profiler::now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts); // async-signal-safe
+    return int64_t{ts.tv_sec} * 1'000'000'000 + ts.tv_nsec;
+}
+
+// ── Start / stop ───────────────────────────────────────────────────────────────
+
+void Profiler::start() {
+    if (running_)
+        return;
+    running_   = true;
+    origin_ns_ = now_ns();
+    push(0);
+
+    if (mode_ != Mode::Sample)
+        return;
+    Profiler* expected = nullptr;
+    if (!sampling_profiler.compare_exchange_strong(expected, this))
+        throw std::runtime_error("another profiler is already sampling");
+    samples_.resize(kMaxSamples);
+
+    struct sigaction sa {};
+    sa.sa_handler = &Profiler::on_sigprof;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, &previous_action);
+
+    itimerval timer{};
+    timer.it_interval.tv_sec  = interval_us_ / 1'000'000;
+    timer.it_interval.tv_usec = interval_us_ % 1'000'000;
+    timer.it_value            = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+
+void Profiler::stop() {
+    if (!running_)
+        return;
+    if (mode_ == Mode::Sample) {
+        itimerval off{};
+        setitimer(ITIMER_PROF, &off, nullptr);
+        sigaction(SIGPROF, &previous_action, nullptr);
+        sampling_profiler.store(nullptr);
+    }
+    while (!frames_.empty())
+        pop();
+    running_ = false;
+    if (mode_ == Mode::Sample)
+        estimate_from_samples();
+}
+
+void Profiler::on_sigprof(int) {
+    Profiler* p = sampling_profiler.load(std::memory_order_relaxed);
+    if (!p)
+        return;
+    const int saved_errno = errno;
+    const size_t i        = p->sample_count_.fetch_add(1, std::memory_order_relaxed);
+    if (i < kMaxSamples)
+        p->samples_[i] = Sample{p->current_context_.load(std::memory_order_relaxed), now_ns()};
+    errno = saved_errno;
+}
+
+// ── Sites and contexts ─────────────────────────────────────────────────────────
+
+int Profiler::function_site(const FuncLitNode& fn) {
+    auto [it, inserted] = function_sites_.try_emplace(&fn, static_cast<int>(sites_.size()));
+    if (inserted)
+        sites_.push_back(Site{SiteKind::Function,
+                              std::format("func@{}:{}", fn.loc.line, fn.loc.col),
+                              fn.loc.line,
+                              fn.loc.col});
+    return it->second;
+}
+
+int Profiler::line_site(int line) {
+    if (line < 0)
+        line = 0;
+    if (static_cast<size_t>(line) >= line_sites_.size())
+        line_sites_.resize(line + 1, -1);
+    int& site = line_sites_[line];
+    if (site < 0) {
+        site = static_cast<int>(sites_.size());
+        sites_.push_back(Site{SiteKind::Line, std::format("line {}", line), line});
+    }
+    return site;
+}
+
+int Profiler::child_context(int parent, int site) {
+    if (const int c = contexts_[parent].last_child; c >= 0 && contexts_[c].site == site)
+        return c;
+    for (const int c : contexts_[parent].children) {
+        if (contexts_[c].site == site) {
+            contexts_[parent].last_child = c;
+            return c;
+        }
+    }
+    const int c = static_cast<int>(contexts_.size());
+    contexts_.push_back(Context{site, parent});
+    contexts_[parent].children.push_back(c);
+    contexts_[parent].last_child = c;
+    return c;
+}
+
+// ── Frame stack ────────────────────────────────────────────────────────────────
+
+void Profiler::push(int site) {
+    const int context = frames_.empty() ? 0 : child_context(frames_.back().context, site);
+    Site& s           = sites_[site];
+    ++s.calls;
+    ++s.active;
+    int& top = s.kind == SiteKind::Function ? top_function_ : top_line_;
+    frames_.push_back(Frame{site, context, top, mode_ == Mode::Exact ? now_ns() : 0, 0, 0});
+    top = static_cast<int>(frames_.size()) - 1;
+    if (mode_ == Mode::Sample)
+        current_context_.store(context, std::memory_order_relaxed);
+}
+
+void Profiler::pop() {
+    const Frame f = frames_.back();
+    frames_.pop_back();
+    Site& s  = sites_[f.site];
+    int& top = s.kind == SiteKind::Function ? top_function_ : top_line_;
+    top      = f.prev_same;
+    --s.active;
+
+    if (mode_ == Mode::Sample) {
+        current_context_.store(frames_.empty() ? 0 : frames_.back().context,
+                               std::memory_order_relaxed);
+        return;
+    }
+
+    const int64_t inclusive = now_ns() - f.start_ns;
+    if (s.active == 0)
+        s.inclusive_ns += inclusive;
+    s.exclusive_ns += inclusive - f.same_child_ns;
+    contexts_[f.context].exclusive_ns += inclusive - f.child_ns;
+    if (!frames_.empty())
+        frames_.back().child_ns += inclusive;
+    if (top >= 0)
+        frames_[top].same_child_ns += inclusive;
+
+    if (events_.size() < kMaxTraceEvents)
+        events_.push_back(TraceEvent{f.site, f.start_ns - origin_ns_, inclusive});
+    else
+        ++dropped_events_;
+}
+
+// ── Interpreter hooks ──────────────────────────────────────────────────────────
+
+void Profiler::enter_function(const FuncLitNode& fn) {
+    push(function_site(fn));
+}
+
+void Profiler::leave_function() {
+    pop();
+}
+
+bool Profiler::enter_line(int line) {
+    const int site = line_site(line);
+    if (top_line_ > top_function_ && frames_[top_line_].site == site)
+        return false;
+    push(site);
+    return true;
+}
+
+void Profiler::leave_line() {
+    pop();
+}
+
+void Profiler::count_alloc() {
+    if (top_function_ >= 0)
+        ++sites_[frames_[top_function_].site].allocs;
+    if (top_line_ >= 0)
+        ++sites_[frames_[top_line_].site].allocs;
+}
+
+void Profiler::name_function(const FuncLitNode& fn, const std::string& name) {
+    auto [it, inserted] = function_sites_.try_emplace(&fn, static_cast<int>(sites_.size()));
+    if (inserted)
+        sites_.push_back(Site{SiteKind::Function, name, fn.loc.line, fn.loc.col});
+}
+
+// ── Sampling estimates ─────────────────────────────────────────────────────────
+//
+// Each sample stands for one timer interval of CPU time spent in its context.
+// A context's samples count towards the inclusive time of every distinct site
+// on its path, and towards the exclusive time of the innermost function and
+// the innermost line on it.
+
+void Profiler::estimate_from_samples() {
+    const size_t n       = std::min(sample_count_.load(), samples_.size());
+    const int64_t weight = int64_t{interval_us_} * 1000;
+    for (size_t i = 0; i < n; ++i)
+        ++contexts_[samples_[i].context].samples;
+
+    std::vector<size_t> seen(sites_.size(), 0);
+    for (size_t c = 0; c < contexts_.size(); ++c) {
+        Context& ctx = contexts_[c];
+        if (ctx.samples == 0)
+            continue;
+        const int64_t t  = static_cast<int64_t>(ctx.samples) * weight;
+        ctx.exclusive_ns = t;
+        bool function_done = false, line_done = false;
+        for (int k = static_cast<int>(c); k >= 0; k = contexts_[k].parent) {
+            const int site = contexts_[k].site;
+            Site& s        = sites_[site];
+            if (seen[site] != c + 1) {
+                seen[site] = c + 1;
+                s.inclusive_ns += t;
+            }
+            bool& done = s.kind == SiteKind::Function ? function_done : line_done;
+            if (!done) {
+                s.exclusive_ns += t;
+                done = true;
+            }
+        }
+    }
+}
+
+// ── Output ─────────────────────────────────────────────────────────────────────
+
+std::string Profiler::context_path(int context) const {
+    std::vector<int> path;
+    for (int k = context; k >= 0; k = contexts_[k].parent)
+        path.push_back(contexts_[k].site);
+    std::string s;
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        if (!s.empty())
+            s += ';';
+        s += sites_[*it].name;
+    }
+    return s;
+}
+
+// One "path value" line per calling context; values are nanoseconds of
+// exclusive time (exact mode) or sample counts (sampling mode).
+void Profiler::write_collapsed(std::ostream& os) const {
+    for (size_t c = 0; c < contexts_.size(); ++c) {
+        const Context& ctx    = contexts_[c];
+        const uint64_t weight = mode_ == Mode::Sample ? ctx.samples
+                                                      : static_cast<uint64_t>(ctx.exclusive_ns);
+        if (weight > 0)
+            os << context_path(static_cast<int>(c)) << ' ' << weight << '\n';
+    }
+}
+
+void Profiler::write_chrome_trace(std::ostream& os) const {
+    os << "{\"traceEvents\":[\n";
+    os << R"({"name":"process_name","ph":"M","pid":1,"tid":1,"args":{"name":"dinterp"}})";
+    for (const TraceEvent& e : events_) {
+        const Site& s = sites_[e.site];
+        os << std::format(",\n{{\"name\":\"{}\",\"cat\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                          "\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                          json_escape(s.name),
+                          s.kind == SiteKind::Function ? "function" : "line",
+                          to_us(e.start_ns),
+                          to_us(e.dur_ns));
+    }
+    os << "\n],\n\"displayTimeUnit\":\"ns\",\n";
+
+    if (mode_ == Mode::Sample) {
+        os << "\"stackFrames\":{";
+        for (size_t c = 0; c < contexts_.size(); ++c) {
+            const Context& ctx = contexts_[c];
+            os << std::format("{}\n\"{}\":{{\"name\":\"{}\"", c ? "," : "", c,
+                              json_escape(sites_[ctx.site].name));
+            if (ctx.parent >= 0)
+                os << std::format(",\"parent\":\"{}\"", ctx.parent);
+            os << '}';
+        }
+        os << "\n},\n\"samples\":[";
+        const size_t n = std::min(sample_count_.load(), samples_.size());
+        for (size_t i = 0; i < n; ++i)
+            os << std::format("{}\n{{\"cpu\":0,\"tid\":1,\"name\":\"cpu\",\"weight\":1,"
+                              "\"ts\":{:.3f},\"sf\":\"{}\"}}",
+                              i ? "," : "",
+                              to_us(samples_[i].ts_ns - origin_ns_),
+                              samples_[i].context);
+        os << "\n],\n";
+    }
+
+    const size_t taken   = sample_count_.load();
+    const size_t dropped = taken > kMaxSamples ? taken - kMaxSamples : 0;
+    os << std::format("\"otherData\":{{\"mode\":\"{}\",\"interval_us\":{},"
+                      "\"dropped_events\":{},\"dropped_samples\":{}}},\n",
+                      mode_ == Mode::Sample ? "sample" : "exact",
+                      interval_us_,
+                      dropped_events_,
+                      dropped);
+
+    // Per-site summaries, in source order.
+    std::vector<const Site*> functions, lines;
+    for (const Site& s : sites_)
+        (s.kind == SiteKind::Function ? functions : lines).push_back(&s);
+    const auto by_position = [](const Site* a, const Site* b) {
+        return std::pair{a->line, a->col} < std::pair{b->line, b->col};
+    };
+    std::ranges::stable_sort(functions, by_position);
+    std::ranges::stable_sort(lines, by_position);
+
+    const auto write_sites = [&](std::string_view key, const std::vector<const Site*>& v) {
+        os << '"' << key << "\":[";
+        for (size_t i = 0; i < v.size(); ++i) {
+            const Site& s = *v[i];
+            os << std::format("{}\n{{\"name\":\"{}\",\"line\":{},\"col\":{},\"calls\":{},"
+                              "\"inclusive_ns\":{},\"exclusive_ns\":{},\"allocs\":{}}}",
+                              i ? "," : "",
+                              json_escape(s.name),
+                              s.line,
+                              s.col,
+                              s.calls,
+                              s.inclusive_ns,
+                              s.exclusive_ns,
+                              s.allocs);
+        }
+        os << "\n]";
+    };
+    write_sites("functions", functions);
+    os << ",\n";
+    write_sites("lines", lines);
+    os << "\n}\n";
+}
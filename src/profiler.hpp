@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct FuncLitNode;
+
+// ── Profiler ──────────────────────────────────────────────────────────────────
+//
+// Attributes the cost of a D program to functions (FuncLitNode) and to source
+// lines (the line of each executed statement).  The Interpreter reports
+// function calls, statements and runtime allocations through the hooks below;
+// when no profiler is attached those hooks are never reached.
+//
+// Two modes:
+//   Exact   – reads the clock on every hook and records one trace event per
+//             function call; precise but slows execution down noticeably.
+//   Sample  – hooks only maintain a shadow stack; a SIGPROF interval timer
+//             records which stack is current.  Times are estimated from the
+//             sample counts, call and allocation counts stay exact.
+//
+// Results are kept per site (function or line) and per calling context, and
+// can be written as Chrome trace-event JSON or as collapsed stacks for
+// flamegraph tools.
+
+class Profiler {
+public:
+    enum class Mode { Exact, Sample };
+
+    explicit Profiler(Mode mode = Mode::Exact, int interval_us = 1000);
+    ~Profiler();
+
+    Profiler(const Profiler&)            = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    void start();
+    void stop();
+
+    // ── Interpreter hooks ─────────────────────────────────────────────────────
+    void enter_function(const FuncLitNode& fn);
+    void leave_function();
+    // Returns false (and pushes nothing) for a statement nested on the line
+    // that is already executing; leave_line() is only called after true.
+    bool enter_line(int line);
+    void leave_line();
+    void count_alloc();
+    void name_function(const FuncLitNode& fn, const std::string& name);
+
+    // ── Output ────────────────────────────────────────────────────────────────
+    void write_chrome_trace(std::ostream& os) const;
+    void write_collapsed(std::ostream& os) const;
+
+private:
+    enum class SiteKind : uint8_t { Function, Line };
+
+    struct Site {
+        SiteKind kind;
+        std::string name;
+        int line{0};
+        int col{0};
+        uint64_t calls{0};
+        uint64_t allocs{0};
+        int64_t inclusive_ns{0};
+        int64_t exclusive_ns{0};
+        int active{0}; // live frames; inclusive time is added by the outermost
+    };
+
+    // Calling-context tree node: one per distinct path of sites.
+    struct Context {
+        int site;
+        int parent;
+        int last_child{-1}; // one-entry lookup cache for loops
+        std::vector<int> children{};
+        int64_t exclusive_ns{0};
+        uint64_t samples{0};
+    };
+
+    struct Frame {
+        int site;
+        int context;
+        int prev_same; // enclosing frame of the same site kind, or -1
+        int64_t start_ns;
+        int64_t child_ns;      // time in directly nested frames of any kind
+        int64_t same_child_ns; // time in nested frames of the same kind
+    };
+
+    struct Sample {
+        int context;
+        int64_t ts_ns;
+    };
+
+    struct TraceEvent {
+        int site;
+        int64_t start_ns;
+        int64_t dur_ns;
+    };
+
+    static constexpr size_t kMaxSamples     = size_t{1} << 18;
+    static constexpr size_t kMaxTraceEvents = size_t{1} << 20;
+
+    Mode mode_;
+    int interval_us_;
+    bool running_{false};
+    int64_t origin_ns_{0};
+
+    std::vector<Site> sites_;
+    std::unordered_map<const FuncLitNode*, int> function_sites_;
+    std::vector<int> line_sites_; // line → site, -1 when unseen
+
+    std::vector<Context> contexts_;
+    std::vector<Frame> frames_;
+    int top_function_{-1};
+    int top_line_{-1};
+
+    std::vector<TraceEvent> events_;
+    uint64_t dropped_events_{0};
+
+    // Written by the SIGPROF handler.
+    std::atomic<int> current_context_{0};
+    std::vector<Sample> samples_;
+    std::atomic<size_t> sample_count_{0};
+
+    int function_site(const FuncLitNode& fn);
+    int line_site(int line);
+    int child_context(int parent, int site);
+
+    void push(int site);
+    void pop();
+
+    void estimate_from_samples();
+    std::string context_path(int context) const;
+
+    static int64_t now_ns();
+    static void on_sigprof(int);
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// ── Region ────────────────────────────────────────────────────────────────────
+//
+// Bump-pointer memory for the objects of one run.  Allocation advances a
+// pointer through the current chunk; a request that does not fit starts a new
+// chunk, twice the size of the last.  Deallocation does nothing: release()
+// drops every chunk at once, keeping the largest for the next run, so a run's
+// objects cost nothing to free beyond their destructors.  Nothing allocated
+// from a region may be used after release().
+
+class Region {
+public:
+    Region()                         = default;
+    Region(const Region&)            = delete;
+    Region& operator=(const Region&) = delete;
+
+    void* allocate(size_t size, size_t align) {
+        auto p = (cur_ + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+        if (p + size > end_ || p < cur_)
+            p = grow(size, align);
+        cur_   = p + size;
+        used_ += size;
+        return reinterpret_cast<void*>(p);
+    }
+
+    void release() noexcept {
+        if (chunks_.size() > 1)
+            chunks_.erase(chunks_.begin(), chunks_.end() - 1);
+        cur_  = chunks_.empty() ? 0 : reinterpret_cast<uintptr_t>(chunks_.back().data.get());
+        end_  = chunks_.empty() ? 0 : cur_ + chunks_.back().size;
+        used_ = 0;
+    }
+
+    // Bytes handed out since the last release().
+    uint64_t used() const noexcept { return used_; }
+
+private:
+    struct Chunk {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+    static constexpr size_t kFirstChunk = 64 * 1024;
+
+    std::vector<Chunk> chunks_;
+    uintptr_t cur_{0};
+    uintptr_t end_{0};
+    uint64_t used_{0};
+
+    uintptr_t grow(size_t size, size_t align) {
+        const size_t last = chunks_.empty() ? kFirstChunk / 2 : chunks_.back().size;
+        const size_t n    = std::max(last * 2, size + align);
+        chunks_.push_back({std::make_unique_for_overwrite<std::byte[]>(n), n});
+        cur_ = reinterpret_cast<uintptr_t>(chunks_.back().data.get());
+        end_ = cur_ + n;
+        return (cur_ + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+    }
+};
+
+// Standard allocator over a Region, for std::allocate_shared.
+template <class T>
+struct RegionAllocator {
+    using value_type = T;
+
+    Region* region;
+
+    explicit RegionAllocator(Region& r) noexcept : region{&r} {}
+    template <class U>
+    RegionAllocator(const RegionAllocator<U>& other) noexcept : region{other.region} {}
+
+    T* allocate(size_t n) { return static_cast<T*>(region->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) noexcept {}
+
+    template <class U>
+    bool operator==(const RegionAllocator<U>& other) const noexcept {
+        return region == other.region;
+    }
+};
+
+// Region of the run in progress on this thread, if it allocates from one
+// (Interpreter::set_region).  DValue's factories consult it.
+inline constinit thread_local Region* active_region = nullptr;
@@ -0,0 +1,212 @@
+#pragma once
+
+// ── Byte-scanning kernels for the lexer ───────────────────────────────────────
+//
+// Each kernel consumes 32 (AVX2) or 16 (SSE2) bytes per step and finishes the
+// tail with the portable scalar loop, which is also the whole implementation
+// on targets without SSE2.  The instruction set is chosen at compile time from
+// the predefined __AVX2__ / __SSE2__ macros (see DLANG_NATIVE_ARCH in CMake).
+//
+// All functions take a half-open range [p, end) and never read past `end`.
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define DLANG_SCAN_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DLANG_SCAN_SSE2 1
+#endif
+
+namespace scan {
+
+// ── Scalar character classes (match the C-locale <cctype> predicates) ────────
+
+constexpr bool is_space(unsigned char c) noexcept {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+constexpr bool is_ident(unsigned char c) noexcept {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c == '_';
+}
+
+namespace detail {
+
+#if defined(DLANG_SCAN_AVX2)
+
+using vec                    = __m256i;
+inline constexpr size_t kVec = 32;
+
+inline vec load(const char* p) noexcept {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+inline vec splat(char c) noexcept {
+    return _mm256_set1_epi8(c);
+}
+inline vec eq(vec a, vec b) noexcept {
+    return _mm256_cmpeq_epi8(a, b);
+}
+inline vec either(vec a, vec b) noexcept {
+    return _mm256_or_si256(a, b);
+}
+inline vec sub(vec a, vec b) noexcept {
+    return _mm256_sub_epi8(a, b);
+}
+// Lanes where (unsigned)a <= (unsigned)b.
+inline vec ule(vec a, vec b) noexcept {
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(a, b), a);
+}
+inline uint32_t mask(vec v) noexcept {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(v));
+}
+
+#elif defined(DLANG_SCAN_SSE2)
+
+using vec                    = __m128i;
+inline constexpr size_t kVec = 16;
+
+inline vec load(const char* p) noexcept {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+inline vec splat(char c) noexcept {
+    return _mm_set1_epi8(c);
+}
+inline vec eq(vec a, vec b) noexcept {
+    return _mm_cmpeq_epi8(a, b);
+}
+inline vec either(vec a, vec b) noexcept {
+    return _mm_or_si128(a, b);
+}
+inline vec sub(vec a, vec b) noexcept {
+    return _mm_sub_epi8(a, b);
+}
+inline vec ule(vec a, vec b) noexcept {
+    return _mm_cmpeq_epi8(_mm_min_epu8(a, b), a);
+}
+inline uint32_t mask(vec v) noexcept {
+    return static_cast<uint32_t>(_mm_movemask_epi8(v));
+}
+
+#endif
+
+#if defined(DLANG_SCAN_AVX2) || defined(DLANG_SCAN_SSE2)
+
+inline constexpr uint32_t kFull = kVec == 32 ? 0xFFFFFFFFu : 0xFFFFu;
+
+// ' ' or '\t'..'\r'
+inline uint32_t space_mask(vec x) noexcept {
+    const vec ctrl = ule(sub(x, splat('\t')), splat('\r' - '\t'));
+    return mask(either(eq(x, splat(' ')), ctrl));
+}
+
+// [0-9A-Za-z_]
+inline uint32_t ident_mask(vec x) noexcept {
+    const vec digit = ule(sub(x, splat('0')), splat(9));
+    const vec lower = either(x, splat(0x20));
+    const vec alpha = ule(sub(lower, splat('a')), splat('z' - 'a'));
+    return mask(either(either(digit, alpha), eq(x, splat('_'))));
+}
+
+#endif
+
+} // namespace detail
+
+// Returns the first byte in [p, end) that is not whitespace, or `end`.
+inline const char* skip_space(const char* p, const char* end) noexcept {
+#if defined(DLANG_SCAN_AVX2) || defined(DLANG_SCAN_SSE2)
+    using namespace detail;
+    for (; static_cast<size_t>(end - p) >= kVec; p += kVec) {
+        const uint32_t m = space_mask(load(p)) ^ kFull;
+        if (m)
+            return p + std::countr_zero(m);
+    }
+#endif
+    while (p != end && is_space(static_cast<unsigned char>(*p)))
+        ++p;
+    return p;
+}
+
+// Returns the first byte in [p, end) that is not an identifier character.
+inline const char* skip_ident(const char* p, const char* end) noexcept {
+#if defined(DLANG_SCAN_AVX2) || defined(DLANG_SCAN_SSE2)
+    using namespace detail;
+    for (; static_cast<size_t>(end - p) >= kVec; p += kVec) {
+        const uint32_t m = ident_mask(load(p)) ^ kFull;
+        if (m)
+            return p + std::countr_zero(m);
+    }
+#endif
+    while (p != end && is_ident(static_cast<unsigned char>(*p)))
+        ++p;
+    return p;
+}
+
+// Returns the first occurrence of `c` in [p, end), or `end`.
+inline const char* find(const char* p, const char* end, char c) noexcept {
+#if defined(DLANG_SCAN_AVX2) || defined(DLANG_SCAN_SSE2)
+    using namespace detail;
+    const vec needle = splat(c);
+    for (; static_cast<size_t>(end - p) >= kVec; p += kVec) {
+        const uint32_t m = mask(eq(load(p), needle));
+        if (m)
+            return p + std::countr_zero(m);
+    }
+#endif
+    while (p != end && *p != c)
+        ++p;
+    return p;
+}
+
+// Returns the first occurrence of `a` or `b` in [p, end), or `end`.
+inline const char* find_either(const char* p, const char* end, char a, char b) noexcept {
+#if defined(DLANG_SCAN_AVX2) || defined(DLANG_SCAN_SSE2)
+    using namespace detail;
+    const vec na = splat(a);
+    const vec nb = splat(b);
+    for (; static_cast<size_t>(end - p) >= kVec; p += kVec) {
+        const vec x      = load(p);
+        const uint32_t m = mask(either(eq(x, na), eq(x, nb)));
+        if (m)
+            return p + std::countr_zero(m);
+    }
+#endif
+    while (p != end && *p != a && *p != b)
+        ++p;
+    return p;
+}
+
+// Number of '\n' bytes in [p, end).
+inline size_t count_newlines(const char* p, const char* end) noexcept {
+    size_t n = 0;
+#if defined(DLANG_SCAN_AVX2) || defined(DLANG_SCAN_SSE2)
+    using namespace detail;
+    const vec nl = splat('\n');
+    for (; static_cast<size_t>(end - p) >= kVec; p += kVec)
+        n += std::popcount(mask(eq(load(p), nl)));
+#endif
+    for (; p != end; ++p)
+        n += *p == '\n';
+    return n;
+}
+
+// Last '\n' in [p, end), or nullptr.
+inline const char* find_last_newline(const char* p, const char* end) noexcept {
+#if defined(DLANG_SCAN_AVX2) || defined(DLANG_SCAN_SSE2)
+    using namespace detail;
+    const vec nl = splat('\n');
+    for (; static_cast<size_t>(end - p) >= kVec; end -= kVec) {
+        const uint32_t m = mask(eq(load(end - kVec), nl));
+        if (m)
+            return end - 1 - std::countl_zero(m) + (32 - kVec);
+    }
+#endif
+    while (end != p)
+        if (*--end == '\n')
+            return end;
+    return nullptr;
+}
+
+} // namespace scan
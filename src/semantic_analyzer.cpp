@@ -1,45 +1,117 @@
 #include "semantic_analyzer.hpp"
 
 #include "ast.hpp"
+#include "builtins.hpp"
 
 #include <format>
 
-void SemanticAnalyzer::analyze(const ASTNode& root) {
+void SemanticAnalyzer::analyze(const ASTNode& root, std::span<const std::string> inputs) {
+    open_globals(inputs);
+    work_.push_back({&root, 0});
+    while (!work_.empty()) {
+        const Work w = work_.back();
+        work_.pop_back();
+        if (w.phase == 0)
+            dispatch(*w.node);
+        else
+            resume(*w.node, w.phase);
+        work_.insert(work_.end(), scheduled_.rbegin(), scheduled_.rend());
+        scheduled_.clear();
+    }
+    close_globals();
+}
+
+void SemanticAnalyzer::analyze(FlatAst& ast, std::span<const std::string> inputs) {
+    open_globals(inputs);
+    flat_ = &ast;
+    flat_work_.push_back({ast.root(), 0});
+    while (!flat_work_.empty()) {
+        const FlatWork w = flat_work_.back();
+        flat_work_.pop_back();
+        if (w.phase == 0)
+            visit_flat(w.node);
+        else
+            resume_flat(w.node, w.phase);
+        flat_work_.insert(flat_work_.end(), flat_scheduled_.rbegin(), flat_scheduled_.rend());
+        flat_scheduled_.clear();
+    }
+    flat_ = nullptr;
+    close_globals();
+}
+
+void SemanticAnalyzer::open_globals(std::span<const std::string> inputs) {
     errors_.clear();
-    scopes_.clear();
+    bindings_.clear();
+    declared_.clear();
+    scope_marks_.clear();
+    frames_.clear();
+    funcs_.clear();
     loop_depth_ = 0;
-    func_depth_ = 0;
+    push_scope(); // builtins, so that inputs and globals may shadow them
+    for (const Builtin& b : builtins())
+        declare(std::string{b.name}, {});
+    push_scope(); // inputs
+    for (const auto& name : inputs)
+        declare(name, {});
     push_scope();
-    root.accept(*this);
+}
+
+void SemanticAnalyzer::close_globals() {
+    pop_scope();
+    pop_scope();
     pop_scope();
 }
 
-void SemanticAnalyzer::push_scope() {
-    scopes_.emplace_back();
+void SemanticAnalyzer::push_scope(bool has_frame) {
+    scope_marks_.push_back(declared_.size());
+    frames_.push_back(frames_.empty() ? 0 : frames_.back() + (has_frame ? 1 : 0));
 }
 
 void SemanticAnalyzer::pop_scope() {
-    scopes_.pop_back();
+    for (size_t i = declared_.size(); i > scope_marks_.back(); --i) {
+        declared_.back()->pop_back();
+        declared_.pop_back();
+    }
+    scope_marks_.pop_back();
+    frames_.pop_back();
 }
 
-void SemanticAnalyzer::declare(const std::string& name, Location loc) {
-    auto& scope = scopes_.back();
-    auto it     = scope.find(name);
-    if (it != scope.end()) {
+void SemanticAnalyzer::declare(const std::string& name, Location loc, bool* captured) {
+    auto& stack = bindings_[name];
+    if (!stack.empty() && stack.back().scope == scope()) {
         error(loc, std::format("'{}' already declared in this scope (previously at line {})", name,
-                               it->second));
-    } else {
-        scope[name] = loc.line;
+                               stack.back().line));
+        return;
     }
+    stack.push_back({scope(), loc.line, captured});
+    declared_.push_back(&stack);
+    if (captured)
+        *captured = false;
 }
 
 int SemanticAnalyzer::resolve(const std::string& name, Location loc) {
-    for (int d = static_cast<int>(scopes_.size()) - 1; d >= 0; --d) {
-        if (scopes_[d].count(name))
-            return static_cast<int>(scopes_.size()) - 1 - d;
+    auto it = bindings_.find(name);
+    if (it == bindings_.end() || it->second.empty()) {
+        error(loc, std::format("use of undeclared variable '{}'", name));
+        return -1;
+    }
+    const Binding& b = it->second.back();
+    capture(it->first, b);
+    return frames_.back() - frames_[b.scope];
+}
+
+// Records `b` as free in each function being analyzed that encloses the use but
+// not the declaration.
+void SemanticAnalyzer::capture(std::string_view name, const Binding& b) {
+    if (funcs_.empty() || b.scope >= funcs_.back().scope)
+        return;
+    if (b.captured)
+        *b.captured = true;
+    for (auto f = funcs_.rbegin(); f != funcs_.rend() && b.scope < f->scope; ++f) {
+        if (f->node && f->free.insert(name).second)
+            f->node->free_vars.push_back(
+                {std::string{name}, frames_[f->scope - 1] - frames_[b.scope]});
     }
-    error(loc, std::format("use of undeclared variable '{}'", name));
-    return -1;
 }
 
 void SemanticAnalyzer::error(Location loc, std::string msg) {
@@ -48,7 +120,62 @@ void SemanticAnalyzer::error(Location loc, std::string msg) {
 
 void SemanticAnalyzer::accept(const ASTNode* n) {
     if (n)
-        n->accept(*this);
+        scheduled_.push_back({n, 0});
+}
+
+// Phase 1 opens a loop and phase 2 closes it; Body, VarDef and FuncLit have a
+// single phase, which ends their visit.
+void SemanticAnalyzer::resume(const ASTNode& n, int phase) {
+    switch (n.kind) {
+    case NodeKind::VarDef: {
+        const auto& d = static_cast<const VarDefNode&>(n);
+        return resume(n.kind, phase, d.varname, d.loc, &d.captured);
+    }
+    case NodeKind::ForRange: {
+        const auto& f = static_cast<const ForRangeNode&>(n);
+        return resume(n.kind, phase, f.iter, f.loc, &f.captured);
+    }
+    case NodeKind::ForIter: {
+        const auto& f = static_cast<const ForIterNode&>(n);
+        return resume(n.kind, phase, f.iter, f.loc, &f.captured);
+    }
+    default:
+        return resume(n.kind, phase, {}, n.loc, nullptr);
+    }
+}
+
+void SemanticAnalyzer::resume(NodeKind kind, int phase, const std::string& name, Location loc,
+                              bool* captured) {
+    switch (kind) {
+    case NodeKind::Body:
+        pop_scope();
+        return;
+    case NodeKind::VarDef:
+        declare(name, loc, captured);
+        return;
+    case NodeKind::While:
+    case NodeKind::LoopInf:
+        loop_depth_ += phase == 1 ? 1 : -1;
+        return;
+    case NodeKind::ForRange:
+    case NodeKind::ForIter:
+        if (phase == 1) {
+            ++loop_depth_;
+            push_scope();
+            if (!name.empty())
+                declare(name, loc, captured);
+        } else {
+            pop_scope();
+            --loop_depth_;
+        }
+        return;
+    case NodeKind::FuncLit:
+        funcs_.pop_back();
+        pop_scope();
+        return;
+    default:
+        return;
+    }
 }
 
 void SemanticAnalyzer::visit(const ProgramNode& n) {
@@ -56,11 +183,81 @@ void SemanticAnalyzer::visit(const ProgramNode& n) {
         accept(s.get());
 }
 
+namespace {
+
+// Calls f with each name a statement list declares in its own scope.  A short
+// if does not open a scope, so a declaration under one counts.
+template <class F>
+void for_each_declared(const std::vector<std::unique_ptr<ASTNode>>& stmts, F&& f) {
+    for (const auto& s : stmts) {
+        const ASTNode* stmt = s.get();
+        while (stmt && stmt->kind == NodeKind::IfShort)
+            stmt = static_cast<const IfShortNode*>(stmt)->stmt.get();
+        if (stmt && stmt->kind == NodeKind::VarDecl)
+            for (const auto& d : static_cast<const VarDeclNode*>(stmt)->defs)
+                f(static_cast<const VarDefNode&>(*d).varname);
+    }
+}
+
+// Whether the body of `n` uses the iterator only as the base of a field read,
+// and can change no array or tuple: it calls nothing, defines no function and
+// assigns to variables only.  A copy of each element then does as well as the
+// element.  Names are compared, not bindings, which errs on the safe side.
+bool reads_fields(const ForIterNode& n) {
+    std::vector<const ASTNode*> pending{n.body.get()};
+    while (!pending.empty()) {
+        const ASTNode& x = *pending.back();
+        pending.pop_back();
+        const ASTNode* base = nullptr;
+        switch (x.kind) {
+        case NodeKind::Call:
+        case NodeKind::FuncLit:
+            return false;
+        case NodeKind::Assign:
+            if (static_cast<const AssignNode&>(x).lhs->kind != NodeKind::Ident)
+                return false;
+            break;
+        case NodeKind::Ident:
+            if (static_cast<const IdentNode&>(x).ident_name == n.iter)
+                return false;
+            break;
+        case NodeKind::DotField:
+            base = static_cast<const DotFieldNode&>(x).base.get();
+            break;
+        case NodeKind::DotInt:
+            base = static_cast<const DotIntNode&>(x).base.get();
+            break;
+        default:
+            break;
+        }
+        if (const auto* id = node_cast<IdentNode>(base); id && id->ident_name == n.iter)
+            continue;
+        for_each_child(x, [&](const std::unique_ptr<ASTNode>& c) { pending.push_back(c.get()); });
+    }
+    return true;
+}
+
+} // namespace
+
+// A body that declares nothing runs in the enclosing frame.  So does a function
+// body that does not redeclare a parameter: a call makes a fresh parameter frame
+// anyway, and the body's variables go in it.
 void SemanticAnalyzer::visit(const BodyNode& n) {
-    push_scope();
+    const bool func_body = in_func() && funcs_.back().scope == scope() &&
+                           funcs_.back().node->body.get() == &n;
+    bool declares = false, shadows = false;
+    for_each_declared(n.stmts, [&](const std::string& name) {
+        declares = true;
+        if (func_body)
+            if (auto it = bindings_.find(name);
+                it != bindings_.end() && !it->second.empty() && it->second.back().scope == scope())
+                shadows = true;
+    });
+    n.has_frame = func_body ? shadows : declares;
+    push_scope(n.has_frame);
     for (const auto& s : n.stmts)
         accept(s.get());
-    pop_scope();
+    then(n, 1);
 }
 
 void SemanticAnalyzer::visit(const VarDeclNode& n) {
@@ -70,13 +267,13 @@ void SemanticAnalyzer::visit(const VarDeclNode& n) {
 
 void SemanticAnalyzer::visit(const VarDefNode& n) {
 
-    const bool is_func_init = n.init && dynamic_cast<const FuncLitNode*>(n.init.get()) != nullptr;
+    const bool is_func_init = n.init && n.init->kind == NodeKind::FuncLit;
     if (is_func_init)
-        declare(n.varname, n.loc);
+        declare(n.varname, n.loc, &n.captured);
     if (n.init)
         accept(n.init.get());
     if (!is_func_init)
-        declare(n.varname, n.loc);
+        then(n, 1);
 }
 
 void SemanticAnalyzer::visit(const AssignNode& n) {
@@ -98,38 +295,31 @@ void SemanticAnalyzer::visit(const IfShortNode& n) {
 
 void SemanticAnalyzer::visit(const WhileNode& n) {
     accept(n.cond.get());
-    ++loop_depth_;
+    then(n, 1);
     accept(n.body.get());
-    --loop_depth_;
+    then(n, 2);
 }
 
 void SemanticAnalyzer::visit(const ForRangeNode& n) {
     accept(n.from.get());
     accept(n.to.get());
-    ++loop_depth_;
-    push_scope();
-    if (!n.iter.empty())
-        declare(n.iter, n.loc);
+    then(n, 1);
     accept(n.body.get());
-    pop_scope();
-    --loop_depth_;
+    then(n, 2);
 }
 
 void SemanticAnalyzer::visit(const ForIterNode& n) {
+    n.reads_fields = reads_fields(n);
     accept(n.iterable.get());
-    ++loop_depth_;
-    push_scope();
-    if (!n.iter.empty())
-        declare(n.iter, n.loc);
+    then(n, 1);
     accept(n.body.get());
-    pop_scope();
-    --loop_depth_;
+    then(n, 2);
 }
 
 void SemanticAnalyzer::visit(const LoopInfNode& n) {
     ++loop_depth_;
     accept(n.body.get());
-    --loop_depth_;
+    then(n, 2);
 }
 
 void SemanticAnalyzer::visit(const ExitNode& n) {
@@ -202,16 +392,141 @@ void SemanticAnalyzer::visit(const TupleElemNode& n) {
 void SemanticAnalyzer::visit(const ParamListNode& n) {
     for (const auto& p : n.params) {
         const auto* ident = static_cast<const IdentNode*>(p.get());
-        declare(ident->ident_name, ident->loc);
+        declare(ident->ident_name, ident->loc, &ident->captured);
     }
 }
 
 void SemanticAnalyzer::visit(const FuncLitNode& n) {
-    ++func_depth_;
+    n.free_vars.clear();
     push_scope();
+    funcs_.push_back({&n, scope(), {}});
     if (n.params)
         visit(static_cast<const ParamListNode&>(*n.params));
     accept(n.body.get());
-    pop_scope();
-    --func_depth_;
+    then(n, 1);
+}
+
+// The optimizer runs after analysis, but re-analyzing its output is harmless.
+void SemanticAnalyzer::visit(const InvariantNode& n) {
+    accept(n.expr.get());
+}
+
+void SemanticAnalyzer::visit(const InductionNode& n) {
+    accept(n.expr.get());
+}
+
+// ── Flat encoding ─────────────────────────────────────────────────────────────
+//
+// Mirrors the visits above node for node, so that the scopes open and close and
+// the errors come out in the same order.
+
+void SemanticAnalyzer::accept_flat(FlatAst::Index i) {
+    if (i != FlatAst::kNone)
+        flat_scheduled_.push_back({i, 0});
+}
+
+void SemanticAnalyzer::resume_flat(FlatAst::Index i, int phase) {
+    const FlatAst& ast  = *flat_;
+    const NodeKind kind = ast.kind(i);
+    const bool named    = kind == NodeKind::VarDef || kind == NodeKind::ForRange ||
+                       kind == NodeKind::ForIter;
+    resume(kind, phase, named ? std::string{ast.text(i)} : std::string{}, ast.loc(i), nullptr);
+}
+
+void SemanticAnalyzer::visit_flat(FlatAst::Index i) {
+    FlatAst& ast  = *flat_;
+    const auto ch = ast.children(i);
+    switch (ast.kind(i)) {
+    case NodeKind::Body: {
+        const bool func_body =
+            in_func() && funcs_.back().scope == scope() && funcs_.back().body == i;
+        bool declares = false, shadows = false;
+        for (FlatAst::Index s : ch) {
+            while (s != FlatAst::kNone && ast.kind(s) == NodeKind::IfShort)
+                s = ast.children(s)[1];
+            if (s == FlatAst::kNone || ast.kind(s) != NodeKind::VarDecl)
+                continue;
+            for (const FlatAst::Index d : ast.children(s)) {
+                declares = true;
+                if (func_body)
+                    if (auto it = bindings_.find(std::string{ast.text(d)});
+                        it != bindings_.end() && !it->second.empty() &&
+                        it->second.back().scope == scope())
+                        shadows = true;
+            }
+        }
+        const bool has_frame = func_body ? shadows : declares;
+        ast.set_has_frame(i, has_frame);
+        push_scope(has_frame);
+        for (const FlatAst::Index s : ch)
+            accept_flat(s);
+        then_flat(i, 1);
+        return;
+    }
+    case NodeKind::VarDef: {
+        const FlatAst::Index init = ch[0];
+        const bool is_func_init   = init != FlatAst::kNone && ast.kind(init) == NodeKind::FuncLit;
+        if (is_func_init)
+            declare(std::string{ast.text(i)}, ast.loc(i));
+        accept_flat(init);
+        if (!is_func_init)
+            then_flat(i, 1);
+        return;
+    }
+    case NodeKind::While:
+        accept_flat(ch[0]);
+        then_flat(i, 1);
+        accept_flat(ch[1]);
+        then_flat(i, 2);
+        return;
+    case NodeKind::ForRange:
+        accept_flat(ch[0]);
+        accept_flat(ch[1]);
+        then_flat(i, 1);
+        accept_flat(ch[2]);
+        then_flat(i, 2);
+        return;
+    case NodeKind::ForIter:
+        accept_flat(ch[0]);
+        then_flat(i, 1);
+        accept_flat(ch[1]);
+        then_flat(i, 2);
+        return;
+    case NodeKind::LoopInf:
+        ++loop_depth_;
+        accept_flat(ch[0]);
+        then_flat(i, 2);
+        return;
+    case NodeKind::Exit:
+        if (!in_loop())
+            error(ast.loc(i), "'exit' used outside of a loop");
+        return;
+    case NodeKind::Return:
+        if (!in_func())
+            error(ast.loc(i), "'return' used outside of a function");
+        accept_flat(ch[0]);
+        return;
+    case NodeKind::Is:
+        accept_flat(ch[0]);
+        return;
+    case NodeKind::Ident:
+        ast.set_resolved_depth(i, resolve(std::string{ast.text(i)}, ast.loc(i)));
+        return;
+    case NodeKind::ParamList:
+        for (const FlatAst::Index p : ch)
+            declare(std::string{ast.text(p)}, ast.loc(p));
+        return;
+    case NodeKind::FuncLit:
+        push_scope();
+        funcs_.push_back({nullptr, scope(), {}, ch[1]});
+        if (ch[0] != FlatAst::kNone)
+            visit_flat(ch[0]);
+        accept_flat(ch[1]);
+        then_flat(i, 1);
+        return;
+    default: // the rest visit their children in order
+        for (const FlatAst::Index c : ch)
+            accept_flat(c);
+        return;
+    }
 }
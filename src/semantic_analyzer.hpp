@@ -2,9 +2,14 @@
 
 #include "ast.hpp"
 #include "ast_visitor.hpp"
+#include "flat_ast.hpp"
 
+#include <cstddef>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 struct SemanticError {
@@ -12,9 +17,25 @@ struct SemanticError {
     std::string message;
 };
 
-struct SemanticAnalyzer : ASTVisitorBase<SemanticAnalyzer> {
-
-    void analyze(const ASTNode& root);
+// Resolves every identifier to the number of frames between its use and its
+// declaration (IdentNode::resolved_depth) and fills in the capture annotations
+// (see ast.hpp) and ForIterNode::reads_fields.  A body that declares nothing,
+// and a function body, share the enclosing frame where they can
+// (BodyNode::has_frame); such a body does not count towards the depth of the
+// names used in it.  Each name maps to a stack of its visible declarations, so
+// a lookup is one hash probe whatever the nesting; closing a scope pops the
+// declarations it logged.  Nodes are visited from an explicit work stack
+// rather than by recursion, so the depth of the tree does not matter.
+struct SemanticAnalyzer final : ASTVisitorBase<SemanticAnalyzer> {
+
+    // `inputs` are globals supplied by the host (see Engine), declared in a
+    // scope enclosing the program's.
+    void analyze(const ASTNode& root, std::span<const std::string> inputs = {});
+    // The same analysis over the flat encoding, walking its index ranges: the
+    // resolved depths and has_frame go into the nodes' auxiliary words and the
+    // errors are those analyze() reports for the tree.  The flat encoding has
+    // no room for the capture annotations or reads_fields, which are left out.
+    void analyze(FlatAst& ast, std::span<const std::string> inputs = {});
 
     const std::vector<SemanticError>& errors() const noexcept { return errors_; }
     bool ok() const noexcept { return errors_.empty(); }
@@ -46,27 +67,82 @@ struct SemanticAnalyzer : ASTVisitorBase<SemanticAnalyzer> {
     void visit(const TupleElemNode&) override;
     void visit(const ParamListNode&) override;
     void visit(const FuncLitNode&) override;
+    void visit(const InvariantNode&) override;
+    void visit(const InductionNode&) override;
 
 private:
-    using Scope = std::unordered_map<std::string, int /*decl line*/>;
-
-    std::vector<Scope> scopes_;
+    struct Binding {
+        int scope; // index of the declaring scope
+        int line;
+        bool* captured; // the declaration's flag; nullptr for builtins and inputs
+    };
+    // A function literal being analyzed.
+    struct Func {
+        const FuncLitNode* node;                   // nullptr in the flat encoding
+        int scope;                                 // index of its parameter scope
+        std::unordered_set<std::string_view> free; // names in node->free_vars
+        FlatAst::Index body = FlatAst::kNone;      // in the flat encoding
+    };
+
+    // The visible declarations of each name, innermost last.
+    std::unordered_map<std::string, std::vector<Binding>> bindings_;
+    std::vector<std::vector<Binding>*> declared_; // undo log: the stacks pushed to, in order
+    std::vector<size_t> scope_marks_;             // declared_.size() on entry to each scope
+    std::vector<int> frames_;                     // frame index of each scope
+    std::vector<Func> funcs_;                     // innermost last
     int loop_depth_{0};
-    int func_depth_{0};
+
+    // A node to visit (phase 0), or the part of its visit that follows the
+    // children scheduled before it (phase 1 and up; see resume()).
+    struct Work {
+        const ASTNode* node;
+        int phase;
+    };
+    std::vector<Work> work_;      // next last
+    std::vector<Work> scheduled_; // by the visit in progress, in order
+
+    // The same for the flat encoding being analyzed.
+    struct FlatWork {
+        FlatAst::Index node;
+        int phase;
+    };
+    FlatAst* flat_{nullptr};
+    std::vector<FlatWork> flat_work_;
+    std::vector<FlatWork> flat_scheduled_;
 
     std::vector<SemanticError> errors_;
 
-    void push_scope();
+    void push_scope(bool has_frame = true);
     void pop_scope();
 
-    void declare(const std::string& name, Location loc);
+    int scope() const noexcept { return static_cast<int>(scope_marks_.size()) - 1; }
+
+    void declare(const std::string& name, Location loc, bool* captured = nullptr);
 
     int resolve(const std::string& name, Location loc);
+    void capture(std::string_view name, const Binding& b);
 
     bool in_loop() const noexcept { return loop_depth_ > 0; }
-    bool in_func() const noexcept { return func_depth_ > 0; }
+    bool in_func() const noexcept { return !funcs_.empty(); }
 
     void error(Location loc, std::string msg);
 
+    // Opens the scopes of the builtins, the inputs and the program; and closes them.
+    void open_globals(std::span<const std::string> inputs);
+    void close_globals();
+
+    // Schedules a visit of `n` (if any) after the current one.
     void accept(const ASTNode* n);
+    // Schedules resume(n, phase) after the nodes scheduled before it.
+    void then(const ASTNode& n, int phase) { scheduled_.push_back({&n, phase}); }
+    void resume(const ASTNode& n, int phase);
+    // The part of resume() shared by both encodings; `name` is a VarDef's or a
+    // loop's, `captured` its flag (nullptr in the flat encoding).
+    void resume(NodeKind kind, int phase, const std::string& name, Location loc, bool* captured);
+
+    // visit(), accept(), then() and resume() for the flat encoding.
+    void visit_flat(FlatAst::Index i);
+    void accept_flat(FlatAst::Index i);
+    void then_flat(FlatAst::Index i, int phase) { flat_scheduled_.push_back({i, phase}); }
+    void resume_flat(FlatAst::Index i, int phase);
 };
@@ -0,0 +1,487 @@
+#include "snapshot.hpp"
+
+#include "builtins.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <span>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ── File format ───────────────────────────────────────────────────────────────
+//
+//   Header
+//   globals    u64 count, then count × (str name, val)
+//   objects    one record per id, in id order
+//   table      u64 file offset of each object record
+//
+// A str is a u64 length and the bytes; a val is a tag byte followed by the
+// i64 / f64 / u8 / str of a scalar, or by the u64 id of an array, tuple or
+// function object.  Object records start with their tag:
+//
+//   Array      u8 kind; Ints/Reals: i64 first key, u64 n, n raw elements;
+//              Boxed: u64 n, n × (i64 key, val)
+//   Tuple      u64 n, n × (str name, val)
+//   Func       i32 line, i32 col of the FuncLitNode, u64 n, n frame ids
+//   Builtin    u32 index in builtins()
+//   Frame      u64 n, n × (str name, val)
+//   RootFrame  u32 depth in the env of the run
+
+namespace {
+
+enum class Tag : uint8_t {
+    None,
+    Int,
+    Real,
+    Bool,
+    String,
+    Array,
+    Tuple,
+    Func,
+    Builtin,
+    Frame,
+    RootFrame,
+};
+
+constexpr char kMagic[8]     = {'D', 'S', 'N', 'A', 'P', '0', '0', '1'};
+constexpr size_t kRootFrames = 3; // builtins, inputs, globals
+
+struct Header {
+    char magic[8];
+    uint64_t hash;
+    int64_t line;
+    uint64_t objects;
+    uint64_t table;
+};
+
+// ── Writer ────────────────────────────────────────────────────────────────────
+
+class Writer {
+public:
+    explicit Writer(const Env& env) : env_{env} {}
+
+    std::string write(uint64_t hash, int line) {
+        out_.resize(sizeof(Header));
+        put_entries(*env_.at(kRootFrames - 1));
+
+        // Records may queue further objects while they are written.
+        std::vector<uint64_t> offsets;
+        for (size_t id = 0; id < pending_.size(); ++id) {
+            offsets.push_back(out_.size());
+            put_object(pending_[id].first, pending_[id].second);
+        }
+
+        Header h{};
+        std::memcpy(h.magic, kMagic, sizeof kMagic);
+        h.hash    = hash;
+        h.line    = line;
+        h.objects = offsets.size();
+        h.table   = out_.size();
+        for (const uint64_t off : offsets)
+            put(off);
+        std::memcpy(out_.data(), &h, sizeof h);
+        return std::move(out_);
+    }
+
+private:
+    const Env& env_;
+    std::string out_;
+    std::unordered_map<const void*, uint64_t> ids_;
+    std::vector<std::pair<Tag, const void*>> pending_; // by id
+
+    template <typename T> void put(T v) {
+        char bytes[sizeof v];
+        std::memcpy(bytes, &v, sizeof v);
+        out_.append(bytes, sizeof v);
+    }
+    void put_str(std::string_view s) {
+        put<uint64_t>(s.size());
+        out_ += s;
+    }
+
+    // The id of object p, queued for writing when first seen.
+    uint64_t id(Tag tag, const void* p) {
+        auto [it, inserted] = ids_.try_emplace(p, pending_.size());
+        if (inserted)
+            pending_.emplace_back(tag, p);
+        return it->second;
+    }
+
+    uint64_t frame_id(const FramePtr& f) {
+        for (size_t d = 0; d < kRootFrames && d < env_.size(); ++d)
+            if (env_[d] == f)
+                return id(Tag::RootFrame, f.get());
+        return id(Tag::Frame, f.get());
+    }
+
+    void put_value(const DValue& v) {
+        switch (v.type) {
+        case DValue::Type::None:
+            return put(Tag::None);
+        case DValue::Type::Int:
+            put(Tag::Int);
+            return put<int64_t>(v.ival);
+        case DValue::Type::Real:
+            put(Tag::Real);
+            return put(v.rval);
+        case DValue::Type::Bool:
+            put(Tag::Bool);
+            return put<uint8_t>(v.bval);
+        case DValue::Type::String:
+            put(Tag::String);
+            return put_str(v.sval);
+        case DValue::Type::Array:
+            put(Tag::Array);
+            return put(id(Tag::Array, v.aval.get()));
+        case DValue::Type::Tuple:
+            put(Tag::Tuple);
+            return put(id(Tag::Tuple, v.tval.get()));
+        case DValue::Type::Func:
+            if (v.fval->code)
+                throw SnapshotError{"closures of the closure engine cannot be saved"};
+            put(Tag::Func);
+            return put(id(v.fval->native ? Tag::Builtin : Tag::Func, v.fval.get()));
+        }
+    }
+
+    void put_entries(const Frame& f) {
+        put<uint64_t>(f.size());
+        for (const auto& [name, v] : f) {
+            put_str(name);
+            put_value(v);
+        }
+    }
+
+    void put_object(Tag tag, const void* p) {
+        put(tag);
+        switch (tag) {
+        case Tag::Array: {
+            const auto& a = *static_cast<const ArrayStorage*>(p);
+            a.expose(); // Records are written as the tuples they hold
+            put(a.kind());
+            if (a.kind() == ArrayStorage::Kind::Ints || a.kind() == ArrayStorage::Kind::Reals) {
+                put<int64_t>(a.first_key());
+                put<uint64_t>(a.size());
+                const auto bytes = a.kind() == ArrayStorage::Kind::Ints
+                                       ? std::as_bytes(a.ints())
+                                       : std::as_bytes(a.reals());
+                out_.append(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+            } else if (a.kind() == ArrayStorage::Kind::Boxed) {
+                put<uint64_t>(a.size());
+                for (const auto& [k, v] : a.boxed()) {
+                    put<int64_t>(k);
+                    put_value(v);
+                }
+            }
+            return;
+        }
+        case Tag::Tuple: {
+            const auto& elems = *static_cast<const std::vector<TupleElem>*>(p);
+            put<uint64_t>(elems.size());
+            for (const auto& e : elems) {
+                put_str(e.name);
+                put_value(e.value);
+            }
+            return;
+        }
+        case Tag::Func: {
+            const auto& f = *static_cast<const FuncClosure*>(p);
+            put<int32_t>(f.node->loc.line);
+            put<int32_t>(f.node->loc.col);
+            put<uint64_t>(f.captured_env.size());
+            for (const auto& frame : f.captured_env)
+                put(frame_id(frame));
+            return;
+        }
+        case Tag::Builtin: {
+            const Builtin* b = static_cast<const FuncClosure*>(p)->native;
+            return put(static_cast<uint32_t>(b - builtins().data()));
+        }
+        case Tag::Frame:
+            return put_entries(*static_cast<const Frame*>(p));
+        case Tag::RootFrame:
+            for (uint32_t d = 0; d < kRootFrames; ++d)
+                if (env_[d].get() == p)
+                    return put(d);
+            return;
+        default:
+            return;
+        }
+    }
+};
+
+[[noreturn]] void corrupt() {
+    throw SnapshotError{"snapshot is corrupt"};
+}
+
+} // namespace
+
+uint64_t source_hash(std::string_view source) {
+    uint64_t h = 14695981039346656037ull;
+    for (const char c : source) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+void write_snapshot(const std::string& path, uint64_t hash, int line, const Env& env) {
+    const std::string bytes = Writer{env}.write(hash, line);
+    std::ofstream f{path, std::ios::binary};
+    if (!f || !f.write(bytes.data(), static_cast<std::streamsize>(bytes.size())))
+        throw SnapshotError{std::format("cannot write snapshot '{}'", path)};
+}
+
+// ── Reader ────────────────────────────────────────────────────────────────────
+
+// Bounds-checked cursor into the mapping.
+class Snapshot::Reader {
+public:
+    Reader(const Mapping& m, uint64_t pos) : m_{m}, pos_{static_cast<size_t>(pos)} {
+        if (pos > m.size)
+            corrupt();
+    }
+
+    size_t pos() const noexcept { return pos_; }
+
+    template <typename T> T get() {
+        T v;
+        std::memcpy(&v, bytes(sizeof v), sizeof v);
+        return v;
+    }
+    std::string_view get_str() {
+        const auto n = get<uint64_t>();
+        return {bytes(n), static_cast<size_t>(n)};
+    }
+    const char* bytes(uint64_t n) {
+        if (n > m_.size - pos_)
+            corrupt();
+        const char* p = m_.data + pos_;
+        pos_ += static_cast<size_t>(n);
+        return p;
+    }
+
+    // Steps over a val without rebuilding it.
+    void skip_value() {
+        switch (get<Tag>()) {
+        case Tag::None:
+            return;
+        case Tag::Int:
+        case Tag::Real:
+        case Tag::Array:
+        case Tag::Tuple:
+        case Tag::Func:
+            bytes(8);
+            return;
+        case Tag::Bool:
+            bytes(1);
+            return;
+        case Tag::String:
+            get_str();
+            return;
+        default:
+            corrupt();
+        }
+    }
+
+private:
+    const Mapping& m_;
+    size_t pos_;
+};
+
+Snapshot::Mapping::~Mapping() {
+    if (data)
+        ::munmap(const_cast<char*>(data), size);
+}
+
+Snapshot::Snapshot(const std::string& path, uint64_t hash, const ASTNode& root) : root_{root} {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw SnapshotError{
+            std::format("cannot open snapshot '{}': {}", path, std::strerror(errno))};
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(Header))) {
+        void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED) {
+            map_.data = static_cast<const char*>(p);
+            map_.size = static_cast<size_t>(st.st_size);
+        }
+    }
+    ::close(fd);
+
+    Header h{};
+    if (map_.data)
+        std::memcpy(&h, map_.data, sizeof h);
+    if (!map_.data || std::memcmp(h.magic, kMagic, sizeof kMagic) != 0 || h.table > map_.size ||
+        h.objects > (map_.size - h.table) / sizeof(uint64_t))
+        throw SnapshotError{std::format("'{}' is not a snapshot", path)};
+    if (h.hash != hash)
+        throw SnapshotError{std::format("snapshot '{}' was taken from another program", path)};
+    line_          = static_cast<int>(h.line);
+    objects_count_ = h.objects;
+    table_         = static_cast<size_t>(h.table);
+
+    // Index the globals by name; their values are rebuilt by load().
+    Reader r{map_, sizeof(Header)};
+    for (auto n = r.get<uint64_t>(); n > 0; --n) {
+        const std::string_view name = r.get_str();
+        globals_.emplace(name, r.pos());
+        r.skip_value();
+    }
+}
+
+std::optional<DValue> Snapshot::load(const std::string& name, const Env& env) {
+    const auto it = globals_.find(name);
+    if (it == globals_.end())
+        return std::nullopt;
+    Reader r{map_, it->second};
+    return value(r, env);
+}
+
+DValue Snapshot::value(Reader& r, const Env& env) {
+    DValue v;
+    switch (r.get<Tag>()) {
+    case Tag::None:
+        return v;
+    case Tag::Int:
+        return DValue::make_int(r.get<int64_t>());
+    case Tag::Real:
+        return DValue::make_real(r.get<double>());
+    case Tag::Bool:
+        return DValue::make_bool(r.get<uint8_t>() != 0);
+    case Tag::String:
+        return DValue::make_str(std::string{r.get_str()});
+    case Tag::Array:
+        v.type = DValue::Type::Array;
+        v.aval = std::static_pointer_cast<ArrayStorage>(
+            object(r.get<uint64_t>(), static_cast<uint8_t>(Tag::Array), env));
+        return v;
+    case Tag::Tuple:
+        v.type = DValue::Type::Tuple;
+        v.tval = std::static_pointer_cast<std::vector<TupleElem>>(
+            object(r.get<uint64_t>(), static_cast<uint8_t>(Tag::Tuple), env));
+        return v;
+    case Tag::Func:
+        v.type = DValue::Type::Func;
+        v.fval = std::static_pointer_cast<FuncClosure>(
+            object(r.get<uint64_t>(), static_cast<uint8_t>(Tag::Func), env));
+        return v;
+    default:
+        corrupt();
+    }
+}
+
+FramePtr Snapshot::frame(uint64_t id, const Env& env) {
+    return std::static_pointer_cast<Frame>(object(id, static_cast<uint8_t>(Tag::Frame), env));
+}
+
+// Every object is registered before its contents are rebuilt, so references
+// back to it (cycles) find it.
+std::shared_ptr<void> Snapshot::object(uint64_t id, uint8_t expected, const Env& env) {
+    if (id >= objects_count_)
+        corrupt();
+    if (objects_.empty())
+        objects_.resize(static_cast<size_t>(objects_count_));
+    if (objects_[id])
+        return objects_[id];
+
+    Reader r{map_, Reader{map_, table_ + id * sizeof(uint64_t)}.get<uint64_t>()};
+    const Tag tag = r.get<Tag>();
+    const auto want = static_cast<Tag>(expected);
+    if (tag != want && !(want == Tag::Func && tag == Tag::Builtin) &&
+        !(want == Tag::Frame && tag == Tag::RootFrame))
+        corrupt();
+
+    switch (tag) {
+    case Tag::Array: {
+        auto a       = std::make_shared<ArrayStorage>();
+        objects_[id] = a;
+        const auto kind = r.get<ArrayStorage::Kind>();
+        if (kind == ArrayStorage::Kind::Ints || kind == ArrayStorage::Kind::Reals) {
+            const auto first = r.get<int64_t>();
+            const auto n     = r.get<uint64_t>();
+            if (n > map_.size / 8)
+                corrupt();
+            const char* p = r.bytes(n * 8);
+            if (kind == ArrayStorage::Kind::Ints) {
+                std::vector<long long> elems(static_cast<size_t>(n));
+                std::memcpy(elems.data(), p, n * 8);
+                *a = ArrayStorage{first, std::move(elems)};
+            } else {
+                std::vector<double> elems(static_cast<size_t>(n));
+                std::memcpy(elems.data(), p, n * 8);
+                *a = ArrayStorage{first, std::move(elems)};
+            }
+        } else if (kind == ArrayStorage::Kind::Boxed) {
+            for (auto n = r.get<uint64_t>(); n > 0; --n) {
+                const auto key = r.get<int64_t>();
+                a->set(key, value(r, env));
+            }
+        }
+        return a;
+    }
+    case Tag::Tuple: {
+        auto t       = std::make_shared<std::vector<TupleElem>>();
+        objects_[id] = t;
+        for (auto n = r.get<uint64_t>(); n > 0; --n) {
+            std::string name{r.get_str()};
+            DValue v = value(r, env);
+            t->push_back({std::move(name), std::move(v)});
+        }
+        return t;
+    }
+    case Tag::Func: {
+        const int line = r.get<int32_t>();
+        const int col  = r.get<int32_t>();
+        auto f         = std::make_shared<FuncClosure>(FuncClosure{func(line, col), {}});
+        objects_[id]   = f;
+        for (auto n = r.get<uint64_t>(); n > 0; --n)
+            f->captured_env.push_back(frame(r.get<uint64_t>(), env));
+        return f;
+    }
+    case Tag::Builtin: {
+        const auto i = r.get<uint32_t>();
+        if (i >= builtins().size())
+            corrupt();
+        return objects_[id] = DValue::make_builtin(&builtins()[i]).fval;
+    }
+    case Tag::Frame: {
+        auto f       = std::make_shared<Frame>();
+        objects_[id] = f;
+        for (auto n = r.get<uint64_t>(); n > 0; --n) {
+            std::string name{r.get_str()};
+            DValue v = value(r, env);
+            (*f)[std::move(name)] = std::move(v);
+        }
+        return f;
+    }
+    case Tag::RootFrame: {
+        // Not kept: the frames belong to the run.
+        const auto d = r.get<uint32_t>();
+        if (d >= kRootFrames || d >= env.size())
+            corrupt();
+        return env[d];
+    }
+    default:
+        corrupt();
+    }
+}
+
+const FuncLitNode* Snapshot::func(int line, int col) {
+    if (funcs_.empty()) {
+        auto index = [this](auto& self, const ASTNode& n) -> void {
+            if (const auto* f = node_cast<FuncLitNode>(&n))
+                funcs_.emplace(std::pair{n.loc.line, n.loc.col}, f);
+            for_each_child(n, [&](const std::unique_ptr<ASTNode>& c) { self(self, *c); });
+        };
+        index(index, root_);
+    }
+    const auto it = funcs_.find({line, col});
+    if (it == funcs_.end())
+        corrupt();
+    return it->second;
+}
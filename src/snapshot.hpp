@@ -0,0 +1,95 @@
+#pragma once
+
+#include "ast.hpp"
+#include "value.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ── Heap snapshots ────────────────────────────────────────────────────────────
+//
+// A snapshot holds the global variables of a tree-interpreter run, taken
+// between two top-level statements (dinterp --snapshot-after=<line>), so that a
+// later run of the same program can continue from there (dinterp --restore)
+// instead of executing again the statements that built them.
+//
+// The file holds the object graph reachable from the global frame: strings,
+// arrays, tuples, closures and the frames the closures captured.  Every array,
+// tuple, closure and frame is written once and referred to by id, so aliasing
+// and cycles survive the round trip.  A closure names its FuncLitNode by source
+// location, and the builtins, inputs and global frames of the run by depth.
+// The snapshot records a hash of the program text and is only valid for that
+// text; numbers are stored in the byte order of the machine that wrote them.
+//
+// Restoring maps the file read-only and decodes nothing up front.  The
+// interpreter asks for a global the first time a lookup misses it in the global
+// frame; only the objects reachable from that global are rebuilt, each once per
+// run.  Unboxed arrays are copied straight out of the mapping.
+
+// Unreadable, malformed or mismatched snapshot, or a value that cannot be saved.
+struct SnapshotError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// FNV-1a hash of a program text, recorded in and checked against snapshots.
+uint64_t source_hash(std::string_view source);
+
+// Writes the globals of a run to `path`.  `env` starts with the builtins,
+// inputs and global frames of the run.  Throws SnapshotError.
+void write_snapshot(const std::string& path, uint64_t hash, int line, const Env& env);
+
+class Snapshot {
+public:
+    // Maps `path`.  Throws SnapshotError when the file cannot be read, is not a
+    // snapshot, or was taken from a program text with another hash.  `root` is
+    // the AST of that program; it must outlive the Snapshot.
+    Snapshot(const std::string& path, uint64_t hash, const ASTNode& root);
+
+    // Top-level statements starting on or before this line had run.
+    int line() const noexcept { return line_; }
+
+    // Rebuilds global `name`, or returns nullopt if the snapshot does not hold
+    // it.  `env` starts with the builtins, inputs and global frames of the
+    // restoring run.
+    std::optional<DValue> load(const std::string& name, const Env& env);
+
+    // Forgets the objects rebuilt so far; the next run rebuilds its own.
+    void release() noexcept { objects_.clear(); }
+
+private:
+    class Reader;
+
+    // The read-only mapping of the file; unmapped on destruction.
+    struct Mapping {
+        const char* data{nullptr};
+        size_t size{0};
+        Mapping() = default;
+        Mapping(const Mapping&)            = delete;
+        Mapping& operator=(const Mapping&) = delete;
+        ~Mapping();
+    };
+
+    Mapping map_;
+    int line_{0};
+    uint64_t objects_count_{0};
+    size_t table_{0}; // offset of the object offset table
+    const ASTNode& root_;
+
+    std::unordered_map<std::string_view, size_t> globals_; // name → offset of its value
+    std::map<std::pair<int, int>, const FuncLitNode*> funcs_; // by (line, col), built on demand
+    std::vector<std::shared_ptr<void>> objects_;             // rebuilt objects by id
+
+    DValue value(Reader& r, const Env& env);
+    std::shared_ptr<void> object(uint64_t id, uint8_t expected, const Env& env);
+    FramePtr frame(uint64_t id, const Env& env);
+    const FuncLitNode* func(int line, int col);
+};
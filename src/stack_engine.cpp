@@ -0,0 +1,713 @@
+#include "stack_engine.hpp"
+
+#include "builtins.hpp"
+#include "interpreter.hpp"
+#include "value_ops.hpp"
+
+#include <cstddef>
+#include <format>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ── Task steps ────────────────────────────────────────────────────────────────
+//
+// Task::step starts at 0.  Nodes that run a list (Program, Body, VarDecl,
+// Print, ArrayLit, TupleLit, Call) count the elements already pushed; the
+// others use the constants below.  A loop whose body is running, or a call
+// whose callee is, is where `exit` or `return` stops unwinding.
+
+namespace {
+
+constexpr uint32_t kWhileBody    = 2; // 1: condition running
+constexpr uint32_t kForRangeBody = 3; // 1, 2: bounds running
+constexpr uint32_t kForIterBody  = 2; // 1: iterable running
+constexpr uint32_t kLoopInfBody  = 1;
+constexpr uint32_t kCalling      = UINT32_MAX;
+
+bool in_loop_body(NodeKind kind, uint32_t step) {
+    switch (kind) {
+    case NodeKind::While:
+        return step == kWhileBody;
+    case NodeKind::ForRange:
+        return step == kForRangeBody;
+    case NodeKind::ForIter:
+        return step == kForIterBody;
+    case NodeKind::LoopInf:
+        return step == kLoopInfBody;
+    default:
+        return false;
+    }
+}
+
+} // namespace
+
+// ── StackEngine ───────────────────────────────────────────────────────────────
+
+StackEngine::StackEngine(std::ostream& out) : out_{out} {}
+
+void StackEngine::run(const ASTNode& root, const Frame& inputs) {
+    struct BudgetScope {
+        Budget& b;
+        ~BudgetScope() { b.stop(); }
+    } budget_scope{budget_};
+    // Drops what an error left on the stacks and, as Interpreter::run does,
+    // breaks the reference cycles between closures and the frames they capture.
+    struct Reset {
+        StackEngine& e;
+        ~Reset() {
+            e.tasks_.clear();
+            e.values_.clear();
+            e.iterations_.clear();
+            e.callers_.push_back({std::move(e.env_), nullptr});
+            for (auto& caller : e.callers_)
+                for (auto& frame : caller.env)
+                    frame->clear();
+            e.callers_.clear();
+        }
+    } reset{*this};
+    budget_.start();
+
+    env_.clear();
+    frames_.clear();
+    env_.push_back(std::make_shared<Frame>()); // builtins
+    for (const Builtin& b : builtins())
+        (*env_.back())[std::string{b.name}] = DValue::make_builtin(&b);
+    env_.push_back(std::make_shared<Frame>(inputs));
+    env_.push_back(std::make_shared<Frame>());
+
+    if (!push(root))
+        while (!tasks_.empty())
+            step();
+}
+
+// Leaves are evaluated on the spot: their value is pushed and true returned.
+// Any other node becomes a task and runs from the next step().
+bool StackEngine::push(const ASTNode& n) {
+    switch (n.kind) {
+    case NodeKind::IntLit:
+        values_.push_back(DValue::make_int(static_cast<const IntLitNode&>(n).value));
+        return true;
+    case NodeKind::RealLit:
+        values_.push_back(DValue::make_real(static_cast<const RealLitNode&>(n).value));
+        return true;
+    case NodeKind::StrLit:
+        values_.push_back(DValue::make_str(static_cast<const StrLitNode&>(n).value));
+        return true;
+    case NodeKind::BoolLit:
+        values_.push_back(DValue::make_bool(static_cast<const BoolLitNode&>(n).value));
+        return true;
+    case NodeKind::NoneLit:
+    case NodeKind::Type:
+        values_.emplace_back();
+        return true;
+    case NodeKind::Ident:
+        values_.push_back(variable(static_cast<const IdentNode&>(n)));
+        return true;
+    case NodeKind::FuncLit:
+        values_.push_back(DValue::make_func(&static_cast<const FuncLitNode&>(n), env_));
+        return true;
+    // Optimizer annotations run their original expression.
+    case NodeKind::Invariant:
+        return push(*static_cast<const InvariantNode&>(n).expr);
+    case NodeKind::Induction:
+        return push(*static_cast<const InductionNode&>(n).expr);
+    case NodeKind::TupleElem:
+        return push(*static_cast<const TupleElemNode&>(n).expr);
+    default:
+        tasks_.push_back({&n});
+        return false;
+    }
+}
+
+DValue StackEngine::pop() {
+    DValue v = std::move(values_.back());
+    values_.pop_back();
+    return v;
+}
+
+// Moves the top `n` values into a vector, bottom first.
+std::vector<DValue> StackEngine::pop(size_t n) {
+    std::vector<DValue> v(std::make_move_iterator(values_.end() - static_cast<ptrdiff_t>(n)),
+                          std::make_move_iterator(values_.end()));
+    values_.resize(values_.size() - n);
+    return v;
+}
+
+// Finishes the top task with value `v`.
+void StackEngine::result(DValue v) {
+    tasks_.pop_back();
+    values_.push_back(std::move(v));
+}
+
+// Advances the top task.  Every case leaves the task to the next step() once
+// it has pushed a child task; `t` is not touched after that, since the push
+// may have moved it.  Leaves pushed on the way fall through to the next step.
+void StackEngine::step() {
+    Task& t             = tasks_.back();
+    const ASTNode& node = *t.node;
+    switch (node.kind) {
+    // A statement that is an expression leaves its value behind; it is
+    // dropped before the next one runs.
+    case NodeKind::Program: {
+        const auto& n = static_cast<const ProgramNode&>(node);
+        if (t.step == 0)
+            t.values = values_.size();
+        values_.resize(t.values);
+        if (t.step < n.stmts.size())
+            push(*n.stmts[t.step++]);
+        else
+            tasks_.pop_back();
+        return;
+    }
+    case NodeKind::Body: {
+        const auto& n = static_cast<const BodyNode&>(node);
+        if (t.step == 0) {
+            if (n.has_frame)
+                enter(&n);
+            t.values = values_.size();
+        }
+        values_.resize(t.values);
+        if (t.step < n.stmts.size()) {
+            push(*n.stmts[t.step++]);
+            return;
+        }
+        if (n.has_frame)
+            leave(&n);
+        tasks_.pop_back();
+        return;
+    }
+    case NodeKind::VarDecl: {
+        const auto& n = static_cast<const VarDeclNode&>(node);
+        if (t.step < n.defs.size())
+            push(*n.defs[t.step++]);
+        else
+            tasks_.pop_back();
+        return;
+    }
+    case NodeKind::VarDef: {
+        const auto& n = static_cast<const VarDefNode&>(node);
+        if (t.step == 0 && n.init) {
+            // As in the Interpreter, a function literal captures the frame
+            // with its own variable already in it.
+            if (n.init->kind == NodeKind::FuncLit)
+                (*env_.back())[n.varname] = {};
+            t.step = 1;
+            if (!push(*n.init))
+                return;
+        }
+        (*env_.back())[n.varname] = n.init ? pop() : DValue{};
+        tasks_.pop_back();
+        return;
+    }
+    case NodeKind::Assign:
+        return assign(static_cast<const AssignNode&>(node), t);
+    case NodeKind::If: {
+        const auto& n = static_cast<const IfNode&>(node);
+        if (t.step == 0) {
+            t.step = 1;
+            if (!push(*n.cond))
+                return;
+        }
+        // The chosen branch replaces the If: nothing is left to do after it.
+        const bool cond = pop().is_truthy();
+        tasks_.pop_back();
+        if (cond)
+            push(*n.then_body);
+        else if (n.else_body)
+            push(*n.else_body);
+        return;
+    }
+    case NodeKind::IfShort: {
+        const auto& n = static_cast<const IfShortNode&>(node);
+        if (t.step == 0) {
+            t.step = 1;
+            if (!push(*n.cond))
+                return;
+        }
+        const bool cond = pop().is_truthy();
+        tasks_.pop_back();
+        if (cond)
+            push(*n.stmt);
+        return;
+    }
+    case NodeKind::While: {
+        const auto& n = static_cast<const WhileNode&>(node);
+        if (t.step != 1) {
+            t.step = 1;
+            if (!push(*n.cond))
+                return;
+        }
+        if (!pop().is_truthy()) {
+            tasks_.pop_back();
+            return;
+        }
+        budget_.step(n.loc);
+        t.step   = kWhileBody;
+        t.values = values_.size();
+        push(*n.body);
+        return;
+    }
+    case NodeKind::ForRange:
+        return for_range(static_cast<const ForRangeNode&>(node), t);
+    case NodeKind::ForIter:
+        return for_iter(static_cast<const ForIterNode&>(node), t);
+    case NodeKind::LoopInf: {
+        const auto& n = static_cast<const LoopInfNode&>(node);
+        budget_.step(n.loc);
+        t.step   = kLoopInfBody;
+        t.values = values_.size();
+        push(*n.body);
+        return;
+    }
+    case NodeKind::Exit:
+        return unwind_exit();
+    case NodeKind::Return: {
+        const auto& n = static_cast<const ReturnNode&>(node);
+        if (t.step == 0 && n.value) {
+            t.step = 1;
+            if (!push(*n.value))
+                return;
+        }
+        return unwind_return(n.value ? pop() : DValue{});
+    }
+    case NodeKind::Print: {
+        // Output is interleaved with evaluation, as in the Interpreter, so
+        // that the callees of later operands print after the earlier ones.
+        const auto& n = static_cast<const PrintNode&>(node);
+        for (;;) {
+            if (t.step > 0)
+                out_ << pop().to_string();
+            if (t.step == n.exprs.size())
+                break;
+            if (t.step > 0)
+                out_ << ' ';
+            if (!push(*n.exprs[t.step++]))
+                return;
+        }
+        out_ << '\n';
+        tasks_.pop_back();
+        return;
+    }
+    case NodeKind::BinOp:
+        return binary(static_cast<const BinOpNode&>(node), t);
+    case NodeKind::UnaryOp: {
+        const auto& n = static_cast<const UnaryOpNode&>(node);
+        if (t.step == 0) {
+            t.step = 1;
+            if (!push(*n.operand))
+                return;
+        }
+        return result(unary_op(n.op, pop()));
+    }
+    case NodeKind::Is: {
+        const auto& n = static_cast<const IsNode&>(node);
+        if (t.step == 0) {
+            t.step = 1;
+            if (!push(*n.operand))
+                return;
+        }
+        const auto type = static_cast<const TypeNode&>(*n.type_node).type;
+        return result(DValue::make_bool(has_type(pop(), type)));
+    }
+    case NodeKind::Index: {
+        const auto& n = static_cast<const IndexNode&>(node);
+        switch (t.step) {
+        case 0:
+            t.step = 1;
+            if (!push(*n.base))
+                return;
+            [[fallthrough]];
+        case 1:
+            t.step = 2;
+            if (!push(*n.index_expr))
+                return;
+        }
+        const DValue key  = pop();
+        const DValue base = pop();
+        return result(index_get(base, key));
+    }
+    case NodeKind::Call:
+        return call(static_cast<const CallNode&>(node), t);
+    case NodeKind::DotField: {
+        const auto& n = static_cast<const DotFieldNode&>(node);
+        if (const auto* idx = node_cast<IndexNode>(n.base.get())) {
+            // a[k].field: an array of Records is read in place.
+            switch (t.step) {
+            case 0:
+                t.step = 1;
+                if (!push(*idx->base))
+                    return;
+                [[fallthrough]];
+            case 1:
+                t.step = 2;
+                if (!push(*idx->index_expr))
+                    return;
+            }
+            const DValue key  = pop();
+            const DValue base = pop();
+            return result(element_field_get(base, key, n.field));
+        }
+        if (t.step == 0) {
+            t.step = 1;
+            if (!push(*n.base))
+                return;
+        }
+        const DValue base = pop();
+        return result(field_get(base, n.field));
+    }
+    case NodeKind::DotInt: {
+        const auto& n = static_cast<const DotIntNode&>(node);
+        if (const auto* idx = node_cast<IndexNode>(n.base.get())) {
+            // a[k].index: an array of Records is read in place.
+            switch (t.step) {
+            case 0:
+                t.step = 1;
+                if (!push(*idx->base))
+                    return;
+                [[fallthrough]];
+            case 1:
+                t.step = 2;
+                if (!push(*idx->index_expr))
+                    return;
+            }
+            const DValue key  = pop();
+            const DValue base = pop();
+            return result(element_dot_int_get(base, key, n.index));
+        }
+        if (t.step == 0) {
+            t.step = 1;
+            if (!push(*n.base))
+                return;
+        }
+        const DValue base = pop();
+        return result(dot_int_get(base, n.index));
+    }
+    case NodeKind::ArrayLit: {
+        const auto& n = static_cast<const ArrayLitNode&>(node);
+        while (t.step < n.elems.size())
+            if (!push(*n.elems[t.step++]))
+                return;
+        ArrayStorage a;
+        for (auto& v : pop(n.elems.size()))
+            a.push_back(std::move(v));
+        return result(DValue::make_array(std::move(a)));
+    }
+    case NodeKind::TupleLit: {
+        const auto& n = static_cast<const TupleLitNode&>(node);
+        while (t.step < n.elems.size())
+            if (!push(*n.elems[t.step++]))
+                return;
+        std::vector<TupleElem> elems;
+        auto values = pop(n.elems.size());
+        for (size_t i = 0; i < values.size(); ++i) {
+            const auto& te = static_cast<const TupleElemNode&>(*n.elems[i]);
+            elems.push_back(TupleElem{te.elem_name, std::move(values[i])});
+        }
+        return result(DValue::make_tuple(std::move(elems)));
+    }
+    default:
+        throw std::logic_error{std::format("StackEngine: unexpected {} task", node.kind_name())};
+    }
+}
+
+void StackEngine::assign(const AssignNode& n, Task& t) {
+    using T = DValue::Type;
+    if (const BinOpNode* add = self_concatenation(n)) {
+        // x := x + e may append to x's array or tuple in place.
+        switch (t.step) {
+        case 0:
+            t.step = 1;
+            if (!push(*add->left))
+                return;
+            [[fallthrough]];
+        case 1:
+            t.step = 2;
+            if (!push(*add->right))
+                return;
+        }
+        DValue R  = pop();
+        DValue L  = pop();
+        DValue& x = variable(static_cast<const IdentNode&>(*n.lhs));
+        if (!(L.type == T::Array || L.type == T::Tuple) || !append_in_place(x, L, R))
+            x = binary_op(BinOpNode::Op::ADD, L, R);
+        tasks_.pop_back();
+        return;
+    }
+    // The right-hand side runs first, then the parts of the target.
+    const ASTNode& lhs = *n.lhs;
+    if (t.step == 0) {
+        t.step = 1;
+        if (!push(*n.rhs))
+            return;
+    }
+    if (const auto* id = node_cast<IdentNode>(&lhs)) {
+        variable(*id) = pop();
+        tasks_.pop_back();
+        return;
+    }
+    if (const auto* idx = node_cast<IndexNode>(&lhs)) {
+        switch (t.step) {
+        case 1:
+            t.step = 2;
+            if (!push(*idx->base))
+                return;
+            [[fallthrough]];
+        case 2:
+            t.step = 3;
+            if (!push(*idx->index_expr))
+                return;
+        }
+        const DValue key  = pop();
+        const DValue base = pop();
+        index_set(base, key, pop());
+        tasks_.pop_back();
+        return;
+    }
+    const auto* dot = node_cast<DotFieldNode>(&lhs);
+    const auto* di  = node_cast<DotIntNode>(&lhs);
+    if (!dot && !di)
+        throw std::runtime_error("invalid lvalue");
+    if (const auto* idx = node_cast<IndexNode>(dot ? dot->base.get() : di->base.get())) {
+        // a[k].field := v: an array of Records is written in place.
+        switch (t.step) {
+        case 1:
+            t.step = 2;
+            if (!push(*idx->base))
+                return;
+            [[fallthrough]];
+        case 2:
+            t.step = 3;
+            if (!push(*idx->index_expr))
+                return;
+        }
+        const DValue key  = pop();
+        const DValue base = pop();
+        if (dot)
+            element_field_set(base, key, dot->field, pop());
+        else
+            element_dot_int_set(base, key, di->index, pop());
+        tasks_.pop_back();
+        return;
+    }
+    if (t.step == 1) {
+        t.step = 2;
+        if (!push(dot ? *dot->base : *di->base))
+            return;
+    }
+    const DValue base = pop();
+    if (dot)
+        field_set(base, dot->field, pop());
+    else
+        dot_int_set(base, di->index, pop());
+    tasks_.pop_back();
+}
+
+void StackEngine::for_range(const ForRangeNode& n, Task& t) {
+    switch (t.step) {
+    case 0:
+        t.step = 1;
+        if (!push(*n.from))
+            return;
+        [[fallthrough]];
+    case 1:
+        t.step = 2;
+        if (!push(*n.to))
+            return;
+        [[fallthrough]];
+    case 2:
+        t.end = pop().ival;
+        t.i   = pop().ival;
+        enter(&n); // scope for the iterator
+        break;
+    default: // the body has finished an iteration
+        ++t.i;
+    }
+    if (t.i > t.end) {
+        leave(&n);
+        tasks_.pop_back();
+        return;
+    }
+    budget_.step(n.loc);
+    if (!n.iter.empty())
+        (*env_.back())[n.iter] = DValue::make_int(t.i);
+    t.step   = kForRangeBody;
+    t.values = values_.size();
+    push(*n.body);
+}
+
+void StackEngine::for_iter(const ForIterNode& n, Task& t) {
+    if (t.step == 0) {
+        t.step = 1;
+        if (!push(*n.iterable))
+            return;
+    }
+    if (t.step == 1) {
+        DValue iterable = pop();
+        if (iterable.type != DValue::Type::Array && iterable.type != DValue::Type::Tuple)
+            throw std::runtime_error("cannot iterate over non-array/tuple");
+        Iteration it{std::move(iterable)};
+        if (it.iterable.type == DValue::Type::Array)
+            it.cursor.emplace(*it.iterable.aval, n.reads_fields);
+        iterations_.push_back(std::move(it));
+        enter(&n); // scope for the iterator
+        t.step = kForIterBody;
+    }
+
+    Iteration& it = iterations_.back();
+    DValue elem;
+    bool more = false;
+    if (it.cursor) {
+        more = it.cursor->next(elem);
+    } else if (it.next < it.iterable.tval->size()) {
+        elem = (*it.iterable.tval)[it.next++].value;
+        more = true;
+    }
+    if (!more) {
+        iterations_.pop_back();
+        leave(&n);
+        tasks_.pop_back();
+        return;
+    }
+    budget_.step(n.loc);
+    if (!n.iter.empty())
+        (*env_.back())[n.iter] = std::move(elem);
+    t.values = values_.size();
+    push(*n.body);
+}
+
+void StackEngine::binary(const BinOpNode& n, Task& t) {
+    using Op = BinOpNode::Op;
+    switch (t.step) {
+    case 0:
+        t.step = 1;
+        if (!push(*n.left))
+            return;
+        [[fallthrough]];
+    case 1:
+        // Short-circuit: the right operand runs only when it decides the result.
+        if (n.op == Op::AND || n.op == Op::OR) {
+            const bool l = pop().is_truthy();
+            if (l == (n.op == Op::OR))
+                return result(DValue::make_bool(l));
+        }
+        t.step = 2;
+        if (!push(*n.right))
+            return;
+    }
+    if (n.op == Op::AND || n.op == Op::OR)
+        return result(DValue::make_bool(pop().is_truthy()));
+    const DValue R = pop();
+    const DValue L = pop();
+    if (n.op == Op::XOR)
+        return result(DValue::make_bool(L.is_truthy() != R.is_truthy()));
+    result(binary_op(n.op, L, R));
+}
+
+void StackEngine::call(const CallNode& n, Task& t) {
+    if (t.step == kCalling) { // the callee's body has finished without `return`
+        leave_call();
+        return result({});
+    }
+    if (t.step == 0) {
+        t.step = 1;
+        if (!push(*n.callee))
+            return;
+    }
+    while (t.step <= n.args.size())
+        if (!push(*n.args[t.step++ - 1]))
+            return;
+
+    std::vector<DValue> args = pop(n.args.size());
+    const DValue callee      = pop();
+    budget_.step(n.loc);
+    if (callee.type != DValue::Type::Func)
+        throw std::runtime_error("call on non-function");
+    const FuncClosure& closure = *callee.fval;
+    if (closure.native)
+        return result(call_builtin(*closure.native, args));
+    const FuncLitNode& fn = *closure.node;
+
+    FramePtr params = frames_.acquire(&fn);
+    if (fn.params) {
+        const auto& pl = static_cast<const ParamListNode&>(*fn.params);
+        for (size_t i = 0; i < pl.params.size(); ++i) {
+            const auto& ident           = static_cast<const IdentNode&>(*pl.params[i]);
+            (*params)[ident.ident_name] = i < args.size() ? std::move(args[i]) : DValue{};
+        }
+    }
+    callers_.push_back({std::move(env_), &fn});
+    env_ = closure.captured_env;
+    env_.push_back(std::move(params));
+    t.step   = kCalling;
+    t.values = values_.size();
+    push(*fn.body);
+}
+
+// Pops the callee's parameter frame and returns to the caller's environment.
+void StackEngine::leave_call() {
+    leave(callers_.back().callee);
+    env_ = std::move(callers_.back().env);
+    callers_.pop_back();
+}
+
+// ── Unwinding ─────────────────────────────────────────────────────────────────
+
+// Undoes what `t` had set up when it is popped before finishing.
+void StackEngine::abandon(const Task& t) {
+    switch (t.node->kind) {
+    case NodeKind::Body:
+        if (t.step > 0 && static_cast<const BodyNode*>(t.node)->has_frame)
+            leave(t.node);
+        return;
+    case NodeKind::ForRange:
+        if (t.step == kForRangeBody)
+            leave(t.node);
+        return;
+    case NodeKind::ForIter:
+        if (t.step == kForIterBody) {
+            iterations_.pop_back();
+            leave(t.node);
+        }
+        return;
+    case NodeKind::Call:
+        if (t.step == kCalling)
+            leave_call();
+        return;
+    default:
+        return;
+    }
+}
+
+// Pops tasks up to and including the innermost loop whose body is running,
+// across calls if need be, like an ExitSignal in the Interpreter.
+void StackEngine::unwind_exit() {
+    while (!tasks_.empty()) {
+        const Task t = tasks_.back();
+        tasks_.pop_back();
+        abandon(t);
+        if (in_loop_body(t.node->kind, t.step)) {
+            values_.resize(t.values);
+            return;
+        }
+    }
+    throw ExitSignal{};
+}
+
+// Pops tasks up to the innermost call in progress, which then yields `v`.
+void StackEngine::unwind_return(DValue v) {
+    while (!tasks_.empty()) {
+        const Task t = tasks_.back();
+        tasks_.pop_back();
+        abandon(t);
+        if (t.node->kind == NodeKind::Call && t.step == kCalling) {
+            values_.resize(t.values);
+            values_.push_back(std::move(v));
+            return;
+        }
+    }
+    throw ReturnSignal{std::move(v)};
+}
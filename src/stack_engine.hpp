@@ -0,0 +1,95 @@
+#pragma once
+
+#include "ast.hpp"
+#include "budget.hpp"
+#include "frame_pool.hpp"
+#include "value.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <vector>
+
+// ── StackEngine ───────────────────────────────────────────────────────────────
+//
+// Execution engine for programs too deep for the other two.  The Interpreter
+// and the ClosureEngine evaluate an operand by recursing into it and run a D
+// call as a C++ call, so a long operator chain or a deep D recursion overflows
+// the native stack.  StackEngine keeps both on the heap: a task stack holds one
+// entry per node being executed, with how far it has got, and operands travel
+// on a value stack.  A D call pushes the callee's body as one more task, and
+// `exit` and `return` pop tasks down to the loop or call they leave.  Depth is
+// bounded by memory only.
+//
+// Values, frames and closures are the Interpreter's; output and runtime errors
+// match it.  Optimizer annotations are run through, as in the ClosureEngine.
+// The AST must have passed semantic analysis (resolved_depth is consumed).
+
+class StackEngine {
+public:
+    explicit StackEngine(std::ostream& out);
+    // `inputs` holds the values of the names passed to SemanticAnalyzer::analyze.
+    void run(const ASTNode& root, const Frame& inputs = {});
+
+    // Limits later runs; exceeding a limit throws BudgetExceeded.
+    void set_budget(const Budget::Limits& limits) { budget_ = Budget{limits}; }
+
+private:
+    // A node being executed.  `step` counts its progress (see stack_engine.cpp).
+    struct Task {
+        const ASTNode* node;
+        uint32_t step{0};
+        size_t values{0}; // values_.size() on entry to a body, loop body or callee
+        long long i{0};   // ForRange: iterator value
+        long long end{0}; // ForRange: last iterator value
+    };
+    // A ForIter loop in progress.
+    struct Iteration {
+        DValue iterable;
+        std::optional<ArrayStorage::Cursor> cursor{}; // arrays
+        size_t next{0};                               // tuples
+    };
+    // A call in progress: the environment to return to and the function called.
+    struct Caller {
+        Env env;
+        const FuncLitNode* callee;
+    };
+
+    std::ostream& out_;
+    Budget budget_;
+    Env env_;
+    FramePool frames_;
+    std::vector<Task> tasks_;
+    std::vector<DValue> values_;
+    std::vector<Caller> callers_; // innermost last
+    std::vector<Iteration> iterations_;
+
+    bool push(const ASTNode& n);
+    DValue pop();
+    std::vector<DValue> pop(size_t n);
+    void result(DValue v);
+
+    void step();
+    void assign(const AssignNode& n, Task& t);
+    void for_range(const ForRangeNode& n, Task& t);
+    void for_iter(const ForIterNode& n, Task& t);
+    void binary(const BinOpNode& n, Task& t);
+    void call(const CallNode& n, Task& t);
+
+    void leave_call();
+    void unwind_exit();
+    void unwind_return(DValue v);
+    void abandon(const Task& t);
+
+    // Opens and closes the frame of the scope of `owner` (see FramePool).
+    void enter(const void* owner) { env_.push_back(frames_.acquire(owner)); }
+    void leave(const void* owner) {
+        frames_.release(env_.back(), owner);
+        env_.pop_back();
+    }
+
+    DValue& variable(const IdentNode& id) {
+        return (*env_[env_.size() - 1 - id.resolved_depth])[id.ident_name];
+    }
+};
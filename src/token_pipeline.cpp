@@ -0,0 +1,52 @@
+#include "token_pipeline.hpp"
+
+#include "lexer.hpp"
+
+#include <bit>
+#include <utility>
+
+TokenPipeline::TokenPipeline(std::string source, size_t capacity)
+    : ring_{std::bit_ceil(capacity)},
+      worker_{&TokenPipeline::produce, this, std::move(source)} {}
+
+TokenPipeline::~TokenPipeline() {
+    stop_.store(true, std::memory_order_relaxed);
+    worker_.join();
+}
+
+void TokenPipeline::produce(std::string source) {
+    try {
+        Lexer lexer{std::move(source)};
+        while (true) {
+            yy::parser::symbol_type sym = lexer.next();
+            const bool eof              = sym.kind() == yy::parser::symbol_kind::S_YYEOF;
+            while (!ring_.try_push(std::move(sym))) {
+                if (stop_.load(std::memory_order_relaxed))
+                    return;
+                std::this_thread::yield();
+            }
+            if (eof)
+                break;
+        }
+    } catch (...) {
+        error_ = std::current_exception();
+    }
+    done_.store(true, std::memory_order_release);
+}
+
+yy::parser::symbol_type TokenPipeline::next() {
+    std::optional<yy::parser::symbol_type> sym;
+    while (!ring_.try_pop(sym)) {
+        if (done_.load(std::memory_order_acquire)) {
+            // Everything the producer pushed is visible now; drain it first.
+            if (ring_.try_pop(sym))
+                break;
+            if (error_)
+                std::rethrow_exception(std::exchange(error_, nullptr));
+            return yy::parser::make_YYEOF(last_location_);
+        }
+        std::this_thread::yield();
+    }
+    last_location_ = sym->location;
+    return std::move(*sym);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "parser.tab.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+
+// ── SpscRing ──────────────────────────────────────────────────────────────────
+//
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread.  Each side owns one index and keeps a cached copy of the other's, so
+// the shared cache lines are only touched when the cached view says the ring
+// looks full (producer) or empty (consumer).
+
+template <typename T> class SpscRing {
+public:
+    explicit SpscRing(size_t capacity_pow2)
+        : slots_{std::make_unique<std::optional<T>[]>(capacity_pow2)},
+          mask_{capacity_pow2 - 1} {}
+
+    bool try_push(T&& v) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ > mask_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ > mask_)
+                return false;
+        }
+        slots_[tail & mask_].emplace(std::move(v));
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Moves the oldest element into `out` (which must be disengaged).
+    bool try_pop(std::optional<T>& out) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_)
+                return false;
+        }
+        auto& slot = slots_[head & mask_];
+        out.emplace(std::move(*slot));
+        slot.reset();
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static constexpr size_t kLine = 64;
+
+    std::unique_ptr<std::optional<T>[]> slots_;
+    const size_t mask_;
+
+    alignas(kLine) std::atomic<size_t> head_{0}; // next slot to read
+    alignas(kLine) size_t tail_cache_{0};        // consumer's view of tail_
+    alignas(kLine) std::atomic<size_t> tail_{0}; // next slot to write
+    alignas(kLine) size_t head_cache_{0};        // producer's view of head_
+};
+
+// ── TokenPipeline ─────────────────────────────────────────────────────────────
+//
+// Runs a Lexer over `source` on a worker thread and hands the tokens, each
+// carrying its semantic value and location, to the thread calling next().
+// Lexer errors thrown on the worker are rethrown from next().  Destroying the
+// pipeline early (e.g. after a parse error) stops and joins the worker.
+
+class TokenPipeline {
+public:
+    explicit TokenPipeline(std::string source, size_t capacity = 4096);
+    ~TokenPipeline();
+
+    TokenPipeline(const TokenPipeline&)            = delete;
+    TokenPipeline& operator=(const TokenPipeline&) = delete;
+
+    yy::parser::symbol_type next();
+
+private:
+    SpscRing<yy::parser::symbol_type> ring_;
+    std::atomic<bool> done_{false};           // producer has pushed its last token
+    std::atomic<bool> stop_{false};           // consumer is going away
+    std::exception_ptr error_;                // written before done_ is released
+    yy::parser::location_type last_location_; // consumer side only
+    std::thread worker_;
+
+    void produce(std::string source);
+};
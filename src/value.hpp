@@ -0,0 +1,355 @@
+#pragma once
+
+#include "interp_stats.hpp"
+#include "region.hpp"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct FuncLitNode;
+
+// ── Runtime value ─────────────────────────────────────────────────────────────
+//
+// Forward declarations to break circular dependencies:
+//   DValue  ← shared_ptr<vector<TupleElem>>
+//   TupleElem ← DValue (by value)
+//
+// Solution: DValue holds a shared_ptr to an opaque vector; TupleElem is
+// defined after DValue is complete; make_tuple/make_func are out-of-line.
+
+struct TupleElem;    // forward – complete definition follows DValue
+class ArrayStorage;  // forward – complete definition follows TupleElem
+struct FuncClosure;  // forward – complete definition follows TupleElem
+struct CompiledFunc; // closure engine code for a FuncLitNode (closure_engine.cpp)
+struct Builtin;      // native function (builtins.hpp)
+
+struct DValue {
+    enum class Type { None, Int, Real, Bool, String, Array, Tuple, Func };
+    Type type{Type::None};
+
+    long long ival{};
+    double rval{};
+    bool bval{};
+    std::string sval;
+    std::shared_ptr<ArrayStorage> aval;                // Array: key → value
+    std::shared_ptr<std::vector<TupleElem>> tval;      // Tuple elements (heap)
+    std::shared_ptr<FuncClosure> fval;                 // Function closure
+    [[no_unique_address]] ValueTracker tracker;        // counts copies/moves
+
+    static DValue make_none() { return {}; }
+    static DValue make_int(long long v) {
+        DValue d;
+        d.type = Type::Int;
+        d.ival = v;
+        return d;
+    }
+    static DValue make_real(double v) {
+        DValue d;
+        d.type = Type::Real;
+        d.rval = v;
+        return d;
+    }
+    static DValue make_bool(bool v) {
+        DValue d;
+        d.type = Type::Bool;
+        d.bval = v;
+        return d;
+    }
+    static DValue make_str(std::string v) {
+        DValue d;
+        d.type = Type::String;
+        d.sval = std::move(v);
+        if (active_stats && d.sval.capacity() > std::string{}.capacity()) [[unlikely]]
+            ++active_stats->string_allocs;
+        return d;
+    }
+
+    // Declared here, defined after TupleElem / ArrayStorage / FuncClosure are complete:
+    static DValue make_array(ArrayStorage a);
+    static DValue make_tuple(std::vector<TupleElem> e);
+    static DValue make_func(
+        const FuncLitNode* n,
+        std::vector<std::shared_ptr<std::unordered_map<std::string, DValue>>> env);
+    static DValue make_compiled_func(const FuncLitNode* n,
+                                     std::vector<std::shared_ptr<std::vector<DValue>>> env,
+                                     const CompiledFunc* code);
+    static DValue make_builtin(const Builtin* b);
+
+    std::string to_string() const;
+    bool is_truthy() const; // throws if not Bool
+};
+
+// ── TupleElem (complete after DValue) ────────────────────────────────────────
+
+struct TupleElem {
+    std::string name; // empty for unnamed elements
+    DValue value;
+};
+
+// ── ArrayStorage (complete after TupleElem) ──────────────────────────────────
+//
+// Elements of an array, keyed by integer in ascending order.  An array whose
+// keys are consecutive and whose elements are all Int (or all Real) keeps them
+// unboxed in a vector: 8 bytes per element instead of a map node holding a
+// full DValue.  The representation is chosen by the first element stored.  It
+// switches to a map of DValues, for good, the first time an element of another
+// type is stored, or a key that would leave a gap or go below the first key.
+// Unboxed elements are handed out as fresh DValues, never by reference.
+//
+// Tuples all of one shape (the same element names, in order) are kept as
+// Records: one column per element, itself unboxed while its values are all
+// Int or all Real.  A tuple is taken apart only if nothing else refers to it,
+// as a fresh literal does not; otherwise the array is boxed, so that the tuple
+// it holds stays the one stored.  Single elements are read and written through
+// cell() and set_cell().  Anything that exposes a whole element (find(),
+// boxed(), a copy or a Cursor that keeps its rows) boxes the array first,
+// building its tuples: from then on they have identities that later changes
+// must be seen through.  Where those identities cannot be observed, as in
+// for_each() or a loop that only reads fields of its rows, a walk hands out
+// each row as a tuple built for the step and leaves the columns be.
+
+class ArrayStorage {
+public:
+    enum class Kind : uint8_t { Empty, Ints, Reals, Boxed, Records };
+    using Map = std::map<long long, DValue>;
+
+    ArrayStorage() = default;
+    // A copy shares the tuples of `other`, which is boxed first.
+    ArrayStorage(const ArrayStorage& other);
+    ArrayStorage(ArrayStorage&&) noexcept = default;
+    ArrayStorage& operator=(const ArrayStorage& other) { return *this = ArrayStorage{other}; }
+    ArrayStorage& operator=(ArrayStorage&&) noexcept = default;
+    // Unboxed arrays with keys first, first + 1, ... (empty when the vector is).
+    ArrayStorage(long long first, std::vector<long long> ints)
+        : kind_{ints.empty() ? Kind::Empty : Kind::Ints}, first_{first}, ints_{std::move(ints)} {}
+    ArrayStorage(long long first, std::vector<double> reals)
+        : kind_{reals.empty() ? Kind::Empty : Kind::Reals}, first_{first},
+          reals_{std::move(reals)} {}
+
+    Kind kind() const noexcept { return kind_; }
+    size_t size() const noexcept;
+    bool empty() const noexcept { return size() == 0; }
+    // One past the largest key, or 1 when empty: where `+` and push_back() append.
+    long long next_key() const noexcept;
+
+    std::optional<DValue> find(long long key) const;
+    void set(long long key, DValue v);
+    void push_back(DValue v) { set(next_key(), std::move(v)); }
+    // Appends the elements of `other` from next_key() on.
+    void append(const ArrayStorage& other);
+
+    // Unboxed contents: keys first_key() .. first_key() + size() - 1.
+    long long first_key() const noexcept { return first_; }
+    std::span<const long long> ints() const noexcept { return ints_; }
+    std::span<const double> reals() const noexcept { return reals_; }
+    // Boxed contents (kind() == Boxed after expose()).
+    const Map& boxed() const {
+        expose();
+        return map_;
+    }
+
+    // Records: the row of `key` and the column of the first element named
+    // `name`, or nullopt.
+    std::optional<size_t> row(long long key) const noexcept;
+    std::optional<size_t> column(const std::string& name) const noexcept;
+    size_t columns() const noexcept { return names_.size(); }
+    DValue cell(size_t row, size_t column) const;
+    void set_cell(size_t row, size_t column, DValue v);
+    // Boxes Records (see above); does nothing to the other kinds.
+    void expose() const {
+        if (kind_ == Kind::Records) [[unlikely]]
+            box_records();
+    }
+
+    // Calls f(key, value) for every element in key order.  The array must not
+    // change during the walk; use Cursor for that.  Records are not boxed, so
+    // f must not keep a row it is handed.
+    template <class F>
+    void for_each(F&& f) const;
+
+    // Walks the elements in key order while the loop body may store into the
+    // array: like a map iterator, it still visits elements stored at keys
+    // above the current one.  With `row_copies`, Records rows are handed out
+    // as fresh tuples instead of boxing the array: for a walk that cannot tell
+    // a copy of a row from the row.
+    class Cursor {
+    public:
+        explicit Cursor(const ArrayStorage& a, bool row_copies = false)
+            : a_{&a}, row_copies_{row_copies} {}
+        bool next(DValue& value);
+
+    private:
+        const ArrayStorage* a_;
+        bool row_copies_;
+        bool started_{false};
+        bool boxed_{false};
+        long long key_{0};
+        size_t index_{0};
+        Map::const_iterator it_{};
+    };
+
+private:
+    // A Records column: Ints or Reals unboxed, Boxed in `values`.
+    struct Column {
+        Kind kind;
+        std::vector<long long> ints;
+        std::vector<double> reals;
+        std::vector<DValue> values;
+    };
+
+    // Exposing Records changes the representation of a const array, never
+    // its contents, hence `mutable`.
+    mutable Kind kind_{Kind::Empty};
+    long long first_{1};
+    std::vector<long long> ints_;
+    std::vector<double> reals_;
+    mutable Map map_;
+    mutable std::vector<std::string> names_; // Records: the shape
+    mutable std::vector<Column> columns_;
+    mutable size_t rows_{0};
+
+    bool fits(const DValue& v) const noexcept;
+    void set_row(size_t row, std::vector<TupleElem>& elems);
+    void box_records() const;
+    DValue row_tuple(size_t row) const;
+
+    DValue unboxed(size_t i) const {
+        return kind_ == Kind::Ints ? DValue::make_int(ints_[i]) : DValue::make_real(reals_[i]);
+    }
+    void box();
+};
+
+inline size_t ArrayStorage::size() const noexcept {
+    switch (kind_) {
+    case Kind::Ints:
+        return ints_.size();
+    case Kind::Reals:
+        return reals_.size();
+    case Kind::Records:
+        return rows_;
+    case Kind::Boxed:
+        return map_.size();
+    default:
+        return 0;
+    }
+}
+
+inline long long ArrayStorage::next_key() const noexcept {
+    if (kind_ == Kind::Boxed)
+        return map_.empty() ? 1 : map_.rbegin()->first + 1;
+    return kind_ == Kind::Empty ? 1 : first_ + static_cast<long long>(size());
+}
+
+inline std::optional<DValue> ArrayStorage::find(long long key) const {
+    expose();
+    if (kind_ == Kind::Boxed) {
+        auto it = map_.find(key);
+        if (it == map_.end())
+            return std::nullopt;
+        return it->second;
+    }
+    const auto i = static_cast<unsigned long long>(key - first_);
+    if (kind_ == Kind::Empty || key < first_ || i >= size())
+        return std::nullopt;
+    return unboxed(i);
+}
+
+template <class F>
+void ArrayStorage::for_each(F&& f) const {
+    if (kind_ == Kind::Boxed) {
+        for (const auto& [k, v] : map_)
+            f(k, v);
+        return;
+    }
+    if (kind_ == Kind::Records) {
+        for (size_t r = 0; r < rows_; ++r)
+            f(first_ + static_cast<long long>(r), row_tuple(r));
+        return;
+    }
+    for (size_t i = 0, n = size(); i < n; ++i)
+        f(first_ + static_cast<long long>(i), unboxed(i));
+}
+
+// ── Environment types ─────────────────────────────────────────────────────────
+
+using Frame    = std::unordered_map<std::string, DValue>;
+using FramePtr = std::shared_ptr<Frame>;
+using Env      = std::vector<FramePtr>;
+
+// The closure engine resolves every variable to a (depth, slot) pair at
+// compile time, so its frames are plain vectors indexed by slot.
+using SlotFrame    = std::vector<DValue>;
+using SlotFramePtr = std::shared_ptr<SlotFrame>;
+using SlotEnv      = std::vector<SlotFramePtr>;
+
+// ── FuncClosure (complete after Env) ─────────────────────────────────────────
+
+struct FuncClosure {
+    const FuncLitNode* node;           // non-owning; AST owns the node
+    Env captured_env;                  // lexical environment at definition time
+    SlotEnv captured_slots{};          // same, for closures made by the closure engine
+    const CompiledFunc* code{nullptr}; // closure engine only; owned by the engine
+    const Builtin* native{nullptr};    // set for builtins, which have no node
+};
+
+// ── Out-of-line factory definitions (all dependencies now complete) ────────────
+
+// Arrays, tuples and closures come from the active Region, if any.
+template <class T, class... Args>
+std::shared_ptr<T> make_object(Args&&... args) {
+    if (active_region) [[unlikely]]
+        return std::allocate_shared<T>(RegionAllocator<T>{*active_region},
+                                       std::forward<Args>(args)...);
+    return std::make_shared<T>(std::forward<Args>(args)...);
+}
+
+inline DValue DValue::make_tuple(std::vector<TupleElem> e) {
+    DValue d;
+    d.type = Type::Tuple;
+    d.tval = make_object<std::vector<TupleElem>>(std::move(e));
+    if (active_stats) [[unlikely]]
+        ++active_stats->tuple_allocs;
+    return d;
+}
+
+inline DValue DValue::make_array(ArrayStorage a) {
+    DValue d;
+    d.type = Type::Array;
+    d.aval = make_object<ArrayStorage>(std::move(a));
+    if (active_stats) [[unlikely]]
+        ++active_stats->array_allocs;
+    return d;
+}
+
+inline DValue DValue::make_func(const FuncLitNode* n, Env env) {
+    DValue d;
+    d.type = Type::Func;
+    d.fval = make_object<FuncClosure>(FuncClosure{n, std::move(env)});
+    if (active_stats) [[unlikely]]
+        ++active_stats->closure_allocs;
+    return d;
+}
+
+inline DValue DValue::make_compiled_func(const FuncLitNode* n, SlotEnv env,
+                                         const CompiledFunc* code) {
+    DValue d;
+    d.type = Type::Func;
+    d.fval = make_object<FuncClosure>(FuncClosure{n, {}, std::move(env), code});
+    if (active_stats) [[unlikely]]
+        ++active_stats->closure_allocs;
+    return d;
+}
+
+inline DValue DValue::make_builtin(const Builtin* b) {
+    DValue d;
+    d.type = Type::Func;
+    d.fval = std::make_shared<FuncClosure>(FuncClosure{nullptr, {}, {}, nullptr, b});
+    return d;
+}
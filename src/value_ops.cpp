@@ -0,0 +1,578 @@
+#include "value_ops.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <stdexcept>
+
+// ── DValue helpers ─────────────────────────────────────────────────────────────
+
+std::string DValue::to_string() const {
+    switch (type) {
+    case Type::None:
+        return "none";
+    case Type::Int:
+        return std::to_string(ival);
+    case Type::Bool:
+        return bval ? "true" : "false";
+    case Type::String:
+        return sval;
+    case Type::Real:
+        if (std::isfinite(rval) && rval == std::floor(rval))
+            return std::to_string(static_cast<long long>(rval));
+        return std::format("{:g}", rval);
+    case Type::Array: {
+        std::string s = "[";
+        bool first    = true;
+        aval->for_each([&](long long, const DValue& v) {
+            if (!first)
+                s += ", ";
+            s += v.to_string();
+            first = false;
+        });
+        return s + "]";
+    }
+    case Type::Tuple: {
+        std::string s = "{";
+        bool first    = true;
+        for (auto& e : *tval) {
+            if (!first)
+                s += ", ";
+            s += e.name.empty() ? e.value.to_string() : e.name + " := " + e.value.to_string();
+            first = false;
+        }
+        return s + "}";
+    }
+    case Type::Func:
+        return "<func>";
+    }
+    return "";
+}
+
+bool DValue::is_truthy() const {
+    if (type == Type::Bool)
+        return bval;
+    throw std::runtime_error("non-boolean value used in boolean context");
+}
+
+// ── ArrayStorage ──────────────────────────────────────────────────────────────
+
+namespace {
+
+ArrayStorage::Kind column_kind(const DValue& v) {
+    if (v.type == DValue::Type::Int)
+        return ArrayStorage::Kind::Ints;
+    if (v.type == DValue::Type::Real)
+        return ArrayStorage::Kind::Reals;
+    return ArrayStorage::Kind::Boxed;
+}
+
+} // namespace
+
+ArrayStorage::ArrayStorage(const ArrayStorage& other)
+    : kind_{(other.expose(), other.kind_)}, first_{other.first_}, ints_{other.ints_},
+      reals_{other.reals_}, map_{other.map_} {}
+
+void ArrayStorage::set(long long key, DValue v) {
+    if (kind_ == Kind::Empty) {
+        if (v.type == DValue::Type::Int)
+            kind_ = Kind::Ints;
+        else if (v.type == DValue::Type::Real)
+            kind_ = Kind::Reals;
+        else if (v.type == DValue::Type::Tuple && v.tval.use_count() == 1 && !v.tval->empty()) {
+            kind_ = Kind::Records;
+            for (const auto& e : *v.tval) {
+                names_.push_back(e.name);
+                columns_.push_back({column_kind(e.value), {}, {}, {}});
+            }
+        } else
+            kind_ = Kind::Boxed;
+        first_ = key;
+    }
+    if (kind_ == Kind::Records) {
+        const unsigned long long i =
+            static_cast<unsigned long long>(key) - static_cast<unsigned long long>(first_);
+        if (key >= first_ && i <= rows_ && fits(v)) {
+            set_row(i, *v.tval);
+            return;
+        }
+        box_records();
+    } else if (kind_ != Kind::Boxed) {
+        const auto elem = kind_ == Kind::Ints ? DValue::Type::Int : DValue::Type::Real;
+        // Offset from the first key, computed without signed overflow.
+        const unsigned long long i =
+            static_cast<unsigned long long>(key) - static_cast<unsigned long long>(first_);
+        if (v.type == elem && key >= first_ && i <= size()) {
+            if (kind_ == Kind::Ints) {
+                if (i == ints_.size())
+                    ints_.push_back(v.ival);
+                else
+                    ints_[i] = v.ival;
+            } else {
+                if (i == reals_.size())
+                    reals_.push_back(v.rval);
+                else
+                    reals_[i] = v.rval;
+            }
+            return;
+        }
+        box();
+    }
+    map_[key] = std::move(v);
+}
+
+void ArrayStorage::append(const ArrayStorage& other) {
+    if (kind_ == other.kind_ && kind_ == Kind::Ints) {
+        ints_.insert(ints_.end(), other.ints_.begin(), other.ints_.end());
+        return;
+    }
+    if (kind_ == other.kind_ && kind_ == Kind::Reals) {
+        reals_.insert(reals_.end(), other.reals_.begin(), other.reals_.end());
+        return;
+    }
+    // The appended tuples are the ones `other` holds.
+    other.expose();
+    long long key = next_key();
+    other.for_each([&](long long, const DValue& v) { set(key++, v); });
+}
+
+bool ArrayStorage::fits(const DValue& v) const noexcept {
+    if (v.type != DValue::Type::Tuple || v.tval.use_count() != 1 || v.tval->size() != columns())
+        return false;
+    for (size_t c = 0; c < columns(); ++c)
+        if ((*v.tval)[c].name != names_[c])
+            return false;
+    return true;
+}
+
+void ArrayStorage::set_row(size_t row, std::vector<TupleElem>& elems) {
+    for (size_t c = 0; c < columns(); ++c) {
+        if (row == rows_) {
+            // Reserve the cell; set_cell() stores into it.
+            Column& col = columns_[c];
+            if (col.kind == Kind::Ints)
+                col.ints.push_back(0);
+            else if (col.kind == Kind::Reals)
+                col.reals.push_back(0);
+            else
+                col.values.emplace_back();
+        }
+        set_cell(row, c, std::move(elems[c].value));
+    }
+    if (row == rows_)
+        ++rows_;
+}
+
+std::optional<size_t> ArrayStorage::row(long long key) const noexcept {
+    const auto i = static_cast<unsigned long long>(key) - static_cast<unsigned long long>(first_);
+    if (kind_ != Kind::Records || key < first_ || i >= rows_)
+        return std::nullopt;
+    return i;
+}
+
+std::optional<size_t> ArrayStorage::column(const std::string& name) const noexcept {
+    const auto it = std::ranges::find(names_, name);
+    if (it == names_.end())
+        return std::nullopt;
+    return it - names_.begin();
+}
+
+DValue ArrayStorage::cell(size_t row, size_t column) const {
+    const Column& col = columns_[column];
+    if (col.kind == Kind::Ints)
+        return DValue::make_int(col.ints[row]);
+    if (col.kind == Kind::Reals)
+        return DValue::make_real(col.reals[row]);
+    return col.values[row];
+}
+
+void ArrayStorage::set_cell(size_t row, size_t column, DValue v) {
+    Column& col = columns_[column];
+    if (col.kind != Kind::Boxed && col.kind != column_kind(v)) {
+        // The column holds another type from now on: box it.
+        std::vector<DValue> values;
+        values.reserve(rows_ + 1);
+        for (size_t r = 0, n = std::max(col.ints.size(), col.reals.size()); r < n; ++r)
+            values.push_back(cell(r, column));
+        col = {Kind::Boxed, {}, {}, std::move(values)};
+    }
+    if (col.kind == Kind::Ints)
+        col.ints[row] = v.ival;
+    else if (col.kind == Kind::Reals)
+        col.reals[row] = v.rval;
+    else
+        col.values[row] = std::move(v);
+}
+
+DValue ArrayStorage::row_tuple(size_t row) const {
+    std::vector<TupleElem> elems;
+    elems.reserve(columns());
+    for (size_t c = 0; c < columns(); ++c)
+        elems.push_back({names_[c], cell(row, c)});
+    return DValue::make_tuple(std::move(elems));
+}
+
+void ArrayStorage::box_records() const {
+    Map m;
+    for (size_t r = 0; r < rows_; ++r)
+        m.emplace_hint(m.end(), first_ + static_cast<long long>(r), row_tuple(r));
+    map_     = std::move(m);
+    names_   = {};
+    columns_ = {};
+    rows_    = 0;
+    kind_    = Kind::Boxed;
+}
+
+void ArrayStorage::box() {
+    Map m;
+    for (size_t i = 0, n = size(); i < n; ++i)
+        m.emplace_hint(m.end(), first_ + static_cast<long long>(i), unboxed(i));
+    map_   = std::move(m);
+    ints_  = {};
+    reals_ = {};
+    kind_  = Kind::Boxed;
+}
+
+bool ArrayStorage::Cursor::next(DValue& value) {
+    const ArrayStorage& a = *a_;
+    if (!row_copies_)
+        a.expose();
+    if (a.kind_ == Kind::Boxed) {
+        if (!boxed_) {
+            // First step, or the array was boxed during the walk.
+            it_    = started_ ? a.map_.upper_bound(key_) : a.map_.begin();
+            boxed_ = true;
+        } else if (it_ != a.map_.end()) {
+            ++it_;
+        }
+        if (it_ == a.map_.end())
+            return false;
+        key_  = it_->first;
+        value = it_->second;
+    } else {
+        if (started_)
+            ++index_;
+        if (index_ >= a.size())
+            return false;
+        key_  = a.first_ + static_cast<long long>(index_);
+        value = a.kind_ == Kind::Records ? a.row_tuple(index_) : a.unboxed(index_);
+    }
+    started_ = true;
+    return true;
+}
+
+namespace {
+
+// ── Helper: floor division (spec: integer/integer rounds down) ─────────────────
+long long floor_div(long long a, long long b) {
+    long long q = a / b;
+    if (a % b != 0 && (a ^ b) < 0)
+        --q; // adjust when signs differ
+    return q;
+}
+
+// ── Numeric coercion helpers ───────────────────────────────────────────────────
+double to_real(const DValue& v) {
+    if (v.type == DValue::Type::Int)
+        return static_cast<double>(v.ival);
+    if (v.type == DValue::Type::Real)
+        return v.rval;
+    throw std::runtime_error("expected numeric value");
+}
+bool is_numeric(const DValue& v) {
+    return v.type == DValue::Type::Int || v.type == DValue::Type::Real;
+}
+bool is_mixed_real(const DValue& a, const DValue& b) {
+    return is_numeric(a) && is_numeric(b) &&
+           (a.type == DValue::Type::Real || b.type == DValue::Type::Real);
+}
+
+} // namespace
+
+// ── Operators ──────────────────────────────────────────────────────────────────
+
+DValue binary_op(BinOpNode::Op op, const DValue& L, const DValue& R) {
+    using T  = DValue::Type;
+    using Op = BinOpNode::Op;
+
+    switch (op) {
+    case Op::ADD:
+        if (L.type == T::Int && R.type == T::Int)
+            return DValue::make_int(L.ival + R.ival);
+        else if (is_mixed_real(L, R))
+            return DValue::make_real(to_real(L) + to_real(R));
+        else if (L.type == T::String && R.type == T::String)
+            return DValue::make_str(L.sval + R.sval);
+        else if (L.type == T::Array && R.type == T::Array) {
+            ArrayStorage result = *L.aval;
+            result.append(*R.aval);
+            return DValue::make_array(std::move(result));
+        } else if (L.type == T::Tuple && R.type == T::Tuple) {
+            std::vector<TupleElem> elems = *L.tval;
+            for (auto& e : *R.tval)
+                elems.push_back(e);
+            return DValue::make_tuple(std::move(elems));
+        } else
+            throw std::runtime_error("invalid operands for +");
+
+    case Op::SUB:
+        if (L.type == T::Int && R.type == T::Int)
+            return DValue::make_int(L.ival - R.ival);
+        else if (is_mixed_real(L, R))
+            return DValue::make_real(to_real(L) - to_real(R));
+        else
+            throw std::runtime_error("invalid operands for -");
+
+    case Op::MUL:
+        if (L.type == T::Int && R.type == T::Int)
+            return DValue::make_int(L.ival * R.ival);
+        else if (is_mixed_real(L, R))
+            return DValue::make_real(to_real(L) * to_real(R));
+        else
+            throw std::runtime_error("invalid operands for *");
+
+    case Op::DIV:
+        if (L.type == T::Int && R.type == T::Int)
+            return DValue::make_int(floor_div(L.ival, R.ival));
+        else if (is_mixed_real(L, R))
+            return DValue::make_real(to_real(L) / to_real(R));
+        else
+            throw std::runtime_error("invalid operands for /");
+
+    // Comparisons
+    case Op::LT:
+        if (is_numeric(L) && is_numeric(R))
+            return DValue::make_bool(to_real(L) < to_real(R));
+        else
+            throw std::runtime_error("< requires numeric operands");
+    case Op::LE:
+        if (is_numeric(L) && is_numeric(R))
+            return DValue::make_bool(to_real(L) <= to_real(R));
+        else
+            throw std::runtime_error("<= requires numeric operands");
+    case Op::GT:
+        if (is_numeric(L) && is_numeric(R))
+            return DValue::make_bool(to_real(L) > to_real(R));
+        else
+            throw std::runtime_error("> requires numeric operands");
+    case Op::GE:
+        if (is_numeric(L) && is_numeric(R))
+            return DValue::make_bool(to_real(L) >= to_real(R));
+        else
+            throw std::runtime_error(">= requires numeric operands");
+
+    case Op::EQ: {
+        bool eq = false;
+        if (L.type == T::None && R.type == T::None)
+            eq = true;
+        else if (L.type == T::None || R.type == T::None)
+            eq = false;
+        else if (L.type == T::Bool && R.type == T::Bool)
+            eq = L.bval == R.bval;
+        else if (L.type == T::String && R.type == T::String)
+            eq = L.sval == R.sval;
+        else if (is_numeric(L) && is_numeric(R)) {
+            if (L.type == T::Int && R.type == T::Int)
+                eq = L.ival == R.ival;
+            else
+                eq = to_real(L) == to_real(R);
+        }
+        return DValue::make_bool(eq);
+    }
+    case Op::NEQ: {
+        bool eq = false;
+        if (L.type == T::None && R.type == T::None)
+            eq = true;
+        else if (L.type == T::None || R.type == T::None)
+            eq = false;
+        else if (L.type == T::Bool && R.type == T::Bool)
+            eq = L.bval == R.bval;
+        else if (L.type == T::String && R.type == T::String)
+            eq = L.sval == R.sval;
+        else if (is_numeric(L) && is_numeric(R)) {
+            if (L.type == T::Int && R.type == T::Int)
+                eq = L.ival == R.ival;
+            else
+                eq = to_real(L) == to_real(R);
+        }
+        return DValue::make_bool(!eq);
+    }
+    default:
+        break;
+    }
+    return {};
+}
+
+const BinOpNode* self_concatenation(const AssignNode& n) {
+    const auto* x   = node_cast<IdentNode>(n.lhs.get());
+    const auto* add = node_cast<BinOpNode>(n.rhs.get());
+    if (!x || !add || add->op != BinOpNode::Op::ADD)
+        return nullptr;
+    const auto* y = node_cast<IdentNode>(add->left.get());
+    if (!y || y->ident_name != x->ident_name || y->resolved_depth != x->resolved_depth)
+        return nullptr;
+    return add;
+}
+
+bool append_in_place(DValue& x, DValue& L, const DValue& R) {
+    using T = DValue::Type;
+    if (L.type != R.type || x.type != L.type)
+        return false;
+    // Only x and L refer to the array or tuple: no one can see it change.
+    if (L.type == T::Array && x.aval == L.aval && L.aval.use_count() == 2) {
+        L = {};
+        x.aval->append(*R.aval);
+        return true;
+    }
+    if (L.type == T::Tuple && x.tval == L.tval && L.tval.use_count() == 2) {
+        L = {};
+        x.tval->insert(x.tval->end(), R.tval->begin(), R.tval->end());
+        return true;
+    }
+    return false;
+}
+
+DValue unary_op(UnaryOpNode::Op op, const DValue& v) {
+    switch (op) {
+    case UnaryOpNode::Op::UPLUS:
+        if (v.type == DValue::Type::Int)
+            return DValue::make_int(v.ival);
+        if (v.type == DValue::Type::Real)
+            return DValue::make_real(v.rval);
+        throw std::runtime_error("unary + on non-numeric");
+    case UnaryOpNode::Op::UMINUS:
+        if (v.type == DValue::Type::Int)
+            return DValue::make_int(-v.ival);
+        if (v.type == DValue::Type::Real)
+            return DValue::make_real(-v.rval);
+        throw std::runtime_error("unary - on non-numeric");
+    case UnaryOpNode::Op::NOT:
+        return DValue::make_bool(!v.is_truthy());
+    }
+    return {};
+}
+
+bool has_type(const DValue& v, TypeNode::Type t) {
+    switch (t) {
+    case TypeNode::Type::INT:
+        return v.type == DValue::Type::Int;
+    case TypeNode::Type::REAL:
+        return v.type == DValue::Type::Real;
+    case TypeNode::Type::BOOL:
+        return v.type == DValue::Type::Bool;
+    case TypeNode::Type::STRING:
+        return v.type == DValue::Type::String;
+    case TypeNode::Type::NONE:
+        return v.type == DValue::Type::None;
+    case TypeNode::Type::ARRAY:
+        return v.type == DValue::Type::Array;
+    case TypeNode::Type::TUPLE:
+        return v.type == DValue::Type::Tuple;
+    case TypeNode::Type::FUNC:
+        return v.type == DValue::Type::Func;
+    }
+    return false;
+}
+
+// ── Element access ─────────────────────────────────────────────────────────────
+
+DValue index_get(const DValue& base, const DValue& key) {
+    if (base.type != DValue::Type::Array)
+        throw std::runtime_error("index on non-array");
+    if (key.type != DValue::Type::Int)
+        throw std::runtime_error("array index must be integer");
+    std::optional<DValue> v = base.aval->find(key.ival);
+    if (!v)
+        throw std::runtime_error(std::format("array key {} not found", key.ival));
+    return std::move(*v);
+}
+
+void index_set(const DValue& base, const DValue& key, DValue v) {
+    if (base.type != DValue::Type::Array)
+        throw std::runtime_error("index assignment on non-array");
+    if (key.type != DValue::Type::Int)
+        throw std::runtime_error("array index must be integer");
+    base.aval->set(key.ival, std::move(v));
+}
+
+const DValue& field_get(const DValue& base, const std::string& field) {
+    if (base.type != DValue::Type::Tuple)
+        throw std::runtime_error("dot field access on non-tuple");
+    for (const auto& e : *base.tval)
+        if (e.name == field)
+            return e.value;
+    throw std::runtime_error(std::format("tuple has no field '{}'", field));
+}
+
+void field_set(const DValue& base, const std::string& field, DValue v) {
+    if (base.type != DValue::Type::Tuple)
+        throw std::runtime_error("field assignment on non-tuple");
+    for (auto& e : *base.tval) {
+        if (e.name == field) {
+            e.value = std::move(v);
+            return;
+        }
+    }
+    throw std::runtime_error(std::format("tuple has no field '{}'", field));
+}
+
+const DValue& dot_int_get(const DValue& base, long long index) {
+    if (base.type != DValue::Type::Tuple)
+        throw std::runtime_error("dot-int access on non-tuple");
+    if (index < 1 || index > static_cast<long long>(base.tval->size()))
+        throw std::runtime_error(std::format("tuple index {} out of range", index));
+    return (*base.tval)[index - 1].value;
+}
+
+void dot_int_set(const DValue& base, long long index, DValue v) {
+    if (base.type != DValue::Type::Tuple)
+        throw std::runtime_error("dot-int assignment on non-tuple");
+    if (index < 1 || index > static_cast<long long>(base.tval->size()))
+        throw std::runtime_error("tuple index out of range");
+    (*base.tval)[index - 1].value = std::move(v);
+}
+
+namespace {
+
+// The row of base[key], if base keeps Records.
+std::optional<size_t> record_row(const DValue& base, const DValue& key) {
+    if (base.type != DValue::Type::Array || key.type != DValue::Type::Int)
+        return std::nullopt;
+    return base.aval->row(key.ival);
+}
+
+} // namespace
+
+DValue element_field_get(const DValue& base, const DValue& key, const std::string& field) {
+    if (const auto row = record_row(base, key))
+        if (const auto column = base.aval->column(field))
+            return base.aval->cell(*row, *column);
+    return field_get(index_get(base, key), field);
+}
+
+void element_field_set(const DValue& base, const DValue& key, const std::string& field,
+                       DValue v) {
+    if (const auto row = record_row(base, key)) {
+        if (const auto column = base.aval->column(field)) {
+            base.aval->set_cell(*row, *column, std::move(v));
+            return;
+        }
+    }
+    field_set(index_get(base, key), field, std::move(v));
+}
+
+DValue element_dot_int_get(const DValue& base, const DValue& key, long long index) {
+    const auto row = record_row(base, key);
+    if (row && index >= 1 && index <= static_cast<long long>(base.aval->columns()))
+        return base.aval->cell(*row, index - 1);
+    return dot_int_get(index_get(base, key), index);
+}
+
+void element_dot_int_set(const DValue& base, const DValue& key, long long index, DValue v) {
+    const auto row = record_row(base, key);
+    if (row && index >= 1 && index <= static_cast<long long>(base.aval->columns())) {
+        base.aval->set_cell(*row, index - 1, std::move(v));
+        return;
+    }
+    dot_int_set(index_get(base, key), index, std::move(v));
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "ast.hpp"
+#include "value.hpp"
+
+#include <string>
+
+// ── Value operations ──────────────────────────────────────────────────────────
+//
+// Language semantics of the D operators, shared by every execution engine so
+// that they agree on results and on runtime error messages.  Errors are
+// reported as std::runtime_error.
+
+// Arithmetic, concatenation and comparison operators.  AND/OR/XOR short-circuit
+// and are evaluated by the engines themselves.
+DValue binary_op(BinOpNode::Op op, const DValue& L, const DValue& R);
+
+// The `x + e` of an assignment `x := x + e`, else null.
+const BinOpNode* self_concatenation(const AssignNode& n);
+
+// Performs `x := L + R` for such an assignment, where L is the value just read
+// from x and R that of e, by appending R to x's array or tuple in place when
+// nothing else refers to it, so that building a sequence one element at a time
+// is linear rather than quadratic.  Returns false, leaving x and L alone, when
+// the result must be a new array or tuple; the caller then assigns
+// binary_op(ADD, L, R).
+bool append_in_place(DValue& x, DValue& L, const DValue& R);
+
+DValue unary_op(UnaryOpNode::Op op, const DValue& v);
+
+// `v is t`
+bool has_type(const DValue& v, TypeNode::Type t);
+
+// base[key]
+DValue index_get(const DValue& base, const DValue& key);
+void index_set(const DValue& base, const DValue& key, DValue v);
+
+// base.field
+const DValue& field_get(const DValue& base, const std::string& field);
+void field_set(const DValue& base, const std::string& field, DValue v);
+
+// base.index (1-based)
+const DValue& dot_int_get(const DValue& base, long long index);
+void dot_int_set(const DValue& base, long long index, DValue v);
+
+// base[key].field and base[key].index in one step.  An array of Records (see
+// ArrayStorage) is read or written in place, without building the tuple;
+// results and errors are those of the two steps.
+DValue element_field_get(const DValue& base, const DValue& key, const std::string& field);
+void element_field_set(const DValue& base, const DValue& key, const std::string& field,
+                       DValue v);
+DValue element_dot_int_get(const DValue& base, const DValue& key, long long index);
+void element_dot_int_set(const DValue& base, const DValue& key, long long index, DValue v);
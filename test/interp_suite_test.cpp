@@ -1,14 +1,26 @@
 #include "ast.hpp"
+#include "budget.hpp"
+#include "closure_engine.hpp"
+#include "engine.hpp"
 #include "interpreter.hpp"
 #include "lexer.hpp"
+#include "optimizer.hpp"
 #include "parser.tab.hpp"
+#include "profiler.hpp"
 #include "semantic_analyzer.hpp"
+#include "snapshot.hpp"
+#include "stack_engine.hpp"
 
 #include <filesystem>
+#include <format>
 #include <fstream>
 #include <gtest/gtest.h>
+#include <latch>
+#include <span>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -19,41 +31,645 @@ static std::string read_file(const std::string& path) {
 
 static const std::string SUITE_DIR{TEST_SUITE_DIR};
 
-class InterpSuiteTest : public ::testing::TestWithParam<int> {};
+// Parses and analyzes `src`, with `inputs` declared as globals.  A failure is
+// reported, and leaves nullptr.
+static std::unique_ptr<ASTNode> parse_and_analyze(const std::string& src,
+                                                  std::span<const std::string> inputs = {}) {
+    std::unique_ptr<ASTNode> root;
+    std::istringstream stream(src);
+    Lexer lexer(stream);
+    yy::parser parser{root, lexer};
+    if (parser.parse() != 0 || !root) {
+        ADD_FAILURE() << "parse failed";
+        return nullptr;
+    }
+    SemanticAnalyzer sema;
+    sema.analyze(*root, inputs);
+    if (!sema.ok()) {
+        ADD_FAILURE() << "sema error: " << sema.errors().front().message;
+        return nullptr;
+    }
+    return root;
+}
+
+class InterpSuiteTest : public ::testing::TestWithParam<int> {
+protected:
+    // Runs the suite program through `run(root, out)` and compares what it
+    // prints with the program's .gold file.
+    template <class Run>
+    void expect_golden(Run&& run) {
+        const int n                  = GetParam();
+        const std::string input_path = SUITE_DIR + "/test" + std::to_string(n) + ".dl";
+        const std::string gold_path  = SUITE_DIR + "/test" + std::to_string(n) + ".gold";
+        if (!fs::exists(input_path) || !fs::exists(gold_path))
+            GTEST_SKIP() << "files missing for test" << n;
+        SCOPED_TRACE("test" + std::to_string(n));
+
+        auto root = parse_and_analyze(read_file(input_path));
+        ASSERT_NE(root, nullptr);
+        std::ostringstream out;
+        ASSERT_NO_THROW(run(*root, out)) << "runtime error";
+        EXPECT_EQ(out.str(), read_file(gold_path)) << "output mismatch";
+    }
+};
 
 TEST_P(InterpSuiteTest, RunAndCompareGolden) {
-    int n                  = GetParam();
-    std::string input_path = SUITE_DIR + "/test" + std::to_string(n) + ".dl";
-    std::string gold_path  = SUITE_DIR + "/test" + std::to_string(n) + ".gold";
+    expect_golden([](ASTNode& root, std::ostream& out) { Interpreter(out).run(root); });
+}
 
-    if (!fs::exists(input_path) || !fs::exists(gold_path))
-        GTEST_SKIP() << "files missing for test" << n;
+TEST_P(InterpSuiteTest, ClosureEngineMatchesGolden) {
+    expect_golden([](ASTNode& root, std::ostream& out) { ClosureEngine(out).run(root); });
+}
 
-    std::string src      = read_file(input_path);
-    std::string expected = read_file(gold_path);
+TEST_P(InterpSuiteTest, StackEngineMatchesGolden) {
+    expect_golden([](ASTNode& root, std::ostream& out) { StackEngine(out).run(root); });
+}
 
-    std::unique_ptr<ASTNode> root;
-    std::istringstream stream(src);
-    Lexer lexer(stream);
-    yy::parser parser{root, lexer};
-    ASSERT_EQ(parser.parse(), 0) << "parse failed for test" << n;
+// Profiling must not change what a program prints.
+TEST_P(InterpSuiteTest, ProfiledRunMatchesGolden) {
+    Profiler prof;
+    expect_golden([&](ASTNode& root, std::ostream& out) {
+        Interpreter interp(out);
+        interp.set_profiler(&prof);
+        prof.start();
+        interp.run(root);
+        prof.stop();
+    });
+    if (IsSkipped() || HasFatalFailure())
+        return;
+
+    std::ostringstream trace, folded;
+    prof.write_chrome_trace(trace);
+    prof.write_collapsed(folded);
+    EXPECT_NE(trace.str().find("\"traceEvents\""), std::string::npos);
+    EXPECT_EQ(folded.str().rfind("<main>", 0), 0u) << folded.str();
+}
+
+// The loop optimizer must not change what a program prints.
+TEST_P(InterpSuiteTest, OptimizedRunMatchesGolden) {
+    expect_golden([](ASTNode& root, std::ostream& out) {
+        Optimizer{}.optimize(root);
+        Interpreter(out).run(root);
+    });
+}
+
+// Nor may inlining, which runs before it.
+TEST_P(InterpSuiteTest, InlinedRunMatchesGolden) {
+    expect_golden([](ASTNode& root, std::ostream& out) {
+        Optimizer opt;
+        if (opt.inline_calls(root) > 0) {
+            SemanticAnalyzer sema;
+            sema.analyze(root);
+            ASSERT_TRUE(sema.ok()) << "sema error after inlining";
+        }
+        opt.optimize(root);
+        Interpreter(out).run(root);
+    });
+}
+
+INSTANTIATE_TEST_SUITE_P(Suite, InterpSuiteTest, ::testing::Range(1, 159),
+                         [](const ::testing::TestParamInfo<int>& i) {
+                             return "test" + std::to_string(i.param);
+                         });
+
+TEST(Profiler, CountsCallsLinesAndAllocations) {
+    const std::string src = "var fib := func(n) is\n"
+                            "    if n < 2 then return n end\n"
+                            "    return fib(n - 1) + fib(n - 2)\n"
+                            "end\n"
+                            "var a := [1, 2]\n"
+                            "print fib(10)\n";
+
+    auto root = parse_and_analyze(src);
+    ASSERT_NE(root, nullptr);
+
+    Profiler prof;
+    std::ostringstream out;
+    Interpreter interp(out);
+    interp.set_profiler(&prof);
+    prof.start();
+    interp.run(*root);
+    prof.stop();
+    EXPECT_EQ(out.str(), "55\n");
+
+    std::ostringstream trace;
+    prof.write_chrome_trace(trace);
+    const std::string json = trace.str();
+    // fib(10) makes 177 calls; line 2 runs once per call, including the nested return.
+    EXPECT_NE(json.find(R"("name":"fib","line":1,"col":12,"calls":177,)"), std::string::npos)
+        << json.substr(json.find("\"functions\""));
+    EXPECT_NE(json.find(R"("name":"line 2","line":2,"col":0,"calls":177,)"), std::string::npos);
+    // The closure and the array literal are the only allocations on lines 1 and 5.
+    EXPECT_NE(json.find(R"("name":"line 5","line":5,"col":0,"calls":1,)"), std::string::npos);
+    EXPECT_NE(json.find(R"("allocs":1})"), std::string::npos);
+}
+
+TEST(InterpStats, CountsFramesSignalsAndAllocations) {
+    const std::string src = "var f := func(n) is return n + 1 end\n"
+                            "var t := {a := 1}\n"
+                            "for i in 1..3 loop\n"
+                            "    if f(i) > 3 then exit end\n"
+                            "end\n";
+
+    auto root = parse_and_analyze(src);
+    ASSERT_NE(root, nullptr);
+
+    InterpStats stats;
+    std::ostringstream out;
+    Interpreter interp(out);
+    interp.set_stats(&stats);
+    interp.run(*root);
+
+    EXPECT_EQ(stats.return_signals, 3u);
+    EXPECT_EQ(stats.exit_signals, 1u);
+    EXPECT_EQ(stats.closure_allocs, 1u);
+    EXPECT_EQ(stats.tuple_allocs, 1u);
+    EXPECT_EQ(stats.array_allocs, 0u);
+    EXPECT_GT(stats.frames_pushed, 0u);
+    EXPECT_GT(stats.lookups, 0u);
+    EXPECT_GT(stats.value_moves, 0u);
+    EXPECT_GE(stats.peak_env_depth, 3u);
+    EXPECT_EQ(active_stats, nullptr);
+}
+
+TEST(InterpStats, ReusesFramesAcrossIterations) {
+    // Per iteration: the loop body's frame and the call's, which holds the
+    // function body's variable too; the `if` body declares nothing and gets none.
+    auto frames = [](int n) {
+        const std::string src = "var f := func(x) is\n"
+                                "    var y := x * 2\n"
+                                "    return y\n"
+                                "end\n"
+                                "var s := 0\n"
+                                "for i in 1.." +
+                                std::to_string(n) +
+                                " loop\n"
+                                "    var d := f(i)\n"
+                                "    if d > 4 then s := s + d end\n"
+                                "end\n"
+                                "print s\n";
+        InterpStats stats;
+        if (const auto root = parse_and_analyze(src)) {
+            std::ostringstream out;
+            Interpreter interp(out);
+            interp.set_stats(&stats);
+            interp.run(*root);
+        }
+        return std::pair{stats.frames_pushed, stats.frames_allocated};
+    };
+
+    const auto [pushed10, allocated10]     = frames(10);
+    const auto [pushed1000, allocated1000] = frames(1000);
+    EXPECT_EQ(pushed1000 - pushed10, 990u * 2);
+    EXPECT_EQ(allocated1000, allocated10);
+}
+
+TEST(InterpStats, SpecializesStableOperandTypes) {
+    // f's `+` and get's index specialize to Ints during the loops, as does the
+    // loop's own `+`; Reals in f and the boxed array in get fail their guards.
+    const std::string src = "var f := func(a, b) => a + b\n"
+                            "var s := 0\n"
+                            "for i in 1..20 loop\n"
+                            "    s := f(s, i)\n"
+                            "end\n"
+                            "print s, f(1.5, 2.5), f(\"a\", \"b\")\n"
+                            "var arr := [1, 2, 3]\n"
+                            "var get := func(k) => arr[k]\n"
+                            "var t := 0\n"
+                            "for i in 1..10 loop\n"
+                            "    t := t + get(2)\n"
+                            "end\n"
+                            "arr[4] := \"x\"\n"
+                            "print t, get(1), get(4)\n";
+    auto root = parse_and_analyze(src);
+    ASSERT_NE(root, nullptr);
+
+    InterpStats stats;
+    std::ostringstream out;
+    Interpreter interp(out);
+    interp.set_stats(&stats);
+    interp.run(*root);
+    EXPECT_EQ(out.str(), "210 4 ab\n20 1 x\n");
+    EXPECT_EQ(stats.nodes_specialized, 3u);
+    EXPECT_EQ(stats.guard_failures, 2u);
+
+    // The feedback is kept in the tree: a second run starts from it, and the
+    // nodes made generic stay generic.
+    stats = {};
+    out.str("");
+    interp.run(*root);
+    EXPECT_EQ(out.str(), "210 4 ab\n20 1 x\n");
+    EXPECT_EQ(stats.nodes_specialized, 0u);
+    EXPECT_EQ(stats.guard_failures, 0u);
+}
+
+TEST(Region, AllocatesFromTheRunsRegion) {
+    // The run fails at the end, holding every tuple and closure it made.
+    const std::string src = "var keep := []\n"
+                            "for i in 1..50 loop\n"
+                            "    keep[i] := {a := i, f := func(x) => x + i}\n"
+                            "end\n"
+                            "print len(keep), keep[7] + {b := n}\n"
+                            "print keep[51]\n";
+    const std::vector<std::string> inputs{"n"};
+    auto root = parse_and_analyze(src, inputs);
+    ASSERT_NE(root, nullptr);
+
+    // Each run's values are dropped and its region released before the next.
+    auto region_bytes = [&](DValue n) {
+        InterpStats stats;
+        std::ostringstream out;
+        Interpreter interp(out);
+        interp.set_stats(&stats);
+        interp.set_region(true);
+        for (int i = 0; i < 2; ++i) {
+            out.str("");
+            EXPECT_THROW(interp.run(*root, Frame{{"n", n}}), std::runtime_error);
+            EXPECT_TRUE(out.str().starts_with("50 {a := 7, f := <func>, b := "));
+        }
+        return stats.region_bytes;
+    };
+    EXPECT_GT(region_bytes(DValue::make_int(2)), 0u);
+    // An input array could keep the run's values: no region.
+    EXPECT_EQ(region_bytes(DValue::make_array({})), 0u);
+}
+
+TEST(Concatenation, AppendsToUnsharedSequencesInPlace) {
+    const std::string src = "var acc := []\n"
+                            "var t := {}\n"
+                            "for i in 1..5 loop\n"
+                            "    acc := acc + [i]\n"
+                            "    t := t + {v := i}\n"
+                            "end\n"
+                            "var b := acc\n"
+                            "var u := t\n"
+                            "acc := acc + [6]\n"
+                            "t := t + {w := 6}\n"
+                            "print acc, b\n"
+                            "print len(t), len(u)\n";
+
+    auto root = parse_and_analyze(src);
+    ASSERT_NE(root, nullptr);
+
+    const std::string expected = "[1, 2, 3, 4, 5, 6] [1, 2, 3, 4, 5]\n6 5\n";
+    InterpStats stats;
+    std::ostringstream tree_out, closure_out, stack_out;
+    Interpreter interp(tree_out);
+    interp.set_stats(&stats);
+    interp.run(*root);
+    ClosureEngine closures(closure_out);
+    closures.run(*root);
+    StackEngine stack(stack_out);
+    stack.run(*root);
+    EXPECT_EQ(tree_out.str(), expected);
+    EXPECT_EQ(closure_out.str(), expected);
+    EXPECT_EQ(stack_out.str(), expected);
+
+    // The literals, and one new array once `b` shares acc's.
+    EXPECT_EQ(stats.array_allocs, 8u);
+    EXPECT_EQ(stats.tuple_allocs, 8u);
+}
+
+TEST(Optimizer, HoistsInvariantsAndInductionVariables) {
+    const std::string src = "var n := 3\n"
+                            "var a := [5, 6]\n"
+                            "var f := func(d) is\n"
+                            "    var s := 0\n"
+                            "    for i in 1..2 loop\n"
+                            "        s := s + d * 10 + a[1] + i * 4 + 1\n"
+                            "        if d > 0 then s := s + f(d - 1) end\n"
+                            "    end\n"
+                            "    return s\n"
+                            "end\n"
+                            "for i in 1..2 loop\n"
+                            "    print n * 2 + a[2], i * 2\n"
+                            "end\n"
+                            "print f(2)\n";
+
+    auto root = parse_and_analyze(src);
     ASSERT_NE(root, nullptr);
 
+    Optimizer opt;
+    opt.optimize(*root);
+    // In f's loop `d * 10`, `d > 0` and `d - 1` are cached, but `a[1]` is not:
+    // the loop makes a call.  In the top-level loop `n * 2 + a[2]` is cached
+    // as a whole.
+    EXPECT_EQ(opt.loops(), 2u);
+    EXPECT_EQ(opt.invariants(), 4u);
+    EXPECT_EQ(opt.inductions(), 2u); // i * 4 + 1 and i * 2
+
+    // The recursive call re-enters f's loop while the outer execution's
+    // cached `d * 10` is live.
+    std::ostringstream out;
+    Interpreter interp(out);
+    interp.run(*root);
+    EXPECT_EQ(out.str(), "12 2\n12 4\n248\n");
+}
+
+TEST(Optimizer, InlinesSmallFunctionLiterals) {
+    const std::string src = "var k := 10\n"
+                            "var add := func(a, b) => a + b + k\n"
+                            "var sq := func(x) => x * x\n"
+                            "var g := func(x) => x + 1\n"
+                            "g := func(x) => x + 2\n"
+                            "print add(1, 2)\n"
+                            "print sq(k)\n"
+                            "print sq(add(1, 2))\n"
+                            "print g(1)\n"
+                            "if true then\n"
+                            "    var k := 100\n"
+                            "    print add(1, 2)\n"
+                            "end\n"
+                            "print add(sq(2), 1)\n";
+
+    auto root = parse_and_analyze(src);
+    ASSERT_NE(root, nullptr);
+
+    // Not inlined: sq of a call (x is used twice), g (reassigned), and add
+    // where a local k would capture add's free k.
+    Optimizer opt;
+    EXPECT_EQ(opt.inline_calls(*root), 5u);
     SemanticAnalyzer sema;
     sema.analyze(*root);
-    ASSERT_TRUE(sema.ok()) << "sema error for test" << n;
+    ASSERT_TRUE(sema.ok());
 
     std::ostringstream out;
     Interpreter interp(out);
-    ASSERT_NO_THROW(interp.run(*root)) << "runtime error for test" << n;
+    interp.run(*root);
+    EXPECT_EQ(out.str(), "13\n100\n169\n3\n13\n15\n");
+}
+
+TEST(Builtins, AgreeAcrossEngines) {
+    const std::string src = "var a := [3, 1, 2]\n"
+                            "print len(a), len({x := 1}), len(\"abc\")\n"
+                            "print sum(a), sum([1.5, 0.5]), sum([])\n"
+                            "print min(a), max(a), max([1, 2.5])\n"
+                            "print dot(a, [1, 2, 3]), sort(a), sort([2, 0.5])\n"
+                            "print map_scale(a, 2), fill(2, \"x\")\n"
+                            "print find(a, 2), find(a, 7), find([\"p\", \"q\"], \"q\")\n"
+                            "var len := 5\n"
+                            "print len\n";
+
+    auto root = parse_and_analyze(src);
+    ASSERT_NE(root, nullptr);
 
-    EXPECT_EQ(out.str(), expected) << "output mismatch for test" << n;
+    const std::string expected = "3 1 3\n6 2 0\n1 3 2.5\n11 [1, 2, 3] [0.5, 2]\n"
+                                 "[6, 2, 4] [x, x]\n3 none 2\n5\n";
+    std::ostringstream tree_out, closure_out;
+    Interpreter interp(tree_out);
+    interp.run(*root);
+    ClosureEngine engine(closure_out);
+    engine.run(*root);
+    EXPECT_EQ(tree_out.str(), expected);
+    EXPECT_EQ(closure_out.str(), expected);
 }
 
-INSTANTIATE_TEST_SUITE_P(Suite, InterpSuiteTest, ::testing::Range(1, 159),
-                         [](const ::testing::TestParamInfo<int>& i) {
-                             return "test" + std::to_string(i.param);
-                         });
+TEST(ArrayStorage, StaysUnboxedUntilTypeOrKeysDiverge) {
+    ArrayStorage a;
+    a.push_back(DValue::make_int(1));
+    a.push_back(DValue::make_int(2));
+    a.set(1, DValue::make_int(5));
+    EXPECT_EQ(a.kind(), ArrayStorage::Kind::Ints);
+    EXPECT_EQ(a.size(), 2u);
+    EXPECT_EQ(a.next_key(), 3);
+
+    // A walk sees elements appended by the loop body, across the switch to
+    // boxed storage.
+    ArrayStorage::Cursor cursor{a};
+    DValue v;
+    std::string seen;
+    while (cursor.next(v)) {
+        seen += v.to_string() + " ";
+        if (v.type == DValue::Type::Int && v.ival == 5)
+            a.push_back(DValue::make_real(0.5));
+    }
+    EXPECT_EQ(seen, "5 2 0.5 ");
+    EXPECT_EQ(a.kind(), ArrayStorage::Kind::Boxed);
+
+    ArrayStorage r;
+    r.set(4, DValue::make_real(1.5));
+    r.set(5, DValue::make_real(2.5));
+    EXPECT_EQ(r.kind(), ArrayStorage::Kind::Reals);
+    EXPECT_EQ(r.first_key(), 4);
+    EXPECT_FALSE(r.find(3).has_value());
+    r.set(7, DValue::make_real(3.5)); // leaves a gap at 6
+    EXPECT_EQ(r.kind(), ArrayStorage::Kind::Boxed);
+    EXPECT_EQ(r.find(5)->rval, 2.5);
+    EXPECT_EQ(r.next_key(), 8);
+}
+
+TEST(ArrayStorage, KeepsSameShapedTuplesInColumns) {
+    auto row = [](long long x, DValue tag) {
+        return DValue::make_tuple({{"x", DValue::make_int(x)}, {"tag", std::move(tag)}});
+    };
+    ArrayStorage a;
+    a.push_back(row(1, DValue::make_str("a")));
+    a.push_back(row(2, DValue::make_str("b")));
+    EXPECT_EQ(a.kind(), ArrayStorage::Kind::Records);
+    ASSERT_TRUE(a.row(2).has_value());
+    EXPECT_EQ(a.cell(*a.row(2), *a.column("x")).ival, 2);
+    a.set_cell(0, *a.column("x"), DValue::make_real(0.5)); // the column is boxed
+    EXPECT_EQ(a.cell(0, 0).rval, 0.5);
+    EXPECT_EQ(a.kind(), ArrayStorage::Kind::Records);
+
+    // A tuple referred to elsewhere is stored as it is.
+    const DValue shared = row(3, DValue::make_none());
+    a.push_back(shared);
+    EXPECT_EQ(a.kind(), ArrayStorage::Kind::Boxed);
+    shared.tval->front().value = DValue::make_int(30);
+    EXPECT_EQ(a.find(3)->tval->front().value.ival, 30);
+    EXPECT_EQ(a.find(1)->to_string(), "{x := 0.5, tag := a}");
+
+    // Reading a whole element builds the tuples, which later reads share.
+    ArrayStorage b;
+    b.push_back(row(1, DValue::make_none()));
+    const DValue first = *b.find(1);
+    EXPECT_EQ(b.kind(), ArrayStorage::Kind::Boxed);
+    EXPECT_EQ(b.find(1)->tval, first.tval);
+}
+
+TEST(ArrayStorage, WalksRecordsWithoutBoxingWhenAsked) {
+    ArrayStorage a;
+    for (long long x : {1, 2, 3})
+        a.push_back(DValue::make_tuple({{"x", DValue::make_int(x)}}));
+
+    std::string seen;
+    a.for_each([&](long long k, const DValue& v) {
+        seen += std::format("{}:{} ", k, v.to_string());
+    });
+    EXPECT_EQ(seen, "1:{x := 1} 2:{x := 2} 3:{x := 3} ");
+    ArrayStorage::Cursor copies{a, /*row_copies=*/true};
+    DValue v;
+    long long sum = 0;
+    while (copies.next(v))
+        sum += v.tval->front().value.ival;
+    EXPECT_EQ(sum, 6);
+    EXPECT_EQ(a.kind(), ArrayStorage::Kind::Records);
+
+    // Without row copies the walk hands out the stored tuples.
+    ArrayStorage::Cursor rows{a};
+    ASSERT_TRUE(rows.next(v));
+    EXPECT_EQ(a.kind(), ArrayStorage::Kind::Boxed);
+    EXPECT_EQ(a.find(1)->tval, v.tval);
+}
+
+TEST(Budget, StopsRunawayLoopsInBothEngines) {
+    const std::string src = "var f := func(n) is return n end\n"
+                            "var i := 0\n"
+                            "loop\n"
+                            "    i := f(i + 1)\n"
+                            "end\n";
+
+    auto root = parse_and_analyze(src);
+    ASSERT_NE(root, nullptr);
+
+    Budget::Limits limits;
+    limits.max_steps = 10000;
+    std::ostringstream out;
+    Interpreter interp(out);
+    interp.set_budget(limits);
+    try {
+        interp.run(*root);
+        FAIL() << "tree engine ran past its step limit";
+    } catch (const BudgetExceeded& e) {
+        EXPECT_STREQ(e.what(), "step limit of 10000 exceeded");
+        EXPECT_TRUE(e.loc.line == 3 || e.loc.line == 4) << e.loc.line;
+    }
+
+    limits            = {};
+    limits.timeout_ms = 20;
+    ClosureEngine engine(out);
+    engine.set_budget(limits);
+    EXPECT_THROW(engine.run(*root), BudgetExceeded);
+}
+
+// A budget's heap limit counts what its own thread allocates, not what runs on
+// other threads do meanwhile.
+TEST(Budget, ChargesEachThreadItsOwnHeap) {
+    if (!Budget::heap_limit_supported())
+        GTEST_SKIP() << "heap counting is not available in this build";
+
+    Budget::Limits limits;
+    limits.max_heap_bytes = 8 << 20;
+    std::latch started{1}, allocated{1}, checked{1};
+    std::thread other{[&] {
+        started.wait();
+        std::vector<char> big(64 << 20, 1);
+        EXPECT_EQ(big.back(), 1);
+        allocated.count_down();
+        checked.wait();
+    }};
+
+    Budget budget{limits};
+    budget.start();
+    started.count_down();
+    allocated.wait();
+    std::vector<char> small(1 << 20, 1);
+    EXPECT_EQ(small.back(), 1);
+    EXPECT_NO_THROW(budget.step({})); // refuels, and checks the limits
+    checked.count_down();
+    other.join();
+
+    std::vector<char> big(16 << 20, 1);
+    EXPECT_EQ(big.back(), 1);
+    EXPECT_THROW(budget.step({}), BudgetExceeded);
+    budget.stop();
+}
+
+TEST(Snapshot, RestoredRunMatchesFullRun) {
+    const std::string src = "var a := []\n"
+                            "for i in 1..1000 loop a[i] := i * i end\n"
+                            "var b := a\n"
+                            "var m := [1, \"x\"]\n"
+                            "var n := m\n"
+                            "var t := {k := 2.5, [m, n]}\n"
+                            "var mk := func(n) is return func => n + 1 end\n"
+                            "var f := mk(41)\n"
+                            "var g := len\n"
+                            "print \"prefix\"\n"
+                            "b[1] := 7\n"
+                            "n[2] := \"y\"\n"
+                            "print a[1], a[1000], m[2], t.k, t.2[1][2], t.2[2][2], f(), g(a)\n";
+
+    auto root = parse_and_analyze(src);
+    ASSERT_NE(root, nullptr);
+
+    const std::string path = (fs::temp_directory_path() / "interp_suite_snapshot.snap").string();
+    const uint64_t hash    = source_hash(src);
+    std::ostringstream full;
+    Interpreter writer(full);
+    writer.snapshot_after(9, path, hash);
+    writer.run(*root);
+    EXPECT_EQ(full.str(), "prefix\n7 1000000 y 2.5 y y 42 1000\n");
+
+    std::ostringstream restored;
+    Snapshot snapshot(path, hash, *root);
+    EXPECT_EQ(snapshot.line(), 9);
+    Interpreter reader(restored);
+    reader.restore_from(&snapshot);
+    reader.run(*root);
+    reader.run(*root); // objects are rebuilt afresh for every run
+    EXPECT_EQ(restored.str(), "prefix\n7 1000000 y 2.5 y y 42 1000\n"
+                              "prefix\n7 1000000 y 2.5 y y 42 1000\n");
+
+    EXPECT_THROW(Snapshot(path, hash + 1, *root), SnapshotError);
+    fs::remove(path);
+}
+
+TEST(Engine, RunsOneProgramFromManyThreads) {
+    const std::string src = "var acc := 0\n"
+                            "for i in 1..n loop acc := acc + i end\n"
+                            "var twice := func(k) is return k * 2 end\n"
+                            "print acc, twice(n), [n] + [1]\n";
+
+    for (const auto backend :
+         {Engine::Backend::Tree, Engine::Backend::Closure, Engine::Backend::Stack}) {
+        const auto program = Engine{{.backend = backend, .opt_level = 1}}.compile(src, {"n"});
+        std::vector<std::thread> threads;
+        std::vector<int> failures(4);
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t] {
+                for (long long n = t * 100; n < t * 100 + 50; ++n) {
+                    std::ostringstream out;
+                    Context ctx{program, out};
+                    ctx.set_input("n", DValue::make_int(n));
+                    ctx.run();
+                    const std::string expected =
+                        std::format("{} {} [{}, 1]\n", n * (n + 1) / 2, 2 * n, n);
+                    failures[t] += out.str() != expected;
+                }
+            });
+        }
+        for (auto& th : threads)
+            th.join();
+        for (int t = 0; t < 4; ++t)
+            EXPECT_EQ(failures[t], 0) << "thread " << t;
+    }
+
+    EXPECT_THROW(Engine{}.compile("print m\n", {"n"}), CompileError);
+    std::ostringstream out;
+    Context ctx{Engine{}.compile("print n\n", {"n"}), out};
+    EXPECT_THROW(ctx.set_input("m", DValue::make_int(1)), std::out_of_range);
+}
+
+// Far deeper than the native stack allows for one C++ frame per level.
+TEST(StackEngine, RunsDeepRecursionAndExpressions) {
+    std::string src = "var count := func(n) is\n"
+                      "    if n = 0 then return 0 end\n"
+                      "    return 1 + count(n - 1)\n"
+                      "end\n"
+                      "var a := 1\n"
+                      "print count(300000), a";
+    for (int i = 0; i < 300000; ++i)
+        src += " + a";
+    src += "\n";
+
+    const auto program = Engine{{.backend = Engine::Backend::Stack}}.compile(src);
+    std::ostringstream out;
+    Context ctx{program, out};
+    ctx.run();
+    EXPECT_EQ(out.str(), "300000 300001\n");
+}
 
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
@@ -1,4 +1,6 @@
 #include "ast.hpp"
+#include "descent_parser.hpp"
+#include "flat_ast.hpp"
 #include "lexer.hpp"
 #include "parser.tab.hpp"
 
@@ -21,10 +23,12 @@ std::string read_file(const std::string& path) {
 }
 
 // Helper to run parser on input string
-std::unique_ptr<ASTNode> parse_input(const std::string& input) {
+std::unique_ptr<ASTNode> parse_input(const std::string& input, bool pipeline = false) {
     std::unique_ptr<ASTNode> parse_result;
     std::istringstream input_stream(input);
     Lexer lexer(input_stream);
+    if (pipeline)
+        lexer.enable_pipeline();
     yy::parser parser{parse_result, lexer};
     int result = parser.parse();
 
@@ -34,6 +38,16 @@ std::unique_ptr<ASTNode> parse_input(const std::string& input) {
     return parse_result;
 }
 
+// Same with the hand-written parser
+std::unique_ptr<ASTNode> descent_parse(const std::string& input) {
+    std::unique_ptr<ASTNode> parse_result;
+    Lexer lexer(input);
+    DescentParser parser{parse_result, lexer};
+    if (parser.parse() != 0)
+        return nullptr;
+    return parse_result;
+}
+
 static const std::string SUITE_DIR{TEST_SUITE_DIR};
 
 class SuiteTest : public ::testing::TestWithParam<int> {
@@ -44,39 +58,68 @@ protected:
     std::string get_test_gold_path(int test_num) const {
         return SUITE_DIR + "/test" + std::to_string(test_num) + ".pgold";
     }
-};
 
-// Parameterized test: parse each .dl file and compare AST output
-TEST_P(SuiteTest, ParseAndCompareGolden) {
-    int test_num           = GetParam();
-    std::string input_path = get_test_input_path(test_num);
-    std::string gold_path  = get_test_gold_path(test_num);
-
-    // Skip if files don't exist
-    if (!fs::exists(input_path) || !fs::exists(gold_path)) {
-        GTEST_SKIP() << "Test files not found for test" << test_num;
+    // Parses the suite program with `parse(input)` and compares what
+    // `print(root, out)` prints with the program's .pgold file, or expects no
+    // tree when the gold file records a parse error.
+    template <class Parse, class Print>
+    void expect_golden(Parse&& parse, Print&& print) {
+        const int test_num           = GetParam();
+        const std::string input_path = get_test_input_path(test_num);
+        const std::string gold_path  = get_test_gold_path(test_num);
+
+        // Skip if files don't exist
+        if (!fs::exists(input_path) || !fs::exists(gold_path)) {
+            GTEST_SKIP() << "Test files not found for test" << test_num;
+        }
+
+        const std::string expected_gold = read_file(gold_path);
+        auto root                       = parse(read_file(input_path));
+
+        // If gold file indicates parse failure, root should be null
+        if (expected_gold.find("Parse error") != std::string::npos) {
+            EXPECT_EQ(root, nullptr) << "Expected parse error for test" << test_num;
+            return;
+        }
+
+        ASSERT_NE(root, nullptr) << "Parse failed for test" << test_num;
+
+        std::stringstream captured;
+        print(*root, captured);
+        EXPECT_EQ(captured.str(), expected_gold) << "AST output mismatch for test" << test_num;
     }
 
-    std::string input         = read_file(input_path);
-    std::string expected_gold = read_file(gold_path);
-
-    // Parse the input
-    auto root = parse_input(input);
-
-    // If gold file indicates parse failure, root should be null
-    if (expected_gold.find("Parse error") != std::string::npos) {
-        EXPECT_EQ(root, nullptr) << "Expected parse error for test" << test_num;
-        return;
+    template <class Parse>
+    void expect_golden(Parse&& parse) {
+        expect_golden(parse, [](const ASTNode& root, std::ostream& out) { root.print(0, out); });
     }
+};
 
-    ASSERT_NE(root, nullptr) << "Parse failed for test" << test_num;
+// Parameterized test: parse each .dl file and compare AST output
+TEST_P(SuiteTest, ParseAndCompareGolden) {
+    expect_golden([](const std::string& input) { return parse_input(input); });
+}
 
-    // Capture AST output and compare with golden
-    std::stringstream captured;
-    root->print(0, captured);
-    std::string actual_output = captured.str();
+// Same comparison with the lexer running on its own thread
+TEST_P(SuiteTest, PipelinedParseMatchesGolden) {
+    expect_golden([](const std::string& input) { return parse_input(input, /*pipeline=*/true); });
+}
+
+// The hand-written parser builds the same tree as Bison's
+TEST_P(SuiteTest, DescentParseMatchesGolden) {
+    expect_golden(descent_parse);
+}
 
-    EXPECT_EQ(actual_output, expected_gold) << "AST output mismatch for test" << test_num;
+// The flat encoding prints the same tree, both directly and after rebuilding
+// the pointer AST from it
+TEST_P(SuiteTest, FlatAstMatchesGolden) {
+    const auto parse = [](const std::string& input) { return parse_input(input); };
+    expect_golden(parse, [](const ASTNode& root, std::ostream& out) {
+        FlatAst::flatten(root).print(out);
+    });
+    expect_golden(parse, [](const ASTNode& root, std::ostream& out) {
+        FlatAst::flatten(root).unflatten()->print(0, out);
+    });
 }
 
 // Generate parameterized tests for tests 1-151
@@ -85,6 +128,75 @@ INSTANTIATE_TEST_SUITE_P(SuiteTests, SuiteTest, ::testing::Range(1, 159),
                              return "test" + std::to_string(info.param);
                          });
 
+// Both parsers stop at the same token, with the same message
+TEST(DescentParser, ReportsSyntaxErrorsAsBisonDoes) {
+    const std::string cases[] = {
+        "print 1 < 2 < 3",
+        "print - -x",
+        "print -x is int",
+        "x is int",
+        "var a := (f)(1)",
+        "var a := [1, 2][1]",
+        "print {a := 1, b[1] := 2}",
+        "for i in 1..3 loop print i",
+        "if x then print 1 else print 2",
+        "var f := func() => 1",
+        "var f := func(x, ) => x",
+        "print t.\"s\"",
+        "return :=",
+        "print x is [1]",
+        "x := 1 end",
+        "var",
+        "print 1 +",
+        "print (1",
+        "print 1 @ 2",
+        "loop exit end end",
+        "print " + std::string(500, '('),
+    };
+    for (const std::string& src : cases) {
+        testing::internal::CaptureStderr();
+        const bool bison_ok         = parse_input(src) != nullptr;
+        const std::string bison_err = testing::internal::GetCapturedStderr();
+        testing::internal::CaptureStderr();
+        const bool descent_ok         = descent_parse(src) != nullptr;
+        const std::string descent_err = testing::internal::GetCapturedStderr();
+        EXPECT_FALSE(bison_ok) << src;
+        EXPECT_EQ(descent_ok, bison_ok) << src;
+        EXPECT_EQ(descent_err, bison_err) << src;
+    }
+
+    // Deep nesting parses to the same tree with both.  Only once the stack budget
+    // is spent, where Bison's parser goes on, does ours stop with an error.
+    const auto nested = [](int depth) {
+        return "print " + std::string(depth, '(') + "1" + std::string(depth, ')');
+    };
+    for (const int depth : {1200, 3000}) {
+        const std::string src = nested(depth);
+        auto bison            = parse_input(src);
+        auto descent          = descent_parse(src);
+        ASSERT_NE(bison, nullptr) << depth;
+        ASSERT_NE(descent, nullptr) << depth;
+        std::ostringstream bison_tree, descent_tree;
+        bison->print(0, bison_tree);
+        descent->print(0, descent_tree);
+        EXPECT_EQ(descent_tree.str(), bison_tree.str()) << depth;
+    }
+    const std::string deep = nested(100000);
+    EXPECT_NE(parse_input(deep), nullptr);
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(descent_parse(deep), nullptr);
+    EXPECT_NE(testing::internal::GetCapturedStderr().find("nesting too deep"), std::string::npos);
+
+    std::string ifs;
+    for (int i = 0; i < 100000; ++i)
+        ifs += "if x => ";
+    ifs += "print 1";
+    EXPECT_NE(parse_input(ifs), nullptr);
+    testing::internal::CaptureStderr();
+    EXPECT_EQ(descent_parse(ifs), nullptr);
+    EXPECT_NE(testing::internal::GetCapturedStderr().find("nesting too deep"), std::string::npos);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,439 @@
+/*
+ * perf_check – time the lexer, parser and interpreter against a baseline
+ *
+ * Usage:
+ *   perf_check --bin-dir=<dir> --suite=<dir> --workloads=<dir> --baseline=<json>
+ *              [--runs=<n>] [--time-tolerance=<pct>] [--memory-tolerance=<pct>]
+ *              [--filter=<text>] [--update]
+ *
+ * Benchmarks:
+ *   suite/<tool>           dlexer, dparser and dinterp over every test*.dl in
+ *                          <suite>, one process per file; times are summed,
+ *                          peak RSS is the largest of the files
+ *   scaled/lex, scaled/parse
+ *                          dlexer and dparser over the suite concatenated
+ *                          kScaleCopies times (written next to the binaries)
+ *   scaled/<name>/<engine> dinterp --engine=tree|closure|stack over each .dl
+ *                          file in <workloads>
+ *
+ * Each benchmark runs <runs> times (default 5).  Time is the CPU time (user +
+ * system) of the child processes, which is steadier than wall time on a busy
+ * machine; memory is their peak RSS.  The medians are compared with the
+ * baseline: a benchmark regresses when its time grows by more than
+ * <time-tolerance> percent (default 20) and by more than kSlackMs, or its
+ * peak RSS grows by more than <memory-tolerance> percent (default 10).
+ * Benchmarks missing from the baseline are reported but do not fail.
+ *
+ * --update writes the measurements to <baseline> instead of comparing.
+ * --filter runs only the benchmarks whose name contains <text>.
+ *
+ * Exit codes: 0 no regression, 1 regression, 2 usage or I/O error.
+ */
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <print>
+#include <spawn.h>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <vector>
+
+extern char** environ;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr int kScaleCopies         = 100;
+constexpr double kSlackMs          = 2.0; // timings closer than this never regress
+constexpr int kDefaultRuns         = 5;
+constexpr double kDefaultTimePct   = 20.0;
+constexpr double kDefaultMemoryPct = 10.0;
+
+struct Sample {
+    double ms{0};         // CPU time
+    long long peak_kb{0}; // max RSS
+    bool ok{true};        // exited with status 0
+};
+
+struct Benchmark {
+    std::string name;
+    std::vector<std::vector<std::string>> commands; // one process each, run in sequence
+};
+
+// ── Running ───────────────────────────────────────────────────────────────────
+
+// Runs argv with stdout and stderr discarded.  Benchmarks ignore the exit
+// status: some suite programs stop with an error on purpose.
+std::optional<Sample> run_process(const std::vector<std::string>& argv) {
+    std::vector<char*> args;
+    for (const auto& a : argv)
+        args.push_back(const_cast<char*>(a.c_str()));
+    args.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+    pid_t pid    = 0;
+    const int rc = posix_spawn(&pid, args[0], &actions, nullptr, args.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0)
+        return std::nullopt;
+
+    int status = 0;
+    rusage ru{};
+    if (wait4(pid, &status, 0, &ru) != pid)
+        return std::nullopt;
+    const auto ms = [](const timeval& t) { return t.tv_sec * 1e3 + t.tv_usec / 1e3; };
+    return Sample{ms(ru.ru_utime) + ms(ru.ru_stime), ru.ru_maxrss,
+                  WIFEXITED(status) && WEXITSTATUS(status) == 0};
+}
+
+std::optional<Sample> run_benchmark(const Benchmark& b) {
+    Sample total;
+    for (const auto& cmd : b.commands) {
+        const auto s = run_process(cmd);
+        if (!s)
+            return std::nullopt;
+        total.ms += s->ms;
+        total.peak_kb = std::max(total.peak_kb, s->peak_kb);
+    }
+    return total;
+}
+
+template <typename T> T median(std::vector<T> v) {
+    std::ranges::sort(v);
+    return v[v.size() / 2];
+}
+
+// ── Baseline file ─────────────────────────────────────────────────────────────
+//
+//   {
+//     "benchmarks": {
+//       "<name>": { "median_ms": <number>, "peak_rss_kb": <number> },
+//       ...
+//     }
+//   }
+//
+// The reader accepts exactly this shape (any whitespace, any key order).
+
+class BaselineReader {
+public:
+    explicit BaselineReader(std::string_view text) : s_{text} {}
+
+    std::optional<std::map<std::string, Sample>> read() {
+        std::map<std::string, Sample> out;
+        const bool ok = object([&](const std::string& key) {
+            if (key != "benchmarks")
+                return false;
+            return object([&](const std::string& name) {
+                Sample& sample = out[name];
+                return object([&](const std::string& field) {
+                    const auto v = number();
+                    if (!v)
+                        return false;
+                    if (field == "median_ms")
+                        sample.ms = *v;
+                    else if (field == "peak_rss_kb")
+                        sample.peak_kb = static_cast<long long>(*v);
+                    else
+                        return false;
+                    return true;
+                });
+            });
+        });
+        skip_ws();
+        if (!ok || pos_ != s_.size())
+            return std::nullopt;
+        return out;
+    }
+
+private:
+    std::string_view s_;
+    size_t pos_{0};
+
+    void skip_ws() {
+        while (pos_ < s_.size() && std::isspace(static_cast<unsigned char>(s_[pos_])))
+            ++pos_;
+    }
+    bool eat(char c) {
+        skip_ws();
+        if (pos_ < s_.size() && s_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+    std::optional<std::string> string() {
+        if (!eat('"'))
+            return std::nullopt;
+        const size_t end = s_.find('"', pos_);
+        if (end == std::string_view::npos)
+            return std::nullopt;
+        std::string out{s_.substr(pos_, end - pos_)};
+        pos_ = end + 1;
+        return out;
+    }
+    std::optional<double> number() {
+        skip_ws();
+        double v = 0;
+        auto [end, ec] = std::from_chars(s_.data() + pos_, s_.data() + s_.size(), v);
+        if (ec != std::errc{})
+            return std::nullopt;
+        pos_ = static_cast<size_t>(end - s_.data());
+        return v;
+    }
+    // { "key": <member>, ... } where member(key) reads the value.
+    template <typename F> bool object(F&& member) {
+        if (!eat('{'))
+            return false;
+        if (eat('}'))
+            return true;
+        do {
+            const auto key = string();
+            if (!key || !eat(':') || !member(*key))
+                return false;
+        } while (eat(','));
+        return eat('}');
+    }
+};
+
+bool write_baseline(const fs::path& path, const std::map<std::string, Sample>& results) {
+    std::ofstream f{path};
+    if (!f)
+        return false;
+    f << "{\n  \"benchmarks\": {\n";
+    size_t i = 0;
+    for (const auto& [name, s] : results)
+        f << std::format("    \"{}\": {{ \"median_ms\": {:.2f}, \"peak_rss_kb\": {} }}{}\n", name,
+                         s.ms, s.peak_kb, ++i < results.size() ? "," : "");
+    f << "  }\n}\n";
+    return static_cast<bool>(f);
+}
+
+// ── Benchmarks ────────────────────────────────────────────────────────────────
+
+std::vector<fs::path> sorted_files(const fs::path& dir, std::string_view prefix) {
+    std::vector<fs::path> out;
+    for (const auto& e : fs::directory_iterator{dir}) {
+        const auto name = e.path().filename().string();
+        if (e.is_regular_file() && name.starts_with(prefix) && name.ends_with(".dl"))
+            out.push_back(e.path());
+    }
+    std::ranges::sort(out);
+    return out;
+}
+
+// The suite programs that parse, each wrapped in `if true then ... end` so
+// that their globals do not clash, concatenated kScaleCopies times: a large
+// input for the lexer and for dparser, which also runs the analyzer.
+std::optional<fs::path> write_scaled_source(const std::vector<fs::path>& suite,
+                                            const fs::path& dir) {
+    std::string text;
+    for (const auto& p : suite) {
+        const auto parsed = run_process({(dir / "dparser").string(), p.string()});
+        if (!parsed || !parsed->ok)
+            continue;
+        std::ifstream f{p};
+        text += "if true then\n";
+        text.append(std::istreambuf_iterator<char>{f}, {});
+        text += "\nend\n";
+    }
+    const fs::path out = dir / "perf_scaled.dl";
+    std::ofstream f{out};
+    for (int i = 0; i < kScaleCopies; ++i)
+        f << text;
+    if (!f)
+        return std::nullopt;
+    return out;
+}
+
+std::vector<Benchmark> benchmarks(const fs::path& bin, const std::vector<fs::path>& suite,
+                                  const std::vector<fs::path>& workloads,
+                                  const fs::path& scaled) {
+    std::vector<Benchmark> out;
+    for (const char* tool : {"dlexer", "dparser", "dinterp"}) {
+        Benchmark b{std::string{"suite/"} + tool, {}};
+        for (const auto& p : suite)
+            b.commands.push_back({(bin / tool).string(), p.string()});
+        out.push_back(std::move(b));
+    }
+    out.push_back({"scaled/lex", {{(bin / "dlexer").string(), scaled.string()}}});
+    out.push_back({"scaled/parse", {{(bin / "dparser").string(), scaled.string()}}});
+    for (const auto& w : workloads)
+        for (const char* engine : {"tree", "closure", "stack"})
+            out.push_back({"scaled/" + w.stem().string() + "/" + engine,
+                           {{(bin / "dinterp").string(), std::string{"--engine="} + engine,
+                             w.string()}}});
+    return out;
+}
+
+std::optional<double> parse_number(std::string_view v) {
+    double d       = 0;
+    auto [end, ec] = std::from_chars(v.data(), v.data() + v.size(), d);
+    if (ec != std::errc{} || end != v.data() + v.size() || d < 0)
+        return std::nullopt;
+    return d;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    fs::path bin, suite_dir, workload_dir, baseline_path;
+    int runs          = kDefaultRuns;
+    double time_pct   = kDefaultTimePct;
+    double memory_pct = kDefaultMemoryPct;
+    bool update       = false;
+    std::string filter;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        // The text after `prefix`, if arg starts with it.
+        const auto value = [&](std::string_view prefix) -> std::optional<std::string_view> {
+            if (!arg.starts_with(prefix))
+                return std::nullopt;
+            return arg.substr(prefix.size());
+        };
+        std::optional<double> n;
+        if (auto v = value("--bin-dir=")) {
+            bin = *v;
+        } else if (auto v = value("--suite=")) {
+            suite_dir = *v;
+        } else if (auto v = value("--workloads=")) {
+            workload_dir = *v;
+        } else if (auto v = value("--baseline=")) {
+            baseline_path = *v;
+        } else if (auto v = value("--filter=")) {
+            filter = *v;
+        } else if (arg == "--update") {
+            update = true;
+        } else if (auto v = value("--runs="); v && (n = parse_number(*v)) && *n >= 1) {
+            runs = static_cast<int>(*n);
+        } else if (auto v = value("--time-tolerance="); v && (n = parse_number(*v))) {
+            time_pct = *n;
+        } else if (auto v = value("--memory-tolerance="); v && (n = parse_number(*v))) {
+            memory_pct = *n;
+        } else {
+            std::println(stderr, "Error: invalid argument '{}'", arg);
+            return 2;
+        }
+    }
+    if (bin.empty() || suite_dir.empty() || workload_dir.empty() || baseline_path.empty()) {
+        std::println(stderr,
+                     "Usage: perf_check --bin-dir=<dir> --suite=<dir> --workloads=<dir> "
+                     "--baseline=<json> [--runs=<n>] [--time-tolerance=<pct>] "
+                     "[--memory-tolerance=<pct>] [--filter=<text>] [--update]");
+        return 2;
+    }
+
+    std::map<std::string, Sample> baseline;
+    if (!update) {
+        std::ifstream f{baseline_path};
+        const std::string text{std::istreambuf_iterator<char>{f}, {}};
+        auto parsed = BaselineReader{text}.read();
+        if (!f || !parsed) {
+            std::println(stderr, "Error: cannot read baseline '{}'", baseline_path.string());
+            return 2;
+        }
+        baseline = std::move(*parsed);
+    }
+
+    std::vector<fs::path> suite, workloads;
+    std::optional<fs::path> scaled;
+    try {
+        suite     = sorted_files(suite_dir, "test");
+        workloads = sorted_files(workload_dir, "");
+        scaled    = write_scaled_source(suite, bin);
+    } catch (const fs::filesystem_error& ex) {
+        std::println(stderr, "Error: {}", ex.what());
+        return 2;
+    }
+    if (!scaled) {
+        std::println(stderr, "Error: cannot write the scaled source in '{}'", bin.string());
+        return 2;
+    }
+
+    std::println("{:<28} {:>10} {:>10} {:>8} {:>10} {:>10} {:>8}", "benchmark", "base ms",
+                 "ms", "time", "base KB", "KB", "memory");
+    std::map<std::string, Sample> results;
+    int regressions = 0;
+    for (const auto& b : benchmarks(bin, suite, workloads, *scaled)) {
+        if (!filter.empty() && b.name.find(filter) == std::string::npos)
+            continue;
+        std::vector<double> ms;
+        std::vector<long long> kb;
+        for (int r = 0; r < runs; ++r) {
+            const auto s = run_benchmark(b);
+            if (!s) {
+                std::println(stderr, "Error: cannot run '{}'", b.commands.front().front());
+                return 2;
+            }
+            ms.push_back(s->ms);
+            kb.push_back(s->peak_kb);
+        }
+        const Sample now{median(ms), median(kb)};
+        results[b.name] = now;
+        if (update) {
+            std::println("{:<28} {:>10} {:>10.1f} {:>8} {:>10} {:>10} {:>8}", b.name, "", now.ms,
+                         "", "", now.peak_kb, "");
+            continue;
+        }
+
+        const auto it = baseline.find(b.name);
+        if (it == baseline.end()) {
+            std::println("{:<28} {:>10} {:>10.1f} {:>8} {:>10} {:>10} {:>8}", b.name, "-", now.ms,
+                         "new", "-", now.peak_kb, "new");
+            continue;
+        }
+        const Sample& base = it->second;
+        const double dt    = base.ms > 0 ? (now.ms / base.ms - 1) * 100 : 0;
+        const double dm =
+            base.peak_kb > 0 ? (static_cast<double>(now.peak_kb) / base.peak_kb - 1) * 100 : 0;
+        const bool slow  = dt > time_pct && now.ms - base.ms > kSlackMs;
+        const bool heavy = dm > memory_pct;
+        regressions += slow || heavy;
+        std::println("{:<28} {:>10.1f} {:>10.1f} {:>+7.1f}% {:>10} {:>10} {:>+7.1f}%{}", b.name,
+                     base.ms, now.ms, dt, base.peak_kb, now.peak_kb, dm,
+                     slow && heavy ? "  SLOWER, LARGER"
+                     : slow        ? "  SLOWER"
+                     : heavy       ? "  LARGER"
+                                   : "");
+    }
+
+    if (update) {
+        // Keep the entries of benchmarks that were filtered out.
+        if (!filter.empty()) {
+            std::ifstream f{baseline_path};
+            const std::string text{std::istreambuf_iterator<char>{f}, {}};
+            if (auto old = BaselineReader{text}.read())
+                results.merge(*old);
+        }
+        if (!write_baseline(baseline_path, results)) {
+            std::println(stderr, "Error: cannot write baseline '{}'", baseline_path.string());
+            return 2;
+        }
+        std::println("Wrote {} benchmarks to {}", results.size(), baseline_path.string());
+        return 0;
+    }
+    for (const auto& [name, s] : baseline)
+        if (!results.contains(name) && (filter.empty() || name.find(filter) != std::string::npos))
+            std::println("{:<28} missing from this run", name);
+    if (regressions) {
+        std::println("{} benchmark{} regressed (tolerance: time {}%, memory {}%)", regressions,
+                     regressions == 1 ? "" : "s", time_pct, memory_pct);
+        return 1;
+    }
+    std::println("No regressions (tolerance: time {}%, memory {}%)", time_pct, memory_pct);
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include "scan.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+
+// Reference implementations: one byte at a time, no vector code.
+
+static const char* ref_skip_space(const char* p, const char* end) {
+    while (p != end && scan::is_space(static_cast<unsigned char>(*p)))
+        ++p;
+    return p;
+}
+
+static const char* ref_skip_ident(const char* p, const char* end) {
+    while (p != end && scan::is_ident(static_cast<unsigned char>(*p)))
+        ++p;
+    return p;
+}
+
+static const char* ref_find_either(const char* p, const char* end, char a, char b) {
+    while (p != end && *p != a && *p != b)
+        ++p;
+    return p;
+}
+
+static const char* ref_find_last_newline(const char* p, const char* end) {
+    const char* last = nullptr;
+    for (; p != end; ++p)
+        if (*p == '\n')
+            last = p;
+    return last;
+}
+
+// Random text drawn from a small alphabet so every class boundary is hit,
+// at lengths straddling the 16- and 32-byte vector widths.
+static std::string random_text(std::mt19937& rng, size_t len) {
+    static const std::string alphabet = " \t\n\r\v\fazAZ09_\"'\\/.+\x80\xff";
+    std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+    std::uniform_int_distribution<int> run(0, 40);
+    std::string s;
+    while (s.size() < len) {
+        const char c = alphabet[pick(rng)];
+        s.append(std::min<size_t>(run(rng), len - s.size()), c);
+    }
+    return s;
+}
+
+TEST(ScanKernels, CharacterClassesMatchCctype) {
+    for (int c = 0; c < 256; ++c) {
+        EXPECT_EQ(scan::is_space(c), std::isspace(c) != 0) << c;
+        EXPECT_EQ(scan::is_ident(c), std::isalnum(c) != 0 || c == '_') << c;
+    }
+}
+
+TEST(ScanKernels, MatchScalarReference) {
+    std::mt19937 rng(1234);
+    for (size_t len = 0; len < 130; ++len) {
+        for (int round = 0; round < 20; ++round) {
+            const std::string s = random_text(rng, len);
+            const char* b       = s.data();
+            const char* e       = b + s.size();
+            for (size_t off = 0; off <= s.size(); ++off) {
+                const char* p = b + off;
+                ASSERT_EQ(scan::skip_space(p, e), ref_skip_space(p, e));
+                ASSERT_EQ(scan::skip_ident(p, e), ref_skip_ident(p, e));
+                ASSERT_EQ(scan::find(p, e, '\n'), ref_find_either(p, e, '\n', '\n'));
+                ASSERT_EQ(scan::find_either(p, e, '"', '\\'), ref_find_either(p, e, '"', '\\'));
+                ASSERT_EQ(scan::find_last_newline(p, e), ref_find_last_newline(p, e));
+                ASSERT_EQ(scan::count_newlines(p, e),
+                          static_cast<size_t>(std::count(p, e, '\n')));
+            }
+        }
+    }
+}
+
+TEST(ScanKernels, LongRuns) {
+    const std::string spaces(1000, ' ');
+    EXPECT_EQ(scan::skip_space(spaces.data(), spaces.data() + spaces.size()),
+              spaces.data() + spaces.size());
+
+    std::string ident(999, 'x');
+    ident += '+';
+    EXPECT_EQ(scan::skip_ident(ident.data(), ident.data() + ident.size()), ident.data() + 999);
+
+    std::string lines(1000, '\n');
+    EXPECT_EQ(scan::count_newlines(lines.data(), lines.data() + lines.size()), 1000u);
+}
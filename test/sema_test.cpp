@@ -1,9 +1,13 @@
 #include "ast.hpp"
+#include "flat_ast.hpp"
 #include "lexer.hpp"
 #include "parser.tab.hpp"
 #include "semantic_analyzer.hpp"
 
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <iterator>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -349,6 +353,228 @@ TEST(SemaError, DuplicateDeclLineIsCorrect) {
     EXPECT_TRUE(has_error(r, "line 1"));
 }
 
+// --- Resolution and captures ---
+
+template <typename T>
+static std::vector<const T*> find_all(const ASTNode& root) {
+    std::vector<const T*> found;
+    if (const auto* n = node_cast<T>(&root))
+        found.push_back(n);
+    for_each_child(root, [&](const std::unique_ptr<ASTNode>& c) {
+        auto sub = find_all<T>(*c);
+        found.insert(found.end(), sub.begin(), sub.end());
+    });
+    return found;
+}
+
+TEST(SemaScopes, DeeplyNestedResolution) {
+    constexpr int kDepth = 300;
+    std::string src      = "var x := 1\n";
+    for (int i = 0; i < kDepth; ++i)
+        src += "if true then\nvar y := " + std::to_string(i) + "\n";
+    src += "print x, y\n";
+    for (int i = 0; i < kDepth; ++i)
+        src += "end\n";
+    src += "print x\n";
+
+    auto root = parse(src);
+    ASSERT_NE(root, nullptr);
+    SemanticAnalyzer sa;
+    sa.analyze(*root);
+    ASSERT_TRUE(sa.ok());
+    std::vector<int> depths;
+    for (const auto* id : find_all<IdentNode>(*root))
+        if (id->ident_name == "x")
+            depths.push_back(id->resolved_depth);
+    EXPECT_EQ(depths, (std::vector<int>{kDepth, 0}));
+}
+
+TEST(SemaScopes, BodiesWithoutDeclarationsHaveNoFrame) {
+    auto root = parse(R"(
+var s := 0
+for i in 1..3 loop
+    if i > 1 then
+        s := s + i
+    end
+    if i = 3 => var t := s
+end
+)");
+    ASSERT_NE(root, nullptr);
+    SemanticAnalyzer sa;
+    sa.analyze(*root);
+    ASSERT_TRUE(sa.ok());
+
+    auto bodies = find_all<BodyNode>(*root);
+    ASSERT_EQ(bodies.size(), 2u);
+    EXPECT_TRUE(bodies[0]->has_frame); // the loop body, through the short if
+    EXPECT_FALSE(bodies[1]->has_frame);
+    // Inside the `then` body, s is two frames out: the loop body's and the
+    // iterator's, but none for the `then` body itself.
+    for (const auto* id : find_all<IdentNode>(*bodies[1]))
+        EXPECT_EQ(id->resolved_depth, id->ident_name == "s" ? 2 : 1) << id->ident_name;
+}
+
+TEST(SemaScopes, FunctionBodiesShareTheParameterFrame) {
+    auto root = parse(R"(
+var f := func(x) is
+    var y := x + 1
+    return y
+end
+var g := func(x) is
+    var x := 2
+    return x
+end
+)");
+    ASSERT_NE(root, nullptr);
+    SemanticAnalyzer sa;
+    sa.analyze(*root);
+    ASSERT_TRUE(sa.ok());
+
+    auto funcs = find_all<FuncLitNode>(*root);
+    ASSERT_EQ(funcs.size(), 2u);
+    EXPECT_FALSE(static_cast<const BodyNode&>(*funcs[0]->body).has_frame);
+    for (const auto* id : find_all<IdentNode>(*funcs[0]->body))
+        EXPECT_EQ(id->resolved_depth, 0) << id->ident_name;
+    // Redeclaring a parameter needs a scope, and so a frame, of its own.
+    EXPECT_TRUE(static_cast<const BodyNode&>(*funcs[1]->body).has_frame);
+}
+
+TEST(SemaScopes, FreeVariablesAndCaptures) {
+    auto root = parse(R"(
+var n := 10
+var make := func(k) is
+    var total := 0
+    var add := func(x) is
+        total := total + x + k + n
+        return total
+    end
+    return add
+end
+)");
+    ASSERT_NE(root, nullptr);
+    SemanticAnalyzer sa;
+    sa.analyze(*root);
+    ASSERT_TRUE(sa.ok());
+
+    auto funcs = find_all<FuncLitNode>(*root);
+    ASSERT_EQ(funcs.size(), 2u);
+    auto names = [](const FuncLitNode& f) {
+        std::vector<std::pair<std::string, int>> v;
+        for (const auto& fv : f.free_vars)
+            v.emplace_back(fv.name, fv.depth);
+        return v;
+    };
+    using Free = std::vector<std::pair<std::string, int>>;
+    EXPECT_EQ(names(*funcs[0]), (Free{{"n", 0}}));
+    // make's body shares the parameter frame, so k is as near as total.
+    EXPECT_EQ(names(*funcs[1]), (Free{{"total", 0}, {"k", 0}, {"n", 1}}));
+
+    std::vector<std::string> captured;
+    for (const auto* d : find_all<VarDefNode>(*root))
+        if (d->captured)
+            captured.push_back(d->varname);
+    EXPECT_EQ(captured, (std::vector<std::string>{"n", "total"}));
+    auto param = [](const FuncLitNode& f) {
+        const auto& params = static_cast<const ParamListNode&>(*f.params).params;
+        return static_cast<const IdentNode*>(params.at(0).get());
+    };
+    EXPECT_TRUE(param(*funcs[0])->captured);  // k
+    EXPECT_FALSE(param(*funcs[1])->captured); // x
+}
+
+TEST(SemaLoops, MarksLoopsThatOnlyReadFields) {
+    auto root = parse(R"(
+var rows := [{x := 1, y := 2}]
+var s := 0
+for p in rows loop s := s + p.x * p.2 end
+for p in rows loop p.x := 1 end
+for p in rows loop rows[1].x := p.x end
+for p in rows loop s := p end
+for p in rows loop print p end
+for p in rows loop s := len(p.x) end
+for p in rows loop s := func => p.x end
+for rows loop s := s + 1 end
+)");
+    ASSERT_NE(root, nullptr);
+    SemanticAnalyzer sa;
+    sa.analyze(*root);
+    ASSERT_TRUE(sa.ok());
+
+    std::vector<bool> marked;
+    for (const auto* f : find_all<ForIterNode>(*root))
+        marked.push_back(f->reads_fields);
+    EXPECT_EQ(marked, (std::vector<bool>{true, false, false, false, false, false, false, true}));
+}
+
+// --- Flat encoding ---
+
+// Analyzes `root` as a tree and, separately, in its flat encoding, and expects
+// the same errors and the same depths and frames on every node.
+static void expect_flat_matches_tree(const ASTNode& root) {
+    FlatAst flat = FlatAst::flatten(root);
+    SemanticAnalyzer tree_sa, flat_sa;
+    tree_sa.analyze(root);
+    flat_sa.analyze(flat);
+
+    ASSERT_EQ(flat_sa.errors().size(), tree_sa.errors().size());
+    for (size_t i = 0; i < tree_sa.errors().size(); ++i) {
+        EXPECT_EQ(flat_sa.errors()[i].message, tree_sa.errors()[i].message);
+        EXPECT_EQ(flat_sa.errors()[i].loc.line, tree_sa.errors()[i].loc.line);
+    }
+    const FlatAst analyzed = FlatAst::flatten(root);
+    ASSERT_EQ(flat.size(), analyzed.size());
+    for (FlatAst::Index i = 0; i < flat.size(); ++i) {
+        if (flat.kind(i) == NodeKind::Ident || flat.kind(i) == NodeKind::Body) {
+            EXPECT_EQ(flat.aux(i), analyzed.aux(i)) << flat.kind_name(i) << " at node " << i;
+        }
+    }
+}
+
+TEST(SemaFlat, MatchesTheTreeAnalysis) {
+    auto valid = parse(R"(
+var f := func(a, b) is
+    var a := 1
+    var g := func(c) => a + b + c
+    return g(2)
+end
+var n := 0
+for i in 1..3 loop
+    if i > 1 => var m := i
+    n := n + f(i, 0)
+end
+for p in [{x := 1}] loop print p.x end
+while n > 0 loop n := n - 1; if n = 2 => exit end
+loop exit end
+print n is int, f
+)");
+    ASSERT_NE(valid, nullptr);
+    expect_flat_matches_tree(*valid);
+
+    auto invalid = parse(R"(
+var x := 1, x := 2
+print y
+exit
+return 1
+var f := func(p, p) => q
+for i in 1..2 loop var i := i end
+)");
+    ASSERT_NE(invalid, nullptr);
+    expect_flat_matches_tree(*invalid);
+}
+
+TEST(SemaFlat, MatchesTheTreeAnalysisOnTheSuite) {
+    for (int n = 1;; ++n) {
+        const std::string path = TEST_SUITE_DIR "/test" + std::to_string(n) + ".dl";
+        if (!std::filesystem::exists(path))
+            break;
+        SCOPED_TRACE(path);
+        std::ifstream f(path);
+        // The suite has programs with syntax errors, which leave nothing to analyze.
+        if (auto root = parse(std::string(std::istreambuf_iterator<char>(f), {})))
+            expect_flat_matches_tree(*root);
+    }
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();